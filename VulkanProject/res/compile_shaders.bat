@@ -24,4 +24,8 @@ set GLSLC_PATH=%VULKAN_SDK_PATH%\Bin\glslc.exe
 %GLSLC_PATH% -fshader-stage=fragment shaders/fragment.glsl   -o shaders/fragment.spv
 %GLSLC_PATH% -fshader-stage=compute  shaders/raytracer.glsl  -o shaders/raytracer.spv
 %GLSLC_PATH% -fshader-stage=compute  shaders/cubemapgen.glsl -o shaders/cubemapgen.spv
+%GLSLC_PATH% -fshader-stage=compute  shaders/wavefront_generate.glsl -o shaders/wavefront_generate.spv
+%GLSLC_PATH% -fshader-stage=compute  shaders/wavefront_extend.glsl -o shaders/wavefront_extend.spv
+%GLSLC_PATH% -fshader-stage=compute  shaders/wavefront_shade.glsl -o shaders/wavefront_shade.spv
+%GLSLC_PATH% -fshader-stage=compute  shaders/wavefront_accumulate.glsl -o shaders/wavefront_accumulate.spv
 :: pause
\ No newline at end of file
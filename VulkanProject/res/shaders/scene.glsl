@@ -0,0 +1,1065 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+// Resources and functions that are shared between the megakernel and the wavefront kernels
+
+#include "halton.glsl"
+#include "random.glsl"
+#include "math.glsl"
+#include "tonemap.glsl"
+#include "shared.h"
+
+#define BACKGROUND_TYPE_NONE (0)
+#define BACKGROUND_TYPE_GRADIENT (1)
+#define BACKGROUND_TYPE_SKYBOX (2)
+
+#define SIGMA (0.0001)
+
+#define GAMMA (2.2)
+
+#define USE_RAY_OFFSET (0)
+
+layout (binding = 0, rgba32f) uniform image2D uOutput;
+layout (binding = 1, rgba32f) uniform image2D uAccumulation;
+
+// Sum of the squared luminance of each sample, used to estimate the variance of each pixel
+layout (binding = 17, r32f) uniform image2D uSecondMoment;
+
+layout (binding = 9) uniform samplerCube uSkybox;
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Global uniforms */
+
+layout(binding = 2) uniform CameraBufferObject 
+{
+    mat4 Projection;
+    mat4 View;
+    vec4 Position;
+    vec4 Forward;
+
+    // Offset of the image in the film (xy) and the size of the whole film (zw), the image is smaller when rendering tiles
+    ivec4 Film;
+
+    // Size of the image in the render targets (xy), the targets are allocated larger so that they survive a resize
+    ivec4 Image;
+} uCamera;
+
+// Changes every dispatch so it is pushed instead of uploaded, must match FFrameConstants
+layout(push_constant) uniform FrameConstants
+{
+    uint NumSamples;
+    uint SamplesPerDispatch;
+
+#if defined(WAVEFRONT_CONSTANTS)
+    // Set by the wavefront pipeline for each pass, placed after the frame constants
+    uint Bounce;
+    uint MaxBounces;
+    uint Sample;
+#endif
+} uConstants;
+
+layout(binding = 4) uniform SceneBufferObject 
+{
+    uint  NumQuads;
+    uint  NumSpheres;
+    uint  NumPlanes;
+    uint  NumMaterials;
+    
+    uint  BackgroundType;
+    float Exposure;
+    uint  NumBVHNodes;
+    uint  NumLights;
+
+    uint  MinBounces;
+    uint  MaxBounces;
+    uint  AdaptiveMinSamples;
+    float AdaptiveThreshold;
+
+    uint  DisplayMode;
+    uint  Padding0;
+    uint  Padding1;
+    uint  Padding2;
+} uScene;
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Scene objects */
+
+#define MATERIAL_LAMBERTIAN (1)
+#define MATERIAL_METAL      (2)
+#define MATERIAL_EMISSIVE   (3)
+#define MATERIAL_DIELECTRIC (4)
+
+struct Material
+{
+    vec4  Albedo;
+    vec4  Emissive;
+    uint  Type;
+    float Roughness;
+    float RefractionIndex;
+    uint  Padding1;
+};
+
+struct Quad
+{
+    vec4 Position;
+    vec4 Edge0;
+    vec4 Edge1;
+    uint MaterialIndex;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+struct Sphere
+{
+    vec4 PositionAndRadius;
+    uint MaterialIndex;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+struct Plane 
+{
+    vec4 NormalAndDistance;
+    uint MaterialIndex;
+    uint Padding0;
+    uint Padding1;
+    uint Padding2;
+};
+
+layout(std430, binding = 5) buffer QuadBuffer
+{
+    Quad Quads[];
+};
+
+layout(std430, binding = 6) buffer SphereBuffer
+{
+    Sphere Spheres[];
+};
+
+layout(std430, binding = 7) buffer PlaneBuffer
+{
+    Plane Planes[];
+};
+
+layout(std430, binding = 8) buffer MaterialBuffer
+{
+    Material Materials[];
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* BVH */
+
+#define PRIMITIVE_TYPE_QUAD   (0)
+#define PRIMITIVE_TYPE_SPHERE (1)
+#define PRIMITIVE_TYPE_MESH   (2)
+#define PRIMITIVE_INDEX_BITS  (24)
+#define PRIMITIVE_INDEX_MASK  ((1u << PRIMITIVE_INDEX_BITS) - 1u)
+#define PRIMITIVE_INVALID     (0xffffffffu)
+
+// Must match BVH.h, the builder makes leaves at this depth so the stack never overflows
+#define BVH_MAX_STACK_DEPTH (32)
+#define BVH_MISS            (1e30)
+
+// Inner nodes store the left child in LeftOrFirst and the right child is the next node,
+// leaves store the first primitive in LeftOrFirst
+struct BVHNode
+{
+    vec3 Min;
+    uint LeftOrFirst;
+    vec3 Max;
+    uint NumPrimitives;
+};
+
+layout(std430, binding = 10) buffer BVHNodeBuffer
+{
+    BVHNode BVHNodes[];
+};
+
+layout(std430, binding = 11) buffer BVHPrimitiveBuffer
+{
+    uint BVHPrimitives[];
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Meshes */
+
+// Each mesh has its own BVH, the nodes are relative to FirstNode and the leaves relative to FirstTriangle
+struct Mesh
+{
+    uint FirstNode;
+    uint FirstTriangle;
+    uint NumTriangles;
+    uint MaterialIndex;
+};
+
+layout(std430, binding = 12) buffer MeshBuffer
+{
+    Mesh Meshes[];
+};
+
+layout(std430, binding = 13) buffer MeshBVHNodeBuffer
+{
+    BVHNode MeshBVHNodes[];
+};
+
+layout(std430, binding = 14) buffer MeshVertexBuffer
+{
+    vec4 MeshVertices[];
+};
+
+layout(std430, binding = 15) buffer MeshIndexBuffer
+{
+    uint MeshIndices[];
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Lights */
+
+// Emissive quads and spheres, Area is the area that is sampled
+struct Light
+{
+    uint  Primitive;
+    float Area;
+    uint  Padding0;
+    uint  Padding1;
+};
+
+layout(std430, binding = 16) buffer LightBuffer
+{
+    Light Lights[];
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Ray Structs */
+
+struct Ray
+{
+    vec3 Origin;
+    vec3 Direction;
+};
+
+struct RayPayLoad
+{
+    vec3  Normal;
+    vec3  Position;
+    float T;
+    float MinT;
+    float MaxT;
+    bool  FrontFace;
+    uint  MaterialIndex;
+    uint  Primitive;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Code */
+
+vec3 HemisphereSampleUniform(float u, float v) 
+{
+    float phi      = v * 2.0 * PI;
+    float cosTheta = 1.0 - u;
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    return normalize(vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta));
+}
+
+bool IsAlmostZero(vec3 Value)
+{
+    return Value.x <= SIGMA && Value.y <= SIGMA && Value.z <= SIGMA; 
+}
+
+void HitQuad(in Quad Quad, in Ray Ray, inout RayPayLoad PayLoad)
+{
+    vec3 Q = Quad.Position.xyz;
+    vec3 U = Quad.Edge0.xyz;
+    vec3 V = Quad.Edge1.xyz;
+    vec3 N = cross(U, V);
+    vec3 W = N / dot(N, N);
+
+    vec3  Normal = normalize(N);
+    float D = dot(Normal, Q);
+
+    float DdotN = dot(Ray.Direction, Normal);
+    if (abs(DdotN) < SIGMA)
+    {
+        return;
+    }
+
+    float t = (D - dot(Normal, Ray.Origin)) / DdotN;
+    if (PayLoad.MinT < t && t < PayLoad.MaxT)
+    {
+        if (t < PayLoad.T)
+        {
+            vec3 Intersection = Ray.Origin + (Ray.Direction * t);
+            vec3 PlanarHit    = Intersection - Q;
+            float Alpha = dot(W, cross(PlanarHit, V));
+            float Beta  = dot(W, cross(U, PlanarHit));
+            if (Alpha < 0.0 || 1.0 < Alpha || Beta < 0.0 || 1.0 < Beta)
+            {
+                return;
+            }
+
+            PayLoad.T             = t;
+            PayLoad.MaterialIndex = Quad.MaterialIndex;
+            PayLoad.FrontFace     = true;
+            PayLoad.Position      = Ray.Origin + Ray.Direction * PayLoad.T;
+
+            if (DdotN >= 0.0)
+            {
+                PayLoad.Normal = -Normal;
+            }
+            else
+            {
+                PayLoad.Normal = Normal;
+            }
+        }
+    }
+}
+
+void HitSphere(in Sphere Sphere, in Ray Ray, inout RayPayLoad PayLoad)
+{
+    vec3  SpherePos    = Sphere.PositionAndRadius.xyz;
+    float SphereRadius = Sphere.PositionAndRadius.w;
+
+    vec3  oc = Ray.Origin - SpherePos;
+    float a = dot(Ray.Direction, Ray.Direction);
+    float b = dot(Ray.Direction, oc);
+    float c = dot(oc, oc) - (SphereRadius * SphereRadius);
+
+    float Discriminant = (b * b) - (a * c);
+    if (Discriminant < 0.0)
+    {
+        return;
+    }
+
+    float t = (-b - sqrt(Discriminant)) / a;
+    if (t <= PayLoad.MinT || t >= PayLoad.MaxT)
+    {
+        t = (-b + sqrt(Discriminant)) / a;
+        if (t <= PayLoad.MinT || t >= PayLoad.MaxT)
+        {
+            return;
+        }
+    }
+
+    if (t <= PayLoad.T)
+    {
+        PayLoad.T             = t;
+        PayLoad.MaterialIndex = Sphere.MaterialIndex;
+        PayLoad.Position      = Ray.Origin + Ray.Direction * PayLoad.T;
+
+        vec3 OutsideNormal = normalize((PayLoad.Position - SpherePos) / SphereRadius);
+        if (dot(Ray.Direction, OutsideNormal) < 0.0)
+        {
+            PayLoad.Normal    = OutsideNormal;
+            PayLoad.FrontFace = true;
+        }
+        else
+        {
+            PayLoad.Normal    = -OutsideNormal;
+            PayLoad.FrontFace = false;
+        }
+    }
+}
+
+void HitPlane(in Plane Plane, in Ray Ray, inout RayPayLoad PayLoad)
+{
+    vec3  PlaneNormal = normalize(Plane.NormalAndDistance.xyz);
+    float PlaneDist   = Plane.NormalAndDistance.w;
+
+    float DdotN = dot(Ray.Direction, PlaneNormal);
+    if (abs(DdotN) < SIGMA)
+    {
+        return;
+    }
+
+    vec3 Center = PlaneNormal * PlaneDist;
+    vec3 Diff   = Center - Ray.Origin;
+
+    float t = dot(Diff, PlaneNormal) / DdotN;
+    if (t > 0.0)
+    {
+        if (t < PayLoad.T)
+        {
+            PayLoad.T             = t;
+            PayLoad.MaterialIndex = Plane.MaterialIndex;
+            PayLoad.FrontFace     = true;
+            PayLoad.Position      = Ray.Origin + Ray.Direction * PayLoad.T;
+
+            if (DdotN >= 0.0)
+            {
+                PayLoad.Normal = -PlaneNormal;
+            }
+            else
+            {
+                PayLoad.Normal = PlaneNormal;
+            }
+        }
+    }
+}
+
+// Returns the distance to the box or BVH_MISS
+float HitAABB(in vec3 Min, in vec3 Max, in Ray Ray, in vec3 InvDirection, in float MinT, in float MaxT)
+{
+    vec3 T0 = (Min - Ray.Origin) * InvDirection;
+    vec3 T1 = (Max - Ray.Origin) * InvDirection;
+
+    vec3 TMin = min(T0, T1);
+    vec3 TMax = max(T0, T1);
+
+    float TNear = max(max(TMin.x, TMin.y), max(TMin.z, MinT));
+    float TFar  = min(min(TMax.x, TMax.y), min(TMax.z, MaxT));
+    if (TNear <= TFar)
+    {
+        return TNear;
+    }
+    else
+    {
+        return BVH_MISS;
+    }
+}
+
+// Traversal of the scene and the mesh BVHs, the closest child is visited first and the other one is pushed. The
+// builder makes sure that no BVH is deeper than the stack
+struct BVHTraversal
+{
+    uint Stack[BVH_MAX_STACK_DEPTH];
+    uint StackSize;
+    uint NodeIndex;
+};
+
+BVHTraversal BeginTraversal()
+{
+    BVHTraversal Traversal;
+    Traversal.StackSize = 0;
+    Traversal.NodeIndex = 0;
+    return Traversal;
+}
+
+// Continues with the last pushed node, returns false when the traversal is done
+bool PopNode(inout BVHTraversal Traversal)
+{
+    if (Traversal.StackSize == 0)
+    {
+        return false;
+    }
+
+    Traversal.NodeIndex = Traversal.Stack[--Traversal.StackSize];
+    return true;
+}
+
+// Continues with the closest child that the ray hits, the right child is always stored after the left one
+bool VisitChildren(inout BVHTraversal Traversal, in uint LeftIndex, in BVHNode Left, in BVHNode Right, in Ray Ray, in vec3 InvDirection, in RayPayLoad PayLoad)
+{
+    uint  Near     = LeftIndex;
+    uint  Far      = LeftIndex + 1;
+    float NearDist = HitAABB(Left.Min,  Left.Max,  Ray, InvDirection, PayLoad.MinT, PayLoad.T);
+    float FarDist  = HitAABB(Right.Min, Right.Max, Ray, InvDirection, PayLoad.MinT, PayLoad.T);
+    if (NearDist > FarDist)
+    {
+        uint  TempIndex = Near;
+        float TempDist  = NearDist;
+        Near     = Far;
+        NearDist = FarDist;
+        Far      = TempIndex;
+        FarDist  = TempDist;
+    }
+
+    if (NearDist == BVH_MISS)
+    {
+        return PopNode(Traversal);
+    }
+
+    if (FarDist != BVH_MISS)
+    {
+        Traversal.Stack[Traversal.StackSize++] = Far;
+    }
+
+    Traversal.NodeIndex = Near;
+    return true;
+}
+
+void HitTriangle(in uint Triangle, in uint MaterialIndex, in Ray Ray, inout RayPayLoad PayLoad)
+{
+    vec3 V0 = MeshVertices[MeshIndices[(Triangle * 3) + 0]].xyz;
+    vec3 V1 = MeshVertices[MeshIndices[(Triangle * 3) + 1]].xyz;
+    vec3 V2 = MeshVertices[MeshIndices[(Triangle * 3) + 2]].xyz;
+
+    // Moller-Trumbore
+    vec3  Edge0 = V1 - V0;
+    vec3  Edge1 = V2 - V0;
+    vec3  P     = cross(Ray.Direction, Edge1);
+    float Det   = dot(Edge0, P);
+    if (abs(Det) < 1e-9)
+    {
+        return;
+    }
+
+    float InvDet = 1.0 / Det;
+    vec3  T = Ray.Origin - V0;
+    float U = dot(T, P) * InvDet;
+    if (U < 0.0 || U > 1.0)
+    {
+        return;
+    }
+
+    vec3  Q = cross(T, Edge0);
+    float V = dot(Ray.Direction, Q) * InvDet;
+    if (V < 0.0 || (U + V) > 1.0)
+    {
+        return;
+    }
+
+    float t = dot(Edge1, Q) * InvDet;
+    if (PayLoad.MinT < t && t < PayLoad.T)
+    {
+        PayLoad.T             = t;
+        PayLoad.MaterialIndex = MaterialIndex;
+        PayLoad.Position      = Ray.Origin + Ray.Direction * PayLoad.T;
+
+        vec3 Normal = normalize(cross(Edge0, Edge1));
+        if (dot(Ray.Direction, Normal) < 0.0)
+        {
+            PayLoad.Normal    = Normal;
+            PayLoad.FrontFace = true;
+        }
+        else
+        {
+            PayLoad.Normal    = -Normal;
+            PayLoad.FrontFace = false;
+        }
+    }
+}
+
+void TraverseMeshBVH(in Mesh Mesh, in Ray Ray, in vec3 InvDirection, inout RayPayLoad PayLoad)
+{
+    if (Mesh.NumTriangles == 0)
+    {
+        return;
+    }
+
+    BVHTraversal Traversal = BeginTraversal();
+    bool         bContinue = true;
+    while (bContinue)
+    {
+        BVHNode Node = MeshBVHNodes[Mesh.FirstNode + Traversal.NodeIndex];
+        if (Node.NumPrimitives > 0)
+        {
+            for (uint i = 0; i < Node.NumPrimitives; i++)
+            {
+                HitTriangle(Mesh.FirstTriangle + Node.LeftOrFirst + i, Mesh.MaterialIndex, Ray, PayLoad);
+            }
+
+            bContinue = PopNode(Traversal);
+        }
+        else
+        {
+            BVHNode Left  = MeshBVHNodes[Mesh.FirstNode + Node.LeftOrFirst];
+            BVHNode Right = MeshBVHNodes[Mesh.FirstNode + Node.LeftOrFirst + 1];
+            bContinue = VisitChildren(Traversal, Node.LeftOrFirst, Left, Right, Ray, InvDirection, PayLoad);
+        }
+    }
+}
+
+void HitPrimitive(in uint Primitive, in Ray Ray, in vec3 InvDirection, inout RayPayLoad PayLoad)
+{
+    uint  Type  = Primitive >> PRIMITIVE_INDEX_BITS;
+    uint  Index = Primitive & PRIMITIVE_INDEX_MASK;
+    float PrevT = PayLoad.T;
+    if (Type == PRIMITIVE_TYPE_QUAD)
+    {
+        Quad Quad = Quads[Index];
+        HitQuad(Quad, Ray, PayLoad);
+    }
+    else if (Type == PRIMITIVE_TYPE_SPHERE)
+    {
+        Sphere Sphere = Spheres[Index];
+        HitSphere(Sphere, Ray, PayLoad);
+    }
+    else if (Type == PRIMITIVE_TYPE_MESH)
+    {
+        // The top level only stores the bounds of the mesh
+        Mesh Mesh = Meshes[Index];
+        TraverseMeshBVH(Mesh, Ray, InvDirection, PayLoad);
+    }
+
+    // Remember what was hit so that we can find out if it was a light
+    if (PayLoad.T < PrevT)
+    {
+        PayLoad.Primitive = Primitive;
+    }
+}
+
+void TraverseBVH(in Ray Ray, inout RayPayLoad PayLoad)
+{
+    vec3 InvDirection = 1.0 / Ray.Direction;
+
+    BVHNode Root = BVHNodes[0];
+    if (HitAABB(Root.Min, Root.Max, Ray, InvDirection, PayLoad.MinT, PayLoad.T) == BVH_MISS)
+    {
+        return;
+    }
+
+    BVHTraversal Traversal = BeginTraversal();
+    bool         bContinue = true;
+    while (bContinue)
+    {
+        BVHNode Node = BVHNodes[Traversal.NodeIndex];
+        if (Node.NumPrimitives > 0)
+        {
+            for (uint i = 0; i < Node.NumPrimitives; i++)
+            {
+                HitPrimitive(BVHPrimitives[Node.LeftOrFirst + i], Ray, InvDirection, PayLoad);
+            }
+
+            bContinue = PopNode(Traversal);
+        }
+        else
+        {
+            BVHNode Left  = BVHNodes[Node.LeftOrFirst];
+            BVHNode Right = BVHNodes[Node.LeftOrFirst + 1];
+            bContinue = VisitChildren(Traversal, Node.LeftOrFirst, Left, Right, Ray, InvDirection, PayLoad);
+        }
+    }
+}
+
+bool TraceRay(in Ray Ray, inout RayPayLoad PayLoad)
+{
+    PayLoad.Primitive = PRIMITIVE_INVALID;
+
+    // Quads and spheres are stored in the BVH
+    if (uScene.NumBVHNodes > 0)
+    {
+        TraverseBVH(Ray, PayLoad);
+    }
+
+    // Planes are infinite and are always tested
+    for (uint i = 0; i < uScene.NumPlanes; i++)
+    {
+        float PrevT = PayLoad.T;
+
+        Plane Plane = Planes[i];
+        HitPlane(Plane, Ray, PayLoad);
+
+        // Planes are never lights
+        if (PayLoad.T < PrevT)
+        {
+            PayLoad.Primitive = PRIMITIVE_INVALID;
+        }
+    }
+
+    if (PayLoad.T < PayLoad.MaxT)
+    {
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+// Generates the primary ray for a pixel, Size is the size of the film and SampleIndex selects the jitter
+Ray GenerateCameraRay(in ivec2 Pixel, in ivec2 Size, in uint SampleIndex)
+{
+    // Setup the camera
+    vec3 CameraPosition = uCamera.Position.xyz;
+    vec3 CamForward     = normalize(uCamera.Forward.xyz);
+    vec3 CamUp          = vec3(0.0, 1.0, 0.0);
+    CamUp = normalize(CamUp - dot(CamUp, CamForward) * CamForward);
+    vec3 CamRight = normalize(cross(CamUp, CamForward));
+
+    float AspectRatio  = float(Size.x) / float(Size.y);
+    vec2  FilmCorner   = vec2(-1.0, -1.0);
+    float FilmDistance = 1.0;
+    vec3  FilmCenter   = CameraPosition + (CamForward * FilmDistance);
+
+    // Jitter the camera each frame
+    vec2 Jitter = Halton23(SampleIndex);
+    Jitter = (Jitter * 2.0) - vec2(1.0);
+
+    vec2 FilmUV = (vec2(Pixel) + Jitter) / vec2(Size.xy);
+    FilmUV.y = 1.0 - FilmUV.y;
+    FilmUV   = FilmUV * 2.0;
+
+    vec2 FilmCoord = FilmCorner + FilmUV;
+    FilmCoord.x = FilmCoord.x * AspectRatio;
+
+    vec3 FilmTarget = FilmCenter + (CamRight * FilmCoord.x) + (CamUp * FilmCoord.y);
+
+    Ray Ray;
+    Ray.Origin    = CameraPosition;
+    Ray.Direction = normalize(FilmTarget - CameraPosition);
+    return Ray;
+}
+
+// Scatters the ray based on the material and attenuates the throughput, returns false for materials that do not scatter
+bool ScatterRay(in Material Material, in Ray InRay, in RayPayLoad PayLoad, inout uint RandomSeed, inout vec3 Throughput, out Ray OutRay)
+{
+    vec3 N         = normalize(PayLoad.Normal);
+    vec3 Origin    = vec3(0.0);
+    vec3 Direction = vec3(0.0);
+
+    if (Material.Type == MATERIAL_LAMBERTIAN)
+    {
+        vec3 Rnd = NextRandomUnitSphereVec3(RandomSeed);
+        Direction = normalize(PayLoad.Normal + Rnd);
+
+    #if USE_RAY_OFFSET
+        Origin = PayLoad.Position + (N * SIGMA);
+    #else
+        Origin = PayLoad.Position;
+    #endif
+    }
+    else if (Material.Type == MATERIAL_METAL)
+    {
+        vec3 Rnd = NextRandomHemisphere(RandomSeed, PayLoad.Normal);
+
+        vec3 Reflection = reflect(InRay.Direction, N);
+        Direction = normalize(Reflection + Rnd * Material.Roughness);
+    #if USE_RAY_OFFSET
+        Origin = PayLoad.Position + (N * SIGMA);
+    #else
+        Origin = PayLoad.Position;
+    #endif
+    }
+    else if (Material.Type == MATERIAL_DIELECTRIC)
+    {
+        float RefractionRatio = PayLoad.FrontFace ? (1.0 / max(Material.RefractionIndex, SIGMA)) : Material.RefractionIndex;
+
+        vec3  RayDirection = normalize(InRay.Direction); 
+        float CosTheta = min(dot(-RayDirection, PayLoad.Normal), 1.0);
+        float SinTheta = sqrt(1.0 - CosTheta * CosTheta);
+
+        bool bShouldReflect = RefractionRatio * SinTheta >= 1.0;
+        if (bShouldReflect || Reflectance(CosTheta, RefractionRatio) > NextRandom(RandomSeed))
+        {
+            vec3 Rnd = NextRandomHemisphere(RandomSeed, PayLoad.Normal);
+
+            vec3 Reflection = reflect(RayDirection, N);
+            Direction = normalize(Reflection + Rnd * Material.Roughness);
+        }
+        else
+        {
+            // TODO: The GLSL refract seems to give NaN sometimes
+        #if 0
+            vec3 Refracted = refract(RayDirection, N, RefractionRatio);
+        #else
+            vec3 Refracted = RealRefract(RayDirection, N, RefractionRatio);
+        #endif
+            Direction = Refracted;
+        }
+        
+    #if USE_RAY_OFFSET
+        if (PayLoad.FrontFace)
+        {
+            Origin = PayLoad.Position + (N * SIGMA);
+        }
+        else
+        {
+            Origin = PayLoad.Position - (N * SIGMA);
+        }
+    #else
+        Origin = PayLoad.Position;
+    #endif
+    }
+    else
+    {
+        // Emissive or invalid material
+        OutRay = InRay;
+        return false;
+    }
+
+    // Attenuate light
+    vec3 Albedo = min(Material.Albedo.rgb, vec3(0.9));
+    Throughput = Albedo * Throughput;
+
+    // Setup the next ray
+    OutRay.Origin    = Origin;
+    OutRay.Direction = Direction;
+    return true;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Next event estimation */
+
+bool IsLight(in uint Primitive)
+{
+    uint Type = Primitive >> PRIMITIVE_INDEX_BITS;
+    return Primitive != PRIMITIVE_INVALID && (Type == PRIMITIVE_TYPE_QUAD || Type == PRIMITIVE_TYPE_SPHERE);
+}
+
+// Area that is sampled on the light, spheres only sample the half that faces the shading point
+float GetLightArea(in uint Primitive)
+{
+    uint Type  = Primitive >> PRIMITIVE_INDEX_BITS;
+    uint Index = Primitive & PRIMITIVE_INDEX_MASK;
+    if (Type == PRIMITIVE_TYPE_QUAD)
+    {
+        return length(cross(Quads[Index].Edge0.xyz, Quads[Index].Edge1.xyz));
+    }
+    else
+    {
+        float Radius = Spheres[Index].PositionAndRadius.w;
+        return 2.0 * PI * Radius * Radius;
+    }
+}
+
+// The lights are picked uniformly so the pdf is converted from area to solid angle and divided by the number of lights
+float GetLightPdf(in float Area, in vec3 Origin, in vec3 LightPosition, in vec3 LightNormal)
+{
+    vec3  ToLight  = LightPosition - Origin;
+    float Dist2    = dot(ToLight, ToLight);
+    float CosLight = abs(dot(normalize(LightNormal), ToLight)) / sqrt(Dist2);
+    if (CosLight < SIGMA || Area <= 0.0)
+    {
+        return 0.0;
+    }
+
+    return Dist2 / (CosLight * Area * float(uScene.NumLights));
+}
+
+float PowerHeuristic(in float PdfA, in float PdfB)
+{
+    float A2 = PdfA * PdfA;
+    float B2 = PdfB * PdfB;
+    return A2 / max(A2 + B2, 1e-12);
+}
+
+// Weight for emissive surfaces that are found by the BSDF, BSDFPdf is zero when the previous bounce could not sample lights
+float GetEmissiveWeight(in Ray Ray, in RayPayLoad PayLoad, in float BSDFPdf)
+{
+    if (BSDFPdf <= 0.0 || !IsLight(PayLoad.Primitive))
+    {
+        return 1.0;
+    }
+
+    float LightPdf = GetLightPdf(GetLightArea(PayLoad.Primitive), Ray.Origin, PayLoad.Position, PayLoad.Normal);
+    return PowerHeuristic(BSDFPdf, LightPdf);
+}
+
+// Pdf of the direction that ScatterRay sampled, zero for materials where we do not sample the lights
+float GetBSDFPdf(in Material Material, in RayPayLoad PayLoad, in vec3 Direction)
+{
+    if (Material.Type != MATERIAL_LAMBERTIAN || uScene.NumLights == 0)
+    {
+        return 0.0;
+    }
+
+    return max(dot(normalize(PayLoad.Normal), Direction), 0.0) / PI;
+}
+
+bool IsOccluded(in vec3 Origin, in vec3 Direction, in float Distance)
+{
+    Ray ShadowRay;
+    ShadowRay.Origin    = Origin;
+    ShadowRay.Direction = Direction;
+
+    // Stop right before the light so that it does not occlude itself
+    RayPayLoad ShadowPayLoad;
+    ShadowPayLoad.MinT = 0.001;
+    ShadowPayLoad.MaxT = Distance * 0.999;
+    ShadowPayLoad.T    = ShadowPayLoad.MaxT;
+    return TraceRay(ShadowRay, ShadowPayLoad);
+}
+
+// Samples a point on a random light and returns the light that reaches the surface, weighted against the BSDF
+vec3 SampleDirectLight(in Material Material, in RayPayLoad PayLoad, inout uint RandomSeed)
+{
+    if (Material.Type != MATERIAL_LAMBERTIAN || uScene.NumLights == 0)
+    {
+        return vec3(0.0);
+    }
+
+    uint  LightIndex = min(uint(NextRandom(RandomSeed) * float(uScene.NumLights)), uScene.NumLights - 1);
+    Light Light      = Lights[LightIndex];
+
+    uint Type  = Light.Primitive >> PRIMITIVE_INDEX_BITS;
+    uint Index = Light.Primitive & PRIMITIVE_INDEX_MASK;
+
+    vec3 LightPosition;
+    vec3 LightNormal;
+    uint LightMaterialIndex;
+    if (Type == PRIMITIVE_TYPE_QUAD)
+    {
+        Quad Quad = Quads[Index];
+        float U = NextRandom(RandomSeed);
+        float V = NextRandom(RandomSeed);
+        LightPosition      = Quad.Position.xyz + (Quad.Edge0.xyz * U) + (Quad.Edge1.xyz * V);
+        LightNormal        = cross(Quad.Edge0.xyz, Quad.Edge1.xyz);
+        LightMaterialIndex = Quad.MaterialIndex;
+    }
+    else
+    {
+        // Sample the half of the sphere that faces the surface
+        Sphere Sphere = Spheres[Index];
+        vec3 Center = Sphere.PositionAndRadius.xyz;
+        vec3 Dir    = NextRandomHemisphere(RandomSeed, normalize(PayLoad.Position - Center));
+        LightPosition      = Center + (Dir * abs(Sphere.PositionAndRadius.w));
+        LightNormal        = Dir;
+        LightMaterialIndex = Sphere.MaterialIndex;
+    }
+
+    vec3  N        = normalize(PayLoad.Normal);
+    vec3  ToLight  = LightPosition - PayLoad.Position;
+    float Distance = length(ToLight);
+    vec3  L        = ToLight / max(Distance, SIGMA);
+
+    float CosSurface = dot(N, L);
+    if (CosSurface <= 0.0)
+    {
+        return vec3(0.0);
+    }
+
+    float LightPdf = GetLightPdf(Light.Area, PayLoad.Position, LightPosition, LightNormal);
+    if (LightPdf <= 0.0)
+    {
+        return vec3(0.0);
+    }
+
+    if (IsOccluded(PayLoad.Position, L, Distance))
+    {
+        return vec3(0.0);
+    }
+
+    // Same attenuation as ScatterRay
+    Material LightMaterial = Materials[min(LightMaterialIndex, uScene.NumMaterials)];
+    vec3     BSDF          = min(Material.Albedo.rgb, vec3(0.9)) / PI;
+    float    BSDFPdf       = CosSurface / PI;
+    float    Weight        = PowerHeuristic(LightPdf, BSDFPdf);
+    return LightMaterial.Emissive.rgb * BSDF * CosSurface * Weight / LightPdf;
+}
+
+// Terminates paths that carry little energy after the minimum number of bounces, the survivors are weighted up to stay unbiased
+bool RussianRoulette(in uint Depth, inout vec3 Throughput, inout uint RandomSeed)
+{
+    if (Depth < uScene.MinBounces)
+    {
+        return true;
+    }
+
+    float SurvivalProbability = min(max(Throughput.r, max(Throughput.g, Throughput.b)), 0.95);
+    if (NextRandom(RandomSeed) >= SurvivalProbability)
+    {
+        return false;
+    }
+
+    Throughput = Throughput / SurvivalProbability;
+    return true;
+}
+
+vec3 SampleBackground(in vec3 Direction)
+{
+    vec3 BackGroundColor = vec3(0.0);
+    if (uScene.BackgroundType == BACKGROUND_TYPE_NONE)
+    {
+        // Only light source is the emissive surfaces
+        BackGroundColor = vec3(0.0);
+    }
+    else if (uScene.BackgroundType == BACKGROUND_TYPE_GRADIENT)
+    {
+        // Create a gradient
+        vec3  UnitDirection = normalize(Direction);
+        float Alpha = 0.5 * (UnitDirection.y + 1.0);
+        BackGroundColor = (1.0 - Alpha) * vec3(1.0, 1.0, 1.0) + Alpha * vec3(0.5, 0.7, 1.0);
+    }
+    else if (uScene.BackgroundType == BACKGROUND_TYPE_SKYBOX)
+    {
+        // Sample the Skybox
+        vec3 UnitDirection = normalize(Direction);
+        vec4 SkyboxColor   = texture(uSkybox, UnitDirection);
+        BackGroundColor = SkyboxColor.rgb;
+    }
+
+    return BackGroundColor;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Accumulation */
+
+float Luminance(in vec3 Color)
+{
+    return dot(Color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Relative standard error of the mean luminance, the alpha of the accumulation stores the number of samples
+float GetPixelError(in vec4 Accumulation, in float SecondMoment)
+{
+    float N = Accumulation.a;
+    if (N < 2.0)
+    {
+        return 1e30;
+    }
+
+    float Mean     = Luminance(Accumulation.rgb) / N;
+    float Variance = max((SecondMoment / N) - (Mean * Mean), 0.0);
+    return sqrt(Variance / N) / max(Mean, 1e-3);
+}
+
+// Index of the next sample of the pixel, which is the number of samples it already has. Selects the jitter and the random
+// sequence, so that the megakernel, the wavefront kernels and the CPU tracer trace the same samples.
+uint GetPixelSampleIndex(in ivec2 Pixel)
+{
+    return uint(imageLoad(uAccumulation, Pixel).a);
+}
+
+// Number of samples to trace for the pixel this dispatch, converged pixels are skipped
+uint GetPixelSamples(in ivec2 Pixel)
+{
+    if (uScene.AdaptiveThreshold > 0.0)
+    {
+        vec4  Accumulation = imageLoad(uAccumulation, Pixel);
+        float SecondMoment = imageLoad(uSecondMoment, Pixel).r;
+        if (Accumulation.a >= float(uScene.AdaptiveMinSamples) && GetPixelError(Accumulation, SecondMoment) < uScene.AdaptiveThreshold)
+        {
+            return 0;
+        }
+    }
+
+    return uConstants.SamplesPerDispatch;
+}
+
+// Blue to green to red
+vec3 Heatmap(in float Value)
+{
+    float T = clamp(Value, 0.0, 1.0);
+    return clamp(vec3((T * 2.0) - 1.0, 1.0 - abs((T * 2.0) - 1.0), 1.0 - (T * 2.0)), 0.0, 1.0);
+}
+
+// Adds the samples to the accumulation and writes the result to the output, SampleColor is the sum of all samples in this
+// dispatch and LuminanceSquared the sum of the squared luminance of each sample
+void AccumulateSample(in ivec2 Pixel, in vec3 SampleColor, in float LuminanceSquared, in uint NumSamples)
+{
+    // Accumulate samples over time
+    vec4  Accumulation = imageLoad(uAccumulation, Pixel);
+    float SecondMoment = imageLoad(uSecondMoment, Pixel).r;
+    if (NumSamples > 0)
+    {
+        Accumulation += vec4(SampleColor, float(NumSamples));
+        SecondMoment += LuminanceSquared;
+        imageStore(uAccumulation, Pixel, Accumulation);
+        imageStore(uSecondMoment, Pixel, vec4(SecondMoment));
+    }
+
+    // Store to scene texture, converged pixels are written as well so that the display mode can change
+    vec3 FinalColor;
+    if (uScene.DisplayMode == DISPLAY_MODE_NOISE)
+    {
+        // The threshold ends up in the middle
+        float Threshold = max(uScene.AdaptiveThreshold, 1e-3);
+        FinalColor = Heatmap(0.5 * GetPixelError(Accumulation, SecondMoment) / Threshold);
+    }
+    else if (uScene.DisplayMode == DISPLAY_MODE_SAMPLES)
+    {
+        FinalColor = Heatmap(Accumulation.a / max(float(uConstants.NumSamples), 1.0));
+    }
+    else
+    {
+        FinalColor = Accumulation.rgb / max(Accumulation.a, 1.0);
+        FinalColor = vec3(1.0) - exp(-FinalColor * uScene.Exposure);
+        FinalColor = pow(FinalColor, vec3(1.0 / GAMMA));
+    }
+
+    imageStore(uOutput, Pixel, vec4(FinalColor, 1.0));
+}
+
+#endif
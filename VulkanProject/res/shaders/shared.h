@@ -0,0 +1,11 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+// Constants that are used by the shaders and by the C++ code, so this file can only contain defines. It is not hot
+// reloaded since the C++ code has to be rebuilt when it changes.
+
+#define DISPLAY_MODE_IMAGE   (0)
+#define DISPLAY_MODE_NOISE   (1)
+#define DISPLAY_MODE_SAMPLES (2)
+
+#endif
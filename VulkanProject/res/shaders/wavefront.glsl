@@ -0,0 +1,211 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+// Resources that are shared between the passes of the wavefront pipeline, the scene is bound to set 0
+
+// The wavefront constants are part of the push constants that scene.glsl declares
+#define WAVEFRONT_CONSTANTS
+
+#include "scene.glsl"
+
+#define WAVEFRONT_NUM_THREADS (256)
+
+// The hits are sorted into one shade queue per material type so that the threads of a shade group run the same code,
+// the first queue holds the rays that missed
+#define WAVEFRONT_NUM_SHADE_QUEUES (5)
+#define WAVEFRONT_SHADE_QUEUE_MISS (0)
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Path state */
+
+// Each pixel owns one path, the index of the path is the linear index of the pixel
+struct PathState
+{
+    vec3  Origin;
+    uint  RandomSeed;
+    vec3  Direction;
+    uint  Depth;
+    vec3  Throughput;
+    float BSDFPdf;
+    vec3  Radiance;
+    uint  bActive;
+};
+
+struct PathHit
+{
+    vec3  Normal;
+    float T;
+    uint  MaterialIndex;
+    uint  FrontFace;
+    uint  bHit;
+    uint  Primitive;
+};
+
+// Count is the number of paths in the queue, the rest are the arguments for vkCmdDispatchIndirect
+struct RayQueueCounter
+{
+    uint Count;
+    uint NumGroupsX;
+    uint NumGroupsY;
+    uint NumGroupsZ;
+};
+
+// Each shade queue starts in a new group, so the dispatch has enough groups for all of them
+struct ShadeQueueCounter
+{
+    uint Counts[WAVEFRONT_NUM_SHADE_QUEUES];
+    uint NumGroupsX;
+    uint NumGroupsY;
+    uint NumGroupsZ;
+};
+
+layout(std430, set = 1, binding = 0) buffer PathStateBuffer
+{
+    PathState PathStates[];
+};
+
+layout(std430, set = 1, binding = 1) buffer PathHitBuffer
+{
+    PathHit PathHits[];
+};
+
+// Two queues of NumPaths entries, one is consumed while the other is filled
+layout(std430, set = 1, binding = 2) buffer RayQueueBuffer
+{
+    uint RayQueue[];
+};
+
+// The counters of one bounce of a sample, every bounce of every sample in a dispatch has its own so that they are only
+// cleared once per dispatch
+struct BounceCounters
+{
+    RayQueueCounter   Rays;
+    ShadeQueueCounter Shade;
+};
+
+layout(std430, set = 1, binding = 3) buffer CounterBuffer
+{
+    BounceCounters Counters[];
+};
+
+// One queue of NumPaths entries per material type, filled by the extend stage
+layout(std430, set = 1, binding = 4) buffer ShadeQueueBuffer
+{
+    uint ShadeQueue[];
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+/* Code */
+
+uint GetNumPaths()
+{
+    ivec2 Size = imageSize(uAccumulation);
+    return uint(Size.x * Size.y);
+}
+
+uint GetQueueOffset(uint Queue)
+{
+    return Queue * GetNumPaths();
+}
+
+// The ray queues alternate between the bounces, the counters are separate for every bounce
+uint GetRayQueue(uint Bounce)
+{
+    return Bounce % 2;
+}
+
+uint GetCounterIndex(uint Bounce)
+{
+    return (uConstants.Sample * (uConstants.MaxBounces + 1)) + Bounce;
+}
+
+// Returns the index of the ray in the current queue or false if the thread is outside the queue
+bool GetQueueIndex(out uint QueueIndex)
+{
+    QueueIndex = gl_GlobalInvocationID.x;
+    return QueueIndex < Counters[GetCounterIndex(uConstants.Bounce)].Rays.Count;
+}
+
+// Adds the path to the queue that is traced in the bounce
+void PushRay(uint Bounce, uint PathIndex)
+{
+    const uint Counter = GetCounterIndex(Bounce);
+
+    uint Slot = atomicAdd(Counters[Counter].Rays.Count, 1);
+    RayQueue[GetQueueOffset(GetRayQueue(Bounce)) + Slot] = PathIndex;
+
+    // The first ray in each group adds the group to the indirect arguments. The counters are cleared to zero, so the
+    // dispatches of the bounces that no path reaches have no groups.
+    if ((Slot % WAVEFRONT_NUM_THREADS) == 0)
+    {
+        atomicAdd(Counters[Counter].Rays.NumGroupsX, 1);
+        if (Slot == 0)
+        {
+            Counters[Counter].Rays.NumGroupsY = 1;
+            Counters[Counter].Rays.NumGroupsZ = 1;
+        }
+    }
+}
+
+// Returns the shade queue of the material type, types that are not known are shaded with the misses
+uint GetShadeQueue(in PathHit Hit)
+{
+    if (Hit.bHit == 0)
+    {
+        return WAVEFRONT_SHADE_QUEUE_MISS;
+    }
+
+    const uint Type = Materials[min(Hit.MaterialIndex, uScene.NumMaterials)].Type;
+    return (Type < WAVEFRONT_NUM_SHADE_QUEUES) ? Type : WAVEFRONT_SHADE_QUEUE_MISS;
+}
+
+void PushShade(uint Queue, uint PathIndex)
+{
+    const uint Counter = GetCounterIndex(uConstants.Bounce);
+
+    uint Slot = atomicAdd(Counters[Counter].Shade.Counts[Queue], 1);
+    ShadeQueue[GetQueueOffset(Queue) + Slot] = PathIndex;
+
+    // Same as for the ray queues, the first hit of any material sets up the other dimensions
+    if ((Slot % WAVEFRONT_NUM_THREADS) == 0)
+    {
+        atomicAdd(Counters[Counter].Shade.NumGroupsX, 1);
+        if (Slot == 0)
+        {
+            Counters[Counter].Shade.NumGroupsY = 1;
+            Counters[Counter].Shade.NumGroupsZ = 1;
+        }
+    }
+}
+
+// The groups are handed to the shade queues in order, returns false if the thread is outside its queue
+bool GetShadePathIndex(out uint PathIndex)
+{
+    PathIndex = 0;
+
+    const uint Counter = GetCounterIndex(uConstants.Bounce);
+
+    uint Group = gl_WorkGroupID.x;
+    for (uint Queue = 0; Queue < WAVEFRONT_NUM_SHADE_QUEUES; Queue++)
+    {
+        const uint Count     = Counters[Counter].Shade.Counts[Queue];
+        const uint NumGroups = (Count + WAVEFRONT_NUM_THREADS - 1) / WAVEFRONT_NUM_THREADS;
+        if (Group < NumGroups)
+        {
+            const uint Slot = (Group * WAVEFRONT_NUM_THREADS) + gl_LocalInvocationID.x;
+            if (Slot >= Count)
+            {
+                return false;
+            }
+
+            PathIndex = ShadeQueue[GetQueueOffset(Queue) + Slot];
+            return true;
+        }
+
+        Group -= NumGroups;
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#version 450
+#include "wavefront.glsl"
+
+#define NUM_THREADS (16)
+
+layout(local_size_x = NUM_THREADS, local_size_y = NUM_THREADS, local_size_z = 1) in;
+
+// Adds the radiance of the finished paths to the image
+void main()
+{
+    const ivec2 Pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (Pixel.x >= uCamera.Image.x || Pixel.y >= uCamera.Image.y)
+    {
+        return;
+    }
+
+    // The paths are stored for the whole render target
+    const ivec2 ImageSize = imageSize(uAccumulation);
+
+    // Converged pixels are not traced but still update the output
+    const uint PathIndex = uint(Pixel.y * ImageSize.x + Pixel.x);
+    if (PathStates[PathIndex].bActive != 0)
+    {
+        vec3 Radiance = PathStates[PathIndex].Radiance;
+        AccumulateSample(Pixel, Radiance, Luminance(Radiance) * Luminance(Radiance), 1);
+    }
+    else
+    {
+        AccumulateSample(Pixel, vec3(0.0), 0.0, 0);
+    }
+}
@@ -0,0 +1,47 @@
+#version 450
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_NUM_THREADS, local_size_y = 1, local_size_z = 1) in;
+
+// Finds the closest hit for every ray in the current queue and sorts the hits by material type for the shade stage
+void main()
+{
+    uint QueueIndex;
+    if (!GetQueueIndex(QueueIndex))
+    {
+        return;
+    }
+
+    const uint PathIndex = RayQueue[GetQueueOffset(GetRayQueue(uConstants.Bounce)) + QueueIndex];
+
+    Ray Ray;
+    Ray.Origin    = PathStates[PathIndex].Origin;
+    Ray.Direction = PathStates[PathIndex].Direction;
+
+    RayPayLoad PayLoad;
+    PayLoad.MinT = 0.001;
+    PayLoad.MaxT = 1000.0;
+    PayLoad.T    = PayLoad.MaxT;
+
+    PathHit Hit;
+    Hit.bHit = TraceRay(Ray, PayLoad) ? 1 : 0;
+    if (Hit.bHit != 0)
+    {
+        Hit.Normal        = PayLoad.Normal;
+        Hit.T             = PayLoad.T;
+        Hit.MaterialIndex = PayLoad.MaterialIndex;
+        Hit.FrontFace     = PayLoad.FrontFace ? 1 : 0;
+    }
+    else
+    {
+        Hit.Normal        = vec3(0.0);
+        Hit.T             = PayLoad.MaxT;
+        Hit.MaterialIndex = 0;
+        Hit.FrontFace     = 0;
+    }
+
+    Hit.Primitive = PayLoad.Primitive;
+    PathHits[PathIndex] = Hit;
+
+    PushShade(GetShadeQueue(Hit), PathIndex);
+}
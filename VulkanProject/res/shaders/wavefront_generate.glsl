@@ -0,0 +1,47 @@
+#version 450
+#include "wavefront.glsl"
+
+#define NUM_THREADS (16)
+
+layout(local_size_x = NUM_THREADS, local_size_y = NUM_THREADS, local_size_z = 1) in;
+
+// Creates the primary ray for each pixel that has not converged and adds it to the first queue
+void main()
+{
+    const ivec2 Pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (Pixel.x >= uCamera.Image.x || Pixel.y >= uCamera.Image.y)
+    {
+        return;
+    }
+
+    // The paths are stored for the whole render target
+    const ivec2 ImageSize = imageSize(uAccumulation);
+
+    // Use the same film as the megakernel so that both pipelines produce the same image, as long as the bounces are within
+    // WAVEFRONT_MAX_BOUNCES
+    const ivec2 FilmPixel = Pixel + uCamera.Film.xy;
+    const ivec2 FilmSize  = uCamera.Film.zw;
+
+    // Each sample in the dispatch runs the whole pipeline, the previous sample is already in the accumulation
+    const uint SampleIndex = GetPixelSampleIndex(Pixel);
+    Ray Ray = GenerateCameraRay(FilmPixel, FilmSize, SampleIndex);
+
+    // Each pixel owns one path, so unlike the megakernel the samples of the converged pixels are not given to the others
+    const uint PathIndex = uint(Pixel.y * ImageSize.x + Pixel.x);
+
+    PathState Path;
+    Path.Origin     = Ray.Origin;
+    Path.RandomSeed = InitRandom(uvec2(FilmPixel), uint(FilmSize.x), SampleIndex);
+    Path.Direction  = Ray.Direction;
+    Path.Depth      = 0;
+    Path.Throughput = vec3(1.0);
+    Path.BSDFPdf    = 0.0;
+    Path.Radiance   = vec3(0.0);
+    Path.bActive    = GetPixelSamples(Pixel) > 0 ? 1 : 0;
+    PathStates[PathIndex] = Path;
+
+    if (Path.bActive != 0)
+    {
+        PushRay(0, PathIndex);
+    }
+}
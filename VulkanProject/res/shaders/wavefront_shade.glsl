@@ -0,0 +1,67 @@
+#version 450
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_NUM_THREADS, local_size_y = 1, local_size_z = 1) in;
+
+// Evaluates the material for every hit in the shade queues and pushes the paths that continue to the next queue. A
+// group only shades hits of the same material type.
+void main()
+{
+    uint PathIndex;
+    if (!GetShadePathIndex(PathIndex))
+    {
+        return;
+    }
+
+    PathState Path = PathStates[PathIndex];
+    PathHit   Hit  = PathHits[PathIndex];
+
+    Ray Ray;
+    Ray.Origin    = Path.Origin;
+    Ray.Direction = Path.Direction;
+
+    if (Hit.bHit == 0)
+    {
+        // Add the background and terminate
+        Path.Radiance += Path.Throughput * SampleBackground(Ray.Direction);
+        PathStates[PathIndex] = Path;
+        return;
+    }
+
+    RayPayLoad PayLoad;
+    PayLoad.Normal        = Hit.Normal;
+    PayLoad.Position      = Ray.Origin + Ray.Direction * Hit.T;
+    PayLoad.T             = Hit.T;
+    PayLoad.MinT          = 0.001;
+    PayLoad.MaxT          = 1000.0;
+    PayLoad.FrontFace     = Hit.FrontFace != 0;
+    PayLoad.MaterialIndex = Hit.MaterialIndex;
+    PayLoad.Primitive     = Hit.Primitive;
+
+    const uint MaterialIndex = min(Hit.MaterialIndex, uScene.NumMaterials);
+    Material Material = Materials[MaterialIndex];
+
+    if (Material.Type == MATERIAL_EMISSIVE)
+    {
+        // Add light, emissive materials do not scatter
+        Path.Radiance += Path.Throughput * Material.Emissive.rgb * GetEmissiveWeight(Ray, PayLoad, Path.BSDFPdf);
+        PathStates[PathIndex] = Path;
+        return;
+    }
+
+    // Sample the lights directly, the shadow ray is traced inline
+    Path.Radiance += Path.Throughput * SampleDirectLight(Material, PayLoad, Path.RandomSeed);
+
+    Path.Depth++;
+    if (ScatterRay(Material, Ray, PayLoad, Path.RandomSeed, Path.Throughput, Ray) &&
+        Path.Depth < uConstants.MaxBounces &&
+        RussianRoulette(Path.Depth, Path.Throughput, Path.RandomSeed))
+    {
+        Path.Origin    = Ray.Origin;
+        Path.Direction = Ray.Direction;
+        Path.BSDFPdf   = GetBSDFPdf(Material, PayLoad, Ray.Direction);
+        PushRay(uConstants.Bounce + 1, PathIndex);
+    }
+
+    PathStates[PathIndex] = Path;
+}
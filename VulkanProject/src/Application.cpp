@@ -1,7 +1,11 @@
 #include "Application.h"
 #include "Renderer/RayTracer.h"
+#include "Renderer/CPURayTracer.h"
 #include "Renderer/GUI.h"
 
+// The pipelines compiled by the driver are kept between runs
+#define PIPELINE_CACHE_PATH RESOURCE_PATH"/pipeline.cache"
+
 extern bool GIsRunning = false;
 
 FApplication* FApplication::AppInstance = nullptr;
@@ -17,6 +21,13 @@ FApplication::FApplication()
     , m_pDevice(nullptr)
     , m_Width(1440)
     , m_Height(900)
+    , m_bHeadless(false)
+    , m_NumTargetSamples(0)
+    , m_TileSize(0)
+    , m_OutputPath()
+    , m_bUseCPU(false)
+    , m_NumThreads(0)
+    , m_bEnableValidation(false)
 {
 }
 
@@ -24,8 +35,23 @@ FApplication::~FApplication()
 {
 }
 
-bool FApplication::Init()
+bool FApplication::Init(const FApplicationParams& appParams)
 {
+    m_Width             = appParams.Width;
+    m_Height            = appParams.Height;
+    m_bHeadless         = appParams.bHeadless;
+    m_NumTargetSamples  = appParams.NumSamples;
+    m_TileSize          = appParams.TileSize;
+    m_OutputPath        = appParams.OutputPath;
+    m_bUseCPU           = appParams.bUseCPU;
+    m_NumThreads        = appParams.NumThreads;
+    m_bEnableValidation = appParams.bEnableValidation;
+
+    if (m_bHeadless)
+    {
+        return InitHeadless();
+    }
+
     // Setup error handling
     glfwSetErrorCallback([](int32_t, const char* pErrorMessage)
     {
@@ -52,10 +78,11 @@ bool FApplication::Init()
     
     // Init Vulkan
     FDeviceParams params;
-    params.pWindow           = m_pWindow;
-    params.bEnableRayTracing = true;
-    params.bEnableValidation = true;
-    params.bVerbose          = false;
+    params.pWindow            = m_pWindow;
+    params.bEnableRayTracing  = true;
+    params.bEnableValidation  = true;
+    params.bVerbose           = false;
+    params.pPipelineCachePath = PIPELINE_CACHE_PATH;
 
     m_pDevice = FDevice::Create(params);
     if (!m_pDevice)
@@ -80,6 +107,70 @@ bool FApplication::Init()
     return true;
 }
 
+bool FApplication::InitHeadless()
+{
+    // The CPU tracer does not need Vulkan at all
+    if (m_bUseCPU)
+    {
+        m_pDevice    = nullptr;
+        m_pSwapchain = nullptr;
+
+        FCPURayTracer* pCPURayTracer = new FCPURayTracer(m_NumThreads);
+        pCPURayTracer->Init(nullptr, nullptr);
+        pCPURayTracer->OnWindowResize(m_Width, m_Height);
+        pCPURayTracer->SetMaxSamples(m_NumTargetSamples);
+        m_pRenderer = pCPURayTracer;
+
+        std::cout << "Rendering " << m_Width << "x" << m_Height << " with " << m_NumTargetSamples << " samples on " << pCPURayTracer->GetNumThreads() << " CPU threads to '" << m_OutputPath << "'\n";
+
+        m_LastTime  = std::chrono::system_clock::now();
+        m_StartTime = m_LastTime;
+        return true;
+    }
+
+    // Init Vulkan without any window or surface
+    FDeviceParams params;
+    params.pWindow            = nullptr;
+    params.bEnableRayTracing  = true;
+    params.bEnableValidation  = m_bEnableValidation;
+    params.bVerbose           = false;
+    params.pPipelineCachePath = PIPELINE_CACHE_PATH;
+
+    m_pDevice = FDevice::Create(params);
+    if (!m_pDevice)
+    {
+        std::cout << "Failed to init Vulkan\n";
+        return false;
+    }
+
+    m_pSwapchain = nullptr;
+
+    FRayTracer* pRayTracer = new FRayTracer();
+    pRayTracer->Init(m_pDevice, nullptr);
+    pRayTracer->SetMaxSamples(m_NumTargetSamples);
+    m_pRenderer = pRayTracer;
+
+    // Large images are rendered in tiles so that only a single tile has to fit in memory
+    if (m_TileSize > 0)
+    {
+        if (!pRayTracer->BeginTiledRender(m_OutputPath.c_str(), m_Width, m_Height, m_TileSize))
+        {
+            std::cout << "Failed to start the tiled render\n";
+            return false;
+        }
+    }
+    else
+    {
+        pRayTracer->OnWindowResize(m_Width, m_Height);
+    }
+
+    std::cout << "Rendering " << m_Width << "x" << m_Height << " with " << m_NumTargetSamples << " samples to '" << m_OutputPath << "'\n";
+
+    m_LastTime  = std::chrono::system_clock::now();
+    m_StartTime = m_LastTime;
+    return true;
+}
+
 bool FApplication::CreateWindow()
 {
     // Setup window
@@ -135,6 +226,12 @@ void FApplication::OnWindowClose(GLFWwindow* pWindow)
 
 void FApplication::Tick()
 {
+    if (m_bHeadless)
+    {
+        TickHeadless();
+        return;
+    }
+
     auto currentTime = std::chrono::system_clock::now();
     
     // Update events
@@ -145,6 +242,12 @@ void FApplication::Tick()
     // Update GUI
     GUI::TickImGui();
     
+    // Release the objects that the GPU is done with
+    if (m_pDevice)
+    {
+        m_pDevice->EmptyDeletionQueue();
+    }
+
     // Render
     m_pRenderer->Tick(elapsedSeconds.count());
     
@@ -164,18 +267,74 @@ void FApplication::Tick()
     m_LastTime = currentTime;
 }
 
+void FApplication::TickHeadless()
+{
+    auto currentTime = std::chrono::system_clock::now();
+    std::chrono::duration<double> elapsedSeconds = currentTime - m_LastTime;
+
+    if (m_pDevice)
+    {
+        m_pDevice->EmptyDeletionQueue();
+    }
+
+    m_pRenderer->Tick(elapsedSeconds.count());
+
+    // When rendering tiles each tile is written by the renderer when it is done, tiles are only supported by FRayTracer
+    const bool bFinished = (m_TileSize > 0) ? static_cast<FRayTracer*>(m_pRenderer)->IsTiledRenderFinished() : (m_pRenderer->GetNumSamples() >= m_NumTargetSamples);
+    if (bFinished)
+    {
+        if (m_pDevice)
+        {
+            m_pDevice->WaitForIdle();
+        }
+
+        std::chrono::duration<double> totalSeconds = std::chrono::system_clock::now() - m_StartTime;
+
+        // The number of samples that were traced, which can differ from the target when a dispatch traces several samples.
+        // When tiling this is the number of samples of the last tile.
+        const uint32_t numFinishedSamples = m_pRenderer->GetNumSamples();
+        const double   numSamples         = double(numFinishedSamples);
+        const double   numPaths           = double(m_Width) * double(m_Height) * numSamples;
+        std::cout << "Finished " << numFinishedSamples << " samples in " << totalSeconds.count() << "s ("
+                  << (numSamples / totalSeconds.count()) << " samples/s, "
+                  << (numPaths / totalSeconds.count()) / 1000000.0 << " MPaths/s)\n";
+
+        if (m_TileSize == 0)
+        {
+            m_pRenderer->SaveImage(m_OutputPath.c_str());
+        }
+
+        GIsRunning = false;
+    }
+
+    m_LastTime = currentTime;
+}
+
 void FApplication::Release()
 {
-    m_pDevice->WaitForIdle();
+    if (m_pDevice)
+    {
+        m_pDevice->WaitForIdle();
+    }
 
     m_pRenderer->Release();
 
-    GUI::ReleaseImGui();
+    if (!m_bHeadless)
+    {
+        GUI::ReleaseImGui();
+        SAFE_DELETE(m_pSwapchain);
+    }
 
-    SAFE_DELETE(m_pSwapchain);
-    m_pDevice->Destroy();
+    if (m_pDevice)
+    {
+        m_pDevice->Destroy();
+    }
+
+    if (!m_bHeadless)
+    {
+        glfwDestroyWindow(m_pWindow);
+        glfwTerminate();
+    }
 
-    glfwDestroyWindow(m_pWindow);
-    glfwTerminate();
     delete this;
 }
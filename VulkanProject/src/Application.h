@@ -15,6 +15,30 @@ inline void StartApplicationLoop()
     GIsRunning = true;
 }
 
+struct FApplicationParams
+{
+    // Headless renders offline without a window and writes the result to OutputPath
+    bool        bHeadless  = false;
+    uint32_t    Width      = 1440;
+    uint32_t    Height     = 900;
+    uint32_t    NumSamples = 1024;
+    std::string OutputPath = "output.pfm";
+
+    // When larger than zero the headless image is rendered in tiles of this size and streamed to OutputPath
+    uint32_t TileSize = 0;
+
+    // Renders headless on the CPU instead, does not need a GPU. Zero threads uses all cores.
+    bool     bUseCPU    = false;
+    uint32_t NumThreads = 0;
+
+    // When larger than zero the CPU intersection kernels are benchmarked with this many rays instead of rendering
+    uint32_t NumBenchmarkRays = 0;
+
+    // The validation layers slow down the GPU so headless renders only enable them when asked, the windowed
+    // application always enables them
+    bool bEnableValidation = false;
+};
+
 class FApplication
 {
 public:
@@ -33,7 +57,7 @@ public:
     FApplication();
     ~FApplication();
 
-    bool Init();
+    bool Init(const FApplicationParams& params);
     
     void Tick();
     
@@ -44,12 +68,20 @@ public:
     void OnWindowResize(GLFWwindow* pWindow, uint32_t width, uint32_t height);
     void OnWindowClose(GLFWwindow* pWindow);
 
+    bool IsHeadless() const
+    {
+        return m_bHeadless;
+    }
+
     FDevice* GetVulkanContext() const
     {
         return m_pDevice;
     }
 
 private:
+    bool InitHeadless();
+    void TickHeadless();
+
     GLFWwindow* m_pWindow;
     IRenderer*  m_pRenderer;
     FDevice*    m_pDevice;
@@ -57,8 +89,18 @@ private:
     
     uint32_t m_Width;
     uint32_t m_Height;
+
+    // Headless
+    bool        m_bHeadless;
+    uint32_t    m_NumTargetSamples;
+    uint32_t    m_TileSize;
+    std::string m_OutputPath;
+    bool        m_bUseCPU;
+    uint32_t    m_NumThreads;
+    bool        m_bEnableValidation;
     
     std::chrono::time_point<std::chrono::system_clock> m_LastTime;
+    std::chrono::time_point<std::chrono::system_clock> m_StartTime;
 
     static FApplication* AppInstance;
 };
@@ -33,6 +33,10 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+// Number of frames that the CPU can record ahead of the GPU, independent of the number of images in the swapchain.
+// More frames give the CPU more slack, fewer frames give lower latency.
+#define NUM_FRAMES_IN_FLIGHT (2)
+
 // Helper Defines
 #define ZERO_MEMORY(dst, size) memset(dst, 0, size)
 #define ZERO_STRUCT(dst)       memset(dst, 0, sizeof(std::remove_pointer_t<decltype(dst)>))
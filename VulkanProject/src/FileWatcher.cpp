@@ -0,0 +1,59 @@
+#include "FileWatcher.h"
+
+FFileWatcher::FFileWatcher(const char* pDirectory, const char* pExtension)
+    : m_Directory(pDirectory)
+    , m_Extension(pExtension)
+    , m_WriteTimes()
+{
+    // The files that already exist are not reported as changed
+    std::vector<std::string> files;
+    Poll(files);
+}
+
+void FFileWatcher::Poll(std::vector<std::string>& outChangedFiles)
+{
+    outChangedFiles.clear();
+
+    // Exceptions are disabled so all the errors are returned, a file that is being saved can be missing for a moment
+    std::error_code error;
+    std::filesystem::directory_iterator iterator(m_Directory, error);
+    if (error)
+    {
+        return;
+    }
+
+    // Incrementing can fail as well, the range-for would throw
+    for (; iterator != std::filesystem::directory_iterator(); iterator.increment(error))
+    {
+        if (error)
+        {
+            return;
+        }
+
+        const std::filesystem::path& path = iterator->path();
+        if (path.extension() != m_Extension)
+        {
+            continue;
+        }
+
+        const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            continue;
+        }
+
+        const std::string filepath = path.generic_string();
+
+        auto file = m_WriteTimes.find(filepath);
+        if (file == m_WriteTimes.end())
+        {
+            m_WriteTimes.emplace(filepath, writeTime);
+            outChangedFiles.emplace_back(filepath);
+        }
+        else if (file->second != writeTime)
+        {
+            file->second = writeTime;
+            outChangedFiles.emplace_back(filepath);
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Core.h"
+#include <filesystem>
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// FileWatcher, polls the modification time of the files with an extension in a directory. Polling
+// a handful of files is cheap and works the same on every platform.
+
+class FFileWatcher
+{
+public:
+    FFileWatcher(const char* pDirectory, const char* pExtension);
+    ~FFileWatcher() = default;
+
+    // Returns the files that were added or modified since the last call
+    void Poll(std::vector<std::string>& outChangedFiles);
+
+private:
+    std::string m_Directory;
+    std::string m_Extension;
+
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_WriteTimes;
+};
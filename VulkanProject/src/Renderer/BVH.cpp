@@ -0,0 +1,248 @@
+#include "BVH.h"
+#include <numeric>
+
+struct FBVHBin
+{
+    FAABB    Bounds;
+    uint32_t Count = 0;
+};
+
+FBVH::FBVH()
+    : m_Nodes()
+    , m_PrimitiveIndices()
+    , m_Centroids()
+    , m_Bounds()
+    , m_Depth(0)
+{
+}
+
+void FBVH::Clear()
+{
+    m_Nodes.clear();
+    m_PrimitiveIndices.clear();
+    m_Centroids.clear();
+    m_Bounds.clear();
+    m_Depth = 0;
+}
+
+void FBVH::Build(const std::vector<FAABB>& primitiveBounds)
+{
+    Clear();
+
+    const uint32_t numPrimitives = static_cast<uint32_t>(primitiveBounds.size());
+    if (numPrimitives == 0)
+    {
+        return;
+    }
+
+    m_PrimitiveIndices.resize(numPrimitives);
+    std::iota(m_PrimitiveIndices.begin(), m_PrimitiveIndices.end(), 0);
+
+    m_Bounds = primitiveBounds;
+    m_Centroids.resize(numPrimitives);
+    for (uint32_t i = 0; i < numPrimitives; i++)
+    {
+        m_Centroids[i] = primitiveBounds[i].GetCenter();
+    }
+
+    // A binary tree never has more than 2N-1 nodes
+    m_Nodes.reserve(2 * numPrimitives - 1);
+
+    FBVHNode root = {};
+    root.LeftOrFirst   = 0;
+    root.NumPrimitives = numPrimitives;
+    m_Nodes.push_back(root);
+    UpdateNodeBounds(0, primitiveBounds);
+
+    // Subdivide without recursion, the second value is the depth of the node
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.push_back({ 0, 1 });
+
+    // Leaves that were cut off by the depth limit while they could still be split
+    uint32_t numForcedLeaves   = 0;
+    uint32_t maxForcedLeafSize = 0;
+
+    while (!stack.empty())
+    {
+        const uint32_t nodeIndex = stack.back().first;
+        const uint32_t depth     = stack.back().second;
+        stack.pop_back();
+
+        m_Depth = std::max(m_Depth, depth);
+
+        FBVHNode& node = m_Nodes[nodeIndex];
+        if (node.NumPrimitives <= 1)
+        {
+            continue;
+        }
+
+        // The traversal pushes at most one node per level, so deeper nodes would not fit on its stack
+        if (depth >= BVH_MAX_STACK_DEPTH)
+        {
+            if (node.NumPrimitives > BVH_MAX_LEAF_SIZE)
+            {
+                numForcedLeaves++;
+                maxForcedLeafSize = std::max(maxForcedLeafSize, node.NumPrimitives);
+            }
+
+            continue;
+        }
+
+        uint32_t  axis          = 0;
+        float     splitPosition = 0.0f;
+        const float splitCost = FindBestSplit(node, axis, splitPosition);
+
+        // Only split when it is cheaper than intersecting all primitives in the leaf, unless the leaf gets too large
+        const float leafCost = float(node.NumPrimitives) * FAABB(node.Min, node.Max).GetSurfaceArea();
+        if (splitCost >= leafCost && node.NumPrimitives <= BVH_MAX_LEAF_SIZE)
+        {
+            continue;
+        }
+
+        // Partition the primitives
+        const uint32_t first = node.LeftOrFirst;
+        const uint32_t last  = first + node.NumPrimitives;
+
+        uint32_t* pMiddle = nullptr;
+        if (splitCost < std::numeric_limits<float>::max())
+        {
+            pMiddle = std::partition(m_PrimitiveIndices.data() + first, m_PrimitiveIndices.data() + last, [&](uint32_t primitiveIndex)
+            {
+                return m_Centroids[primitiveIndex][axis] < splitPosition;
+            });
+        }
+
+        uint32_t numLeft = pMiddle ? static_cast<uint32_t>(pMiddle - (m_PrimitiveIndices.data() + first)) : 0;
+        if (numLeft == 0 || numLeft == node.NumPrimitives)
+        {
+            // All centroids are in the same spot so SAH cannot separate them, split in the middle to keep the leaves small
+            if (node.NumPrimitives <= BVH_MAX_LEAF_SIZE)
+            {
+                continue;
+            }
+
+            numLeft = node.NumPrimitives / 2;
+        }
+
+        const uint32_t leftIndex = static_cast<uint32_t>(m_Nodes.size());
+
+        FBVHNode left = {};
+        left.LeftOrFirst   = first;
+        left.NumPrimitives = numLeft;
+
+        FBVHNode right = {};
+        right.LeftOrFirst   = first + numLeft;
+        right.NumPrimitives = node.NumPrimitives - numLeft;
+
+        // The node reference is not used after this since the vector can grow
+        node.LeftOrFirst   = leftIndex;
+        node.NumPrimitives = 0;
+
+        m_Nodes.push_back(left);
+        m_Nodes.push_back(right);
+        UpdateNodeBounds(leftIndex, primitiveBounds);
+        UpdateNodeBounds(leftIndex + 1, primitiveBounds);
+
+        stack.push_back({ leftIndex,     depth + 1 });
+        stack.push_back({ leftIndex + 1, depth + 1 });
+    }
+
+    // Only the result is needed after the build
+    m_Centroids.clear();
+    m_Bounds.clear();
+
+    assert(m_Depth <= BVH_MAX_STACK_DEPTH);
+    if (numForcedLeaves > 0)
+    {
+        std::cout << "[FBVH]: " << numForcedLeaves << " leaves were cut off at the maximum depth of " << BVH_MAX_STACK_DEPTH << ", the largest has " << maxForcedLeafSize << " primitives\n";
+    }
+}
+
+void FBVH::UpdateNodeBounds(uint32_t nodeIndex, const std::vector<FAABB>& primitiveBounds)
+{
+    FAABB bounds;
+
+    FBVHNode& node = m_Nodes[nodeIndex];
+    for (uint32_t i = 0; i < node.NumPrimitives; i++)
+    {
+        bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.LeftOrFirst + i]]);
+    }
+
+    node.Min = bounds.Min;
+    node.Max = bounds.Max;
+}
+
+float FBVH::FindBestSplit(const FBVHNode& node, uint32_t& outAxis, float& outSplitPosition) const
+{
+    float bestCost = std::numeric_limits<float>::max();
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        // Bin over the centroid bounds since that is what we partition on
+        float boundsMin = std::numeric_limits<float>::max();
+        float boundsMax = -std::numeric_limits<float>::max();
+        for (uint32_t i = 0; i < node.NumPrimitives; i++)
+        {
+            const glm::vec3& centroid = m_Centroids[m_PrimitiveIndices[node.LeftOrFirst + i]];
+            boundsMin = std::min(boundsMin, centroid[axis]);
+            boundsMax = std::max(boundsMax, centroid[axis]);
+        }
+
+        if (boundsMin == boundsMax)
+        {
+            continue;
+        }
+
+        FBVHBin bins[BVH_NUM_BINS];
+
+        const float scale = float(BVH_NUM_BINS) / (boundsMax - boundsMin);
+        for (uint32_t i = 0; i < node.NumPrimitives; i++)
+        {
+            const uint32_t primitiveIndex = m_PrimitiveIndices[node.LeftOrFirst + i];
+            const uint32_t binIndex       = std::min<uint32_t>(BVH_NUM_BINS - 1, uint32_t((m_Centroids[primitiveIndex][axis] - boundsMin) * scale));
+            bins[binIndex].Count++;
+            bins[binIndex].Bounds.Grow(m_Bounds[primitiveIndex]);
+        }
+
+        // Sweep from both sides to get the cost of each plane between the bins
+        float    leftArea[BVH_NUM_BINS - 1];
+        float    rightArea[BVH_NUM_BINS - 1];
+        uint32_t leftCount[BVH_NUM_BINS - 1];
+        uint32_t rightCount[BVH_NUM_BINS - 1];
+
+        FAABB    leftBox;
+        FAABB    rightBox;
+        uint32_t leftSum  = 0;
+        uint32_t rightSum = 0;
+        for (uint32_t i = 0; i < BVH_NUM_BINS - 1; i++)
+        {
+            leftSum += bins[i].Count;
+            leftCount[i] = leftSum;
+            leftBox.Grow(bins[i].Bounds);
+            leftArea[i] = leftBox.GetSurfaceArea();
+
+            rightSum += bins[BVH_NUM_BINS - 1 - i].Count;
+            rightCount[BVH_NUM_BINS - 2 - i] = rightSum;
+            rightBox.Grow(bins[BVH_NUM_BINS - 1 - i].Bounds);
+            rightArea[BVH_NUM_BINS - 2 - i] = rightBox.GetSurfaceArea();
+        }
+
+        const float binWidth = (boundsMax - boundsMin) / float(BVH_NUM_BINS);
+        for (uint32_t i = 0; i < BVH_NUM_BINS - 1; i++)
+        {
+            if (leftCount[i] == 0 || rightCount[i] == 0)
+            {
+                continue;
+            }
+
+            const float cost = float(leftCount[i]) * leftArea[i] + float(rightCount[i]) * rightArea[i];
+            if (cost < bestCost)
+            {
+                bestCost         = cost;
+                outAxis          = axis;
+                outSplitPosition = boundsMin + binWidth * float(i + 1);
+            }
+        }
+    }
+
+    return bestCost;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "Core.h"
+#include <limits>
+
+#define BVH_NUM_BINS          (16)
+#define BVH_MAX_LEAF_SIZE     (4)
+
+// Nodes at this depth are always leaves, so the traversal never pushes more nodes than fit on its stack. Must match
+// the value in scene.glsl
+#define BVH_MAX_STACK_DEPTH   (32)
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Bounding box
+
+struct FAABB
+{
+    FAABB()
+        : Min( std::numeric_limits<float>::max())
+        , Max(-std::numeric_limits<float>::max())
+    {
+    }
+
+    FAABB(const glm::vec3& min, const glm::vec3& max)
+        : Min(min)
+        , Max(max)
+    {
+    }
+
+    void Grow(const glm::vec3& point)
+    {
+        Min = glm::min(Min, point);
+        Max = glm::max(Max, point);
+    }
+
+    void Grow(const FAABB& other)
+    {
+        Min = glm::min(Min, other.Min);
+        Max = glm::max(Max, other.Max);
+    }
+
+    glm::vec3 GetCenter() const
+    {
+        return (Min + Max) * 0.5f;
+    }
+
+    float GetSurfaceArea() const
+    {
+        const glm::vec3 extent = Max - Min;
+        if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+        {
+            return 0.0f;
+        }
+
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    glm::vec3 Min;
+    glm::vec3 Max;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// GPU Node, inner nodes store the index of the left child and the right child is always stored
+// directly after it. Leaves store the index of the first primitive in the primitive index list.
+
+struct FBVHNode
+{
+    glm::vec3 Min;
+    uint32_t  LeftOrFirst;
+    glm::vec3 Max;
+    uint32_t  NumPrimitives;
+
+    bool IsLeaf() const
+    {
+        return NumPrimitives > 0;
+    }
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// BVH built with the surface area heuristic over a set of primitive bounds
+
+class FBVH
+{
+public:
+    FBVH();
+    ~FBVH() = default;
+
+    void Build(const std::vector<FAABB>& primitiveBounds);
+
+    void Clear();
+
+    const std::vector<FBVHNode>& GetNodes() const
+    {
+        return m_Nodes;
+    }
+
+    // Leaves refer into this list, which in turn refers to the primitives passed to Build
+    const std::vector<uint32_t>& GetPrimitiveIndices() const
+    {
+        return m_PrimitiveIndices;
+    }
+
+    uint32_t GetDepth() const
+    {
+        return m_Depth;
+    }
+
+private:
+    void  UpdateNodeBounds(uint32_t nodeIndex, const std::vector<FAABB>& primitiveBounds);
+    float FindBestSplit(const FBVHNode& node, uint32_t& outAxis, float& outSplitPosition) const;
+
+    std::vector<FBVHNode>  m_Nodes;
+    std::vector<uint32_t>  m_PrimitiveIndices;
+    std::vector<glm::vec3> m_Centroids;
+    std::vector<FAABB>     m_Bounds;
+    uint32_t               m_Depth;
+};
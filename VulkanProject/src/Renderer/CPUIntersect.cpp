@@ -0,0 +1,500 @@
+#include "CPUIntersect.h"
+#include "Scene.h"
+#include "MathHelper.h"
+#include <cmath>
+
+#if defined(COMPILER_VISUAL_STUDIO)
+    #include <intrin.h>
+#else
+    #include <cpuid.h>
+#endif
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Scalar kernels, one lane and used when the CPU has no AVX2
+
+namespace
+{
+    struct FSimdScalar
+    {
+        using Float = float;
+        using Mask  = bool;
+
+        static constexpr uint32_t Width = 1;
+
+        static Float Load(const float* pValues)         { return *pValues; }
+        static void  Store(float* pValues, Float value) { *pValues = value; }
+        static Float Set1(float value)                  { return value; }
+        static Float Iota()                             { return 0.0f; }
+
+        static Float Add(Float a, Float b) { return a + b; }
+        static Float Sub(Float a, Float b) { return a - b; }
+        static Float Mul(Float a, Float b) { return a * b; }
+        static Float Div(Float a, Float b) { return a / b; }
+        static Float Max(Float a, Float b) { return std::max(a, b); }
+        static Float Sqrt(Float a)         { return std::sqrt(a); }
+        static Float Abs(Float a)          { return std::abs(a); }
+
+        static Mask CmpLt(Float a, Float b) { return a < b; }
+        static Mask CmpLe(Float a, Float b) { return a <= b; }
+        static Mask CmpGt(Float a, Float b) { return a > b; }
+        static Mask CmpGe(Float a, Float b) { return a >= b; }
+        static Mask And(Mask a, Mask b)     { return a && b; }
+        static Mask Or(Mask a, Mask b)      { return a || b; }
+
+        // Returns a where the mask is set and b otherwise
+        static Float Select(Mask mask, Float a, Float b) { return mask ? a : b; }
+
+        static bool     Any(Mask mask)      { return mask; }
+        static uint32_t MaskBits(Mask mask) { return mask ? 1u : 0u; }
+
+        // Mask of the lanes that are below count
+        static Mask FirstLanes(uint32_t count) { return count > 0; }
+    };
+}
+
+#include "CPUIntersectKernels.inl"
+
+const FIntersectKernels& GetIntersectKernelsScalar()
+{
+    static const FIntersectKernels s_Kernels = MakeIntersectKernels<FSimdScalar>("Scalar");
+    return s_Kernels;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// CPU features
+
+struct FCPUFeatures
+{
+    bool bAVX2   = false;
+    bool bAVX512 = false;
+};
+
+static void GetCPUID(uint32_t leaf, uint32_t subLeaf, uint32_t outRegisters[4])
+{
+#if defined(COMPILER_VISUAL_STUDIO)
+    int registers[4];
+    __cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subLeaf));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        outRegisters[i] = static_cast<uint32_t>(registers[i]);
+    }
+#else
+    __cpuid_count(leaf, subLeaf, outRegisters[0], outRegisters[1], outRegisters[2], outRegisters[3]);
+#endif
+}
+
+// The state components that the OS saves on a context switch
+static uint64_t GetXCR0()
+{
+#if defined(COMPILER_VISUAL_STUDIO)
+    return _xgetbv(0);
+#else
+    uint32_t eax;
+    uint32_t edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+static FCPUFeatures DetectCPUFeatures()
+{
+    FCPUFeatures features;
+
+    uint32_t registers[4];
+    GetCPUID(0, 0, registers);
+    const uint32_t maxLeaf = registers[0];
+    if (maxLeaf < 7)
+    {
+        return features;
+    }
+
+    // The kernels are compiled with FMA enabled together with AVX2
+    GetCPUID(1, 0, registers);
+    const bool bOSXSAVE = (registers[2] & (1u << 27)) != 0;
+    const bool bAVX     = (registers[2] & (1u << 28)) != 0;
+    const bool bFMA     = (registers[2] & (1u << 12)) != 0;
+    if (!bOSXSAVE || !bAVX)
+    {
+        return features;
+    }
+
+    // YMM needs SSE and AVX state, ZMM also needs the opmask and upper ZMM state. macOS only enables the AVX-512 state
+    // on first use, the AVX-512 kernels are therefore not used there which is fine since they are an optimization.
+    const uint64_t xcr0      = GetXCR0();
+    const bool     bOSAVX    = (xcr0 & 0x06) == 0x06;
+    const bool     bOSAVX512 = (xcr0 & 0xe6) == 0xe6;
+
+    GetCPUID(7, 0, registers);
+    const bool bAVX2    = (registers[1] & (1u << 5))  != 0;
+    const bool bAVX512F = (registers[1] & (1u << 16)) != 0;
+
+    features.bAVX2   = bOSAVX && bAVX2 && bFMA;
+    features.bAVX512 = features.bAVX2 && bOSAVX512 && bAVX512F;
+    return features;
+}
+
+static const FCPUFeatures& GetCPUFeatures()
+{
+    static const FCPUFeatures s_Features = DetectCPUFeatures();
+    return s_Features;
+}
+
+static const char* GetISAName(ESimdISA isa)
+{
+    switch (isa)
+    {
+        case ESimdISA::AVX2:   return "AVX2";
+        case ESimdISA::AVX512: return "AVX-512";
+        default:               return "Scalar";
+    }
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// SoAScene
+
+// Offset of component i in an array that is padded for the kernels
+static float* GetComponent(std::vector<float>& data, uint32_t paddedCount, uint32_t component)
+{
+    return data.data() + size_t(paddedCount) * component;
+}
+
+static const float* GetComponent(const std::vector<float>& data, uint32_t paddedCount, uint32_t component)
+{
+    return data.data() + size_t(paddedCount) * component;
+}
+
+void FSoAScene::Build(const FScene& scene)
+{
+    // Spheres
+    m_NumSpheres = static_cast<uint32_t>(scene.m_Spheres.size());
+
+    uint32_t paddedCount = Math::AlignUp(m_NumSpheres, SIMD_MAX_WIDTH);
+    m_SphereData.assign(size_t(paddedCount) * 4, 0.0f);
+    for (uint32_t i = 0; i < m_NumSpheres; i++)
+    {
+        const FSphere& sphere = scene.m_Spheres[i];
+        GetComponent(m_SphereData, paddedCount, 0)[i] = sphere.Position.x;
+        GetComponent(m_SphereData, paddedCount, 1)[i] = sphere.Position.y;
+        GetComponent(m_SphereData, paddedCount, 2)[i] = sphere.Position.z;
+        GetComponent(m_SphereData, paddedCount, 3)[i] = sphere.Radius;
+    }
+
+    // Quads, the normal, W and distance are the same as HitQuad computes
+    m_NumQuads = static_cast<uint32_t>(scene.m_Quads.size());
+
+    paddedCount = Math::AlignUp(m_NumQuads, SIMD_MAX_WIDTH);
+    m_QuadData.assign(size_t(paddedCount) * 16, 0.0f);
+    for (uint32_t i = 0; i < m_NumQuads; i++)
+    {
+        const FQuad&    quad   = scene.m_Quads[i];
+        const glm::vec3 q      = glm::vec3(quad.Position);
+        const glm::vec3 u      = glm::vec3(quad.Edge0);
+        const glm::vec3 v      = glm::vec3(quad.Edge1);
+        const glm::vec3 n      = glm::cross(u, v);
+        const glm::vec3 w      = n / glm::dot(n, n);
+        const glm::vec3 normal = glm::normalize(n);
+
+        const float components[16] =
+        {
+            q.x, q.y, q.z,
+            u.x, u.y, u.z,
+            v.x, v.y, v.z,
+            normal.x, normal.y, normal.z,
+            w.x, w.y, w.z,
+            glm::dot(normal, q),
+        };
+
+        for (uint32_t component = 0; component < 16; component++)
+        {
+            GetComponent(m_QuadData, paddedCount, component)[i] = components[component];
+        }
+    }
+
+    // Planes
+    m_NumPlanes = static_cast<uint32_t>(scene.m_Planes.size());
+
+    paddedCount = Math::AlignUp(m_NumPlanes, SIMD_MAX_WIDTH);
+    m_PlaneData.assign(size_t(paddedCount) * 4, 0.0f);
+    for (uint32_t i = 0; i < m_NumPlanes; i++)
+    {
+        const FPlane&   plane  = scene.m_Planes[i];
+        const glm::vec3 normal = glm::normalize(plane.Normal);
+        GetComponent(m_PlaneData, paddedCount, 0)[i] = normal.x;
+        GetComponent(m_PlaneData, paddedCount, 1)[i] = normal.y;
+        GetComponent(m_PlaneData, paddedCount, 2)[i] = normal.z;
+        GetComponent(m_PlaneData, paddedCount, 3)[i] = plane.Distance;
+    }
+}
+
+FSoASpheres FSoAScene::GetSpheres() const
+{
+    const uint32_t paddedCount = Math::AlignUp(m_NumSpheres, SIMD_MAX_WIDTH);
+
+    FSoASpheres spheres;
+    spheres.pCenterX = GetComponent(m_SphereData, paddedCount, 0);
+    spheres.pCenterY = GetComponent(m_SphereData, paddedCount, 1);
+    spheres.pCenterZ = GetComponent(m_SphereData, paddedCount, 2);
+    spheres.pRadius  = GetComponent(m_SphereData, paddedCount, 3);
+    spheres.Count    = m_NumSpheres;
+    return spheres;
+}
+
+FSoAQuads FSoAScene::GetQuads() const
+{
+    const uint32_t paddedCount = Math::AlignUp(m_NumQuads, SIMD_MAX_WIDTH);
+
+    FSoAQuads quads;
+    quads.pPositionX = GetComponent(m_QuadData, paddedCount, 0);
+    quads.pPositionY = GetComponent(m_QuadData, paddedCount, 1);
+    quads.pPositionZ = GetComponent(m_QuadData, paddedCount, 2);
+    quads.pEdge0X    = GetComponent(m_QuadData, paddedCount, 3);
+    quads.pEdge0Y    = GetComponent(m_QuadData, paddedCount, 4);
+    quads.pEdge0Z    = GetComponent(m_QuadData, paddedCount, 5);
+    quads.pEdge1X    = GetComponent(m_QuadData, paddedCount, 6);
+    quads.pEdge1Y    = GetComponent(m_QuadData, paddedCount, 7);
+    quads.pEdge1Z    = GetComponent(m_QuadData, paddedCount, 8);
+    quads.pNormalX   = GetComponent(m_QuadData, paddedCount, 9);
+    quads.pNormalY   = GetComponent(m_QuadData, paddedCount, 10);
+    quads.pNormalZ   = GetComponent(m_QuadData, paddedCount, 11);
+    quads.pWX        = GetComponent(m_QuadData, paddedCount, 12);
+    quads.pWY        = GetComponent(m_QuadData, paddedCount, 13);
+    quads.pWZ        = GetComponent(m_QuadData, paddedCount, 14);
+    quads.pDistance  = GetComponent(m_QuadData, paddedCount, 15);
+    quads.Count      = m_NumQuads;
+    return quads;
+}
+
+FSoAPlanes FSoAScene::GetPlanes() const
+{
+    const uint32_t paddedCount = Math::AlignUp(m_NumPlanes, SIMD_MAX_WIDTH);
+
+    FSoAPlanes planes;
+    planes.pNormalX  = GetComponent(m_PlaneData, paddedCount, 0);
+    planes.pNormalY  = GetComponent(m_PlaneData, paddedCount, 1);
+    planes.pNormalZ  = GetComponent(m_PlaneData, paddedCount, 2);
+    planes.pDistance = GetComponent(m_PlaneData, paddedCount, 3);
+    planes.Count     = m_NumPlanes;
+    return planes;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// CPUIntersect
+
+namespace CPUIntersect
+{
+    bool IsSupported(ESimdISA isa)
+    {
+        switch (isa)
+        {
+            case ESimdISA::Scalar: return true;
+            case ESimdISA::AVX2:   return GetCPUFeatures().bAVX2;
+            case ESimdISA::AVX512: return GetCPUFeatures().bAVX512;
+            default:               return false;
+        }
+    }
+
+    ESimdISA GetBestISA()
+    {
+        if (IsSupported(ESimdISA::AVX512))
+        {
+            return ESimdISA::AVX512;
+        }
+        else if (IsSupported(ESimdISA::AVX2))
+        {
+            return ESimdISA::AVX2;
+        }
+
+        return ESimdISA::Scalar;
+    }
+
+    const FIntersectKernels& GetKernels(ESimdISA isa)
+    {
+        if (!IsSupported(isa))
+        {
+            return GetIntersectKernelsScalar();
+        }
+
+        switch (isa)
+        {
+            case ESimdISA::AVX2:   return GetIntersectKernelsAVX2();
+            case ESimdISA::AVX512: return GetIntersectKernelsAVX512();
+            default:               return GetIntersectKernelsScalar();
+        }
+    }
+
+    // The closest primitive of each ray, encoded the same way as FScene::GetPrimitiveBounds with the planes after the meshes
+    static uint32_t EncodeHit(uint32_t type, uint32_t index)
+    {
+        return (index == SIMD_INVALID_INDEX) ? SIMD_INVALID_INDEX : ((type << PRIMITIVE_INDEX_BITS) | index);
+    }
+
+    static double GetSecondsSince(const std::chrono::high_resolution_clock::time_point& start)
+    {
+        const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+        return duration.count();
+    }
+
+    void RunBenchmark(uint32_t numRays)
+    {
+        constexpr uint32_t PrimitiveTypePlane = PRIMITIVE_TYPE_MESH + 1;
+        constexpr float    MinT               = 0.001f;
+        constexpr float    MaxT               = 1000.0f;
+
+        FSphereScene scene;
+        scene.Initialize();
+
+        FSoAScene soaScene;
+        soaScene.Build(scene);
+
+        const FSoASpheres spheres = soaScene.GetSpheres();
+        const FSoAQuads   quads   = soaScene.GetQuads();
+        const FSoAPlanes  planes  = soaScene.GetPlanes();
+
+        // Random rays from the camera, spread out a bit more than the view
+        numRays = Math::AlignUp(std::max(numRays, 1u), SIMD_MAX_WIDTH);
+
+        const glm::vec3 origin  = scene.m_Camera.GetPosition();
+        const glm::vec3 forward = glm::normalize(scene.m_Camera.GetForward());
+
+        std::vector<FSimdRay> rays(numRays);
+
+        uint32_t seed = 1;
+        auto nextRandom = [&seed]()
+        {
+            seed = (1664525u * seed + 1013904223u);
+            return (float(seed & 0x00FFFFFF) / float(0x01000000)) * 2.0f - 1.0f;
+        };
+
+        for (FSimdRay& ray : rays)
+        {
+            const glm::vec3 direction = glm::normalize(forward + glm::vec3(nextRandom(), nextRandom(), nextRandom()));
+            ray.Origin[0]    = origin.x;
+            ray.Origin[1]    = origin.y;
+            ray.Origin[2]    = origin.z;
+            ray.Direction[0] = direction.x;
+            ray.Direction[1] = direction.y;
+            ray.Direction[2] = direction.z;
+            ray.MinT         = MinT;
+            ray.MaxT         = MaxT;
+        }
+
+        std::cout << "[CPUIntersect]: Benchmarking " << numRays << " rays against " << spheres.Count << " spheres, " << quads.Count << " quads and " << planes.Count << " planes" << std::endl;
+
+        // The scalar kernels are the reference for the others
+        std::vector<uint32_t> reference;
+        std::vector<uint32_t> results(numRays);
+        for (uint32_t isaIndex = 0; isaIndex < static_cast<uint32_t>(ESimdISA::Count); isaIndex++)
+        {
+            const ESimdISA isa = static_cast<ESimdISA>(isaIndex);
+            if (!IsSupported(isa))
+            {
+                std::cout << "[CPUIntersect]: " << GetISAName(isa) << " is not supported" << std::endl;
+                continue;
+            }
+
+            const FIntersectKernels& kernels = GetKernels(isa);
+
+            // One ray against all the primitives
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < numRays; i++)
+            {
+                float t = MaxT;
+
+                uint32_t hit = EncodeHit(PRIMITIVE_TYPE_SPHERE, kernels.pfnIntersectSpheres(rays[i], spheres, t));
+
+                uint32_t index = kernels.pfnIntersectQuads(rays[i], quads, t);
+                hit = (index != SIMD_INVALID_INDEX) ? EncodeHit(PRIMITIVE_TYPE_QUAD, index) : hit;
+
+                index = kernels.pfnIntersectPlanes(rays[i], planes, t);
+                hit = (index != SIMD_INVALID_INDEX) ? EncodeHit(PrimitiveTypePlane, index) : hit;
+
+                results[i] = hit;
+            }
+
+            const double singleSeconds = GetSecondsSince(start);
+
+            if (reference.empty())
+            {
+                reference = results;
+            }
+
+            uint32_t numMismatches = 0;
+            for (uint32_t i = 0; i < numRays; i++)
+            {
+                numMismatches += (results[i] != reference[i]) ? 1 : 0;
+            }
+
+            // Packets of rays against one primitive at a time, the last type that hit is the closest one
+            start = std::chrono::high_resolution_clock::now();
+            for (uint32_t first = 0; first < numRays; first += SIMD_MAX_WIDTH)
+            {
+                FRayPacket packet;
+                packet.Count = SIMD_MAX_WIDTH;
+                for (uint32_t lane = 0; lane < SIMD_MAX_WIDTH; lane++)
+                {
+                    const FSimdRay& ray = rays[first + lane];
+                    packet.OriginX[lane]    = ray.Origin[0];
+                    packet.OriginY[lane]    = ray.Origin[1];
+                    packet.OriginZ[lane]    = ray.Origin[2];
+                    packet.DirectionX[lane] = ray.Direction[0];
+                    packet.DirectionY[lane] = ray.Direction[1];
+                    packet.DirectionZ[lane] = ray.Direction[2];
+                    packet.MinT[lane]       = ray.MinT;
+                    packet.MaxT[lane]       = ray.MaxT;
+                }
+
+                float    t[SIMD_MAX_WIDTH];
+                uint32_t sphereHits[SIMD_MAX_WIDTH];
+                uint32_t quadHits[SIMD_MAX_WIDTH];
+                uint32_t planeHits[SIMD_MAX_WIDTH];
+                for (uint32_t lane = 0; lane < SIMD_MAX_WIDTH; lane++)
+                {
+                    t[lane]          = MaxT;
+                    sphereHits[lane] = SIMD_INVALID_INDEX;
+                    quadHits[lane]   = SIMD_INVALID_INDEX;
+                    planeHits[lane]  = SIMD_INVALID_INDEX;
+                }
+
+                for (uint32_t i = 0; i < spheres.Count; i++)
+                {
+                    kernels.pfnIntersectSpherePacket(packet, spheres, i, t, sphereHits);
+                }
+
+                for (uint32_t i = 0; i < quads.Count; i++)
+                {
+                    kernels.pfnIntersectQuadPacket(packet, quads, i, t, quadHits);
+                }
+
+                for (uint32_t i = 0; i < planes.Count; i++)
+                {
+                    kernels.pfnIntersectPlanePacket(packet, planes, i, t, planeHits);
+                }
+
+                for (uint32_t lane = 0; lane < SIMD_MAX_WIDTH; lane++)
+                {
+                    uint32_t hit = EncodeHit(PRIMITIVE_TYPE_SPHERE, sphereHits[lane]);
+                    hit = (quadHits[lane]  != SIMD_INVALID_INDEX) ? EncodeHit(PRIMITIVE_TYPE_QUAD, quadHits[lane]) : hit;
+                    hit = (planeHits[lane] != SIMD_INVALID_INDEX) ? EncodeHit(PrimitiveTypePlane, planeHits[lane]) : hit;
+                    results[first + lane] = hit;
+                }
+            }
+
+            const double packetSeconds = GetSecondsSince(start);
+
+            for (uint32_t i = 0; i < numRays; i++)
+            {
+                numMismatches += (results[i] != reference[i]) ? 1 : 0;
+            }
+
+            // Small differences are expected since the wider kernels can fuse multiplies and adds
+            const double singleMRays = double(numRays) / std::max(singleSeconds, 1e-9) / 1e6;
+            const double packetMRays = double(numRays) / std::max(packetSeconds, 1e-9) / 1e6;
+            std::cout << "[CPUIntersect]: " << kernels.pName << " (" << kernels.Width << " lanes): "
+                << singleMRays << " Mrays/s (1 ray vs N primitives), "
+                << packetMRays << " Mrays/s (" << SIMD_MAX_WIDTH << " rays vs 1 primitive), "
+                << numMismatches << " mismatches" << std::endl;
+        }
+
+        std::cout << "[CPUIntersect]: Using " << GetISAName(GetBestISA()) << std::endl;
+    }
+}
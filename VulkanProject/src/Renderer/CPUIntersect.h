@@ -0,0 +1,52 @@
+#pragma once
+#include "Core.h"
+#include "CPUIntersectKernels.h"
+
+struct FScene;
+
+enum class ESimdISA : uint32_t
+{
+    Scalar = 0,
+    AVX2   = 1,
+    AVX512 = 2,
+    Count  = 3,
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// SoAScene, copy of the spheres, quads and planes of a FScene with one array per component so that
+// the SIMD kernels can load one primitive per lane. The arrays are padded to SIMD_MAX_WIDTH.
+
+class FSoAScene
+{
+public:
+    void Build(const FScene& scene);
+
+    // The views point into the scene and are only valid until the next call to Build
+    FSoASpheres GetSpheres() const;
+    FSoAQuads   GetQuads() const;
+    FSoAPlanes  GetPlanes() const;
+
+private:
+    std::vector<float> m_SphereData;
+    std::vector<float> m_QuadData;
+    std::vector<float> m_PlaneData;
+    uint32_t           m_NumSpheres = 0;
+    uint32_t           m_NumQuads   = 0;
+    uint32_t           m_NumPlanes  = 0;
+};
+
+namespace CPUIntersect
+{
+    // Checks both the CPU and that the OS saves the registers
+    bool IsSupported(ESimdISA isa);
+
+    // The widest instruction set that is supported
+    ESimdISA GetBestISA();
+
+    // Falls back to the scalar kernels when the instruction set is not supported
+    const FIntersectKernels& GetKernels(ESimdISA isa);
+
+    // Intersects random camera rays against the spheres, quads and planes of the default scene with every supported
+    // instruction set and prints the throughput in Mrays/s, both for one ray at a time and for packets
+    void RunBenchmark(uint32_t numRays);
+}
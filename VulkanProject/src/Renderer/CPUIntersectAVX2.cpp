@@ -0,0 +1,53 @@
+// This file is compiled with AVX2 enabled (see premake5.lua) and is only called when the CPU supports it. It must not
+// include any header with inline code that is shared with the rest of the program, otherwise the linker could pick the
+// AVX2 version of that code for everyone.
+#include "CPUIntersectKernels.h"
+#include <immintrin.h>
+
+namespace
+{
+    struct FSimdAVX2
+    {
+        using Float = __m256;
+        using Mask  = __m256;
+
+        static constexpr uint32_t Width = 8;
+
+        static Float Load(const float* pValues)         { return _mm256_loadu_ps(pValues); }
+        static void  Store(float* pValues, Float value) { _mm256_storeu_ps(pValues, value); }
+        static Float Set1(float value)                  { return _mm256_set1_ps(value); }
+        static Float Iota()                             { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+
+        static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Float Sqrt(Float a)         { return _mm256_sqrt_ps(a); }
+        static Float Abs(Float a)          { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+        static Mask CmpLt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Mask CmpLe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static Mask CmpGt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static Mask CmpGe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static Mask And(Mask a, Mask b)     { return _mm256_and_ps(a, b); }
+        static Mask Or(Mask a, Mask b)      { return _mm256_or_ps(a, b); }
+
+        // Returns a where the mask is set and b otherwise
+        static Float Select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+
+        static bool     Any(Mask mask)      { return _mm256_movemask_ps(mask) != 0; }
+        static uint32_t MaskBits(Mask mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+
+        // Mask of the lanes that are below count
+        static Mask FirstLanes(uint32_t count) { return CmpLt(Iota(), Set1(float(count))); }
+    };
+}
+
+#include "CPUIntersectKernels.inl"
+
+const FIntersectKernels& GetIntersectKernelsAVX2()
+{
+    static const FIntersectKernels s_Kernels = MakeIntersectKernels<FSimdAVX2>("AVX2");
+    return s_Kernels;
+}
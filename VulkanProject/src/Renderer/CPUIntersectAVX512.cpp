@@ -0,0 +1,57 @@
+// This file is compiled with AVX-512 enabled (see premake5.lua) and is only called when the CPU supports it. It must
+// not include any header with inline code that is shared with the rest of the program, otherwise the linker could pick
+// the AVX-512 version of that code for everyone.
+#include "CPUIntersectKernels.h"
+#include <immintrin.h>
+
+namespace
+{
+    struct FSimdAVX512
+    {
+        using Float = __m512;
+        using Mask  = __mmask16;
+
+        static constexpr uint32_t Width = 16;
+
+        static Float Load(const float* pValues)         { return _mm512_loadu_ps(pValues); }
+        static void  Store(float* pValues, Float value) { _mm512_storeu_ps(pValues, value); }
+        static Float Set1(float value)                  { return _mm512_set1_ps(value); }
+
+        static Float Iota()
+        {
+            return _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+        }
+
+        static Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm512_max_ps(a, b); }
+        static Float Sqrt(Float a)         { return _mm512_sqrt_ps(a); }
+        static Float Abs(Float a)          { return _mm512_abs_ps(a); }
+
+        static Mask CmpLt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static Mask CmpLe(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+        static Mask CmpGt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static Mask CmpGe(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+        static Mask And(Mask a, Mask b)     { return static_cast<Mask>(a & b); }
+        static Mask Or(Mask a, Mask b)      { return static_cast<Mask>(a | b); }
+
+        // Returns a where the mask is set and b otherwise
+        static Float Select(Mask mask, Float a, Float b) { return _mm512_mask_blend_ps(mask, b, a); }
+
+        static bool     Any(Mask mask)      { return mask != 0; }
+        static uint32_t MaskBits(Mask mask) { return static_cast<uint32_t>(mask); }
+
+        // Mask of the lanes that are below count
+        static Mask FirstLanes(uint32_t count) { return (count >= Width) ? Mask(0xffff) : static_cast<Mask>((1u << count) - 1u); }
+    };
+}
+
+#include "CPUIntersectKernels.inl"
+
+const FIntersectKernels& GetIntersectKernelsAVX512()
+{
+    static const FIntersectKernels s_Kernels = MakeIntersectKernels<FSimdAVX512>("AVX-512");
+    return s_Kernels;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+
+// This header is included by the translation units that are compiled for a specific instruction set,
+// it must only contain plain data so that no inline code is compiled with instructions that the CPU
+// might not support.
+
+// The SoA arrays are padded to this so that every kernel can always load a full register
+#define SIMD_MAX_WIDTH     (16)
+#define SIMD_INVALID_INDEX (0xffffffffu)
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// SoA views of the scene arrays, see FSoAScene
+
+struct FSoASpheres
+{
+    const float* pCenterX;
+    const float* pCenterY;
+    const float* pCenterZ;
+    const float* pRadius;
+    uint32_t     Count;
+};
+
+// Normal, W and Distance are precomputed the same way as HitQuad does
+struct FSoAQuads
+{
+    const float* pPositionX;
+    const float* pPositionY;
+    const float* pPositionZ;
+    const float* pEdge0X;
+    const float* pEdge0Y;
+    const float* pEdge0Z;
+    const float* pEdge1X;
+    const float* pEdge1Y;
+    const float* pEdge1Z;
+    const float* pNormalX;
+    const float* pNormalY;
+    const float* pNormalZ;
+    const float* pWX;
+    const float* pWY;
+    const float* pWZ;
+    const float* pDistance;
+    uint32_t     Count;
+};
+
+// The normal is normalized
+struct FSoAPlanes
+{
+    const float* pNormalX;
+    const float* pNormalY;
+    const float* pNormalZ;
+    const float* pDistance;
+    uint32_t     Count;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Rays
+
+struct FSimdRay
+{
+    float Origin[3];
+    float Direction[3];
+    float MinT;
+    float MaxT;
+};
+
+struct FRayPacket
+{
+    float    OriginX[SIMD_MAX_WIDTH];
+    float    OriginY[SIMD_MAX_WIDTH];
+    float    OriginZ[SIMD_MAX_WIDTH];
+    float    DirectionX[SIMD_MAX_WIDTH];
+    float    DirectionY[SIMD_MAX_WIDTH];
+    float    DirectionZ[SIMD_MAX_WIDTH];
+    float    MinT[SIMD_MAX_WIDTH];
+    float    MaxT[SIMD_MAX_WIDTH];
+    uint32_t Count;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Kernels, there is one table per instruction set
+
+struct FIntersectKernels
+{
+    const char* pName;
+    uint32_t    Width;
+
+    // Closest hit of one ray against all primitives. Returns the index of the primitive that is closer than inoutT, or
+    // SIMD_INVALID_INDEX, and updates inoutT.
+    uint32_t (*pfnIntersectSpheres)(const FSimdRay& ray, const FSoASpheres& spheres, float& inoutT);
+    uint32_t (*pfnIntersectQuads)(const FSimdRay& ray, const FSoAQuads& quads, float& inoutT);
+    uint32_t (*pfnIntersectPlanes)(const FSimdRay& ray, const FSoAPlanes& planes, float& inoutT);
+
+    // Intersects all rays in the packet against a single primitive, the rays that hit it closer than pT get their T and
+    // index updated
+    void (*pfnIntersectSpherePacket)(const FRayPacket& packet, const FSoASpheres& spheres, uint32_t sphere, float* pT, uint32_t* pIndex);
+    void (*pfnIntersectQuadPacket)(const FRayPacket& packet, const FSoAQuads& quads, uint32_t quad, float* pT, uint32_t* pIndex);
+    void (*pfnIntersectPlanePacket)(const FRayPacket& packet, const FSoAPlanes& planes, uint32_t plane, float* pT, uint32_t* pIndex);
+};
+
+// Defined in CPUIntersect.cpp, CPUIntersectAVX2.cpp and CPUIntersectAVX512.cpp
+const FIntersectKernels& GetIntersectKernelsScalar();
+const FIntersectKernels& GetIntersectKernelsAVX2();
+const FIntersectKernels& GetIntersectKernelsAVX512();
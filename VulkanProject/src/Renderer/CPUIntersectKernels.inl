@@ -0,0 +1,315 @@
+// Kernels shared by all instruction sets. Each kernel translation unit defines a TSimd wrapper with
+// the Float and Mask types, the number of lanes and the operations used below and then includes
+// this file, that way the math is written once and matches HitSphere, HitQuad and HitPlane.
+#include "CPUIntersectKernels.h"
+
+// Same as SIGMA in scene.glsl
+#define SIMD_SIGMA (0.0001f)
+
+namespace
+{
+    /*///////////////////////////////////////////////////////////////////////////////////////////////*/
+    // Lanes, either one ray broadcasted against a primitive per lane or one ray per lane against a
+    // broadcasted primitive
+
+    template<typename TSimd>
+    struct TRayLanes
+    {
+        typename TSimd::Float OriginX;
+        typename TSimd::Float OriginY;
+        typename TSimd::Float OriginZ;
+        typename TSimd::Float DirectionX;
+        typename TSimd::Float DirectionY;
+        typename TSimd::Float DirectionZ;
+        typename TSimd::Float MinT;
+        typename TSimd::Float MaxT;
+    };
+
+    template<typename TSimd>
+    typename TSimd::Float Dot3(typename TSimd::Float aX, typename TSimd::Float aY, typename TSimd::Float aZ, typename TSimd::Float bX, typename TSimd::Float bY, typename TSimd::Float bZ)
+    {
+        return TSimd::Add(TSimd::Add(TSimd::Mul(aX, bX), TSimd::Mul(aY, bY)), TSimd::Mul(aZ, bZ));
+    }
+
+    template<typename TSimd>
+    TRayLanes<TSimd> BroadcastRay(const FSimdRay& ray)
+    {
+        TRayLanes<TSimd> lanes;
+        lanes.OriginX    = TSimd::Set1(ray.Origin[0]);
+        lanes.OriginY    = TSimd::Set1(ray.Origin[1]);
+        lanes.OriginZ    = TSimd::Set1(ray.Origin[2]);
+        lanes.DirectionX = TSimd::Set1(ray.Direction[0]);
+        lanes.DirectionY = TSimd::Set1(ray.Direction[1]);
+        lanes.DirectionZ = TSimd::Set1(ray.Direction[2]);
+        lanes.MinT       = TSimd::Set1(ray.MinT);
+        lanes.MaxT       = TSimd::Set1(ray.MaxT);
+        return lanes;
+    }
+
+    template<typename TSimd>
+    TRayLanes<TSimd> LoadRays(const FRayPacket& packet, uint32_t first)
+    {
+        TRayLanes<TSimd> lanes;
+        lanes.OriginX    = TSimd::Load(packet.OriginX + first);
+        lanes.OriginY    = TSimd::Load(packet.OriginY + first);
+        lanes.OriginZ    = TSimd::Load(packet.OriginZ + first);
+        lanes.DirectionX = TSimd::Load(packet.DirectionX + first);
+        lanes.DirectionY = TSimd::Load(packet.DirectionY + first);
+        lanes.DirectionZ = TSimd::Load(packet.DirectionZ + first);
+        lanes.MinT       = TSimd::Load(packet.MinT + first);
+        lanes.MaxT       = TSimd::Load(packet.MaxT + first);
+        return lanes;
+    }
+
+    // Loads one primitive per lane starting at first, or broadcasts the primitive at first to all lanes
+    template<typename TSimd>
+    typename TSimd::Float LoadOrBroadcast(const float* pValues, uint32_t first, bool bBroadcast)
+    {
+        return bBroadcast ? TSimd::Set1(pValues[first]) : TSimd::Load(pValues + first);
+    }
+
+    /*///////////////////////////////////////////////////////////////////////////////////////////////*/
+    // Intersection, returns the lanes that hit closer than closestT
+
+    template<typename TSimd>
+    typename TSimd::Mask HitSpheres(const TRayLanes<TSimd>& ray, const FSoASpheres& spheres, uint32_t first, bool bBroadcast, typename TSimd::Float closestT, typename TSimd::Float& outT)
+    {
+        using Float = typename TSimd::Float;
+        using Mask  = typename TSimd::Mask;
+
+        const Float radius = LoadOrBroadcast<TSimd>(spheres.pRadius, first, bBroadcast);
+        const Float ocX    = TSimd::Sub(ray.OriginX, LoadOrBroadcast<TSimd>(spheres.pCenterX, first, bBroadcast));
+        const Float ocY    = TSimd::Sub(ray.OriginY, LoadOrBroadcast<TSimd>(spheres.pCenterY, first, bBroadcast));
+        const Float ocZ    = TSimd::Sub(ray.OriginZ, LoadOrBroadcast<TSimd>(spheres.pCenterZ, first, bBroadcast));
+
+        const Float a = Dot3<TSimd>(ray.DirectionX, ray.DirectionY, ray.DirectionZ, ray.DirectionX, ray.DirectionY, ray.DirectionZ);
+        const Float b = Dot3<TSimd>(ray.DirectionX, ray.DirectionY, ray.DirectionZ, ocX, ocY, ocZ);
+        const Float c = TSimd::Sub(Dot3<TSimd>(ocX, ocY, ocZ, ocX, ocY, ocZ), TSimd::Mul(radius, radius));
+
+        const Float discriminant = TSimd::Sub(TSimd::Mul(b, b), TSimd::Mul(a, c));
+        const Float root         = TSimd::Sqrt(TSimd::Max(discriminant, TSimd::Set1(0.0f)));
+        const Float minusB       = TSimd::Sub(TSimd::Set1(0.0f), b);
+
+        // Use the far root when the near one is outside of the range
+        const Float t0      = TSimd::Div(TSimd::Sub(minusB, root), a);
+        const Float t1      = TSimd::Div(TSimd::Add(minusB, root), a);
+        const Mask  bValid0 = TSimd::And(TSimd::CmpGt(t0, ray.MinT), TSimd::CmpLt(t0, ray.MaxT));
+        const Mask  bValid1 = TSimd::And(TSimd::CmpGt(t1, ray.MinT), TSimd::CmpLt(t1, ray.MaxT));
+
+        outT = TSimd::Select(bValid0, t0, t1);
+
+        Mask bHit = TSimd::CmpGe(discriminant, TSimd::Set1(0.0f));
+        bHit = TSimd::And(bHit, TSimd::Or(bValid0, bValid1));
+        bHit = TSimd::And(bHit, TSimd::CmpLt(outT, closestT));
+        return bHit;
+    }
+
+    template<typename TSimd>
+    typename TSimd::Mask HitQuads(const TRayLanes<TSimd>& ray, const FSoAQuads& quads, uint32_t first, bool bBroadcast, typename TSimd::Float closestT, typename TSimd::Float& outT)
+    {
+        using Float = typename TSimd::Float;
+        using Mask  = typename TSimd::Mask;
+
+        const Float normalX = LoadOrBroadcast<TSimd>(quads.pNormalX, first, bBroadcast);
+        const Float normalY = LoadOrBroadcast<TSimd>(quads.pNormalY, first, bBroadcast);
+        const Float normalZ = LoadOrBroadcast<TSimd>(quads.pNormalZ, first, bBroadcast);
+        const Float d       = LoadOrBroadcast<TSimd>(quads.pDistance, first, bBroadcast);
+
+        const Float dDotN = Dot3<TSimd>(ray.DirectionX, ray.DirectionY, ray.DirectionZ, normalX, normalY, normalZ);
+        const Float oDotN = Dot3<TSimd>(ray.OriginX, ray.OriginY, ray.OriginZ, normalX, normalY, normalZ);
+        outT = TSimd::Div(TSimd::Sub(d, oDotN), dDotN);
+
+        Mask bHit = TSimd::CmpGe(TSimd::Abs(dDotN), TSimd::Set1(SIMD_SIGMA));
+        bHit = TSimd::And(bHit, TSimd::And(TSimd::CmpGt(outT, ray.MinT), TSimd::CmpLt(outT, ray.MaxT)));
+        bHit = TSimd::And(bHit, TSimd::CmpLt(outT, closestT));
+        if (!TSimd::Any(bHit))
+        {
+            return bHit;
+        }
+
+        // Position on the plane relative to the corner
+        const Float pX = TSimd::Sub(TSimd::Add(ray.OriginX, TSimd::Mul(ray.DirectionX, outT)), LoadOrBroadcast<TSimd>(quads.pPositionX, first, bBroadcast));
+        const Float pY = TSimd::Sub(TSimd::Add(ray.OriginY, TSimd::Mul(ray.DirectionY, outT)), LoadOrBroadcast<TSimd>(quads.pPositionY, first, bBroadcast));
+        const Float pZ = TSimd::Sub(TSimd::Add(ray.OriginZ, TSimd::Mul(ray.DirectionZ, outT)), LoadOrBroadcast<TSimd>(quads.pPositionZ, first, bBroadcast));
+
+        const Float uX = LoadOrBroadcast<TSimd>(quads.pEdge0X, first, bBroadcast);
+        const Float uY = LoadOrBroadcast<TSimd>(quads.pEdge0Y, first, bBroadcast);
+        const Float uZ = LoadOrBroadcast<TSimd>(quads.pEdge0Z, first, bBroadcast);
+        const Float vX = LoadOrBroadcast<TSimd>(quads.pEdge1X, first, bBroadcast);
+        const Float vY = LoadOrBroadcast<TSimd>(quads.pEdge1Y, first, bBroadcast);
+        const Float vZ = LoadOrBroadcast<TSimd>(quads.pEdge1Z, first, bBroadcast);
+        const Float wX = LoadOrBroadcast<TSimd>(quads.pWX, first, bBroadcast);
+        const Float wY = LoadOrBroadcast<TSimd>(quads.pWY, first, bBroadcast);
+        const Float wZ = LoadOrBroadcast<TSimd>(quads.pWZ, first, bBroadcast);
+
+        // alpha = dot(w, cross(p, v)) and beta = dot(w, cross(u, p))
+        const Float alpha = Dot3<TSimd>(wX, wY, wZ,
+            TSimd::Sub(TSimd::Mul(pY, vZ), TSimd::Mul(pZ, vY)),
+            TSimd::Sub(TSimd::Mul(pZ, vX), TSimd::Mul(pX, vZ)),
+            TSimd::Sub(TSimd::Mul(pX, vY), TSimd::Mul(pY, vX)));
+        const Float beta = Dot3<TSimd>(wX, wY, wZ,
+            TSimd::Sub(TSimd::Mul(uY, pZ), TSimd::Mul(uZ, pY)),
+            TSimd::Sub(TSimd::Mul(uZ, pX), TSimd::Mul(uX, pZ)),
+            TSimd::Sub(TSimd::Mul(uX, pY), TSimd::Mul(uY, pX)));
+
+        const Float zero = TSimd::Set1(0.0f);
+        const Float one  = TSimd::Set1(1.0f);
+        bHit = TSimd::And(bHit, TSimd::And(TSimd::CmpGe(alpha, zero), TSimd::CmpLe(alpha, one)));
+        bHit = TSimd::And(bHit, TSimd::And(TSimd::CmpGe(beta, zero), TSimd::CmpLe(beta, one)));
+        return bHit;
+    }
+
+    template<typename TSimd>
+    typename TSimd::Mask HitPlanes(const TRayLanes<TSimd>& ray, const FSoAPlanes& planes, uint32_t first, bool bBroadcast, typename TSimd::Float closestT, typename TSimd::Float& outT)
+    {
+        using Float = typename TSimd::Float;
+        using Mask  = typename TSimd::Mask;
+
+        const Float normalX  = LoadOrBroadcast<TSimd>(planes.pNormalX, first, bBroadcast);
+        const Float normalY  = LoadOrBroadcast<TSimd>(planes.pNormalY, first, bBroadcast);
+        const Float normalZ  = LoadOrBroadcast<TSimd>(planes.pNormalZ, first, bBroadcast);
+        const Float distance = LoadOrBroadcast<TSimd>(planes.pDistance, first, bBroadcast);
+
+        // t = dot(center - origin, normal) / dot(direction, normal)
+        const Float dDotN    = Dot3<TSimd>(ray.DirectionX, ray.DirectionY, ray.DirectionZ, normalX, normalY, normalZ);
+        const Float toPlaneX = TSimd::Sub(TSimd::Mul(normalX, distance), ray.OriginX);
+        const Float toPlaneY = TSimd::Sub(TSimd::Mul(normalY, distance), ray.OriginY);
+        const Float toPlaneZ = TSimd::Sub(TSimd::Mul(normalZ, distance), ray.OriginZ);
+        outT = TSimd::Div(Dot3<TSimd>(toPlaneX, toPlaneY, toPlaneZ, normalX, normalY, normalZ), dDotN);
+
+        // Planes are not limited by MinT, same as HitPlane
+        Mask bHit = TSimd::CmpGe(TSimd::Abs(dDotN), TSimd::Set1(SIMD_SIGMA));
+        bHit = TSimd::And(bHit, TSimd::CmpGt(outT, TSimd::Set1(0.0f)));
+        bHit = TSimd::And(bHit, TSimd::CmpLt(outT, closestT));
+        return bHit;
+    }
+
+    /*///////////////////////////////////////////////////////////////////////////////////////////////*/
+    // One ray against all primitives, each lane keeps its own closest hit and they are reduced at the end
+
+    template<typename TSimd, typename TPrimitives, typename THit>
+    uint32_t IntersectAll(const FSimdRay& ray, const TPrimitives& primitives, float& inoutT, THit hit)
+    {
+        using Float = typename TSimd::Float;
+        using Mask  = typename TSimd::Mask;
+
+        const TRayLanes<TSimd> lanes = BroadcastRay<TSimd>(ray);
+
+        Float closestT     = TSimd::Set1(inoutT);
+        Float closestIndex = TSimd::Set1(-1.0f);
+        for (uint32_t first = 0; first < primitives.Count; first += TSimd::Width)
+        {
+            Float t;
+            Mask  bHit = hit(lanes, primitives, first, false, closestT, t);
+            bHit = TSimd::And(bHit, TSimd::FirstLanes(primitives.Count - first));
+
+            // The indices are stored as floats, they are exact up to 2^24 primitives
+            closestT     = TSimd::Select(bHit, t, closestT);
+            closestIndex = TSimd::Select(bHit, TSimd::Add(TSimd::Set1(float(first)), TSimd::Iota()), closestIndex);
+        }
+
+        float laneT[TSimd::Width];
+        float laneIndex[TSimd::Width];
+        TSimd::Store(laneT, closestT);
+        TSimd::Store(laneIndex, closestIndex);
+
+        uint32_t result = SIMD_INVALID_INDEX;
+        for (uint32_t lane = 0; lane < TSimd::Width; lane++)
+        {
+            if (laneIndex[lane] >= 0.0f && laneT[lane] < inoutT)
+            {
+                inoutT = laneT[lane];
+                result = uint32_t(laneIndex[lane]);
+            }
+        }
+
+        return result;
+    }
+
+    template<typename TSimd>
+    uint32_t IntersectSpheres(const FSimdRay& ray, const FSoASpheres& spheres, float& inoutT)
+    {
+        return IntersectAll<TSimd>(ray, spheres, inoutT, HitSpheres<TSimd>);
+    }
+
+    template<typename TSimd>
+    uint32_t IntersectQuads(const FSimdRay& ray, const FSoAQuads& quads, float& inoutT)
+    {
+        return IntersectAll<TSimd>(ray, quads, inoutT, HitQuads<TSimd>);
+    }
+
+    template<typename TSimd>
+    uint32_t IntersectPlanes(const FSimdRay& ray, const FSoAPlanes& planes, float& inoutT)
+    {
+        return IntersectAll<TSimd>(ray, planes, inoutT, HitPlanes<TSimd>);
+    }
+
+    /*///////////////////////////////////////////////////////////////////////////////////////////////*/
+    // A packet of rays against one primitive, pT and pIndex must have room for SIMD_MAX_WIDTH rays
+
+    template<typename TSimd, typename TPrimitives, typename THit>
+    void IntersectPacket(const FRayPacket& packet, const TPrimitives& primitives, uint32_t primitive, float* pT, uint32_t* pIndex, THit hit)
+    {
+        using Float = typename TSimd::Float;
+        using Mask  = typename TSimd::Mask;
+
+        for (uint32_t first = 0; first < packet.Count; first += TSimd::Width)
+        {
+            const TRayLanes<TSimd> lanes = LoadRays<TSimd>(packet, first);
+
+            const Float closestT = TSimd::Load(pT + first);
+
+            Float t;
+            Mask  bHit = hit(lanes, primitives, primitive, true, closestT, t);
+            bHit = TSimd::And(bHit, TSimd::FirstLanes(packet.Count - first));
+
+            TSimd::Store(pT + first, TSimd::Select(bHit, t, closestT));
+
+            uint32_t hitBits = TSimd::MaskBits(bHit);
+            while (hitBits != 0)
+            {
+                uint32_t lane = 0;
+                while ((hitBits & (1u << lane)) == 0)
+                {
+                    lane++;
+                }
+
+                pIndex[first + lane] = primitive;
+                hitBits &= ~(1u << lane);
+            }
+        }
+    }
+
+    template<typename TSimd>
+    void IntersectSpherePacket(const FRayPacket& packet, const FSoASpheres& spheres, uint32_t sphere, float* pT, uint32_t* pIndex)
+    {
+        IntersectPacket<TSimd>(packet, spheres, sphere, pT, pIndex, HitSpheres<TSimd>);
+    }
+
+    template<typename TSimd>
+    void IntersectQuadPacket(const FRayPacket& packet, const FSoAQuads& quads, uint32_t quad, float* pT, uint32_t* pIndex)
+    {
+        IntersectPacket<TSimd>(packet, quads, quad, pT, pIndex, HitQuads<TSimd>);
+    }
+
+    template<typename TSimd>
+    void IntersectPlanePacket(const FRayPacket& packet, const FSoAPlanes& planes, uint32_t plane, float* pT, uint32_t* pIndex)
+    {
+        IntersectPacket<TSimd>(packet, planes, plane, pT, pIndex, HitPlanes<TSimd>);
+    }
+
+    template<typename TSimd>
+    FIntersectKernels MakeIntersectKernels(const char* pName)
+    {
+        FIntersectKernels kernels;
+        kernels.pName                    = pName;
+        kernels.Width                    = TSimd::Width;
+        kernels.pfnIntersectSpheres      = IntersectSpheres<TSimd>;
+        kernels.pfnIntersectQuads        = IntersectQuads<TSimd>;
+        kernels.pfnIntersectPlanes       = IntersectPlanes<TSimd>;
+        kernels.pfnIntersectSpherePacket = IntersectSpherePacket<TSimd>;
+        kernels.pfnIntersectQuadPacket   = IntersectQuadPacket<TSimd>;
+        kernels.pfnIntersectPlanePacket  = IntersectPlanePacket<TSimd>;
+        return kernels;
+    }
+}
@@ -0,0 +1,1054 @@
+#include "CPURayTracer.h"
+#include "ImageWriter.h"
+#include "MathHelper.h"
+#include <glm/gtc/type_ptr.hpp>
+
+// Same as in scene.glsl and raytracer.glsl
+#define NUM_THREADS       (16)
+#define MAX_DEPTH         (1024)
+#define SIGMA             (0.0001f)
+#define BVH_MISS          (1e30f)
+#define PRIMITIVE_INVALID (0xffffffffu)
+
+// Size of the tiles that the workers pick up
+#define CPU_TILE_SIZE (16)
+
+// Scenes without meshes and at most this many spheres and quads are tested without the BVH, a few
+// SIMD loops over all the primitives are faster than traversing the nodes one ray at a time
+#define CPU_FLAT_SCENE_MAX_PRIMITIVES (64)
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Sampling, these match random.glsl and halton.glsl so that both tracers use the same sequences
+
+static uint32_t InitRandom(const glm::uvec2& pixel, uint32_t width, uint32_t frameIndex)
+{
+    constexpr uint32_t BackOff = 16;
+
+    uint32_t v0 = pixel.x + pixel.y * width;
+    uint32_t v1 = frameIndex;
+    uint32_t s0 = 0;
+    for (uint32_t n = 0; n < BackOff; n++)
+    {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+    }
+
+    return v0;
+}
+
+static float NextRandom(uint32_t& seed)
+{
+    seed = (1664525u * seed + 1013904223u);
+    return float(seed & 0x00FFFFFF) / float(0x01000000);
+}
+
+static glm::vec3 NextRandomUnitSphereVec3(uint32_t& seed)
+{
+    glm::vec3 result;
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        result.x = (NextRandom(seed) * 2.0f) - 1.0f;
+        result.y = (NextRandom(seed) * 2.0f) - 1.0f;
+        result.z = (NextRandom(seed) * 2.0f) - 1.0f;
+        if (glm::dot(result, result) < 1.0f)
+        {
+            break;
+        }
+    }
+
+    return glm::normalize(result);
+}
+
+static glm::vec3 NextRandomHemisphere(uint32_t& seed, const glm::vec3& normal)
+{
+    const glm::vec3 unitVector = NextRandomUnitSphereVec3(seed);
+    return (glm::dot(unitVector, normal) <= 0.0f) ? -unitVector : unitVector;
+}
+
+static float RadicalInverse2(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+static float RadicalInverse3(uint32_t a)
+{
+    constexpr float    OneMinusEpsilon = 0.99999994f;
+    constexpr uint32_t Base            = 3;
+    constexpr float    InvBase         = 1.0f / float(Base);
+
+    uint32_t reversedDigits = 0;
+    float    invBaseN       = 1.0f;
+    while (a != 0)
+    {
+        const uint32_t next  = a / Base;
+        const uint32_t digit = a - next * Base;
+        reversedDigits = reversedDigits * Base + digit;
+        invBaseN *= InvBase;
+        a = next;
+    }
+
+    return std::min(float(reversedDigits) * invBaseN, OneMinusEpsilon);
+}
+
+static glm::vec2 Halton23(uint32_t i)
+{
+    return glm::vec2(RadicalInverse2(i), RadicalInverse3(i));
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Math, these match math.glsl
+
+static glm::vec3 RealRefract(const glm::vec3& uv, const glm::vec3& n, float etaiOverEtat)
+{
+    const float     cosTheta     = std::min(glm::dot(-uv, n), 1.0f);
+    const glm::vec3 rOutPerp     = etaiOverEtat * (uv + cosTheta * n);
+    const glm::vec3 rOutParallel = -std::sqrt(std::abs(1.0f - glm::dot(rOutPerp, rOutPerp))) * n;
+    return rOutPerp + rOutParallel;
+}
+
+static float Reflectance(float cosine, float refractionIndex)
+{
+    // Use Schlick's approximation for reflectance.
+    float r0 = (1.0f - refractionIndex) / (1.0f + refractionIndex);
+    r0 = r0 * r0;
+    return r0 + (1.0f - r0) * std::pow((1.0f - cosine), 5.0f);
+}
+
+static float PowerHeuristic(float pdfA, float pdfB)
+{
+    const float a2 = pdfA * pdfA;
+    const float b2 = pdfB * pdfB;
+    return a2 / std::max(a2 + b2, 1e-12f);
+}
+
+static bool IsLight(uint32_t primitive)
+{
+    const uint32_t type = primitive >> PRIMITIVE_INDEX_BITS;
+    return primitive != PRIMITIVE_INVALID && (type == PRIMITIVE_TYPE_QUAD || type == PRIMITIVE_TYPE_SPHERE);
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Intersection, these match scene.glsl. The Set*Hit functions fill in the payload for a hit that was
+// found either here or by the SIMD kernels.
+
+static void SetQuadHit(const FQuad& quad, const FCPURay& ray, float t, FCPURayPayLoad& payLoad)
+{
+    const glm::vec3 normal = glm::normalize(glm::cross(glm::vec3(quad.Edge0), glm::vec3(quad.Edge1)));
+    const float     dDotN  = glm::dot(ray.Direction, normal);
+
+    payLoad.T             = t;
+    payLoad.MaterialIndex = quad.MaterialIndex;
+    payLoad.FrontFace     = true;
+    payLoad.Position      = ray.Origin + ray.Direction * payLoad.T;
+    payLoad.Normal        = (dDotN >= 0.0f) ? -normal : normal;
+}
+
+static void SetSphereHit(const FSphere& sphere, const FCPURay& ray, float t, FCPURayPayLoad& payLoad)
+{
+    payLoad.T             = t;
+    payLoad.MaterialIndex = sphere.MaterialIndex;
+    payLoad.Position      = ray.Origin + ray.Direction * payLoad.T;
+
+    const glm::vec3 outsideNormal = glm::normalize((payLoad.Position - sphere.Position) / sphere.Radius);
+    payLoad.FrontFace = glm::dot(ray.Direction, outsideNormal) < 0.0f;
+    payLoad.Normal    = payLoad.FrontFace ? outsideNormal : -outsideNormal;
+}
+
+static void SetPlaneHit(const FPlane& plane, const FCPURay& ray, float t, FCPURayPayLoad& payLoad)
+{
+    const glm::vec3 planeNormal = glm::normalize(plane.Normal);
+    const float     dDotN       = glm::dot(ray.Direction, planeNormal);
+
+    payLoad.T             = t;
+    payLoad.MaterialIndex = plane.MaterialIndex;
+    payLoad.FrontFace     = true;
+    payLoad.Position      = ray.Origin + ray.Direction * payLoad.T;
+    payLoad.Normal        = (dDotN >= 0.0f) ? -planeNormal : planeNormal;
+}
+
+static void HitQuad(const FQuad& quad, const FCPURay& ray, FCPURayPayLoad& payLoad)
+{
+    const glm::vec3 q = glm::vec3(quad.Position);
+    const glm::vec3 u = glm::vec3(quad.Edge0);
+    const glm::vec3 v = glm::vec3(quad.Edge1);
+    const glm::vec3 n = glm::cross(u, v);
+    const glm::vec3 w = n / glm::dot(n, n);
+
+    const glm::vec3 normal = glm::normalize(n);
+    const float     d      = glm::dot(normal, q);
+
+    const float dDotN = glm::dot(ray.Direction, normal);
+    if (std::abs(dDotN) < SIGMA)
+    {
+        return;
+    }
+
+    const float t = (d - glm::dot(normal, ray.Origin)) / dDotN;
+    if (payLoad.MinT < t && t < payLoad.MaxT && t < payLoad.T)
+    {
+        const glm::vec3 intersection = ray.Origin + (ray.Direction * t);
+        const glm::vec3 planarHit    = intersection - q;
+        const float     alpha        = glm::dot(w, glm::cross(planarHit, v));
+        const float     beta         = glm::dot(w, glm::cross(u, planarHit));
+        if (alpha < 0.0f || 1.0f < alpha || beta < 0.0f || 1.0f < beta)
+        {
+            return;
+        }
+
+        SetQuadHit(quad, ray, t, payLoad);
+    }
+}
+
+static void HitSphere(const FSphere& sphere, const FCPURay& ray, FCPURayPayLoad& payLoad)
+{
+    const glm::vec3 oc = ray.Origin - sphere.Position;
+    const float     a  = glm::dot(ray.Direction, ray.Direction);
+    const float     b  = glm::dot(ray.Direction, oc);
+    const float     c  = glm::dot(oc, oc) - (sphere.Radius * sphere.Radius);
+
+    const float discriminant = (b * b) - (a * c);
+    if (discriminant < 0.0f)
+    {
+        return;
+    }
+
+    float t = (-b - std::sqrt(discriminant)) / a;
+    if (t <= payLoad.MinT || t >= payLoad.MaxT)
+    {
+        t = (-b + std::sqrt(discriminant)) / a;
+        if (t <= payLoad.MinT || t >= payLoad.MaxT)
+        {
+            return;
+        }
+    }
+
+    if (t <= payLoad.T)
+    {
+        SetSphereHit(sphere, ray, t, payLoad);
+    }
+}
+
+static void HitTriangle(const glm::vec3* pVertices, uint32_t materialIndex, const FCPURay& ray, FCPURayPayLoad& payLoad)
+{
+    // Moller-Trumbore
+    const glm::vec3 edge0 = pVertices[1] - pVertices[0];
+    const glm::vec3 edge1 = pVertices[2] - pVertices[0];
+    const glm::vec3 p     = glm::cross(ray.Direction, edge1);
+    const float     det   = glm::dot(edge0, p);
+    if (std::abs(det) < 1e-9f)
+    {
+        return;
+    }
+
+    const float     invDet = 1.0f / det;
+    const glm::vec3 t      = ray.Origin - pVertices[0];
+    const float     u      = glm::dot(t, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return;
+    }
+
+    const glm::vec3 q = glm::cross(t, edge0);
+    const float     v = glm::dot(ray.Direction, q) * invDet;
+    if (v < 0.0f || (u + v) > 1.0f)
+    {
+        return;
+    }
+
+    const float hitT = glm::dot(edge1, q) * invDet;
+    if (payLoad.MinT < hitT && hitT < payLoad.T)
+    {
+        payLoad.T             = hitT;
+        payLoad.MaterialIndex = materialIndex;
+        payLoad.Position      = ray.Origin + ray.Direction * payLoad.T;
+
+        const glm::vec3 normal = glm::normalize(glm::cross(edge0, edge1));
+        payLoad.FrontFace = glm::dot(ray.Direction, normal) < 0.0f;
+        payLoad.Normal    = payLoad.FrontFace ? normal : -normal;
+    }
+}
+
+// Returns the distance to the box or BVH_MISS
+static float HitAABB(const FBVHNode& node, const FCPURay& ray, const glm::vec3& invDirection, float minT, float maxT)
+{
+    const glm::vec3 t0 = (node.Min - ray.Origin) * invDirection;
+    const glm::vec3 t1 = (node.Max - ray.Origin) * invDirection;
+
+    const glm::vec3 tMin = glm::min(t0, t1);
+    const glm::vec3 tMax = glm::max(t0, t1);
+
+    const float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, minT));
+    const float tFar  = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxT));
+    return (tNear <= tFar) ? tNear : BVH_MISS;
+}
+
+// Shared traversal for the scene and the mesh BVHs, visits the closest child first
+template<typename THitLeaf>
+static void TraverseNodes(const FBVHNode* pNodes, const FCPURay& ray, const glm::vec3& invDirection, FCPURayPayLoad& payLoad, THitLeaf hitLeaf)
+{
+    uint32_t stack[BVH_MAX_STACK_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true)
+    {
+        const FBVHNode& node = pNodes[nodeIndex];
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = 0; i < node.NumPrimitives; i++)
+            {
+                hitLeaf(node.LeftOrFirst + i);
+            }
+
+            if (stackSize == 0)
+            {
+                break;
+            }
+
+            nodeIndex = stack[--stackSize];
+            continue;
+        }
+
+        uint32_t nearChild = node.LeftOrFirst;
+        uint32_t farChild  = node.LeftOrFirst + 1;
+        float    nearDist  = HitAABB(pNodes[nearChild], ray, invDirection, payLoad.MinT, payLoad.T);
+        float    farDist   = HitAABB(pNodes[farChild],  ray, invDirection, payLoad.MinT, payLoad.T);
+        if (nearDist > farDist)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(nearDist, farDist);
+        }
+
+        if (nearDist == BVH_MISS)
+        {
+            if (stackSize == 0)
+            {
+                break;
+            }
+
+            nodeIndex = stack[--stackSize];
+        }
+        else
+        {
+            nodeIndex = nearChild;
+            if (farDist != BVH_MISS)
+            {
+                // FBVH::Build makes sure that the tree is not deeper than the stack
+                assert(stackSize < BVH_MAX_STACK_DEPTH);
+                stack[stackSize++] = farChild;
+            }
+        }
+    }
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// WorkStealingQueue
+
+void FWorkStealingQueue::Push(uint32_t item)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Items.push_back(item);
+}
+
+bool FWorkStealingQueue::Pop(uint32_t& outItem)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Items.empty())
+    {
+        return false;
+    }
+
+    outItem = m_Items.back();
+    m_Items.pop_back();
+    return true;
+}
+
+bool FWorkStealingQueue::Steal(uint32_t& outItem)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Items.empty())
+    {
+        return false;
+    }
+
+    outItem = m_Items.front();
+    m_Items.pop_front();
+    return true;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// CPURayTracer
+
+FCPURayTracer::FCPURayTracer(uint32_t numThreads)
+    : m_pScene(nullptr)
+    , m_BVH()
+    , m_BVHPrimitives()
+    , m_Meshes()
+    , m_Lights()
+    , m_pKernels(&GetIntersectKernelsScalar())
+    , m_SoAScene()
+    , m_bFlatScene(false)
+    , m_MinBounces(3)
+    , m_MaxBounces(32)
+    , m_Accumulation()
+    , m_Width(0)
+    , m_Height(0)
+    , m_NumTilesX(0)
+    , m_NumTilesY(0)
+    , m_NumSamples(0)
+    , m_MaxSamples(0)
+    , m_NumRequestedThreads(numThreads)
+    , m_Threads()
+    , m_Queues()
+    , m_Mutex()
+    , m_StartCondition()
+    , m_DoneCondition()
+    , m_Generation(0)
+    , m_NumActiveWorkers(0)
+    , m_bExit(false)
+{
+}
+
+FCPURayTracer::~FCPURayTracer()
+{
+    SAFE_DELETE(m_pScene);
+}
+
+void FCPURayTracer::Init(FDevice*, FSwapchain*)
+{
+    // Same scene as FRayTracer starts with
+    m_pScene = new FSphereScene();
+    m_pScene->Initialize();
+
+    BuildScene();
+
+    m_pKernels = &CPUIntersect::GetKernels(CPUIntersect::GetBestISA());
+    std::cout << "[FCPURayTracer]: Using " << m_pKernels->pName << " intersection kernels" << std::endl;
+
+    // Start the workers, one per core unless something else was requested
+    uint32_t numThreads = m_NumRequestedThreads;
+    if (numThreads == 0)
+    {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    m_Queues = std::vector<FWorkStealingQueue>(numThreads);
+    for (uint32_t i = 0; i < numThreads; i++)
+    {
+        m_Threads.emplace_back(&FCPURayTracer::WorkerThread, this, i);
+    }
+
+    std::cout << "[FCPURayTracer]: Started " << numThreads << " worker threads" << std::endl;
+}
+
+void FCPURayTracer::Release()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_bExit = true;
+    }
+
+    m_StartCondition.notify_all();
+
+    for (std::thread& thread : m_Threads)
+    {
+        thread.join();
+    }
+
+    m_Threads.clear();
+    m_Queues.clear();
+}
+
+void FCPURayTracer::OnWindowResize(uint32_t width, uint32_t height)
+{
+    if ((width == m_Width && height == m_Height) || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    m_Width     = width;
+    m_Height    = height;
+    m_NumTilesX = Math::AlignUp(width,  CPU_TILE_SIZE) / CPU_TILE_SIZE;
+    m_NumTilesY = Math::AlignUp(height, CPU_TILE_SIZE) / CPU_TILE_SIZE;
+
+    m_Accumulation.assign(size_t(width) * size_t(height), glm::vec4(0.0f));
+    m_NumSamples = 0;
+}
+
+void FCPURayTracer::Tick(float)
+{
+    if (m_Accumulation.empty() || (m_MaxSamples > 0 && m_NumSamples >= m_MaxSamples))
+    {
+        return;
+    }
+
+    // The emissive materials can change
+    m_pScene->GetLights(m_Lights);
+
+    // Spread the tiles over the workers, the ones that finish first steal the rest
+    const uint32_t numTiles   = m_NumTilesX * m_NumTilesY;
+    const uint32_t numWorkers = static_cast<uint32_t>(m_Queues.size());
+    for (uint32_t tile = 0; tile < numTiles; tile++)
+    {
+        m_Queues[tile % numWorkers].Push(tile);
+    }
+
+    // Wake up the workers and wait for them to finish
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NumActiveWorkers = numWorkers;
+    m_Generation++;
+    m_StartCondition.notify_all();
+
+    m_DoneCondition.wait(lock, [this]()
+    {
+        return m_NumActiveWorkers == 0;
+    });
+
+    m_NumSamples++;
+}
+
+bool FCPURayTracer::SaveImage(const char* pFilePath)
+{
+    if (m_NumSamples == 0)
+    {
+        std::cout << "[FCPURayTracer]: No image to save" << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec4> pixels(m_Accumulation.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        const float numPixelSamples = std::max(m_Accumulation[i].a, 1.0f);
+        pixels[i] = glm::vec4(glm::vec3(m_Accumulation[i]) / numPixelSamples, 1.0f);
+    }
+
+    const bool bResult = ImageWriter::WriteImage(pFilePath, m_Width, m_Height, glm::value_ptr(pixels[0]), m_pScene->m_Settings.Exposure);
+    if (bResult)
+    {
+        std::cout << "[FCPURayTracer]: Saved image '" << pFilePath << "' (" << m_Width << "x" << m_Height << ", " << m_NumSamples << " samples)" << std::endl;
+    }
+
+    return bResult;
+}
+
+void FCPURayTracer::BuildScene()
+{
+    // Same top level BVH as FRayTracer::BuildBVH
+    std::vector<FAABB>    primitiveBounds;
+    std::vector<uint32_t> primitives;
+    m_pScene->GetPrimitiveBounds(primitiveBounds, primitives);
+
+    m_BVH.Build(primitiveBounds);
+
+    const std::vector<uint32_t>& primitiveIndices = m_BVH.GetPrimitiveIndices();
+    m_BVHPrimitives.resize(primitiveIndices.size());
+    for (size_t i = 0; i < primitiveIndices.size(); i++)
+    {
+        m_BVHPrimitives[i] = primitives[primitiveIndices[i]];
+    }
+
+    // One BVH per mesh, the triangles are stored in leaf order
+    m_Meshes.clear();
+    for (const FMesh& mesh : m_pScene->m_Meshes)
+    {
+        const uint32_t numTriangles = mesh.GetNumTriangles();
+
+        std::vector<FAABB> triangleBounds(numTriangles);
+        for (uint32_t i = 0; i < numTriangles; i++)
+        {
+            triangleBounds[i].Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 0]]));
+            triangleBounds[i].Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 1]]));
+            triangleBounds[i].Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 2]]));
+        }
+
+        FBVH bvh;
+        bvh.Build(triangleBounds);
+
+        FCPUMesh& cpuMesh = m_Meshes.emplace_back();
+        cpuMesh.Nodes         = bvh.GetNodes();
+        cpuMesh.MaterialIndex = mesh.MaterialIndex;
+        cpuMesh.Triangles.reserve(size_t(numTriangles) * 3);
+        for (uint32_t triangle : bvh.GetPrimitiveIndices())
+        {
+            cpuMesh.Triangles.push_back(glm::vec3(mesh.Vertices[mesh.Indices[(3 * triangle) + 0]]));
+            cpuMesh.Triangles.push_back(glm::vec3(mesh.Vertices[mesh.Indices[(3 * triangle) + 1]]));
+            cpuMesh.Triangles.push_back(glm::vec3(mesh.Vertices[mesh.Indices[(3 * triangle) + 2]]));
+        }
+    }
+
+    // SoA copy for the SIMD kernels
+    m_SoAScene.Build(*m_pScene);
+
+    const size_t numPrimitives = m_pScene->m_Spheres.size() + m_pScene->m_Quads.size();
+    m_bFlatScene = m_pScene->m_Meshes.empty() && numPrimitives <= CPU_FLAT_SCENE_MAX_PRIMITIVES;
+
+    m_pScene->GetLights(m_Lights);
+}
+
+void FCPURayTracer::WorkerThread(uint32_t threadIndex)
+{
+    uint32_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_StartCondition.wait(lock, [this, generation]()
+            {
+                return m_bExit || m_Generation != generation;
+            });
+
+            if (m_bExit)
+            {
+                return;
+            }
+
+            generation = m_Generation;
+        }
+
+        uint32_t tile;
+        while (m_Queues[threadIndex].Pop(tile) || StealTile(threadIndex, tile))
+        {
+            RenderTile(tile);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (--m_NumActiveWorkers == 0)
+            {
+                m_DoneCondition.notify_one();
+            }
+        }
+    }
+}
+
+bool FCPURayTracer::StealTile(uint32_t threadIndex, uint32_t& outTile)
+{
+    // Start with the neighbour so that the workers do not all steal from the same queue
+    const uint32_t numQueues = static_cast<uint32_t>(m_Queues.size());
+    for (uint32_t i = 1; i < numQueues; i++)
+    {
+        if (m_Queues[(threadIndex + i) % numQueues].Steal(outTile))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FCPURayTracer::RenderTile(uint32_t tile)
+{
+    const uint32_t startX = (tile % m_NumTilesX) * CPU_TILE_SIZE;
+    const uint32_t startY = (tile / m_NumTilesX) * CPU_TILE_SIZE;
+    const uint32_t endX   = std::min(startX + CPU_TILE_SIZE, m_Width);
+    const uint32_t endY   = std::min(startY + CPU_TILE_SIZE, m_Height);
+
+    // Same film as the GPU, which is aligned to the thread group size
+    const uint32_t filmWidth = Math::AlignUp(m_Width, NUM_THREADS);
+    for (uint32_t y = startY; y < endY; y++)
+    {
+        for (uint32_t x = startX; x < endX; x++)
+        {
+            const glm::ivec2 pixel(x, y);
+
+            // Same sample index as the GPU, which is the number of samples that the pixel already has
+            uint32_t randomSeed = InitRandom(glm::uvec2(pixel), filmWidth, m_NumSamples);
+
+            const glm::vec3 sampleColor = TracePath(pixel, randomSeed);
+            m_Accumulation[size_t(y) * m_Width + x] += glm::vec4(sampleColor, 1.0f);
+        }
+    }
+}
+
+glm::vec3 FCPURayTracer::TracePath(const glm::ivec2& pixel, uint32_t& randomSeed) const
+{
+    // Same camera as GenerateCameraRay in scene.glsl
+    const glm::vec2 filmSize(Math::AlignUp(m_Width, NUM_THREADS), Math::AlignUp(m_Height, NUM_THREADS));
+
+    const glm::vec3 cameraPosition = m_pScene->m_Camera.GetPosition();
+    const glm::vec3 camForward     = glm::normalize(m_pScene->m_Camera.GetForward());
+    glm::vec3       camUp          = glm::vec3(0.0f, 1.0f, 0.0f);
+    camUp = glm::normalize(camUp - glm::dot(camUp, camForward) * camForward);
+    const glm::vec3 camRight = glm::normalize(glm::cross(camUp, camForward));
+
+    const float     aspectRatio = filmSize.x / filmSize.y;
+    const glm::vec3 filmCenter  = cameraPosition + camForward;
+
+    const glm::vec2 jitter = (Halton23(m_NumSamples) * 2.0f) - glm::vec2(1.0f);
+
+    glm::vec2 filmUV = (glm::vec2(pixel) + jitter) / filmSize;
+    filmUV.y = 1.0f - filmUV.y;
+
+    glm::vec2 filmCoord = glm::vec2(-1.0f) + (filmUV * 2.0f);
+    filmCoord.x = filmCoord.x * aspectRatio;
+
+    const glm::vec3 filmTarget = filmCenter + (camRight * filmCoord.x) + (camUp * filmCoord.y);
+
+    FCPURay ray;
+    ray.Origin    = cameraPosition;
+    ray.Direction = glm::normalize(filmTarget - cameraPosition);
+
+    // Same loop as raytracer.glsl
+    glm::vec3 throughput  = glm::vec3(1.0f);
+    glm::vec3 sampleColor = glm::vec3(0.0f);
+    float     bsdfPdf     = 0.0f;
+
+    const uint32_t maxDepth = std::min<uint32_t>(m_MaxBounces, MAX_DEPTH);
+    for (uint32_t i = 0; i < maxDepth; i++)
+    {
+        FCPURayPayLoad payLoad;
+        payLoad.MinT = 0.001f;
+        payLoad.MaxT = 1000.0f;
+        payLoad.T    = payLoad.MaxT;
+
+        if (!TraceRay(ray, payLoad))
+        {
+            sampleColor += throughput * SampleBackground(ray.Direction);
+            break;
+        }
+
+        const FMaterial& material = GetMaterial(payLoad.MaterialIndex);
+        if (material.Type == MATERIAL_EMISSIVE)
+        {
+            // Emissive materials do not scatter
+            sampleColor += throughput * glm::vec3(material.Emissive) * GetEmissiveWeight(ray, payLoad, bsdfPdf);
+            break;
+        }
+
+        // Sample the lights directly
+        sampleColor += throughput * SampleDirectLight(material, payLoad, randomSeed);
+
+        if (!ScatterRay(material, ray, payLoad, randomSeed, throughput, ray))
+        {
+            break;
+        }
+
+        // Pdf of the direction, only lambertian surfaces sample the lights
+        bsdfPdf = 0.0f;
+        if (material.Type == MATERIAL_LAMBERTIAN && !m_Lights.empty())
+        {
+            bsdfPdf = std::max(glm::dot(glm::normalize(payLoad.Normal), ray.Direction), 0.0f) / glm::pi<float>();
+        }
+
+        // Stop paths that do not contribute much
+        if (!RussianRoulette(i + 1, throughput, randomSeed))
+        {
+            break;
+        }
+    }
+
+    return sampleColor;
+}
+
+bool FCPURayTracer::TraceRay(const FCPURay& ray, FCPURayPayLoad& payLoad) const
+{
+    payLoad.Primitive = PRIMITIVE_INVALID;
+
+    FSimdRay simdRay;
+    simdRay.Origin[0]    = ray.Origin.x;
+    simdRay.Origin[1]    = ray.Origin.y;
+    simdRay.Origin[2]    = ray.Origin.z;
+    simdRay.Direction[0] = ray.Direction.x;
+    simdRay.Direction[1] = ray.Direction.y;
+    simdRay.Direction[2] = ray.Direction.z;
+    simdRay.MinT         = payLoad.MinT;
+    simdRay.MaxT         = payLoad.MaxT;
+
+    // Quads, spheres and meshes are stored in the BVH, small scenes skip it
+    if (m_bFlatScene)
+    {
+        TraceFlat(ray, simdRay, payLoad);
+    }
+    else if (!m_BVH.GetNodes().empty())
+    {
+        TraverseBVH(ray, payLoad);
+    }
+
+    // Planes are infinite and are always tested, they are never lights
+    float          t     = payLoad.T;
+    const uint32_t plane = m_pKernels->pfnIntersectPlanes(simdRay, m_SoAScene.GetPlanes(), t);
+    if (plane != SIMD_INVALID_INDEX)
+    {
+        SetPlaneHit(m_pScene->m_Planes[plane], ray, t, payLoad);
+        payLoad.Primitive = PRIMITIVE_INVALID;
+    }
+
+    return payLoad.T < payLoad.MaxT;
+}
+
+void FCPURayTracer::TraceFlat(const FCPURay& ray, const FSimdRay& simdRay, FCPURayPayLoad& payLoad) const
+{
+    // The quads are only hit when they are closer than the closest sphere
+    float          t      = payLoad.T;
+    const uint32_t sphere = m_pKernels->pfnIntersectSpheres(simdRay, m_SoAScene.GetSpheres(), t);
+    const uint32_t quad   = m_pKernels->pfnIntersectQuads(simdRay, m_SoAScene.GetQuads(), t);
+    if (quad != SIMD_INVALID_INDEX)
+    {
+        SetQuadHit(m_pScene->m_Quads[quad], ray, t, payLoad);
+        payLoad.Primitive = (PRIMITIVE_TYPE_QUAD << PRIMITIVE_INDEX_BITS) | quad;
+    }
+    else if (sphere != SIMD_INVALID_INDEX)
+    {
+        SetSphereHit(m_pScene->m_Spheres[sphere], ray, t, payLoad);
+        payLoad.Primitive = (PRIMITIVE_TYPE_SPHERE << PRIMITIVE_INDEX_BITS) | sphere;
+    }
+}
+
+void FCPURayTracer::TraverseBVH(const FCPURay& ray, FCPURayPayLoad& payLoad) const
+{
+    const glm::vec3 invDirection = 1.0f / ray.Direction;
+
+    const FBVHNode* pNodes = m_BVH.GetNodes().data();
+    if (HitAABB(pNodes[0], ray, invDirection, payLoad.MinT, payLoad.T) == BVH_MISS)
+    {
+        return;
+    }
+
+    TraverseNodes(pNodes, ray, invDirection, payLoad, [&](uint32_t index)
+    {
+        HitPrimitive(m_BVHPrimitives[index], ray, invDirection, payLoad);
+    });
+}
+
+void FCPURayTracer::TraverseMeshBVH(const FCPUMesh& mesh, const FCPURay& ray, const glm::vec3& invDirection, FCPURayPayLoad& payLoad) const
+{
+    if (mesh.Nodes.empty())
+    {
+        return;
+    }
+
+    TraverseNodes(mesh.Nodes.data(), ray, invDirection, payLoad, [&](uint32_t triangle)
+    {
+        HitTriangle(&mesh.Triangles[size_t(triangle) * 3], mesh.MaterialIndex, ray, payLoad);
+    });
+}
+
+void FCPURayTracer::HitPrimitive(uint32_t primitive, const FCPURay& ray, const glm::vec3& invDirection, FCPURayPayLoad& payLoad) const
+{
+    const uint32_t type  = primitive >> PRIMITIVE_INDEX_BITS;
+    const uint32_t index = primitive & PRIMITIVE_INDEX_MASK;
+    const float    prevT = payLoad.T;
+    if (type == PRIMITIVE_TYPE_QUAD)
+    {
+        HitQuad(m_pScene->m_Quads[index], ray, payLoad);
+    }
+    else if (type == PRIMITIVE_TYPE_SPHERE)
+    {
+        HitSphere(m_pScene->m_Spheres[index], ray, payLoad);
+    }
+    else if (type == PRIMITIVE_TYPE_MESH)
+    {
+        TraverseMeshBVH(m_Meshes[index], ray, invDirection, payLoad);
+    }
+
+    // Remember what was hit so that we can find out if it was a light
+    if (payLoad.T < prevT)
+    {
+        payLoad.Primitive = primitive;
+    }
+}
+
+bool FCPURayTracer::ScatterRay(const FMaterial& material, const FCPURay& inRay, const FCPURayPayLoad& payLoad, uint32_t& randomSeed, glm::vec3& throughput, FCPURay& outRay) const
+{
+    const glm::vec3 n = glm::normalize(payLoad.Normal);
+
+    glm::vec3 direction;
+    if (material.Type == MATERIAL_LAMBERTIAN)
+    {
+        const glm::vec3 rnd = NextRandomUnitSphereVec3(randomSeed);
+        direction = glm::normalize(payLoad.Normal + rnd);
+    }
+    else if (material.Type == MATERIAL_METAL)
+    {
+        const glm::vec3 rnd = NextRandomHemisphere(randomSeed, payLoad.Normal);
+        direction = glm::normalize(glm::reflect(inRay.Direction, n) + rnd * material.Roughness);
+    }
+    else if (material.Type == MATERIAL_DIELECTRIC)
+    {
+        const float refractionRatio = payLoad.FrontFace ? (1.0f / std::max(material.RefractionIndex, SIGMA)) : material.RefractionIndex;
+
+        const glm::vec3 rayDirection = glm::normalize(inRay.Direction);
+        const float     cosTheta     = std::min(glm::dot(-rayDirection, payLoad.Normal), 1.0f);
+        const float     sinTheta     = std::sqrt(1.0f - cosTheta * cosTheta);
+
+        const bool bShouldReflect = refractionRatio * sinTheta >= 1.0f;
+        if (bShouldReflect || Reflectance(cosTheta, refractionRatio) > NextRandom(randomSeed))
+        {
+            const glm::vec3 rnd = NextRandomHemisphere(randomSeed, payLoad.Normal);
+            direction = glm::normalize(glm::reflect(rayDirection, n) + rnd * material.Roughness);
+        }
+        else
+        {
+            direction = RealRefract(rayDirection, n, refractionRatio);
+        }
+    }
+    else
+    {
+        // Emissive or invalid material
+        outRay = inRay;
+        return false;
+    }
+
+    // Attenuate light
+    throughput = glm::min(glm::vec3(material.Albedo), glm::vec3(0.9f)) * throughput;
+
+    outRay.Origin    = payLoad.Position;
+    outRay.Direction = direction;
+    return true;
+}
+
+glm::vec3 FCPURayTracer::SampleDirectLight(const FMaterial& material, const FCPURayPayLoad& payLoad, uint32_t& randomSeed) const
+{
+    const uint32_t numLights = static_cast<uint32_t>(m_Lights.size());
+    if (material.Type != MATERIAL_LAMBERTIAN || numLights == 0)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    const uint32_t lightIndex = std::min(uint32_t(NextRandom(randomSeed) * float(numLights)), numLights - 1);
+    const FLight&  light      = m_Lights[lightIndex];
+
+    const uint32_t type  = light.Primitive >> PRIMITIVE_INDEX_BITS;
+    const uint32_t index = light.Primitive & PRIMITIVE_INDEX_MASK;
+
+    glm::vec3 lightPosition;
+    glm::vec3 lightNormal;
+    uint32_t  lightMaterialIndex;
+    if (type == PRIMITIVE_TYPE_QUAD)
+    {
+        const FQuad& quad = m_pScene->m_Quads[index];
+        const float  u    = NextRandom(randomSeed);
+        const float  v    = NextRandom(randomSeed);
+        lightPosition      = glm::vec3(quad.Position) + (glm::vec3(quad.Edge0) * u) + (glm::vec3(quad.Edge1) * v);
+        lightNormal        = glm::cross(glm::vec3(quad.Edge0), glm::vec3(quad.Edge1));
+        lightMaterialIndex = quad.MaterialIndex;
+    }
+    else
+    {
+        // Sample the half of the sphere that faces the surface
+        const FSphere&  sphere = m_pScene->m_Spheres[index];
+        const glm::vec3 dir    = NextRandomHemisphere(randomSeed, glm::normalize(payLoad.Position - sphere.Position));
+        lightPosition      = sphere.Position + (dir * std::abs(sphere.Radius));
+        lightNormal        = dir;
+        lightMaterialIndex = sphere.MaterialIndex;
+    }
+
+    const glm::vec3 n        = glm::normalize(payLoad.Normal);
+    const glm::vec3 toLight  = lightPosition - payLoad.Position;
+    const float     distance = glm::length(toLight);
+    const glm::vec3 l        = toLight / std::max(distance, SIGMA);
+
+    const float cosSurface = glm::dot(n, l);
+    if (cosSurface <= 0.0f)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    const float lightPdf = GetLightPdf(light.Area, payLoad.Position, lightPosition, lightNormal);
+    if (lightPdf <= 0.0f)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    // Stop right before the light so that it does not occlude itself
+    FCPURay shadowRay;
+    shadowRay.Origin    = payLoad.Position;
+    shadowRay.Direction = l;
+
+    FCPURayPayLoad shadowPayLoad;
+    shadowPayLoad.MinT = 0.001f;
+    shadowPayLoad.MaxT = distance * 0.999f;
+    shadowPayLoad.T    = shadowPayLoad.MaxT;
+    if (TraceRay(shadowRay, shadowPayLoad))
+    {
+        return glm::vec3(0.0f);
+    }
+
+    // Same attenuation as ScatterRay
+    const FMaterial& lightMaterial = GetMaterial(lightMaterialIndex);
+    const glm::vec3  bsdf          = glm::min(glm::vec3(material.Albedo), glm::vec3(0.9f)) / glm::pi<float>();
+    const float      bsdfPdf       = cosSurface / glm::pi<float>();
+    const float      weight        = PowerHeuristic(lightPdf, bsdfPdf);
+    return glm::vec3(lightMaterial.Emissive) * bsdf * cosSurface * weight / lightPdf;
+}
+
+float FCPURayTracer::GetLightArea(uint32_t primitive) const
+{
+    const uint32_t type  = primitive >> PRIMITIVE_INDEX_BITS;
+    const uint32_t index = primitive & PRIMITIVE_INDEX_MASK;
+    if (type == PRIMITIVE_TYPE_QUAD)
+    {
+        const FQuad& quad = m_pScene->m_Quads[index];
+        return glm::length(glm::cross(glm::vec3(quad.Edge0), glm::vec3(quad.Edge1)));
+    }
+    else
+    {
+        const float radius = m_pScene->m_Spheres[index].Radius;
+        return 2.0f * glm::pi<float>() * radius * radius;
+    }
+}
+
+float FCPURayTracer::GetLightPdf(float area, const glm::vec3& origin, const glm::vec3& lightPosition, const glm::vec3& lightNormal) const
+{
+    const glm::vec3 toLight  = lightPosition - origin;
+    const float     dist2    = glm::dot(toLight, toLight);
+    const float     cosLight = std::abs(glm::dot(glm::normalize(lightNormal), toLight)) / std::sqrt(dist2);
+    if (cosLight < SIGMA || area <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return dist2 / (cosLight * area * float(m_Lights.size()));
+}
+
+float FCPURayTracer::GetEmissiveWeight(const FCPURay& ray, const FCPURayPayLoad& payLoad, float bsdfPdf) const
+{
+    if (bsdfPdf <= 0.0f || !IsLight(payLoad.Primitive))
+    {
+        return 1.0f;
+    }
+
+    const float lightPdf = GetLightPdf(GetLightArea(payLoad.Primitive), ray.Origin, payLoad.Position, payLoad.Normal);
+    return PowerHeuristic(bsdfPdf, lightPdf);
+}
+
+bool FCPURayTracer::RussianRoulette(uint32_t depth, glm::vec3& throughput, uint32_t& randomSeed) const
+{
+    if (depth < m_MinBounces)
+    {
+        return true;
+    }
+
+    const float survivalProbability = std::min(std::max(throughput.r, std::max(throughput.g, throughput.b)), 0.95f);
+    if (NextRandom(randomSeed) >= survivalProbability)
+    {
+        return false;
+    }
+
+    throughput = throughput / survivalProbability;
+    return true;
+}
+
+glm::vec3 FCPURayTracer::SampleBackground(const glm::vec3& direction) const
+{
+    // The skybox is a GPU texture and is not available here, it is treated as no background
+    if (m_pScene->m_Settings.BackgroundType == BACKGROUND_TYPE_GRADIENT)
+    {
+        const glm::vec3 unitDirection = glm::normalize(direction);
+        const float     alpha         = 0.5f * (unitDirection.y + 1.0f);
+        return (1.0f - alpha) * glm::vec3(1.0f, 1.0f, 1.0f) + alpha * glm::vec3(0.5f, 0.7f, 1.0f);
+    }
+
+    return glm::vec3(0.0f);
+}
+
+const FMaterial& FCPURayTracer::GetMaterial(uint32_t materialIndex) const
+{
+    assert(!m_pScene->m_Materials.empty());
+    return m_pScene->m_Materials[std::min<size_t>(materialIndex, m_pScene->m_Materials.size() - 1)];
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "Core.h"
+#include "IRenderer.h"
+#include "Scene.h"
+#include "CPUIntersect.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// WorkStealingQueue, each worker owns a queue and takes work from the back of it. When the queue
+// is empty the worker steals from the front of the other queues so that all cores stay busy even
+// when some tiles are a lot more expensive than others.
+
+class FWorkStealingQueue
+{
+public:
+    void Push(uint32_t item);
+
+    // Used by the owner
+    bool Pop(uint32_t& outItem);
+
+    // Used by the other workers
+    bool Steal(uint32_t& outItem);
+
+private:
+    std::mutex           m_Mutex;
+    std::deque<uint32_t> m_Items;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// CPURayTracer, path traces the same FScene as FRayTracer on the CPU. The materials, light
+// sampling and path termination follow raytracer.glsl so that it can be used as a reference when
+// validating the shaders, and it does not need a GPU at all.
+
+struct FCPURay
+{
+    glm::vec3 Origin;
+    glm::vec3 Direction;
+};
+
+struct FCPURayPayLoad
+{
+    glm::vec3 Normal;
+    glm::vec3 Position;
+    float     T;
+    float     MinT;
+    float     MaxT;
+    bool      FrontFace;
+    uint32_t  MaterialIndex;
+    uint32_t  Primitive;
+};
+
+// Each mesh has its own BVH and the triangles are stored in the same order as the leaves
+struct FCPUMesh
+{
+    std::vector<FBVHNode>  Nodes;
+    std::vector<glm::vec3> Triangles;
+    uint32_t               MaterialIndex = 0;
+};
+
+class FCPURayTracer : public IRenderer
+{
+public:
+    // Zero threads uses all the cores
+    FCPURayTracer(uint32_t numThreads = 0);
+    ~FCPURayTracer();
+
+    // The device and swapchain are not used and can be nullptr
+    virtual void Init(FDevice* pDevice, FSwapchain* pSwapchain) override;
+
+    virtual void Release() override;
+
+    // Traces one sample for every pixel and blocks until all tiles are done
+    virtual void Tick(float deltaTime) override;
+
+    virtual void OnRenderUI() override {}
+
+    virtual void OnWindowResize(uint32_t width, uint32_t height) override;
+
+    virtual bool SaveImage(const char* pFilePath) override;
+
+    virtual uint32_t GetNumSamples() const override
+    {
+        return m_NumSamples;
+    }
+
+    virtual void SetMaxSamples(uint32_t maxSamples) override
+    {
+        m_MaxSamples = maxSamples;
+    }
+
+    uint32_t GetNumThreads() const
+    {
+        return static_cast<uint32_t>(m_Threads.size());
+    }
+
+private:
+    void BuildScene();
+
+    void WorkerThread(uint32_t threadIndex);
+    bool StealTile(uint32_t threadIndex, uint32_t& outTile);
+    void RenderTile(uint32_t tile);
+
+    glm::vec3 TracePath(const glm::ivec2& pixel, uint32_t& randomSeed) const;
+
+    bool TraceRay(const FCPURay& ray, FCPURayPayLoad& payLoad) const;
+    void TraceFlat(const FCPURay& ray, const FSimdRay& simdRay, FCPURayPayLoad& payLoad) const;
+    void TraverseBVH(const FCPURay& ray, FCPURayPayLoad& payLoad) const;
+    void TraverseMeshBVH(const FCPUMesh& mesh, const FCPURay& ray, const glm::vec3& invDirection, FCPURayPayLoad& payLoad) const;
+    void HitPrimitive(uint32_t primitive, const FCPURay& ray, const glm::vec3& invDirection, FCPURayPayLoad& payLoad) const;
+
+    bool      ScatterRay(const FMaterial& material, const FCPURay& inRay, const FCPURayPayLoad& payLoad, uint32_t& randomSeed, glm::vec3& throughput, FCPURay& outRay) const;
+    glm::vec3 SampleDirectLight(const FMaterial& material, const FCPURayPayLoad& payLoad, uint32_t& randomSeed) const;
+    float     GetLightArea(uint32_t primitive) const;
+    float     GetLightPdf(float area, const glm::vec3& origin, const glm::vec3& lightPosition, const glm::vec3& lightNormal) const;
+    float     GetEmissiveWeight(const FCPURay& ray, const FCPURayPayLoad& payLoad, float bsdfPdf) const;
+    bool      RussianRoulette(uint32_t depth, glm::vec3& throughput, uint32_t& randomSeed) const;
+    glm::vec3 SampleBackground(const glm::vec3& direction) const;
+
+    const FMaterial& GetMaterial(uint32_t materialIndex) const;
+
+    // Scene
+    FScene*                m_pScene;
+    FBVH                   m_BVH;
+    std::vector<uint32_t>  m_BVHPrimitives;
+    std::vector<FCPUMesh>  m_Meshes;
+    std::vector<FLight>    m_Lights;
+
+    // The SIMD kernels test the planes, and all the primitives when the scene is small enough to skip the BVH
+    const FIntersectKernels* m_pKernels;
+    FSoAScene                m_SoAScene;
+    bool                     m_bFlatScene;
+
+    // Path termination, same defaults as FRayTracer
+    uint32_t m_MinBounces;
+    uint32_t m_MaxBounces;
+
+    // The alpha stores the number of samples
+    std::vector<glm::vec4> m_Accumulation;
+    uint32_t               m_Width;
+    uint32_t               m_Height;
+    uint32_t               m_NumTilesX;
+    uint32_t               m_NumTilesY;
+
+    // Samples
+    uint32_t m_NumSamples;
+    uint32_t m_MaxSamples;
+
+    // Workers, they sleep between the frames and are woken up when a new sample starts
+    uint32_t                        m_NumRequestedThreads;
+    std::vector<std::thread>        m_Threads;
+    std::vector<FWorkStealingQueue> m_Queues;
+    std::mutex                      m_Mutex;
+    std::condition_variable         m_StartCondition;
+    std::condition_variable         m_DoneCondition;
+    uint32_t                        m_Generation;
+    uint32_t                        m_NumActiveWorkers;
+    bool                            m_bExit;
+};
@@ -7,6 +7,12 @@ struct FCameraBuffer
     glm::mat4 View;
     glm::vec4 Position;
     glm::vec4 Forward;
+
+    // Offset of the image in the film (xy) and the size of the whole film (zw), the image is smaller when rendering tiles
+    glm::ivec4 Film;
+
+    // Size of the image in the render targets (xy), the targets are allocated larger so that they survive a resize
+    glm::ivec4 Image;
 };
 
 class FCamera
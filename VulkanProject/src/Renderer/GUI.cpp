@@ -151,6 +151,7 @@ namespace GUI
             , bWindowOwned(false)
             , IgnoreWindowPosEventFrame(0)
             , IgnoreWindowSizeEventFrame(0)
+            , FrameIndex(0)
         {
         }
         
@@ -163,9 +164,9 @@ namespace GUI
         {
             for (ImGuiFrameRenderData& renderData : FrameData)
             {
-                if (renderData.pCommandBuffer && renderData.pCommandBuffer->IsFinishedOnGPU())
+                if (renderData.pCommandBuffer)
                 {
-                    renderData.pCommandBuffer->WaitForAndResetFences();
+                    renderData.pCommandBuffer->WaitUntilFinished();
                 }
             }
         }
@@ -201,6 +202,7 @@ namespace GUI
         FRenderPass*                       pRenderPass;
         std::vector<FFramebuffer*>         Framebuffers;
         std::vector<ImGuiFrameRenderData> FrameData;
+        uint32_t                          FrameIndex;
         VkClearValue                      ClearValues;
         
         bool bWindowOwned;
@@ -979,7 +981,7 @@ namespace GUI
             textureParams.Width     = width;
             textureParams.Height    = height;
             
-            pRendererBackend->pFontTexture = FTexture::CreateWithData(pRendererBackend->pDevice, textureParams, pixels);
+            pRendererBackend->pFontTexture = FTexture::CreateWithData(pRendererBackend->pDevice, textureParams, nullptr, pixels);
             if (!pRendererBackend->pFontTexture)
             {
                 return false;
@@ -1285,9 +1287,11 @@ namespace GUI
     
     static void ImGuiDestroyFramebuffers(ImGuiViewportData* pViewportData)
     {
+        // The framebuffers are destroyed when the swapchain changes, while the frames in flight can still use them
+        ImGuiRendererBackendData* pRendererBackend = ImGuiGetRendererBackendData();
         for (auto& pFramebuffer : pViewportData->Framebuffers)
         {
-            SAFE_DELETE(pFramebuffer);
+            pRendererBackend->pDevice->DeferDelete(pFramebuffer);
         }
     }
     
@@ -1328,10 +1332,11 @@ namespace GUI
         commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
         commandBufferParams.QueueType = ECommandQueueType::Graphics;
         
-        uint32_t numBackbuffers = pViewportData->pSwapchain->GetNumBackBuffers();
-        pViewportData->FrameData.resize(numBackbuffers);
+        // One set of buffers for each frame in flight, the framebuffers are still one for each image
+        pViewportData->FrameData.resize(NUM_FRAMES_IN_FLIGHT);
+        pViewportData->FrameIndex = 0;
         
-        for (uint32_t i = 0; i < numBackbuffers; i++)
+        for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
         {
             FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(pDevice, commandBufferParams);
             assert(pCommandBuffer != nullptr);
@@ -1500,8 +1505,7 @@ namespace GUI
         ImGuiViewportData* pViewportData = reinterpret_cast<ImGuiViewportData*>(pDrawData->OwnerViewport->RendererUserData);
         assert(pViewportData != nullptr);
         
-        const uint32_t frameIndex = pViewportData->pSwapchain->GetCurrentBackBufferIndex();
-        ImGuiFrameRenderData& renderData = pViewportData->FrameData[frameIndex];
+        ImGuiFrameRenderData& renderData = pViewportData->FrameData[pViewportData->FrameIndex];
         if (pDrawData->TotalVtxCount > 0)
         {
             // Create or resize the vertex/index buffers
@@ -1650,16 +1654,16 @@ namespace GUI
         }
 
         FSwapchain* pSwapchain = pViewportData->pSwapchain;
-        const uint32_t frameIndex = pSwapchain->GetCurrentBackBufferIndex();
+        pViewportData->FrameIndex = (pViewportData->FrameIndex + 1) % NUM_FRAMES_IN_FLIGHT;
         
-        ImGuiFrameRenderData& renderData = pViewportData->FrameData[frameIndex];
+        ImGuiFrameRenderData& renderData = pViewportData->FrameData[pViewportData->FrameIndex];
         renderData.pCommandBuffer->Reset();
         renderData.pCommandBuffer->Begin();
         
         const VkClearValue* pClearValues = (pViewport->Flags & ImGuiViewportFlags_NoRendererClear) ? nullptr : &pViewportData->ClearValues;
         uint32_t clearValueCount         = (pViewport->Flags & ImGuiViewportFlags_NoRendererClear) ? 0 : 1;
         
-        FFramebuffer* pFramebuffer = pViewportData->Framebuffers[frameIndex];
+        FFramebuffer* pFramebuffer = pViewportData->Framebuffers[pSwapchain->GetCurrentBackBufferIndex()];
         renderData.pCommandBuffer->BeginRenderPass(pViewportData->pRenderPass, pFramebuffer, pClearValues, clearValueCount);
         
         ImGuiRenderDrawData(pViewport->DrawData, renderData.pCommandBuffer);
@@ -14,4 +14,18 @@ public:
     virtual void OnRenderUI() = 0;
     
     virtual void OnWindowResize(uint32_t width, uint32_t height) = 0;
+
+    // Offline rendering, used when running headless
+    virtual bool SaveImage(const char*)
+    {
+        return false;
+    }
+
+    virtual uint32_t GetNumSamples() const
+    {
+        return 0;
+    }
+
+    // Limits the total number of samples, zero means no limit
+    virtual void SetMaxSamples(uint32_t) {}
 };
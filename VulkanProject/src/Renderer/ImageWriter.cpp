@@ -0,0 +1,256 @@
+#include "ImageWriter.h"
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <bit>
+
+namespace ImageWriter
+{
+    static bool HasExtension(const std::string& filepath, const char* pExtension)
+    {
+        const size_t extensionLength = strlen(pExtension);
+        if (filepath.size() < extensionLength)
+        {
+            return false;
+        }
+
+        std::string extension = filepath.substr(filepath.size() - extensionLength);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c)
+        {
+            return char(::tolower(c));
+        });
+
+        return extension == pExtension;
+    }
+
+    // The sign of the scale in the header is the byte order of the floats, negative means little endian
+    static const char* GetPFMScale()
+    {
+        return (std::endian::native == std::endian::little) ? "-1.0" : "1.0";
+    }
+
+    // Same tonemapping as in raytracer.glsl
+    static uint8_t TonemapToByte(float value, float exposure)
+    {
+        constexpr float Gamma = 2.2f;
+
+        value = 1.0f - std::exp(-value * exposure);
+        value = std::pow(std::clamp(value, 0.0f, 1.0f), 1.0f / Gamma);
+        return uint8_t(value * 255.0f + 0.5f);
+    }
+
+    bool WritePFM(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels)
+    {
+        assert(pPixels != nullptr);
+
+        std::ofstream file(pFilePath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cout << "Failed to open '" << pFilePath << "' for writing\n";
+            return false;
+        }
+
+        // The floats are written in the byte order of the host
+        file << "PF\n" << width << " " << height << "\n" << GetPFMScale() << "\n";
+
+        // PFM stores the rows from the bottom to the top
+        std::vector<float> row(width * 3);
+        for (uint32_t y = height; y > 0; y--)
+        {
+            const float* pSourceRow = pPixels + size_t(y - 1) * width * 4;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                row[x * 3 + 0] = pSourceRow[x * 4 + 0];
+                row[x * 3 + 1] = pSourceRow[x * 4 + 1];
+                row[x * 3 + 2] = pSourceRow[x * 4 + 2];
+            }
+
+            file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+        }
+
+        std::cout << "Wrote image '" << pFilePath << "'\n";
+        return file.good();
+    }
+
+    bool WritePPM(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels, float exposure)
+    {
+        assert(pPixels != nullptr);
+
+        std::ofstream file(pFilePath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cout << "Failed to open '" << pFilePath << "' for writing\n";
+            return false;
+        }
+
+        file << "P6\n" << width << " " << height << "\n255\n";
+
+        std::vector<uint8_t> row(width * 3);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const float* pSourceRow = pPixels + size_t(y) * width * 4;
+            for (uint32_t x = 0; x < width * 3; x++)
+            {
+                row[x] = TonemapToByte(pSourceRow[(x / 3) * 4 + (x % 3)], exposure);
+            }
+
+            file.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+
+        std::cout << "Wrote image '" << pFilePath << "'\n";
+        return file.good();
+    }
+
+    bool WriteImage(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels, float exposure)
+    {
+        if (HasExtension(pFilePath, ".ppm"))
+        {
+            return WritePPM(pFilePath, width, height, pPixels, exposure);
+        }
+        else
+        {
+            return WritePFM(pFilePath, width, height, pPixels);
+        }
+    }
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// TiledImageWriter
+
+FTiledImageWriter* FTiledImageWriter::Create(const char* pFilePath, uint32_t width, uint32_t height, float exposure)
+{
+    assert(width > 0 && height > 0);
+
+    FTiledImageWriter* pWriter = new FTiledImageWriter();
+    pWriter->m_FilePath = pFilePath;
+    pWriter->m_Width    = width;
+    pWriter->m_Height   = height;
+    pWriter->m_Exposure = exposure;
+    pWriter->m_bIsPFM   = !ImageWriter::HasExtension(pFilePath, ".ppm");
+
+    pWriter->m_File.open(pFilePath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!pWriter->m_File.is_open())
+    {
+        std::cout << "Failed to open '" << pFilePath << "' for writing\n";
+        SAFE_DELETE(pWriter);
+        return nullptr;
+    }
+
+    // The floats are written in the byte order of the host
+    if (pWriter->m_bIsPFM)
+    {
+        pWriter->m_File << "PF\n" << width << " " << height << "\n" << ImageWriter::GetPFMScale() << "\n";
+    }
+    else
+    {
+        pWriter->m_File << "P6\n" << width << " " << height << "\n255\n";
+    }
+
+    // Write the last byte so that the file has its final size, the tiles are written in place
+    const std::streamoff pixelSize = pWriter->m_bIsPFM ? sizeof(float) * 3 : 3;
+    pWriter->m_HeaderSize = pWriter->m_File.tellp();
+    pWriter->m_File.seekp(pWriter->m_HeaderSize + std::streamoff(width) * std::streamoff(height) * pixelSize - 1);
+    pWriter->m_File.put(0);
+
+    if (!pWriter->m_File.good())
+    {
+        std::cout << "Failed to allocate '" << pFilePath << "'\n";
+        SAFE_DELETE(pWriter);
+        return nullptr;
+    }
+
+    return pWriter;
+}
+
+FTiledImageWriter::FTiledImageWriter()
+    : m_File()
+    , m_FilePath()
+    , m_HeaderSize(0)
+    , m_Width(0)
+    , m_Height(0)
+    , m_Exposure(1.0f)
+    , m_bIsPFM(true)
+{
+}
+
+FTiledImageWriter::~FTiledImageWriter()
+{
+    if (m_File.is_open())
+    {
+        m_File.close();
+    }
+}
+
+bool FTiledImageWriter::WriteTile(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* pPixels, uint32_t pixelStride)
+{
+    assert(pPixels != nullptr);
+    assert(m_File.is_open());
+
+    // Tiles at the edges are cropped to the image
+    width  = std::min(width, m_Width - std::min(x, m_Width));
+    height = std::min(height, m_Height - std::min(y, m_Height));
+    if (width == 0 || height == 0)
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> row;
+    for (uint32_t tileY = 0; tileY < height; tileY++)
+    {
+        const float*   pSourceRow = pPixels + size_t(tileY) * pixelStride * 4;
+        const uint32_t imageY     = y + tileY;
+
+        // PFM stores the rows from the bottom to the top
+        std::streamoff rowIndex;
+        std::streamoff pixelSize;
+        if (m_bIsPFM)
+        {
+            rowIndex  = std::streamoff(m_Height - 1 - imageY);
+            pixelSize = sizeof(float) * 3;
+
+            row.resize(size_t(width) * pixelSize);
+            float* pRow = reinterpret_cast<float*>(row.data());
+            for (uint32_t tileX = 0; tileX < width; tileX++)
+            {
+                pRow[tileX * 3 + 0] = pSourceRow[tileX * 4 + 0];
+                pRow[tileX * 3 + 1] = pSourceRow[tileX * 4 + 1];
+                pRow[tileX * 3 + 2] = pSourceRow[tileX * 4 + 2];
+            }
+        }
+        else
+        {
+            rowIndex  = std::streamoff(imageY);
+            pixelSize = 3;
+
+            row.resize(size_t(width) * pixelSize);
+            for (uint32_t tileX = 0; tileX < width * 3; tileX++)
+            {
+                row[tileX] = ImageWriter::TonemapToByte(pSourceRow[(tileX / 3) * 4 + (tileX % 3)], m_Exposure);
+            }
+        }
+
+        m_File.seekp(m_HeaderSize + ((rowIndex * std::streamoff(m_Width)) + std::streamoff(x)) * pixelSize);
+        m_File.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+
+    return m_File.good();
+}
+
+bool FTiledImageWriter::Close()
+{
+    if (!m_File.is_open())
+    {
+        return false;
+    }
+
+    m_File.flush();
+    const bool bResult = m_File.good();
+    m_File.close();
+
+    if (bResult)
+    {
+        std::cout << "Wrote image '" << m_FilePath << "'\n";
+    }
+
+    return bResult;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Core.h"
+#include <fstream>
+
+namespace ImageWriter
+{
+    // Writes tightly packed RGBA32F pixels (top row first) as linear RGB into a Portable FloatMap (.pfm)
+    bool WritePFM(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels);
+
+    // Writes tightly packed linear RGBA32F pixels (top row first) as 8-bit RGB into a binary Portable PixMap (.ppm),
+    // the pixels are tonemapped with the same exposure and gamma that is used for the viewport
+    bool WritePPM(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels, float exposure);
+
+    // Picks the writer based on the file extension, defaults to PFM
+    bool WriteImage(const char* pFilePath, uint32_t width, uint32_t height, const float* pPixels, float exposure);
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// TiledImageWriter, streams an image to disk one tile at a time so that the whole image never has
+// to be in memory. The file gets its final size when it is created and each tile is written
+// directly to its rows, the tiles can therefore be written in any order.
+
+class FTiledImageWriter
+{
+public:
+    // Picks the format based on the file extension the same way as ImageWriter::WriteImage
+    static FTiledImageWriter* Create(const char* pFilePath, uint32_t width, uint32_t height, float exposure);
+
+    FTiledImageWriter();
+    ~FTiledImageWriter();
+
+    // Pixels are tightly packed linear RGBA32F (top row first) with a stride of pixelStride pixels
+    bool WriteTile(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* pPixels, uint32_t pixelStride);
+
+    bool Close();
+
+private:
+    std::fstream   m_File;
+    std::string    m_FilePath;
+    std::streamoff m_HeaderSize;
+    uint32_t       m_Width;
+    uint32_t       m_Height;
+    float          m_Exposure;
+    bool           m_bIsPFM;
+};
@@ -7,7 +7,7 @@ FModel::~FModel()
     SAFE_DELETE(m_pIndexBuffer);
 }
 
-bool FModel::LoadFromFile(const std::string& filepath, FDevice* pDevice, FDeviceMemoryAllocator* pAllocator)
+bool FModel::LoadMeshData(const std::string& filepath, std::vector<FVertex>& outVertices, std::vector<uint32_t>& outIndices)
 {
     tinyobj::attrib_t                attrib;
     std::vector<tinyobj::shape_t>    shapes;
@@ -38,9 +38,10 @@ bool FModel::LoadFromFile(const std::string& filepath, FDevice* pDevice, FDevice
         }
     }
     
-    std::vector<FVertex>  vertices;
-    std::vector<uint16_t> indices;
-    std::unordered_map<FVertex, uint16_t, FVertexHasher> uniqueVertices = {};
+    outVertices.clear();
+    outIndices.clear();
+
+    std::unordered_map<FVertex, uint32_t, FVertexHasher> uniqueVertices = {};
     for (const auto& shape : shapes)
     {
         for (const auto& index : shape.mesh.indices)
@@ -53,25 +54,42 @@ bool FModel::LoadFromFile(const std::string& filepath, FDevice* pDevice, FDevice
                 attrib.vertices[3 * index.vertex_index + 2]
             };
 
-            vertex.TexCoord =
+            if (index.texcoord_index >= 0)
             {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+                vertex.TexCoord =
+                {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                };
+            }
 
             vertex.Color = { 1.0f, 1.0f, 1.0f };
 
             if (uniqueVertices.count(vertex) == 0)
             {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                vertices.push_back(vertex);
+                uniqueVertices[vertex] = static_cast<uint32_t>(outVertices.size());
+                outVertices.push_back(vertex);
             }
 
-            indices.push_back(uniqueVertices[vertex]);
+            outIndices.push_back(uniqueVertices[vertex]);
         }
     }
+
+    return true;
+}
+
+bool FModel::LoadFromFile(const std::string& filepath, FDevice* pDevice, FDeviceMemoryAllocator* pAllocator)
+{
+    std::vector<FVertex>  vertices;
+    std::vector<uint32_t> meshIndices;
+    if (!LoadMeshData(filepath, vertices, meshIndices))
+    {
+        return false;
+    }
     
-    assert(indices.size() < UINT16_MAX);
+    assert(meshIndices.size() < UINT16_MAX);
+
+    std::vector<uint16_t> indices(meshIndices.begin(), meshIndices.end());
     
     FBufferParams vertexBufferParams = {};
     vertexBufferParams.Size             = vertices.size() * sizeof(FVertex);
@@ -62,6 +62,9 @@ class FModel
 {
 public:
     ~FModel();
+
+    // Loads the vertices and indices without creating any GPU resources
+    static bool LoadMeshData(const std::string& filepath, std::vector<FVertex>& outVertices, std::vector<uint32_t>& outIndices);
     
     bool LoadFromFile(const std::string& filepath, FDevice* pDevice, FDeviceMemoryAllocator* pAllocator);
     
@@ -4,9 +4,13 @@
 #include "MathHelper.h"
 #include "GUI.h"
 #include "TextureResource.h"
+#include "ImageWriter.h"
+#include "WavefrontPipeline.h"
+#include "FileWatcher.h"
 #include "Vulkan/Buffer.h"
 #include "Vulkan/Framebuffer.h"
 #include "Vulkan/ShaderModule.h"
+#include "Vulkan/ShaderCompiler.h"
 #include "Vulkan/PipelineState.h"
 #include "Vulkan/CommandBuffer.h"
 #include "Vulkan/DeviceMemoryAllocator.h"
@@ -17,18 +21,185 @@
 #include "Vulkan/Swapchain.h"
 #include "Vulkan/Texture.h"
 #include "Vulkan/TextureView.h"
+#include "Vulkan/UploadRing.h"
 #include "Vulkan/Helpers.h"
+#include "../../res/shaders/shared.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
+#include <bit>
+
+// Same as NUM_THREADS in raytracer.glsl
+#define NUM_THREADS (16)
+
+// The render targets are allocated in steps, so that they are not recreated every frame while the viewport is resized
+#define RENDER_TARGET_ALIGNMENT (256)
+
+// Same as MAX_DEPTH in raytracer.glsl
+#define MAX_BOUNCES (1024)
+
+// Limits for the sample controller, the headless target is larger since there is no UI to keep responsive
+#define MAX_SAMPLES_PER_DISPATCH   (64)
+#define DEFAULT_TARGET_FRAME_TIME  (16.0f)
+#define HEADLESS_TARGET_FRAME_TIME (100.0f)
+
+// The wavefront pipeline has counters for a limited number of samples per dispatch
+static_assert(MAX_SAMPLES_PER_DISPATCH <= WAVEFRONT_MAX_SAMPLES, "The wavefront pipeline has no counters for that many samples");
+
+// Compiled shaders are stored here and reused while their source files do not change
+#define SHADER_CACHE_PATH RESOURCE_PATH"/shaders/cache"
+
+// Seconds between checking the shader files for changes
+#define SHADER_WATCH_INTERVAL (0.25f)
+
+// Initial size of the upload ring for each frame, it grows when the scene needs more
+#define UPLOAD_RING_FRAME_SIZE (256 * 1024)
+
+// Initial size of the quad, sphere, plane, material, BVH and light buffers, they grow when the scene needs more
+#define SCENE_BUFFER_MIN_SIZE (4 * 1024)
+
+static_assert(sizeof(FFrameConstants) == WAVEFRONT_PUSH_CONSTANT_OFFSET, "The wavefront constants are placed after the frame constants");
+
+// Creates a device local storage buffer and uploads the data with a staging buffer, this stalls the GPU
+static FBuffer* CreateStorageBufferWithData(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, const void* pData, VkDeviceSize size)
+{
+    // Empty buffers cannot be bound so always create something
+    FBufferParams bufferParams;
+    bufferParams.Size             = std::max<VkDeviceSize>(size, 16);
+    bufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
+    bufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    FBuffer* pBuffer = FBuffer::Create(pDevice, bufferParams, pAllocator);
+    if (!pBuffer || size == 0)
+    {
+        return pBuffer;
+    }
+
+    FBufferParams stagingBufferParams;
+    stagingBufferParams.Size             = size;
+    stagingBufferParams.MemoryProperties = VK_CPU_BUFFER_USAGE;
+    stagingBufferParams.Usage            = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    FBuffer* pStagingBuffer = FBuffer::CreateWithData(pDevice, stagingBufferParams, nullptr, pData);
+    if (!pStagingBuffer)
+    {
+        SAFE_DELETE(pBuffer);
+        return nullptr;
+    }
+
+    FCommandBufferParams commandBufferParams = {};
+    commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferParams.QueueType = ECommandQueueType::Compute;
+
+    FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(pDevice, commandBufferParams);
+    if (!pCommandBuffer)
+    {
+        SAFE_DELETE(pStagingBuffer);
+        SAFE_DELETE(pBuffer);
+        return nullptr;
+    }
+
+    pCommandBuffer->Reset();
+    pCommandBuffer->Begin();
+
+    VkBufferCopy region = {};
+    region.srcOffset = 0;
+    region.dstOffset = 0;
+    region.size      = size;
+    pCommandBuffer->CopyBuffer(pStagingBuffer->GetBuffer(), pBuffer->GetBuffer(), 1, &region);
+
+    pCommandBuffer->End();
+
+    // The buffers are only used by the compute queue
+    pDevice->Execute(ECommandQueueType::Compute, pCommandBuffer, FSubmitParams());
+    pCommandBuffer->WaitUntilFinished();
+
+    SAFE_DELETE(pCommandBuffer);
+    SAFE_DELETE(pStagingBuffer);
+    return pBuffer;
+}
+
+// Creates a device local storage buffer that is written by the upload ring
+static FBuffer* CreateSceneBuffer(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, VkDeviceSize size)
+{
+    FBufferParams bufferParams;
+    bufferParams.Size             = size;
+    bufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
+    bufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    return FBuffer::Create(pDevice, bufferParams, pAllocator);
+}
+
+// Uploads the elements that changed since the last upload
+template<typename T>
+static void UploadDirtyRanges(FUploadRing* pUploadRing, FBuffer* pBuffer, const std::vector<T>& elements, FDirtyRanges& dirtyRanges)
+{
+    for (const FDirtyRange& range : dirtyRanges.GetRanges())
+    {
+        // Elements can be removed after they were added to the range
+        const uint32_t end = std::min(range.End, static_cast<uint32_t>(elements.size()));
+        if (range.First < end)
+        {
+            pUploadRing->Upload(pBuffer, sizeof(T) * range.First, elements.data() + range.First, sizeof(T) * (end - range.First));
+        }
+    }
+
+    dirtyRanges.Clear();
+}
 
 FRayTracer::FRayTracer()
     : m_pDevice(nullptr)
     , m_pPipeline(nullptr)
+    , m_pWavefrontPipeline(nullptr)
+    , m_bUseWavefront(false)
     , m_pDeviceAllocator(nullptr)
-    , m_CommandBuffers()
+    , m_pDescriptorSet(nullptr)
+    , m_pShaderCompiler(nullptr)
+    , m_ShaderReload()
+    , m_pNewPipeline(nullptr)
+    , m_pShaderWatcher(nullptr)
+    , m_ShaderWatchTimer(0.0f)
+    , m_bReloadShaders(false)
+    , m_pUploadRing(nullptr)
+    , m_CameraBuffer()
+    , m_SceneBuffer()
+    , m_bUploadConstants(true)
+    , m_pMeshInfoBuffer(nullptr)
+    , m_pMeshBVHNodeBuffer(nullptr)
+    , m_pMeshVertexBuffer(nullptr)
+    , m_pMeshIndexBuffer(nullptr)
+    , m_pLightBuffer(nullptr)
+    , m_Frames()
+    , m_CurrentFrame(UINT32_MAX)
+    , m_pAccumulationTexture(nullptr)
+    , m_pAccumulationTextureView(nullptr)
+    , m_pSecondMomentTexture(nullptr)
+    , m_pSecondMomentTextureView(nullptr)
     , m_pSceneTexture(nullptr)
     , m_pSceneTextureView(nullptr)
-    , m_pSceneTextureDescriptorSet(nullptr)
+    , m_BVH()
+    , m_BVHPrimitives()
+    , m_bRebuildBVH(true)
+    , m_bRebuildMeshes(false)
+    , m_Lights()
+    , m_MinBounces(3)
+    , m_MaxBounces(32)
+    , m_AdaptiveThreshold(0.02f)
+    , m_AdaptiveMinSamples(16)
+    , m_DisplayMode(DISPLAY_MODE_IMAGE)
+    , m_NumSamples(0)
+    , m_MaxSamples(0)
+    , m_FrameIndex(0)
     , m_bResetImage(true)
+    , m_bAutoSamplesPerDispatch(true)
+    , m_SamplesPerDispatch(1)
+    , m_TargetFrameTime(DEFAULT_TARGET_FRAME_TIME)
+    , m_pTileWriter(nullptr)
+    , m_FilmWidth(0)
+    , m_FilmHeight(0)
+    , m_TileSize(0)
+    , m_NumTilesX(0)
+    , m_NumTilesY(0)
+    , m_CurrentTile(0)
 {
 }
 
@@ -43,11 +214,14 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     m_pDevice    = pDevice;
     m_pSwapchain = pSwapchain;
 
+    // Allocator for GPU memory, the buffers and textures below are allocated from it
+    m_pDeviceAllocator = new FDeviceMemoryAllocator(m_pDevice);
+
     // Init the textureloader
     FTextureResource::InitLoader(m_pDevice);
     
     // Create skybox
-    m_pSkybox = FTextureResource::LoadCubeMapFromPanoramaFile(m_pDevice, RESOURCE_PATH"/textures/arches.hdr");
+    m_pSkybox = FTextureResource::LoadCubeMapFromPanoramaFile(m_pDevice, m_pDeviceAllocator, RESOURCE_PATH"/textures/arches.hdr");
     assert(m_pSkybox != nullptr);
 
     FSamplerParams samplerParams = {};
@@ -67,9 +241,10 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     // Create scene
     m_pScene = new FSphereScene();
     m_pScene->Initialize();
+    m_pScene->MarkAllDirty();
 
     // Create DescriptorSetLayout
-    constexpr uint32_t numBindings = 10;
+    constexpr uint32_t numBindings = 17;
     VkDescriptorSetLayoutBinding bindings[numBindings];
     bindings[0].binding            = 0;
     bindings[0].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
@@ -89,48 +264,90 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     bindings[2].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[2].pImmutableSamplers = nullptr;
     
-    bindings[3].binding            = 3;
+    bindings[3].binding            = 4;
     bindings[3].descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     bindings[3].descriptorCount    = 1;
     bindings[3].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[3].pImmutableSamplers = nullptr;
 
-    bindings[4].binding            = 4;
-    bindings[4].descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[4].binding            = 5;
+    bindings[4].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[4].descriptorCount    = 1;
     bindings[4].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[4].pImmutableSamplers = nullptr;
 
-    bindings[5].binding            = 5;
+    bindings[5].binding            = 6;
     bindings[5].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[5].descriptorCount    = 1;
     bindings[5].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[5].pImmutableSamplers = nullptr;
 
-    bindings[6].binding            = 6;
+    bindings[6].binding            = 7;
     bindings[6].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[6].descriptorCount    = 1;
     bindings[6].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[6].pImmutableSamplers = nullptr;
-
-    bindings[7].binding            = 7;
+    
+    bindings[7].binding            = 8;
     bindings[7].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[7].descriptorCount    = 1;
     bindings[7].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[7].pImmutableSamplers = nullptr;
     
-    bindings[8].binding            = 8;
-    bindings[8].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[8].binding            = 9;
+    bindings[8].descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     bindings[8].descriptorCount    = 1;
     bindings[8].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[8].pImmutableSamplers = nullptr;
-    
-    bindings[9].binding            = 9;
-    bindings[9].descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    bindings[9].binding            = 10;
+    bindings[9].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[9].descriptorCount    = 1;
     bindings[9].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
     bindings[9].pImmutableSamplers = nullptr;
 
+    bindings[10].binding            = 11;
+    bindings[10].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[10].descriptorCount    = 1;
+    bindings[10].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[10].pImmutableSamplers = nullptr;
+
+    bindings[11].binding            = 12;
+    bindings[11].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[11].descriptorCount    = 1;
+    bindings[11].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[11].pImmutableSamplers = nullptr;
+
+    bindings[12].binding            = 13;
+    bindings[12].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[12].descriptorCount    = 1;
+    bindings[12].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[12].pImmutableSamplers = nullptr;
+
+    bindings[13].binding            = 14;
+    bindings[13].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[13].descriptorCount    = 1;
+    bindings[13].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[13].pImmutableSamplers = nullptr;
+
+    bindings[14].binding            = 15;
+    bindings[14].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[14].descriptorCount    = 1;
+    bindings[14].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[14].pImmutableSamplers = nullptr;
+
+    bindings[15].binding            = 16;
+    bindings[15].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[15].descriptorCount    = 1;
+    bindings[15].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[15].pImmutableSamplers = nullptr;
+
+    bindings[16].binding            = 17;
+    bindings[16].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[16].descriptorCount    = 1;
+    bindings[16].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[16].pImmutableSamplers = nullptr;
+
     FDescriptorSetLayoutParams descriptorSetLayoutParams;
     descriptorSetLayoutParams.pBindings   = bindings;
     descriptorSetLayoutParams.numBindings = numBindings;
@@ -138,16 +355,32 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     m_pDescriptorSetLayout = FDescriptorSetLayout::Create(m_pDevice, descriptorSetLayoutParams);
     assert(m_pDescriptorSetLayout != nullptr);
 
-    // Create PipelineLayout
+    // Create PipelineLayout, the push constants are the frame constants
     FPipelineLayoutParams pipelineLayoutParams;
-    pipelineLayoutParams.ppLayouts  = &m_pDescriptorSetLayout;
-    pipelineLayoutParams.numLayouts = 1;
+    pipelineLayoutParams.ppLayouts        = &m_pDescriptorSetLayout;
+    pipelineLayoutParams.numLayouts       = 1;
+    pipelineLayoutParams.numPushConstants = sizeof(FFrameConstants) / sizeof(uint32_t);
 
     m_pPipelineLayout = FPipelineLayout::Create(m_pDevice, pipelineLayoutParams);
     assert(m_pPipelineLayout != nullptr);
 
+    // Shaders that did not change since the last run are loaded from the cache
+    m_pShaderCompiler = FShaderCompiler::Create(SHADER_CACHE_PATH);
+    if (!m_pShaderCompiler)
+    {
+        std::cout << "[FRayTracer]: Failed to create the shader compiler, using the shaders compiled by the build\n";
+    }
+
     // Create shader and pipeline
-    FShaderModule* pComputeShader = FShaderModule::CreateFromFile(m_pDevice, "main", RESOURCE_PATH"/shaders/raytracer.spv");
+    FShaderModule* pComputeShader = nullptr;
+    if (m_pShaderCompiler)
+    {
+        pComputeShader = FShaderModule::CreateFromSourceFile(m_pDevice, m_pShaderCompiler, "main", RESOURCE_PATH"/shaders/raytracer.glsl", VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    if (!pComputeShader)
+    {
+        pComputeShader = FShaderModule::CreateFromFile(m_pDevice, "main", RESOURCE_PATH"/shaders/raytracer.spv");
+    }
 
     FComputePipelineStateParams pipelineParams = {};
     pipelineParams.pShader         = pComputeShader;
@@ -157,17 +390,21 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     assert(m_pPipeline != nullptr);
 
     delete pComputeShader;
-   
-    // Create DescriptorPool
-    FDescriptorPoolParams poolParams;
-    poolParams.NumUniformBuffers        = 3;
-    poolParams.NumStorageImages         = 2;
-    poolParams.NumStorageBuffers        = 4;
-    poolParams.NumCombinedImageSamplers = 1;
-    poolParams.MaxSets                  = 1;
-    
-    m_pDescriptorPool = FDescriptorPool::Create(m_pDevice, poolParams);
-    assert(m_pDescriptorPool != nullptr);
+
+    // Create the wavefront pipeline, it shares the scene resources with the megakernel. It is optional so
+    // when the shaders are not compiled we only use the megakernel.
+    m_pWavefrontPipeline = FWavefrontPipeline::Create(m_pDevice, m_pDescriptorSetLayout, m_pShaderCompiler);
+    if (!m_pWavefrontPipeline)
+    {
+        std::cout << "[FRayTracer]: Failed to create the wavefront pipeline\n";
+    }
+
+    // Reload the shaders when any of their files change
+    if (m_pShaderCompiler && !IsHeadless())
+    {
+        m_pShaderWatcher = new FFileWatcher(RESOURCE_PATH"/shaders", ".glsl");
+    }
+
 
     // Camera
     FBufferParams cameraBufferParams;
@@ -178,15 +415,6 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     m_pCameraBuffer = FBuffer::Create(m_pDevice, cameraBufferParams, m_pDeviceAllocator);
     assert(m_pCameraBuffer != nullptr);
 
-    // Random
-    FBufferParams randomBufferParams;
-    randomBufferParams.Size             = sizeof(FRandomBuffer);
-    randomBufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
-    randomBufferParams.Usage            = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-    m_pRandomBuffer = FBuffer::Create(m_pDevice, randomBufferParams, m_pDeviceAllocator);
-    assert(m_pRandomBuffer != nullptr);
-
     // SceneBuffer
     FBufferParams sceneBufferParams;
     sceneBufferParams.Size             = sizeof(FSceneBuffer);
@@ -196,76 +424,83 @@ void FRayTracer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     m_pSceneBuffer = FBuffer::Create(m_pDevice, sceneBufferParams, m_pDeviceAllocator);
     assert(m_pSceneBuffer != nullptr);
   
-    // QuadBuffer
-    FBufferParams quadBufferParams;
-    quadBufferParams.Size             = sizeof(FQuad) * MAX_QUAD;
-    quadBufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
-    quadBufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-    m_pQuadBuffer = FBuffer::Create(m_pDevice, quadBufferParams, m_pDeviceAllocator);
+    // Scene buffers, they start small and grow when the scene needs more
+    m_pQuadBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
     assert(m_pQuadBuffer != nullptr);
-    
-    // SphereBuffer
-    FBufferParams sphereBufferParams;
-    sphereBufferParams.Size             = sizeof(FSphere) * MAX_SPHERES;
-    sphereBufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
-    sphereBufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-    m_pSphereBuffer = FBuffer::Create(m_pDevice, sphereBufferParams, m_pDeviceAllocator);
+    m_pSphereBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
     assert(m_pSphereBuffer != nullptr);
 
-    // PlaneBuffer
-    FBufferParams planeBufferParams;
-    planeBufferParams.Size             = sizeof(FPlane) * MAX_PLANES;
-    planeBufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
-    planeBufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-    m_pPlaneBuffer = FBuffer::Create(m_pDevice, planeBufferParams, m_pDeviceAllocator);
+    m_pPlaneBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
     assert(m_pPlaneBuffer != nullptr);
 
-    // MaterialBuffer
-    FBufferParams materialBufferParams;
-    materialBufferParams.Size             = sizeof(FMaterial) * MAX_MATERIALS;
-    materialBufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
-    materialBufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-    m_pMaterialBuffer = FBuffer::Create(m_pDevice, materialBufferParams, m_pDeviceAllocator);
+    m_pMaterialBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
     assert(m_pMaterialBuffer != nullptr);
 
+    m_pBVHNodeBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
+    assert(m_pBVHNodeBuffer != nullptr);
+
+    m_pBVHPrimitiveBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
+    assert(m_pBVHPrimitiveBuffer != nullptr);
+
+    m_pLightBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, SCENE_BUFFER_MIN_SIZE);
+    assert(m_pLightBuffer != nullptr);
+
+    // Mesh buffers depend on the scene
+    CreateMeshBuffers();
+
     // Create the scene texture
     m_ViewportWidth  = 0;
     m_ViewportHeight = 0;
+    m_ImageWidth     = 0;
+    m_ImageHeight    = 0;
     CreateOrResizeSceneTexture(1280, 720);
 
-    // CommandBuffers
+    // Frames in flight, the path tracing runs on the compute queue
     FCommandBufferParams commandBufferParams = {};
     commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferParams.QueueType = ECommandQueueType::Graphics;
+    commandBufferParams.QueueType = ECommandQueueType::Compute;
 
-    uint32_t imageCount = m_pSwapchain->GetNumBackBuffers();
-    m_CommandBuffers.resize(imageCount);
-    for (size_t i = 0; i < m_CommandBuffers.size(); i++)
-    {
-        FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(m_pDevice, commandBufferParams);
-        m_CommandBuffers[i] = pCommandBuffer;
-    }
+    FCommandBufferParams graphicsCommandBufferParams = {};
+    graphicsCommandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    graphicsCommandBufferParams.QueueType = ECommandQueueType::Graphics;
 
-    // Timestamp queries
     FQueryParams queryParams;
     queryParams.queryType  = VK_QUERY_TYPE_TIMESTAMP;
     queryParams.queryCount = 2;
-    
-    m_TimestampQueries.resize(imageCount);
-    for (size_t i = 0; i < m_TimestampQueries.size(); i++)
+
+    for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
     {
-        FQuery* pQuery = FQuery::Create(m_pDevice, queryParams);
-        pQuery->Reset();
-        
-        m_TimestampQueries[i] = pQuery;
+        FFrameResources& frame = m_Frames[i];
+        frame.pCommandBuffer = FCommandBuffer::Create(m_pDevice, commandBufferParams);
+        assert(frame.pCommandBuffer != nullptr);
+
+        frame.pTimestampQuery = FQuery::Create(m_pDevice, queryParams);
+        assert(frame.pTimestampQuery != nullptr);
+        frame.pTimestampQuery->Reset();
+
+        // The display texture is only needed when there is a UI
+        if (IsHeadless())
+        {
+            continue;
+        }
+
+        frame.pGraphicsCommandBuffer = FCommandBuffer::Create(m_pDevice, graphicsCommandBufferParams);
+        assert(frame.pGraphicsCommandBuffer != nullptr);
     }
-    
-    // Allocator for GPU memory
-    m_pDeviceAllocator = new FDeviceMemoryAllocator(m_pDevice->GetDevice(), m_pDevice->GetPhysicalDevice());
+
+    if (IsHeadless())
+    {
+        m_TargetFrameTime = HEADLESS_TARGET_FRAME_TIME;
+    }
+
+    // One region for each frame in flight
+    FUploadRingParams uploadRingParams;
+    uploadRingParams.FrameSize = UPLOAD_RING_FRAME_SIZE;
+    uploadRingParams.NumFrames = NUM_FRAMES_IN_FLIGHT;
+
+    m_pUploadRing = FUploadRing::Create(m_pDevice, uploadRingParams, m_pDeviceAllocator);
+    assert(m_pUploadRing != nullptr);
 }
 
 void FRayTracer::Tick(float deltaTime)
@@ -273,77 +508,156 @@ void FRayTracer::Tick(float deltaTime)
     constexpr float CameraSpeed = 1.5f;
     m_LastCPUTime = deltaTime * 1000.0f; // deltaTime is in seconds
 
+    // When rendering tiles, the current tile is written to the file once it has all its samples
+    if (m_pTileWriter)
+    {
+        if (!IsTiledRenderFinished() && m_MaxSamples > 0 && m_NumSamples >= m_MaxSamples)
+        {
+            FinishTile();
+        }
+
+        if (IsTiledRenderFinished())
+        {
+            return;
+        }
+    }
+
     // Update scene image
     CreateOrResizeSceneTexture(m_ViewportWidth, m_ViewportHeight);
 
-    // Camera Movement
-    glm::vec3 translation(0.0f);
-    if (FInput::IsKeyDown(GLFW_KEY_W))
+    // The path buffers are only needed when the wavefront pipeline is used
+    if (m_bUseWavefront)
     {
-        translation.z = CameraSpeed * deltaTime;
+        m_pWavefrontPipeline->Resize(m_pSceneTexture->GetWidth(), m_pSceneTexture->GetHeight());
     }
-    else if (FInput::IsKeyDown(GLFW_KEY_S))
+
+    // Use the reloaded shaders once they are done compiling, until then the old ones are used
+    if (m_ShaderReload.valid() && m_ShaderReload.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
     {
-        translation.z = -CameraSpeed * deltaTime;
+        if (m_ShaderReload.get())
+        {
+            SwapShaders();
+        }
     }
 
-    if (FInput::IsKeyDown(GLFW_KEY_A))
+    // Upload new meshes if the scene changed
+    if (m_bRebuildMeshes)
     {
-        translation.x = CameraSpeed * deltaTime;
+        CreateMeshBuffers();
     }
-    else if (FInput::IsKeyDown(GLFW_KEY_D))
+
+    // There is no input when running headless
+    if (!IsHeadless())
     {
-        translation.x = -CameraSpeed * deltaTime;
-    }
+        // Camera movement
+        glm::vec3 translation(0.0f);
+        if (FInput::IsKeyDown(GLFW_KEY_W))
+        {
+            translation.z = CameraSpeed * deltaTime;
+        }
+        else if (FInput::IsKeyDown(GLFW_KEY_S))
+        {
+            translation.z = -CameraSpeed * deltaTime;
+        }
 
-    m_pScene->m_Camera.Move(translation);
+        if (FInput::IsKeyDown(GLFW_KEY_A))
+        {
+            translation.x = CameraSpeed * deltaTime;
+        }
+        else if (FInput::IsKeyDown(GLFW_KEY_D))
+        {
+            translation.x = -CameraSpeed * deltaTime;
+        }
 
-    // Camera rotation
-    constexpr float CameraRotationSpeed = glm::pi<float>() / 2;
+        m_pScene->m_Camera.Move(translation);
 
-    glm::vec3 rotation(0.0f);
-    if (FInput::IsKeyDown(GLFW_KEY_LEFT))
-    {
-        rotation.y = -CameraRotationSpeed * deltaTime;
-    }
-    else if (FInput::IsKeyDown(GLFW_KEY_RIGHT))
-    {
-        rotation.y = CameraRotationSpeed * deltaTime;
-    }
+        // Camera rotation
+        constexpr float CameraRotationSpeed = glm::pi<float>() / 2;
 
-    if (FInput::IsKeyDown(GLFW_KEY_UP))
-    {
-        rotation.x = -CameraRotationSpeed * deltaTime;
-    }
-    else if (FInput::IsKeyDown(GLFW_KEY_DOWN))
-    {
-        rotation.x = CameraRotationSpeed * deltaTime;
-    }
+        glm::vec3 rotation(0.0f);
+        if (FInput::IsKeyDown(GLFW_KEY_LEFT))
+        {
+            rotation.y = -CameraRotationSpeed * deltaTime;
+        }
+        else if (FInput::IsKeyDown(GLFW_KEY_RIGHT))
+        {
+            rotation.y = CameraRotationSpeed * deltaTime;
+        }
+
+        if (FInput::IsKeyDown(GLFW_KEY_UP))
+        {
+            rotation.x = -CameraRotationSpeed * deltaTime;
+        }
+        else if (FInput::IsKeyDown(GLFW_KEY_DOWN))
+        {
+            rotation.x = CameraRotationSpeed * deltaTime;
+        }
+
+        m_pScene->m_Camera.Rotate(rotation);
 
-    m_pScene->m_Camera.Rotate(rotation);
+        // Check if we moved and then we reset the image
+        if (glm::length(rotation) > 0.0f || glm::length(translation) > 0.0f)
+        {
+            m_bResetImage = true;
+        }
+
+        // Reload shaders
+        if (FInput::IsKeyDown(GLFW_KEY_R))
+        {
+            m_bReloadShaders = true;
+        }
+    }
 
-    // Check if we moved and then we reset the image
-    if (glm::length(rotation) > 0.0f || glm::length(translation) > 0.0f)
+    // Only the files that the shaders use trigger a reload, the shaders that did not change come from the cache
+    m_ShaderWatchTimer += deltaTime;
+    if (m_pShaderWatcher && m_ShaderWatchTimer >= SHADER_WATCH_INTERVAL)
     {
-        m_bResetImage = true;
+        m_ShaderWatchTimer = 0.0f;
+
+        std::vector<std::string> changedFiles;
+        m_pShaderWatcher->Poll(changedFiles);
+        for (const std::string& filepath : changedFiles)
+        {
+            if (m_pShaderCompiler->IsDependency(filepath.c_str()))
+            {
+                std::cout << "Shader file '" << filepath << "' changed\n";
+                m_bReloadShaders = true;
+            }
+        }
     }
 
-    // Reload shaders
-    if (FInput::IsKeyDown(GLFW_KEY_R))
+    // A change during a reload starts another one when the current one is done
+    if (m_bReloadShaders && !m_ShaderReload.valid())
     {
+        m_bReloadShaders = false;
         ReloadShader();
     }
 
+    // The film is the whole image, which is larger than the traced image when rendering tiles
+    const uint32_t filmWidth  = m_pTileWriter ? m_FilmWidth  : m_ImageWidth;
+    const uint32_t filmHeight = m_pTileWriter ? m_FilmHeight : m_ImageHeight;
+
     // Update
-    m_pScene->m_Camera.Update(90.0f, m_pSceneTexture->GetWidth(), m_pSceneTexture->GetHeight(), 0.1f, 100.0f);
+    m_pScene->m_Camera.Update(90.0f, filmWidth, filmHeight, 0.1f, 100.0f);
 
     // Draw
-    uint32_t frameIndex = m_pSwapchain->GetCurrentBackBufferIndex();
-    FQuery*         pCurrentTimestampQuery = m_TimestampQueries[frameIndex];
-    FCommandBuffer* pCurrentCommandBuffer  = m_CommandBuffers[frameIndex];
+    // The frames are used in order, so that the frame that is waited on is always the oldest one in flight
+    const uint32_t frameIndex = m_FrameIndex % NUM_FRAMES_IN_FLIGHT;
+    m_FrameIndex++;
+
+    FFrameResources& currentFrame           = m_Frames[frameIndex];
+    FQuery*          pCurrentTimestampQuery = currentFrame.pTimestampQuery;
+    FCommandBuffer*  pCurrentCommandBuffer  = currentFrame.pCommandBuffer;
 
     // Begin CommandBuffer
     pCurrentCommandBuffer->Reset();
+    if (currentFrame.pGraphicsCommandBuffer)
+    {
+        currentFrame.pGraphicsCommandBuffer->Reset();
+    }
+
+    // Release the memory that the GPU is done with
+    m_pDeviceAllocator->EmptyGarbageMemory();
 
     constexpr uint32_t timestampCount = 2;
     uint64_t timestamps[timestampCount];
@@ -357,19 +671,37 @@ void FRayTracer::Tick(float deltaTime)
     const double gpuTimingMS     = gpuTiming / 1000000.0;
     m_LastGPUTime = static_cast<float>(gpuTimingMS);
 
+    // The timestamps belong to the last time this frame was used
+    if (m_bAutoSamplesPerDispatch && currentFrame.SamplesPerDispatch > 0 && m_LastGPUTime > 0.0f)
+    {
+        UpdateSamplesPerDispatch(m_LastGPUTime / float(currentFrame.SamplesPerDispatch));
+    }
+
     pCurrentCommandBuffer->Begin();
     pCurrentCommandBuffer->WriteTimestamp(pCurrentTimestampQuery, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
 
-    pCurrentCommandBuffer->TransitionImage(m_pSceneTexture->GetImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-    pCurrentCommandBuffer->TransitionImage(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-
+    // The targets stay in the general layout and are only used by the compute queue, the previous frame can still
+    // be copying the scene texture
+    constexpr VkPipelineStageFlags targetStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
     if (m_bResetImage)
     {
+        // The reset discards the targets while the previous frame can still be tracing into them or copying the scene
+        // texture, so the transition waits for those writes and reads to finish first
+        pCurrentCommandBuffer->PipelineBarrier(targetStages, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, targetStages, 0);
+
+        // The contents are discarded, which is also how the targets get out of the undefined layout after a resize
+        FTexture* targets[] = { m_pSceneTexture, m_pAccumulationTexture, m_pSecondMomentTexture };
+        for (FTexture* pTarget : targets)
+        {
+            pCurrentCommandBuffer->ImageBarrier(pTarget->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, targetStages, 0, targetStages, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+
+        // The alpha of the accumulation is the number of samples in the pixel
         VkClearColorValue clearColor = {};
         clearColor.float32[0] = 0.0f;
         clearColor.float32[1] = 0.0f;
         clearColor.float32[2] = 0.0f;
-        clearColor.float32[3] = 1.0f;
+        clearColor.float32[3] = 0.0f;
 
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -379,15 +711,27 @@ void FRayTracer::Tick(float deltaTime)
         subresourceRange.levelCount     = 1;
 
         pCurrentCommandBuffer->ClearColorImage(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresourceRange);
+        pCurrentCommandBuffer->ClearColorImage(m_pSecondMomentTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresourceRange);
+        pCurrentCommandBuffer->PipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
 
         m_bResetImage = false;
-        m_NumSamples  = 1;
+        m_NumSamples  = 0;
     }
     else
     {
-        m_NumSamples++;
+        pCurrentCommandBuffer->PipelineBarrier(targetStages, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
     }
 
+    // Do not trace more samples than requested, nothing is traced once the image has all of them
+    uint32_t samplesPerDispatch = static_cast<uint32_t>(m_SamplesPerDispatch);
+    if (m_MaxSamples > 0)
+    {
+        samplesPerDispatch = (m_NumSamples < m_MaxSamples) ? std::min(samplesPerDispatch, m_MaxSamples - m_NumSamples) : 0;
+    }
+
+    m_NumSamples += samplesPerDispatch;
+    currentFrame.SamplesPerDispatch = samplesPerDispatch;
+
     // Update FCameraBuffer
     FCameraBuffer cameraBuffer = {};
     cameraBuffer.Projection = m_pScene->m_Camera.GetProjectionMatrix();
@@ -395,19 +739,31 @@ void FRayTracer::Tick(float deltaTime)
     cameraBuffer.Position   = glm::vec4(m_pScene->m_Camera.GetPosition(), 0.0f);
     cameraBuffer.Forward    = glm::vec4(m_pScene->m_Camera.GetForward(), 0.0f);
 
-    pCurrentCommandBuffer->UpdateBuffer(m_pCameraBuffer, 0, sizeof(FCameraBuffer), &cameraBuffer);
-
-    // Update RandomBuffer
-    constexpr uint32_t maxSamples = 16;
-    static uint32_t randFrameIndex = 0;
-    randFrameIndex++;
- 
-    FRandomBuffer randomBuffer = {};
-    randomBuffer.FrameIndex  = randFrameIndex;
-    randomBuffer.SampleIndex = randFrameIndex % maxSamples;
-    randomBuffer.NumSamples  = m_NumSamples;
+    // The film is aligned to the thread group size, this matches the dispatch when not rendering tiles
+    cameraBuffer.Film.x = m_pTileWriter ? int32_t((m_CurrentTile % m_NumTilesX) * m_TileSize) : 0;
+    cameraBuffer.Film.y = m_pTileWriter ? int32_t((m_CurrentTile / m_NumTilesX) * m_TileSize) : 0;
+    cameraBuffer.Film.z = int32_t(Math::AlignUp(filmWidth,  NUM_THREADS));
+    cameraBuffer.Film.w = int32_t(Math::AlignUp(filmHeight, NUM_THREADS));
+    cameraBuffer.Image  = glm::ivec4(int32_t(m_ImageWidth), int32_t(m_ImageHeight), 0, 0);
+
+    // Update FrameConstants, the sample index of each pixel is the number of samples in its accumulation
+    FFrameConstants frameConstants = {};
+    frameConstants.NumSamples         = m_NumSamples;
+    frameConstants.SamplesPerDispatch = samplesPerDispatch;
+
+    // Rebuild the BVH if any of the primitives changed
+    bool bBVHChanged = m_bRebuildBVH;
+    if (m_bRebuildBVH)
+    {
+        BuildBVH();
+    }
 
-    pCurrentCommandBuffer->UpdateBuffer(m_pRandomBuffer, 0, sizeof(FRandomBuffer), &randomBuffer);
+    // The lights depend on the primitives and their materials
+    bool bLightsChanged = bBVHChanged || !m_pScene->m_DirtyQuads.IsEmpty() || !m_pScene->m_DirtySpheres.IsEmpty() || !m_pScene->m_DirtyMaterials.IsEmpty();
+    if (bLightsChanged)
+    {
+        m_pScene->GetLights(m_Lights);
+    }
 
     // Update Scene
     FSceneBuffer sceneBuffer = {};
@@ -417,42 +773,166 @@ void FRayTracer::Tick(float deltaTime)
     sceneBuffer.NumMaterials   = m_pScene->m_Materials.size();
     sceneBuffer.BackgroundType = m_pScene->m_Settings.BackgroundType;
     sceneBuffer.Exposure       = m_pScene->m_Settings.Exposure;
+    sceneBuffer.NumBVHNodes    = static_cast<uint32_t>(m_BVH.GetNodes().size());
+    sceneBuffer.NumLights      = static_cast<uint32_t>(m_Lights.size());
+    sceneBuffer.MinBounces     = static_cast<uint32_t>(m_MinBounces);
+    sceneBuffer.MaxBounces     = static_cast<uint32_t>(m_MaxBounces);
 
-    pCurrentCommandBuffer->UpdateBuffer(m_pSceneBuffer, 0, sizeof(FSceneBuffer), &sceneBuffer);
-    
-    if (!m_pScene->m_Quads.empty())
+    sceneBuffer.AdaptiveMinSamples = static_cast<uint32_t>(m_AdaptiveMinSamples);
+    sceneBuffer.AdaptiveThreshold  = m_AdaptiveThreshold;
+    sceneBuffer.DisplayMode        = static_cast<uint32_t>(m_DisplayMode);
+
+    // New buffers have none of the old content so everything is uploaded again
+    if (GrowSceneBuffers())
     {
-        pCurrentCommandBuffer->UpdateBuffer(m_pQuadBuffer, 0, sizeof(FQuad) * m_pScene->m_Quads.size(), m_pScene->m_Quads.data());
+        m_pScene->MarkAllDirty();
+        bBVHChanged    = true;
+        bLightsChanged = true;
     }
-    if (!m_pScene->m_Spheres.empty())
+
+    // Upload what changed through the ring, the copies are recorded together with a single barrier before the dispatch.
+    // The scene buffers are shared by all frames so a change only has to be uploaded once.
+    m_pUploadRing->BeginFrame(frameIndex);
+    if (m_bUploadConstants || memcmp(&cameraBuffer, &m_CameraBuffer, sizeof(FCameraBuffer)) != 0)
     {
-        pCurrentCommandBuffer->UpdateBuffer(m_pSphereBuffer, 0, sizeof(FSphere) * m_pScene->m_Spheres.size(), m_pScene->m_Spheres.data());
+        m_pUploadRing->Upload(m_pCameraBuffer, 0, &cameraBuffer, sizeof(FCameraBuffer));
+        m_CameraBuffer = cameraBuffer;
     }
-    if (!m_pScene->m_Planes.empty())
+    if (m_bUploadConstants || memcmp(&sceneBuffer, &m_SceneBuffer, sizeof(FSceneBuffer)) != 0)
     {
-        pCurrentCommandBuffer->UpdateBuffer(m_pPlaneBuffer, 0, sizeof(FPlane) * m_pScene->m_Planes.size(), m_pScene->m_Planes.data());
+        m_pUploadRing->Upload(m_pSceneBuffer, 0, &sceneBuffer, sizeof(FSceneBuffer));
+        m_SceneBuffer = sceneBuffer;
     }
-    if (!m_pScene->m_Materials.empty())
+
+    m_bUploadConstants = false;
+
+    UploadDirtyRanges(m_pUploadRing, m_pQuadBuffer, m_pScene->m_Quads, m_pScene->m_DirtyQuads);
+    UploadDirtyRanges(m_pUploadRing, m_pSphereBuffer, m_pScene->m_Spheres, m_pScene->m_DirtySpheres);
+    UploadDirtyRanges(m_pUploadRing, m_pPlaneBuffer, m_pScene->m_Planes, m_pScene->m_DirtyPlanes);
+    UploadDirtyRanges(m_pUploadRing, m_pMaterialBuffer, m_pScene->m_Materials, m_pScene->m_DirtyMaterials);
+    if (bBVHChanged)
+    {
+        m_pUploadRing->Upload(m_pBVHNodeBuffer, 0, m_BVH.GetNodes().data(), sizeof(FBVHNode) * m_BVH.GetNodes().size());
+        m_pUploadRing->Upload(m_pBVHPrimitiveBuffer, 0, m_BVHPrimitives.data(), sizeof(uint32_t) * m_BVHPrimitives.size());
+    }
+    if (bLightsChanged)
     {
-        pCurrentCommandBuffer->UpdateBuffer(m_pMaterialBuffer, 0, sizeof(FMaterial) * m_pScene->m_Materials.size(), m_pScene->m_Materials.data());
+        m_pUploadRing->Upload(m_pLightBuffer, 0, m_Lights.data(), sizeof(FLight) * m_Lights.size());
     }
 
-    // Bind pipeline and descriptorSet
-    pCurrentCommandBuffer->BindComputePipelineState(m_pPipeline.load());
-    pCurrentCommandBuffer->BindComputeDescriptorSet(m_pPipelineLayout, m_pDescriptorSet);
+    m_pUploadRing->Flush(pCurrentCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT);
 
-    // Dispatch
-    const uint32_t Threads = 16;
-    VkExtent2D dispatchSize = { Math::AlignUp(m_pSceneTexture->GetWidth(), Threads) / Threads, Math::AlignUp(m_pSceneTexture->GetHeight(), Threads) / Threads };
-    pCurrentCommandBuffer->Dispatch(dispatchSize.width, dispatchSize.height, 1);
+    // The display texture is still updated below so that the UI keeps showing the finished image
+    if (samplesPerDispatch > 0)
+    {
+        if (m_bUseWavefront)
+        {
+            pCurrentCommandBuffer->PushConstants(m_pWavefrontPipeline->GetPipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(FFrameConstants), &frameConstants);
+            m_pWavefrontPipeline->Dispatch(pCurrentCommandBuffer, m_pDescriptorSet, m_ImageWidth, m_ImageHeight, static_cast<uint32_t>(m_MaxBounces), samplesPerDispatch);
+        }
+        else
+        {
+            // Bind pipeline and descriptorSet
+            pCurrentCommandBuffer->BindComputePipelineState(m_pPipeline);
+            pCurrentCommandBuffer->BindComputeDescriptorSet(m_pPipelineLayout, m_pDescriptorSet);
+            pCurrentCommandBuffer->PushConstants(m_pPipelineLayout, VK_SHADER_STAGE_ALL, 0, sizeof(FFrameConstants), &frameConstants);
+
+            // Dispatch, only the image is traced and not the rest of the render targets
+            VkExtent2D dispatchSize = { Math::AlignUp(m_ImageWidth, NUM_THREADS) / NUM_THREADS, Math::AlignUp(m_ImageHeight, NUM_THREADS) / NUM_THREADS };
+            pCurrentCommandBuffer->Dispatch(dispatchSize.width, dispatchSize.height, 1);
+        }
+    }
 
-    pCurrentCommandBuffer->TransitionImage(m_pSceneTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    pCurrentCommandBuffer->TransitionImage(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // Copy the result into the display texture of this frame and hand it to the graphics queue. The ownership is only
+    // transferred when the queues are in different families.
+    const bool     bTransferOwnership = m_pDevice->GetQueueFamilyIndex(ECommandQueueType::Compute) != m_pDevice->GetQueueFamilyIndex(ECommandQueueType::Graphics);
+    const uint32_t srcQueueFamily     = bTransferOwnership ? m_pDevice->GetQueueFamilyIndex(ECommandQueueType::Compute) : VK_QUEUE_FAMILY_IGNORED;
+    const uint32_t dstQueueFamily     = bTransferOwnership ? m_pDevice->GetQueueFamilyIndex(ECommandQueueType::Graphics) : VK_QUEUE_FAMILY_IGNORED;
+    if (currentFrame.pDisplayTexture)
+    {
+        FTexture* pDisplayTexture = currentFrame.pDisplayTexture;
+
+        // The UI is done with the display texture when the graphics timeline has reached the value of the frame, the
+        // old contents are discarded so the ownership does not have to be transferred back
+        pCurrentCommandBuffer->PipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        pCurrentCommandBuffer->ImageBarrier(pDisplayTexture->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+        VkImageCopy region = {};
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.layerCount = 1;
+        region.extent.width              = m_ImageWidth;
+        region.extent.height             = m_ImageHeight;
+        region.extent.depth              = 1;
+        pCurrentCommandBuffer->CopyImage(m_pSceneTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, pDisplayTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // Release, the timeline wait makes the copy visible to the graphics queue
+        pCurrentCommandBuffer->ImageBarrier(pDisplayTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, srcQueueFamily, dstQueueFamily);
+
+        currentFrame.DisplayWidth  = m_ImageWidth;
+        currentFrame.DisplayHeight = m_ImageHeight;
+    }
 
     pCurrentCommandBuffer->WriteTimestamp(pCurrentTimestampQuery, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
     pCurrentCommandBuffer->End();
 
-    m_pDevice->ExecuteGraphics(pCurrentCommandBuffer, nullptr, nullptr);
+    // Only the shaders sample the uploaded textures, the reset and the copies do not have to wait for them
+    FSubmitParams computeSubmitParams;
+    computeSubmitParams.UploadWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    if (IsHeadless())
+    {
+        m_pDevice->Execute(ECommandQueueType::Compute, pCurrentCommandBuffer, computeSubmitParams);
+        m_CurrentFrame = frameIndex;
+        return;
+    }
+
+    // The copy into the display texture waits for the UI of the last frame that used it, the value is zero before the
+    // first time that the frame is used
+    FTimelineWait computeWait;
+    computeWait.QueueType = ECommandQueueType::Graphics;
+    computeWait.Value     = currentFrame.GraphicsValue;
+    computeWait.Stage     = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    computeSubmitParams.NumTimelineWaits = 1;
+    computeSubmitParams.pTimelineWaits   = &computeWait;
+
+    currentFrame.ComputeValue = m_pDevice->Execute(ECommandQueueType::Compute, pCurrentCommandBuffer, computeSubmitParams);
+
+    // Acquire the display texture on the graphics queue, the UI is submitted after this and samples it. Without the
+    // ownership transfer the layout transition has already been done by the compute queue.
+    FCommandBuffer* pGraphicsCommandBuffer = currentFrame.pGraphicsCommandBuffer;
+    pGraphicsCommandBuffer->Begin();
+
+    if (bTransferOwnership)
+    {
+        pGraphicsCommandBuffer->ImageBarrier(currentFrame.pDisplayTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, srcQueueFamily, dstQueueFamily);
+    }
+
+    pGraphicsCommandBuffer->End();
+
+    FTimelineWait graphicsWait;
+    graphicsWait.QueueType = ECommandQueueType::Compute;
+    graphicsWait.Value     = currentFrame.ComputeValue;
+    graphicsWait.Stage     = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    // The acquire does not use any uploaded textures, the UI waits for them when it is submitted
+    FSubmitParams graphicsSubmitParams;
+    graphicsSubmitParams.NumTimelineWaits = 1;
+    graphicsSubmitParams.pTimelineWaits   = &graphicsWait;
+    graphicsSubmitParams.UploadWaitStage  = 0;
+
+    const uint64_t graphicsValue = m_pDevice->Execute(ECommandQueueType::Graphics, pGraphicsCommandBuffer, graphicsSubmitParams);
+
+    // The UI of the previous frame was submitted before this, so when the graphics timeline reaches this value it is done
+    // with the display texture of the previous frame
+    if (m_CurrentFrame != UINT32_MAX)
+    {
+        m_Frames[m_CurrentFrame].GraphicsValue = graphicsValue;
+    }
+
+    m_CurrentFrame = frameIndex;
 }
 
 void FRayTracer::OnRenderUI()
@@ -509,8 +989,23 @@ void FRayTracer::OnRenderUI()
 
         ImGui::Text("CPU Time %.4f", m_LastCPUTime);
         ImGui::Text("GPU Time %.4f", m_LastGPUTime);
+        ImGui::Text("Uploaded %.2f KB", float(m_pUploadRing->GetNumBytesUploaded()) / 1024.0f);
         
-        ImGui::Text("Current Resolution: %dx%d", m_ViewportWidth, m_ViewportHeight);
+        ImGui::Text("Current Resolution: %dx%d", m_ImageWidth, m_ImageHeight);
+        ImGui::Text("Render Targets: %dx%d", m_pSceneTexture->GetWidth(), m_pSceneTexture->GetHeight());
+        ImGui::Text("Samples: %d", m_NumSamples);
+
+        // Samples per dispatch
+        ImGui::Checkbox("Auto Samples Per Dispatch", &m_bAutoSamplesPerDispatch);
+        if (m_bAutoSamplesPerDispatch)
+        {
+            ImGui::DragFloat("Target Frame Time (ms)", &m_TargetFrameTime, 0.1f, 1.0f, 1000.0f, "%.1f", ImGuiSliderFlags_AlwaysClamp);
+            ImGui::Text("Samples Per Dispatch: %d", m_SamplesPerDispatch);
+        }
+        else
+        {
+            ImGui::DragInt("Samples Per Dispatch", &m_SamplesPerDispatch, 0.1f, 1, MAX_SAMPLES_PER_DISPATCH, "%d", ImGuiSliderFlags_AlwaysClamp);
+        }
 
         ImGui::NewLine();
 
@@ -523,6 +1018,52 @@ void FRayTracer::OnRenderUI()
             m_bResetImage = true;
         }
 
+        // Pipeline selector
+        if (m_pWavefrontPipeline)
+        {
+            const char* pipelines[] =
+            {
+                "Megakernel",
+                "Wavefront",
+            };
+
+            int currentPipeline = m_bUseWavefront ? 1 : 0;
+            if (ImGui::Combo("Pipeline", &currentPipeline, pipelines, IM_ARRAYSIZE(pipelines)))
+            {
+                m_bUseWavefront = (currentPipeline == 1);
+                m_MaxBounces    = std::min(m_MaxBounces, GetBounceLimit());
+                m_MinBounces    = std::min(m_MinBounces, m_MaxBounces);
+                m_bResetImage   = true;
+            }
+        }
+
+        // Path termination
+        if (ImGui::DragInt("Min Bounces", &m_MinBounces, 0.1f, 0, m_MaxBounces, "%d", ImGuiSliderFlags_AlwaysClamp))
+        {
+            m_bResetImage = true;
+        }
+        if (ImGui::DragInt("Max Bounces", &m_MaxBounces, 0.1f, 1, GetBounceLimit(), "%d", ImGuiSliderFlags_AlwaysClamp))
+        {
+            m_MinBounces  = std::min(m_MinBounces, m_MaxBounces);
+            m_bResetImage = true;
+        }
+
+        // Adaptive sampling, changing the threshold does not need a reset since the pixels keep their samples
+        ImGui::DragFloat("Adaptive Threshold", &m_AdaptiveThreshold, 0.001f, 0.0f, 1.0f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+        ImGui::DragInt("Adaptive Min Samples", &m_AdaptiveMinSamples, 0.1f, 2, 4096, "%d", ImGuiSliderFlags_AlwaysClamp);
+
+        // Display mode
+        {
+            const char* displayModes[] =
+            {
+                "Image",
+                "Noise",
+                "Samples",
+            };
+
+            ImGui::Combo("View", &m_DisplayMode, displayModes, IM_ARRAYSIZE(displayModes));
+        }
+
         ImGui::NewLine();
 
         ImGui::Text("Scene:");
@@ -534,6 +1075,7 @@ void FRayTracer::OnRenderUI()
             {
                 "Spheres",
                 "CornellBox",
+                "VikingRoom",
             };
 
             static int currentScene = 0;
@@ -548,7 +1090,10 @@ void FRayTracer::OnRenderUI()
                     SAFE_DELETE(m_pScene);
                     m_pScene = new FSphereScene();
                     m_pScene->Initialize();
-                    m_bResetImage = true;
+                    m_pScene->MarkAllDirty();
+                    m_bResetImage    = true;
+                    m_bRebuildBVH    = true;
+                    m_bRebuildMeshes = true;
                 }
 
                 // Change to CornellBox-scene
@@ -557,7 +1102,22 @@ void FRayTracer::OnRenderUI()
                     SAFE_DELETE(m_pScene);
                     m_pScene = new FCornellBoxScene();
                     m_pScene->Initialize();
-                    m_bResetImage = true;
+                    m_pScene->MarkAllDirty();
+                    m_bResetImage    = true;
+                    m_bRebuildBVH    = true;
+                    m_bRebuildMeshes = true;
+                }
+
+                // Change to VikingRoom-scene
+                if (currentScene == 2)
+                {
+                    SAFE_DELETE(m_pScene);
+                    m_pScene = new FVikingRoomScene();
+                    m_pScene->Initialize();
+                    m_pScene->MarkAllDirty();
+                    m_bResetImage    = true;
+                    m_bRebuildBVH    = true;
+                    m_bRebuildMeshes = true;
                 }
 
                 prevScene = currentScene;
@@ -615,50 +1175,47 @@ void FRayTracer::OnRenderUI()
         ImGui::Separator();
 
         uint32_t imguiID = 0;
+        for (uint32_t index = 0; index < m_pScene->m_Spheres.size(); index++)
         {
-            uint32_t index = 1;
-            for (FSphere& sphere : m_pScene->m_Spheres)
-            {
-                ImGui::PushID(imguiID++);
+            FSphere& sphere = m_pScene->m_Spheres[index];
+            ImGui::PushID(imguiID++);
 
-                ImGui::Text("Sphere %d", index++);
-                if (ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f))
-                {
-                    m_bResetImage = true;
-                }
-                if (ImGui::DragFloat("Radius", &sphere.Radius, 0.01f))
-                {
-                    m_bResetImage = true;
-                }
+            ImGui::Text("Sphere %d", index + 1);
 
-                ImGui::PopID();
-                ImGui::Separator();
+            bool bChanged = false;
+            bChanged |= ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
+            bChanged |= ImGui::DragFloat("Radius", &sphere.Radius, 0.01f);
+            if (bChanged)
+            {
+                m_pScene->m_DirtySpheres.Add(index);
+                m_bResetImage = true;
+                m_bRebuildBVH = true;
             }
+
+            ImGui::PopID();
+            ImGui::Separator();
         }
 
+        for (uint32_t index = 0; index < m_pScene->m_Quads.size(); index++)
         {
-            uint32_t index = 1;
-            for (FQuad& quad : m_pScene->m_Quads)
-            {
-                ImGui::PushID(imguiID++);
+            FQuad& quad = m_pScene->m_Quads[index];
+            ImGui::PushID(imguiID++);
 
-                ImGui::Text("Quad %d", index++);
-                if (ImGui::DragFloat3("Position", glm::value_ptr(quad.Position), 0.1f))
-                {
-                    m_bResetImage = true;
-                }
-                if (ImGui::DragFloat3("Edge0", glm::value_ptr(quad.Edge0), 0.1f))
-                {
-                    m_bResetImage = true;
-                }
-                if (ImGui::DragFloat3("Edge1", glm::value_ptr(quad.Edge1), 0.1f))
-                {
-                    m_bResetImage = true;
-                }
+            ImGui::Text("Quad %d", index + 1);
 
-                ImGui::PopID();
-                ImGui::Separator();
+            bool bChanged = false;
+            bChanged |= ImGui::DragFloat3("Position", glm::value_ptr(quad.Position), 0.1f);
+            bChanged |= ImGui::DragFloat3("Edge0", glm::value_ptr(quad.Edge0), 0.1f);
+            bChanged |= ImGui::DragFloat3("Edge1", glm::value_ptr(quad.Edge1), 0.1f);
+            if (bChanged)
+            {
+                m_pScene->m_DirtyQuads.Add(index);
+                m_bResetImage = true;
+                m_bRebuildBVH = true;
             }
+
+            ImGui::PopID();
+            ImGui::Separator();
         }
 
         ImGui::NewLine();
@@ -676,59 +1233,45 @@ void FRayTracer::OnRenderUI()
                 "Dielectric",
             };
 
-            uint32_t index = 1;
-            for (FMaterial& material : m_pScene->m_Materials)
+            for (uint32_t index = 0; index < m_pScene->m_Materials.size(); index++)
             {
+                FMaterial& material = m_pScene->m_Materials[index];
                 ImGui::PushID(imguiID++);
-                ImGui::Text("Material %d", index++);
+                ImGui::Text("Material %d", index + 1);
                 
+                bool bChanged = false;
+
                 int materialType = material.Type;
                 if (ImGui::Combo("Material Type", &materialType, materialTypes, IM_ARRAYSIZE(materialTypes)))
                 {
                     material.Type = materialType;
-                    m_bResetImage = true;
+                    bChanged      = true;
                 }
 
                 if (material.Type == MATERIAL_LAMBERTIAN)
                 {
-                    if (ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo)))
-                    {
-                        m_bResetImage = true;
-                    }
+                    bChanged |= ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
                 }
                 else if (material.Type == MATERIAL_METAL)
                 {
-                    if (ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo)))
-                    {
-                        m_bResetImage = true;
-                    }
-
-                    if (ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp))
-                    {
-                        m_bResetImage = true;
-                    }
+                    bChanged |= ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
+                    bChanged |= ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
                 }
                 else if (material.Type == MATERIAL_EMISSIVE)
                 {
-                    if (ImGui::ColorEdit3("Emissive", glm::value_ptr(material.Emissive)))
-                    {
-                        m_bResetImage = true;
-                    }
+                    bChanged |= ImGui::ColorEdit3("Emissive", glm::value_ptr(material.Emissive));
                 }
                 else if (material.Type == MATERIAL_DIELECTRIC)
                 {
-                    if (ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo)))
-                    {
-                        m_bResetImage = true;
-                    }
-                    if (ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp))
-                    {
-                        m_bResetImage = true;
-                    }
-                    if (ImGui::DragFloat("RefractionIndex", &material.RefractionIndex, 0.01f, 0.0f, 10.0f, "%.2f"))
-                    {
-                        m_bResetImage = true;
-                    }
+                    bChanged |= ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
+                    bChanged |= ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+                    bChanged |= ImGui::DragFloat("RefractionIndex", &material.RefractionIndex, 0.01f, 0.0f, 10.0f, "%.2f");
+                }
+
+                if (bChanged)
+                {
+                    m_pScene->m_DirtyMaterials.Add(index);
+                    m_bResetImage = true;
                 }
 
                 ImGui::PopID();
@@ -745,9 +1288,14 @@ void FRayTracer::OnRenderUI()
     m_ViewportWidth  = ImGui::GetContentRegionAvail().x;
     m_ViewportHeight = ImGui::GetContentRegionAvail().y;
 
-    if (m_pSceneTexture)
+    // The display texture of the frame that was submitted last, it is acquired by the graphics queue before the UI
+    if (m_CurrentFrame != UINT32_MAX)
     {
-        ImGui::Image(m_pSceneTextureDescriptorSet, { (float)m_pSceneTexture->GetWidth(), (float)m_pSceneTexture->GetHeight() });
+        // Only the part of the display texture that the image was copied to is shown
+        const FFrameResources& currentFrame = m_Frames[m_CurrentFrame];
+        const ImVec2 imageSize = { (float)currentFrame.DisplayWidth, (float)currentFrame.DisplayHeight };
+        const ImVec2 maxUV     = { imageSize.x / (float)currentFrame.pDisplayTexture->GetWidth(), imageSize.y / (float)currentFrame.pDisplayTexture->GetHeight() };
+        ImGui::Image(currentFrame.pDisplayDescriptorSet, imageSize, { 0.0f, 0.0f }, maxUV);
     }
     
     ImGui::End();
@@ -755,81 +1303,291 @@ void FRayTracer::OnRenderUI()
 
 void FRayTracer::Release()
 {
-    FTextureResource::ReleaseLoader();
-    
-    for (auto& commandBuffer : m_CommandBuffers)
+    // The reload uses the device and the pipeline layouts
+    if (m_ShaderReload.valid())
     {
-        SAFE_DELETE(commandBuffer);
+        m_ShaderReload.wait();
     }
 
-    m_CommandBuffers.clear();
+    SAFE_DELETE(m_pNewPipeline);
+    SAFE_DELETE(m_pShaderWatcher);
+    SAFE_DELETE(m_pShaderCompiler);
 
-    for (auto& query : m_TimestampQueries)
+    FTextureResource::ReleaseLoader();
+    
+    for (FFrameResources& frame : m_Frames)
     {
-        SAFE_DELETE(query);
+        SAFE_DELETE(frame.pCommandBuffer);
+        SAFE_DELETE(frame.pGraphicsCommandBuffer);
+        SAFE_DELETE(frame.pTimestampQuery);
+        frame.SamplesPerDispatch = 0;
+        frame.ComputeValue       = 0;
+        frame.GraphicsValue      = 0;
     }
 
-    m_TimestampQueries.clear();
+    m_CurrentFrame = UINT32_MAX;
 
+    SAFE_DELETE(m_pUploadRing);
     SAFE_DELETE(m_pCameraBuffer);
-    SAFE_DELETE(m_pRandomBuffer);
     SAFE_DELETE(m_pSceneBuffer);
     SAFE_DELETE(m_pQuadBuffer);
     SAFE_DELETE(m_pSphereBuffer);
     SAFE_DELETE(m_pPlaneBuffer);
     SAFE_DELETE(m_pMaterialBuffer);
+    SAFE_DELETE(m_pBVHNodeBuffer);
+    SAFE_DELETE(m_pBVHPrimitiveBuffer);
+    SAFE_DELETE(m_pLightBuffer);
+    ReleaseMeshBuffers();
     
     SAFE_DELETE(m_pSkybox);
     SAFE_DELETE(m_pSkyboxSampler);
 
     ReleaseDescriptorSet();
 
-    SAFE_DELETE(m_pDescriptorPool);
+    SAFE_DELETE(m_pTileWriter);
+    SAFE_DELETE(m_pWavefrontPipeline);
     SAFE_DELETE(m_pPipeline);
     SAFE_DELETE(m_pPipelineLayout);
     SAFE_DELETE(m_pDescriptorSetLayout);
-    SAFE_DELETE(m_pDeviceAllocator);
     SAFE_DELETE(m_pAccumulationTexture);
     SAFE_DELETE(m_pAccumulationTextureView);
+    SAFE_DELETE(m_pSecondMomentTexture);
+    SAFE_DELETE(m_pSecondMomentTextureView);
     SAFE_DELETE(m_pSceneTexture);
     SAFE_DELETE(m_pSceneTextureView);
-    SAFE_DELETE(m_pSceneTextureDescriptorSet);
+    ReleaseDisplayTextures();
+
+    // All the resources must have returned their memory
+    SAFE_DELETE(m_pDeviceAllocator);
 }
 
 void FRayTracer::OnWindowResize(uint32_t width, uint32_t height)
 {
+    // When running headless there is no viewport-window that decides the size
+    if (IsHeadless())
+    {
+        m_ViewportWidth  = width;
+        m_ViewportHeight = height;
+    }
+}
+
+bool FRayTracer::SaveImage(const char* pFilePath)
+{
+    if (!m_pAccumulationTexture || m_NumSamples == 0)
+    {
+        std::cout << "[FRayTracer]: No image to save" << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec4> pixels;
+    if (!ReadbackImage(pixels))
+    {
+        return false;
+    }
+
+    const uint32_t width  = m_ImageWidth;
+    const uint32_t height = m_ImageHeight;
+
+    const bool bResult = ImageWriter::WriteImage(pFilePath, width, height, glm::value_ptr(pixels[0]), m_pScene->m_Settings.Exposure);
+    if (bResult)
+    {
+        std::cout << "[FRayTracer]: Saved image '" << pFilePath << "' (" << width << "x" << height << ", " << m_NumSamples << " samples)" << std::endl;
+    }
+
+    return bResult;
+}
+
+bool FRayTracer::ReadbackImage(std::vector<glm::vec4>& outPixels)
+{
+    // Only the image is read back, the rest of the accumulation texture is not traced
+    const uint32_t width  = m_ImageWidth;
+    const uint32_t height = m_ImageHeight;
+
+    FBufferParams bufferParams = {};
+    bufferParams.Usage            = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferParams.MemoryProperties = VK_CPU_BUFFER_USAGE;
+    bufferParams.Size             = VkDeviceSize(width) * VkDeviceSize(height) * sizeof(glm::vec4);
+
+    FBuffer* pReadbackBuffer = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!pReadbackBuffer)
+    {
+        return false;
+    }
+
+    FCommandBufferParams commandBufferParams = {};
+    commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferParams.QueueType = ECommandQueueType::Compute;
+
+    FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(m_pDevice, commandBufferParams);
+    if (!pCommandBuffer)
+    {
+        SAFE_DELETE(pReadbackBuffer);
+        return false;
+    }
+
+    pCommandBuffer->Reset();
+    pCommandBuffer->Begin();
+
+    // The accumulation texture is owned by the compute queue and stays in the general layout, the barrier waits for the
+    // frames that were submitted before
+    pCommandBuffer->ImageBarrier(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width           = width;
+    region.imageExtent.height          = height;
+    region.imageExtent.depth           = 1;
+
+    pCommandBuffer->CopyImageToBuffer(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pReadbackBuffer->GetBuffer(), 1, &region);
+    pCommandBuffer->ImageBarrier(m_pAccumulationTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    pCommandBuffer->End();
+
+    m_pDevice->Execute(ECommandQueueType::Compute, pCommandBuffer, FSubmitParams());
+    pCommandBuffer->WaitUntilFinished();
+
+    // The accumulation texture stores the sum of all samples and the number of samples in alpha, which differs per pixel
+    outPixels.resize(size_t(width) * size_t(height));
+    const glm::vec4* pMapped = reinterpret_cast<const glm::vec4*>(pReadbackBuffer->Map());
+
+    for (size_t i = 0; i < outPixels.size(); i++)
+    {
+        const float numPixelSamples = std::max(pMapped[i].a, 1.0f);
+        outPixels[i] = glm::vec4(glm::vec3(pMapped[i]) / numPixelSamples, 1.0f);
+    }
+
+    pReadbackBuffer->Unmap();
+
+    SAFE_DELETE(pCommandBuffer);
+    SAFE_DELETE(pReadbackBuffer);
+    return true;
+}
+
+bool FRayTracer::BeginTiledRender(const char* pFilePath, uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    assert(IsHeadless());
+
+    // Each tile is traced until it has all samples, so there has to be a limit
+    if (m_MaxSamples == 0 || tileSize == 0)
+    {
+        std::cout << "[FRayTracer]: Tiled rendering needs a sample count and a tile size" << std::endl;
+        return false;
+    }
+
+    SAFE_DELETE(m_pTileWriter);
+    m_pTileWriter = FTiledImageWriter::Create(pFilePath, width, height, m_pScene->m_Settings.Exposure);
+    if (!m_pTileWriter)
+    {
+        return false;
+    }
+
+    m_FilmWidth   = width;
+    m_FilmHeight  = height;
+    m_TileSize    = tileSize;
+    m_NumTilesX   = Math::AlignUp(width,  tileSize) / tileSize;
+    m_NumTilesY   = Math::AlignUp(height, tileSize) / tileSize;
+    m_CurrentTile = 0;
+
+    // The image only holds a single tile, the tiles at the edges are cropped when written
+    m_ViewportWidth  = std::min(tileSize, width);
+    m_ViewportHeight = std::min(tileSize, height);
+    m_bResetImage    = true;
+
+    std::cout << "[FRayTracer]: Rendering " << width << "x" << height << " in " << (m_NumTilesX * m_NumTilesY) << " tiles of " << m_ViewportWidth << "x" << m_ViewportHeight << std::endl;
+    return true;
+}
+
+bool FRayTracer::FinishTile()
+{
+    assert(m_pTileWriter != nullptr);
+
+    const uint32_t tileX = (m_CurrentTile % m_NumTilesX) * m_TileSize;
+    const uint32_t tileY = (m_CurrentTile / m_NumTilesX) * m_TileSize;
+
+    std::vector<glm::vec4> pixels;
+    bool bResult = ReadbackImage(pixels);
+    if (bResult)
+    {
+        const uint32_t width  = m_ImageWidth;
+        const uint32_t height = m_ImageHeight;
+        bResult = m_pTileWriter->WriteTile(tileX, tileY, width, height, glm::value_ptr(pixels[0]), width);
+    }
+
+    if (!bResult)
+    {
+        std::cout << "[FRayTracer]: Failed to write tile " << m_CurrentTile << std::endl;
+    }
+
+    const uint32_t numTiles = m_NumTilesX * m_NumTilesY;
+    m_CurrentTile++;
+
+    std::cout << "[FRayTracer]: Finished tile " << m_CurrentTile << "/" << numTiles << std::endl;
+    if (m_CurrentTile >= numTiles)
+    {
+        bResult = m_pTileWriter->Close() && bResult;
+    }
+
+    // Start the next tile from scratch
+    m_bResetImage = true;
+    return bResult;
 }
 
 void FRayTracer::CreateOrResizeSceneTexture(uint32_t width, uint32_t height)
 {
+    if ((m_pSceneTexture && m_ImageWidth == width && m_ImageHeight == height) || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    // The image is traced into the top left corner of the targets, which are rounded up to the next step
+    const uint32_t targetWidth  = Math::AlignUp(width,  RENDER_TARGET_ALIGNMENT);
+    const uint32_t targetHeight = Math::AlignUp(height, RENDER_TARGET_ALIGNMENT);
+
+    m_ViewportWidth  = m_ImageWidth  = width;
+    m_ViewportHeight = m_ImageHeight = height;
+
+    // When we have resized we need to clear the image as well
+    m_bResetImage = true;
+
     if (m_pSceneTexture)
     {
-        if ((m_pSceneTexture->GetWidth() == width && m_pSceneTexture->GetHeight() == height) || width == 0 || height == 0)
+        // Keep the targets while the image fits, unless it only uses a small part of them
+        const uint64_t oldArea = uint64_t(m_pSceneTexture->GetWidth()) * uint64_t(m_pSceneTexture->GetHeight());
+        const uint64_t newArea = uint64_t(targetWidth) * uint64_t(targetHeight);
+        if (width <= m_pSceneTexture->GetWidth() && height <= m_pSceneTexture->GetHeight() && newArea * 4 > oldArea)
         {
             return;
         }
 
-        m_pDevice->WaitForIdle();
+        // The frames in flight can still use the old objects
+        m_pDevice->DeferDelete(m_pAccumulationTexture);
+        m_pDevice->DeferDelete(m_pAccumulationTextureView);
+        m_pDevice->DeferDelete(m_pSecondMomentTexture);
+        m_pDevice->DeferDelete(m_pSecondMomentTextureView);
+        m_pDevice->DeferDelete(m_pSceneTexture);
+        m_pDevice->DeferDelete(m_pSceneTextureView);
+        DeferReleaseDescriptorSet();
 
-        SAFE_DELETE(m_pAccumulationTexture);
-        SAFE_DELETE(m_pAccumulationTextureView);
-        SAFE_DELETE(m_pSceneTexture);
-        SAFE_DELETE(m_pSceneTextureView);
-        SAFE_DELETE(m_pSceneTextureDescriptorSet);
-        ReleaseDescriptorSet();
+        for (FFrameResources& frame : m_Frames)
+        {
+            m_pDevice->DeferDelete(frame.pDisplayDescriptorSet);
+            m_pDevice->DeferDelete(frame.pDisplayTextureView);
+            m_pDevice->DeferDelete(frame.pDisplayTexture);
+        }
     }
 
     // Create texture for the viewport
     FTextureParams textureParams = {};
     textureParams.Format        = VK_FORMAT_R32G32B32A32_SFLOAT;
     textureParams.ImageType     = VK_IMAGE_TYPE_2D;
-    textureParams.Width         = m_ViewportWidth  = width;
-    textureParams.Height        = m_ViewportHeight = height;
-    textureParams.Usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    textureParams.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    textureParams.Width         = targetWidth;
+    textureParams.Height        = targetHeight;
+    textureParams.Usage         = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    textureParams.InitialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // Transitioned by the compute queue when the image is reset
 
     // Accumulation texture
-    m_pAccumulationTexture = FTexture::Create(m_pDevice, textureParams);
+    m_pAccumulationTexture = FTexture::Create(m_pDevice, textureParams, m_pDeviceAllocator);
     assert(m_pAccumulationTexture != nullptr);
     SetDebugName(m_pDevice->GetDevice(), "AccumulationTexture", reinterpret_cast<uint64_t>(m_pAccumulationTexture->GetImage()), VK_OBJECT_TYPE_IMAGE);
 
@@ -842,8 +1600,25 @@ void FRayTracer::CreateOrResizeSceneTexture(uint32_t width, uint32_t height)
         SetDebugName(m_pDevice->GetDevice(), "AccumulationTextureView", reinterpret_cast<uint64_t>(m_pAccumulationTextureView->GetImageView()), VK_OBJECT_TYPE_IMAGE_VIEW);
     }
 
+    // Second moment texture, only needs a single channel
+    {
+        FTextureParams secondMomentParams = textureParams;
+        secondMomentParams.Format = VK_FORMAT_R32_SFLOAT;
+
+        m_pSecondMomentTexture = FTexture::Create(m_pDevice, secondMomentParams, m_pDeviceAllocator);
+        assert(m_pSecondMomentTexture != nullptr);
+        SetDebugName(m_pDevice->GetDevice(), "SecondMomentTexture", reinterpret_cast<uint64_t>(m_pSecondMomentTexture->GetImage()), VK_OBJECT_TYPE_IMAGE);
+
+        FTextureViewParams textureViewParams = {};
+        textureViewParams.pTexture = m_pSecondMomentTexture;
+
+        m_pSecondMomentTextureView = FTextureView::Create(m_pDevice, textureViewParams);
+        assert(m_pSecondMomentTextureView != nullptr);
+        SetDebugName(m_pDevice->GetDevice(), "SecondMomentTextureView", reinterpret_cast<uint64_t>(m_pSecondMomentTextureView->GetImageView()), VK_OBJECT_TYPE_IMAGE_VIEW);
+    }
+
     // Scene texture
-    m_pSceneTexture = FTexture::Create(m_pDevice, textureParams);
+    m_pSceneTexture = FTexture::Create(m_pDevice, textureParams, m_pDeviceAllocator);
     assert(m_pSceneTexture != nullptr);
     SetDebugName(m_pDevice->GetDevice(), "SceneTexture", reinterpret_cast<uint64_t>(m_pSceneTexture->GetImage()), VK_OBJECT_TYPE_IMAGE);
 
@@ -856,92 +1631,329 @@ void FRayTracer::CreateOrResizeSceneTexture(uint32_t width, uint32_t height)
         SetDebugName(m_pDevice->GetDevice(), "SceneTextureView", reinterpret_cast<uint64_t>(m_pSceneTextureView->GetImageView()), VK_OBJECT_TYPE_IMAGE_VIEW);
     }
 
-    // UI DescriptorSet
-    m_pSceneTextureDescriptorSet = GUI::AllocateTextureID(m_pSceneTextureView);
-    assert(m_pSceneTextureDescriptorSet != nullptr);
+    // The UI samples a copy of the scene texture
+    if (!IsHeadless())
+    {
+        CreateDisplayTextures(targetWidth, targetHeight);
+    }
 
     // Descriptor set for when tracing
     CreateDescriptorSet();
+}
 
-    // When we have resized we need to clear the image as well
-    m_bResetImage = true;
+void FRayTracer::CreateDisplayTextures(uint32_t width, uint32_t height)
+{
+    // Owned by the graphics queue until the compute queue writes them
+    FTextureParams textureParams = {};
+    textureParams.Format        = VK_FORMAT_R32G32B32A32_SFLOAT;
+    textureParams.ImageType     = VK_IMAGE_TYPE_2D;
+    textureParams.Width         = width;
+    textureParams.Height        = height;
+    textureParams.Usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    textureParams.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
+    {
+        FFrameResources& frame = m_Frames[i];
+        frame.pDisplayTexture = FTexture::Create(m_pDevice, textureParams, m_pDeviceAllocator);
+        assert(frame.pDisplayTexture != nullptr);
+        SetDebugName(m_pDevice->GetDevice(), "DisplayTexture[" + std::to_string(i) + "]", reinterpret_cast<uint64_t>(frame.pDisplayTexture->GetImage()), VK_OBJECT_TYPE_IMAGE);
+
+        FTextureViewParams textureViewParams = {};
+        textureViewParams.pTexture = frame.pDisplayTexture;
+
+        frame.pDisplayTextureView = FTextureView::Create(m_pDevice, textureViewParams);
+        assert(frame.pDisplayTextureView != nullptr);
+
+        frame.pDisplayDescriptorSet = GUI::AllocateTextureID(frame.pDisplayTextureView);
+        assert(frame.pDisplayDescriptorSet != nullptr);
+    }
+}
+
+void FRayTracer::ReleaseDisplayTextures()
+{
+    for (FFrameResources& frame : m_Frames)
+    {
+        SAFE_DELETE(frame.pDisplayDescriptorSet);
+        SAFE_DELETE(frame.pDisplayTextureView);
+        SAFE_DELETE(frame.pDisplayTexture);
+    }
 }
 
 void FRayTracer::CreateDescriptorSet()
 {
+    // The pool only holds this set, the old pool is still in use when the set is replaced during the frames in flight
+    FDescriptorPoolParams poolParams;
+    poolParams.NumUniformBuffers        = 2;
+    poolParams.NumStorageImages         = 3;
+    poolParams.NumStorageBuffers        = 11;
+    poolParams.NumCombinedImageSamplers = 1;
+    poolParams.MaxSets                  = 1;
+
+    m_pDescriptorPool = FDescriptorPool::Create(m_pDevice, poolParams);
+    assert(m_pDescriptorPool != nullptr);
+
     m_pDescriptorSet = FDescriptorSet::Create(m_pDevice, m_pDescriptorPool, m_pDescriptorSetLayout);
     assert(m_pDescriptorSet != nullptr);
 
     m_pDescriptorSet->BindStorageImage(m_pSceneTextureView->GetImageView(), 0);
     m_pDescriptorSet->BindStorageImage(m_pAccumulationTextureView->GetImageView(), 1);
     m_pDescriptorSet->BindUniformBuffer(m_pCameraBuffer->GetBuffer(), 2);
-    m_pDescriptorSet->BindUniformBuffer(m_pRandomBuffer->GetBuffer(), 3);
     m_pDescriptorSet->BindUniformBuffer(m_pSceneBuffer->GetBuffer(), 4);
     m_pDescriptorSet->BindStorageBuffer(m_pQuadBuffer->GetBuffer(), 5);
     m_pDescriptorSet->BindStorageBuffer(m_pSphereBuffer->GetBuffer(), 6);
     m_pDescriptorSet->BindStorageBuffer(m_pPlaneBuffer->GetBuffer(), 7);
     m_pDescriptorSet->BindStorageBuffer(m_pMaterialBuffer->GetBuffer(), 8);
     m_pDescriptorSet->BindCombinedImageSampler(m_pSkybox->GetTextureView()->GetImageView(), m_pSkyboxSampler->GetSampler(), 9);
+    m_pDescriptorSet->BindStorageBuffer(m_pBVHNodeBuffer->GetBuffer(), 10);
+    m_pDescriptorSet->BindStorageBuffer(m_pBVHPrimitiveBuffer->GetBuffer(), 11);
+    m_pDescriptorSet->BindStorageBuffer(m_pMeshInfoBuffer->GetBuffer(), 12);
+    m_pDescriptorSet->BindStorageBuffer(m_pMeshBVHNodeBuffer->GetBuffer(), 13);
+    m_pDescriptorSet->BindStorageBuffer(m_pMeshVertexBuffer->GetBuffer(), 14);
+    m_pDescriptorSet->BindStorageBuffer(m_pMeshIndexBuffer->GetBuffer(), 15);
+    m_pDescriptorSet->BindStorageBuffer(m_pLightBuffer->GetBuffer(), 16);
+    m_pDescriptorSet->BindStorageImage(m_pSecondMomentTextureView->GetImageView(), 17);
 }
 
 void FRayTracer::ReleaseDescriptorSet()
 {
     SAFE_DELETE(m_pDescriptorSet);
+    SAFE_DELETE(m_pDescriptorPool);
+}
+
+void FRayTracer::DeferReleaseDescriptorSet()
+{
+    // The set is queued first so that it is freed before its pool
+    m_pDevice->DeferDelete(m_pDescriptorSet);
+    m_pDevice->DeferDelete(m_pDescriptorPool);
 }
 
 void FRayTracer::ReloadShader()
 {
-    static bool bIsCompiling = false;
+    // Wait for the current reload to finish before starting another one
+    if (!m_pShaderCompiler || m_ShaderReload.valid())
+    {
+        return;
+    }
 
-    if (!bIsCompiling)
+    // The future is kept so that Tick never blocks on the compilation
+    m_ShaderReload = std::async(std::launch::async, [this]()
     {
-        bIsCompiling = true;
+        FShaderModule* pComputeShader = FShaderModule::CreateFromSourceFile(m_pDevice, m_pShaderCompiler, "main", RESOURCE_PATH"/shaders/raytracer.glsl", VK_SHADER_STAGE_COMPUTE_BIT);
+        if (!pComputeShader)
+        {
+            std::cout << "FAILED to create ComputeShader\n";
+            return false;
+        }
 
-        std::async(std::launch::async, [this]()
+        FComputePipelineStateParams pipelineParams = {};
+        pipelineParams.pShader         = pComputeShader;
+        pipelineParams.pPipelineLayout = m_pPipelineLayout;
+
+        m_pNewPipeline = FComputePipeline::Create(m_pDevice, pipelineParams);
+        SAFE_DELETE(pComputeShader);
+
+        if (!m_pNewPipeline)
         {
-            // Compile the shaders
-            auto result = std::system(SHADER_SCRIPT_PATH);
-            if (result != 0)
-            {
-                std::cout << "FAILED to Compile Shaders\n";
-                bIsCompiling = false;
-                return false;
-            }
+            std::cout << "FAILED to create ComputePipeline\n";
+            return false;
+        }
 
-            // Upload the new shaders
-            std::cout << "Compiled Shaders Successfully\n";
+        // Both pipelines are swapped together, so keep the current ones when either fails
+        if (m_pWavefrontPipeline && !m_pWavefrontPipeline->CreateShaders(m_pShaderCompiler))
+        {
+            std::cout << "FAILED to reload the wavefront shaders\n";
+            SAFE_DELETE(m_pNewPipeline);
+            return false;
+        }
 
-            // Create shader and pipeline
-            FShaderModule* pComputeShader = FShaderModule::CreateFromFile(m_pDevice, "main", RESOURCE_PATH"/shaders/raytracer.spv");
-            if (!pComputeShader)
-            {
-                std::cout << "FAILED to create ComputeShader\n";
-                bIsCompiling = false;
-                return false;
-            }
+        std::cout << "Compiled Shaders Successfully\n";
+        return true;
+    });
+}
 
-            FComputePipelineStateParams pipelineParams = {};
-            pipelineParams.pShader         = pComputeShader;
-            pipelineParams.pPipelineLayout = m_pPipelineLayout;
+void FRayTracer::SwapShaders()
+{
+    // The old pipelines can still be used by the frames in flight
+    m_pDevice->DeferDelete(m_pPipeline);
+    m_pPipeline    = m_pNewPipeline;
+    m_pNewPipeline = nullptr;
 
-            FComputePipeline* pComputePipeline  = FComputePipeline::Create(m_pDevice, pipelineParams);
-            if (!pComputePipeline)
-            {
-                std::cout << "FAILED to create ComputePipeline\n";
-                SAFE_DELETE(pComputeShader);
-                bIsCompiling = false;
-                return false;
-            }
+    if (m_pWavefrontPipeline)
+    {
+        m_pWavefrontPipeline->SwapShaders();
+    }
 
-            m_pDevice->WaitForIdle();
-            pComputePipeline = m_pPipeline.exchange(pComputePipeline);
+    m_bResetImage = true;
+}
 
-            SAFE_DELETE(pComputeShader);
-            SAFE_DELETE(pComputePipeline);
+void FRayTracer::UpdateSamplesPerDispatch(float gpuTimePerSample)
+{
+    // Grow slowly so that a single fast frame does not cause a spike, but shrink right away when we are over budget
+    const int32_t targetSamples = static_cast<int32_t>(m_TargetFrameTime / std::max(gpuTimePerSample, 0.001f));
+    const int32_t maxSamples    = std::max(m_SamplesPerDispatch * 2, 2);
+    m_SamplesPerDispatch = std::clamp(std::min(targetSamples, maxSamples), 1, MAX_SAMPLES_PER_DISPATCH);
+}
 
-            m_bResetImage = true;
-            bIsCompiling  = false;
-            return true;
-        });
+int32_t FRayTracer::GetBounceLimit() const
+{
+    return m_bUseWavefront ? WAVEFRONT_MAX_BOUNCES : MAX_BOUNCES;
+}
+
+void FRayTracer::BuildBVH()
+{
+    std::vector<FAABB>    primitiveBounds;
+    std::vector<uint32_t> primitives;
+    m_pScene->GetPrimitiveBounds(primitiveBounds, primitives);
+
+    m_BVH.Build(primitiveBounds);
+
+    // Store the primitives in the order that the leaves expect
+    const std::vector<uint32_t>& primitiveIndices = m_BVH.GetPrimitiveIndices();
+    m_BVHPrimitives.resize(primitiveIndices.size());
+    for (size_t i = 0; i < primitiveIndices.size(); i++)
+    {
+        m_BVHPrimitives[i] = primitives[primitiveIndices[i]];
+    }
+
+    m_bRebuildBVH = false;
+}
+
+bool FRayTracer::GrowSceneBuffers()
+{
+    constexpr uint32_t numBuffers = 7;
+    FBuffer** ppBuffers[numBuffers] =
+    {
+        &m_pQuadBuffer,
+        &m_pSphereBuffer,
+        &m_pPlaneBuffer,
+        &m_pMaterialBuffer,
+        &m_pBVHNodeBuffer,
+        &m_pBVHPrimitiveBuffer,
+        &m_pLightBuffer,
+    };
+
+    const VkDeviceSize requiredSizes[numBuffers] =
+    {
+        sizeof(FQuad) * m_pScene->m_Quads.size(),
+        sizeof(FSphere) * m_pScene->m_Spheres.size(),
+        sizeof(FPlane) * m_pScene->m_Planes.size(),
+        sizeof(FMaterial) * m_pScene->m_Materials.size(),
+        sizeof(FBVHNode) * m_BVH.GetNodes().size(),
+        sizeof(uint32_t) * m_BVHPrimitives.size(),
+        sizeof(FLight) * m_Lights.size(),
+    };
+
+    bool bGrow = false;
+    for (uint32_t i = 0; i < numBuffers; i++)
+    {
+        bGrow |= requiredSizes[i] > (*ppBuffers[i])->GetSize();
     }
+
+    if (!bGrow)
+    {
+        return false;
+    }
+
+    // Grow geometrically so that a scene that keeps growing only reallocates a few times
+    for (uint32_t i = 0; i < numBuffers; i++)
+    {
+        FBuffer*& pBuffer = *ppBuffers[i];
+        if (requiredSizes[i] <= pBuffer->GetSize())
+        {
+            continue;
+        }
+
+        // The old buffer can still be used by the frames in flight
+        const VkDeviceSize size = std::bit_ceil(std::max(pBuffer->GetSize() * 2, requiredSizes[i]));
+        m_pDevice->DeferDelete(pBuffer);
+
+        pBuffer = CreateSceneBuffer(m_pDevice, m_pDeviceAllocator, size);
+        assert(pBuffer != nullptr);
+    }
+
+    // Bind the new buffers
+    DeferReleaseDescriptorSet();
+    CreateDescriptorSet();
+    return true;
+}
+
+void FRayTracer::CreateMeshBuffers()
+{
+    // The old buffers can still be used by the frames in flight
+    m_pDevice->DeferDelete(m_pMeshInfoBuffer);
+    m_pDevice->DeferDelete(m_pMeshBVHNodeBuffer);
+    m_pDevice->DeferDelete(m_pMeshVertexBuffer);
+    m_pDevice->DeferDelete(m_pMeshIndexBuffer);
+
+    std::vector<FMeshInfo> meshInfos;
+    std::vector<FBVHNode>  nodes;
+    std::vector<glm::vec4> vertices;
+    std::vector<uint32_t>  indices;
+    for (const FMesh& mesh : m_pScene->m_Meshes)
+    {
+        const uint32_t numTriangles = mesh.GetNumTriangles();
+
+        std::vector<FAABB> triangleBounds(numTriangles);
+        for (uint32_t i = 0; i < numTriangles; i++)
+        {
+            FAABB& bounds = triangleBounds[i];
+            bounds.Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 0]]));
+            bounds.Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 1]]));
+            bounds.Grow(glm::vec3(mesh.Vertices[mesh.Indices[(3 * i) + 2]]));
+        }
+
+        FBVH bvh;
+        bvh.Build(triangleBounds);
+
+        // The nodes are relative to the first node of the mesh and the leaves relative to the first triangle
+        FMeshInfo meshInfo;
+        meshInfo.FirstNode     = static_cast<uint32_t>(nodes.size());
+        meshInfo.FirstTriangle = static_cast<uint32_t>(indices.size() / 3);
+        meshInfo.NumTriangles  = numTriangles;
+        meshInfo.MaterialIndex = mesh.MaterialIndex;
+        meshInfos.push_back(meshInfo);
+
+        nodes.insert(nodes.end(), bvh.GetNodes().begin(), bvh.GetNodes().end());
+
+        // Store the triangles in the same order as the leaves so that no extra indirection is needed
+        const uint32_t firstVertex = static_cast<uint32_t>(vertices.size());
+        for (uint32_t triangle : bvh.GetPrimitiveIndices())
+        {
+            indices.push_back(firstVertex + mesh.Indices[(3 * triangle) + 0]);
+            indices.push_back(firstVertex + mesh.Indices[(3 * triangle) + 1]);
+            indices.push_back(firstVertex + mesh.Indices[(3 * triangle) + 2]);
+        }
+
+        vertices.insert(vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+    }
+
+    m_pMeshInfoBuffer = CreateStorageBufferWithData(m_pDevice, m_pDeviceAllocator, meshInfos.data(), sizeof(FMeshInfo) * meshInfos.size());
+    assert(m_pMeshInfoBuffer != nullptr);
+
+    m_pMeshBVHNodeBuffer = CreateStorageBufferWithData(m_pDevice, m_pDeviceAllocator, nodes.data(), sizeof(FBVHNode) * nodes.size());
+    assert(m_pMeshBVHNodeBuffer != nullptr);
+
+    m_pMeshVertexBuffer = CreateStorageBufferWithData(m_pDevice, m_pDeviceAllocator, vertices.data(), sizeof(glm::vec4) * vertices.size());
+    assert(m_pMeshVertexBuffer != nullptr);
+
+    m_pMeshIndexBuffer = CreateStorageBufferWithData(m_pDevice, m_pDeviceAllocator, indices.data(), sizeof(uint32_t) * indices.size());
+    assert(m_pMeshIndexBuffer != nullptr);
+
+    // Bind the new buffers
+    if (m_pDescriptorSet)
+    {
+        DeferReleaseDescriptorSet();
+        CreateDescriptorSet();
+    }
+
+    m_bRebuildMeshes = false;
+}
+
+void FRayTracer::ReleaseMeshBuffers()
+{
+    SAFE_DELETE(m_pMeshInfoBuffer);
+    SAFE_DELETE(m_pMeshBVHNodeBuffer);
+    SAFE_DELETE(m_pMeshVertexBuffer);
+    SAFE_DELETE(m_pMeshIndexBuffer);
 }
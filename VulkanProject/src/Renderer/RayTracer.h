@@ -5,16 +5,22 @@
 #include "Scene.h"
 
 class FBuffer;
+class FUploadRing;
+class FWavefrontPipeline;
+class FShaderCompiler;
+class FFileWatcher;
+class FTiledImageWriter;
 
 /*///////////////////////////////////////////////////////////////////////////////////////////////*/
 // Buffer Structs
 
-struct FRandomBuffer
+// Pushed for every dispatch, needs to match FrameConstants in scene.glsl
+struct FFrameConstants
 {
-    uint32_t FrameIndex  = 0;
-    uint32_t SampleIndex = 0;
-    uint32_t NumSamples  = 0;
-    uint32_t Padding0    = 0;
+    uint32_t NumSamples = 0;
+
+    // Number of samples per pixel that are traced in one dispatch
+    uint32_t SamplesPerDispatch = 1;
 };
 
 struct FSceneBuffer
@@ -26,8 +32,27 @@ struct FSceneBuffer
 
     uint32_t BackgroundType = 0;
     float    Exposure       = 0.0f;
-    uint32_t Padding0       = 0;
-    uint32_t Padding1       = 0;
+    uint32_t NumBVHNodes    = 0;
+    uint32_t NumLights      = 0;
+
+    uint32_t MinBounces         = 0;
+    uint32_t MaxBounces         = 0;
+    uint32_t AdaptiveMinSamples = 0;
+    float    AdaptiveThreshold  = 0.0f;
+
+    uint32_t DisplayMode = 0;
+    uint32_t Padding0    = 0;
+    uint32_t Padding1    = 0;
+    uint32_t Padding2    = 0;
+};
+
+// Describes where the BVH and triangles of a mesh are stored in the shared mesh buffers
+struct FMeshInfo
+{
+    uint32_t FirstNode     = 0;
+    uint32_t FirstTriangle = 0;
+    uint32_t NumTriangles  = 0;
+    uint32_t MaterialIndex = 0;
 };
 
 /*///////////////////////////////////////////////////////////////////////////////////////////////*/
@@ -48,42 +73,158 @@ public:
     virtual void OnRenderUI() override;
     
     virtual void OnWindowResize(uint32_t width, uint32_t height) override;
+
+    // Reads back the accumulated image and writes it to disk, this stalls the GPU
+    virtual bool SaveImage(const char* pFilePath) override;
+
+    // Renders an image of any size in tiles of tileSize x tileSize pixels, only a single tile is kept in GPU memory. Each tile
+    // is traced until it has the max number of samples and is then streamed to the file. Only supported when headless.
+    bool BeginTiledRender(const char* pFilePath, uint32_t width, uint32_t height, uint32_t tileSize);
+
+    bool IsTiledRenderFinished() const
+    {
+        return m_pTileWriter == nullptr || m_CurrentTile >= (m_NumTilesX * m_NumTilesY);
+    }
+
+    virtual uint32_t GetNumSamples() const override
+    {
+        return m_NumSamples;
+    }
+
+    virtual void SetMaxSamples(uint32_t maxSamples) override
+    {
+        m_MaxSamples = maxSamples;
+    }
+
+    float GetLastGPUTime() const
+    {
+        return m_LastGPUTime;
+    }
+
+    // When there is no swapchain we render offline, without any input or UI
+    bool IsHeadless() const
+    {
+        return m_pSwapchain == nullptr;
+    }
     
 private:
+    // The resources that the GPU can still be using while the CPU records the next frames, they are reused once the
+    // CommandBuffers have been waited on
+    struct FFrameResources
+    {
+        // Path tracing is recorded for the compute queue, the graphics CommandBuffer acquires the display texture
+        class FCommandBuffer* pCommandBuffer         = nullptr;
+        class FCommandBuffer* pGraphicsCommandBuffer = nullptr;
+        class FQuery*         pTimestampQuery        = nullptr;
+
+        // Stored to match the number of samples with the timestamps
+        uint32_t SamplesPerDispatch = 0;
+
+        // Copy of the scene texture that the UI samples on the graphics queue, while the compute queue traces the
+        // next frame into the scene texture
+        class FTexture*       pDisplayTexture       = nullptr;
+        class FTextureView*   pDisplayTextureView   = nullptr;
+        class FDescriptorSet* pDisplayDescriptorSet = nullptr;
+
+        // The part of the display texture that holds the image, the texture has the size of the render targets
+        uint32_t DisplayWidth  = 0;
+        uint32_t DisplayHeight = 0;
+
+        // Values of the compute timeline when the display texture has been written, and of the graphics timeline when
+        // the UI is done with it
+        uint64_t ComputeValue  = 0;
+        uint64_t GraphicsValue = 0;
+    };
+
     void CreateOrResizeSceneTexture(uint32_t width, uint32_t height);
+    void CreateDisplayTextures(uint32_t width, uint32_t height);
+    void ReleaseDisplayTextures();
+
+    // Reads back the accumulation texture divided by the number of samples in each pixel, this stalls the GPU
+    bool ReadbackImage(std::vector<glm::vec4>& outPixels);
+
+    // Writes the current tile to the file and moves on to the next one
+    bool FinishTile();
 
+    // Every set has its own pool, so that a new set can be created while the frames in flight still use the old one
     void CreateDescriptorSet();
     void ReleaseDescriptorSet();
+    void DeferReleaseDescriptorSet();
 
+    // Starts compiling the shaders on a background thread, the current pipelines are used until they are done
     void ReloadShader();
 
-    FDevice*                       m_pDevice;
-    FSwapchain*                    m_pSwapchain;
-    std::atomic<FComputePipeline*> m_pPipeline;
-    class FPipelineLayout*         m_pPipelineLayout;
-    class FDescriptorSetLayout*    m_pDescriptorSetLayout;
-    FDeviceMemoryAllocator*        m_pDeviceAllocator;
-    FDescriptorPool*               m_pDescriptorPool;
-    class FDescriptorSet*          m_pDescriptorSet;
-
-    std::vector<class FCommandBuffer*> m_CommandBuffers;
-    std::vector<class FQuery*>         m_TimestampQueries;
+    // Starts using the pipelines from the last reload, only called when the megakernel and the wavefront kernels all compiled
+    void SwapShaders();
+
+    void BuildBVH();
+
+    // Replaces the scene buffers that are too small for the scene, returns true if any buffer was replaced
+    bool GrowSceneBuffers();
+
+    // Picks the number of samples per dispatch from the measured GPU time so that we hit the target frame time
+    void UpdateSamplesPerDispatch(float gpuTimePerSample);
+
+    // The wavefront pipeline records every bounce so it supports fewer bounces than the megakernel
+    int32_t GetBounceLimit() const;
+
+    // Builds the BVH for each mesh and uploads the triangles, only needed when the scene changes
+    void CreateMeshBuffers();
+    void ReleaseMeshBuffers();
+
+    FDevice*                    m_pDevice;
+    FSwapchain*                 m_pSwapchain;
+    FComputePipeline*           m_pPipeline;
+    FWavefrontPipeline*         m_pWavefrontPipeline;
+    bool                        m_bUseWavefront;
+    class FPipelineLayout*      m_pPipelineLayout;
+    class FDescriptorSetLayout* m_pDescriptorSetLayout;
+    FDeviceMemoryAllocator*     m_pDeviceAllocator;
+    FDescriptorPool*            m_pDescriptorPool;
+    class FDescriptorSet*       m_pDescriptorSet;
+
+    // Shader reloading, the future is ready when the new pipelines have been created
+    FShaderCompiler*  m_pShaderCompiler;
+    std::future<bool> m_ShaderReload;
+    FComputePipeline* m_pNewPipeline;
+    FFileWatcher*     m_pShaderWatcher;
+    float             m_ShaderWatchTimer;
+    bool              m_bReloadShaders;
+
+    // Frames in flight, the number of frames is independent of the number of images in the swapchain. The current
+    // frame is the last one that was submitted, UINT32_MAX before the first frame.
+    FFrameResources m_Frames[NUM_FRAMES_IN_FLIGHT];
+    uint32_t        m_CurrentFrame;
     
+    // Per-frame data is written to the upload ring and copied into the buffers before the dispatch. The constants are
+    // only uploaded when they differ from the last upload.
+    FUploadRing*  m_pUploadRing;
+    FCameraBuffer m_CameraBuffer;
+    FSceneBuffer  m_SceneBuffer;
+    bool          m_bUploadConstants;
+
     // Buffers
     FBuffer* m_pCameraBuffer;
-    FBuffer* m_pRandomBuffer;
     FBuffer* m_pSceneBuffer;
     FBuffer* m_pSphereBuffer;
     FBuffer* m_pPlaneBuffer;
     FBuffer* m_pQuadBuffer;
     FBuffer* m_pMaterialBuffer;
+    FBuffer* m_pBVHNodeBuffer;
+    FBuffer* m_pBVHPrimitiveBuffer;
+    FBuffer* m_pMeshInfoBuffer;
+    FBuffer* m_pMeshBVHNodeBuffer;
+    FBuffer* m_pMeshVertexBuffer;
+    FBuffer* m_pMeshIndexBuffer;
+    FBuffer* m_pLightBuffer;
 
     // SceneTexture
     class FTexture*       m_pAccumulationTexture;
     class FTextureView*   m_pAccumulationTextureView;
+    class FTexture*       m_pSecondMomentTexture;
+    class FTextureView*   m_pSecondMomentTextureView;
     class FTexture*       m_pSceneTexture;
     class FTextureView*   m_pSceneTextureView;
-    class FDescriptorSet* m_pSceneTextureDescriptorSet;
 
     // Skybox
     class FTextureResource* m_pSkybox;
@@ -92,15 +233,51 @@ private:
     // Scene
     FScene* m_pScene;
 
+    // BVH over the quads and spheres, rebuilt when the scene changes
+    FBVH                  m_BVH;
+    std::vector<uint32_t> m_BVHPrimitives;
+    bool                  m_bRebuildBVH;
+    bool                  m_bRebuildMeshes;
+
+    // Emissive primitives, gathered again when the primitives or materials change
+    std::vector<FLight> m_Lights;
+
+    // Path termination, Russian roulette starts after the minimum number of bounces
+    int32_t m_MinBounces;
+    int32_t m_MaxBounces;
+
+    // Adaptive sampling, pixels with a relative error below the threshold stop tracing. A threshold of zero disables it.
+    float   m_AdaptiveThreshold;
+    int32_t m_AdaptiveMinSamples;
+    int32_t m_DisplayMode;
+
     // Samples
     uint32_t         m_NumSamples;
+    uint32_t         m_MaxSamples;
+    uint32_t         m_FrameIndex;
     std::atomic_bool m_bResetImage;
 
+    // Samples per dispatch
+    bool    m_bAutoSamplesPerDispatch;
+    int32_t m_SamplesPerDispatch;
+    float   m_TargetFrameTime;
+
     // Stats
     float m_LastCPUTime;
     float m_LastGPUTime;
 
-    // Viewport
+    // Viewport, the image is the part of the render targets that is traced
     uint32_t m_ViewportWidth;
     uint32_t m_ViewportHeight;
+    uint32_t m_ImageWidth;
+    uint32_t m_ImageHeight;
+
+    // Tiled rendering, the viewport is the size of a tile and the film is the whole image
+    FTiledImageWriter* m_pTileWriter;
+    uint32_t           m_FilmWidth;
+    uint32_t           m_FilmHeight;
+    uint32_t           m_TileSize;
+    uint32_t           m_NumTilesX;
+    uint32_t           m_NumTilesY;
+    uint32_t           m_CurrentTile;
 };
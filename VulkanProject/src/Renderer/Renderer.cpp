@@ -19,6 +19,7 @@ FRenderer::FRenderer()
     , m_pDeviceAllocator(nullptr)
     , m_CommandBuffers()
     , m_Framebuffers()
+    , m_FrameIndex(0)
 {
 }
 
@@ -63,8 +64,7 @@ void FRenderer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     commandBufferParams.QueueType = ECommandQueueType::Graphics;
 
-    uint32_t imageCount = m_pSwapchain->GetNumBackBuffers();
-    m_CommandBuffers.resize(imageCount);
+    m_CommandBuffers.resize(NUM_FRAMES_IN_FLIGHT);
     for (size_t i = 0; i < m_CommandBuffers.size(); i++)
     {
         FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(m_pDevice, commandBufferParams);
@@ -72,7 +72,7 @@ void FRenderer::Init(FDevice* pDevice, FSwapchain* pSwapchain)
     }
 
     // Allocator for GPU mem
-    m_pDeviceAllocator = new FDeviceMemoryAllocator(m_pDevice->GetDevice(), m_pDevice->GetPhysicalDevice());
+    m_pDeviceAllocator = new FDeviceMemoryAllocator(m_pDevice);
 
     m_pModel = new FModel();
     m_pModel->LoadFromFile("res/models/viking_room.obj", m_pDevice, m_pDeviceAllocator);
@@ -98,7 +98,9 @@ void FRenderer::Tick(float deltaTime)
     m_Camera.Update(90.0f, extent.width, extent.height, 0.1f, 100.0f);
     
     // Draw
-    uint32_t frameIndex = m_pSwapchain->GetCurrentBackBufferIndex();
+    const uint32_t frameIndex = m_FrameIndex % NUM_FRAMES_IN_FLIGHT;
+    m_FrameIndex++;
+
     m_pCurrentCommandBuffer = m_CommandBuffers[frameIndex];
 
     // Begin CommandBuffer
@@ -113,7 +115,7 @@ void FRenderer::Tick(float deltaTime)
     
     // Begin renderpass
     VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-    m_pCurrentCommandBuffer->BeginRenderPass(m_pRenderPass, m_Framebuffers[frameIndex], &clearColor, 1);
+    m_pCurrentCommandBuffer->BeginRenderPass(m_pRenderPass, m_Framebuffers[m_pSwapchain->GetCurrentBackBufferIndex()], &clearColor, 1);
     
     // Set viewport
     VkViewport viewport = { 0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f };
@@ -158,7 +160,13 @@ void FRenderer::Release()
 
 void FRenderer::OnWindowResize(uint32_t width, uint32_t height)
 {
-    ReleaseFramebuffers();
+    // The frames in flight can still use the old framebuffers
+    for (FFramebuffer*& pFramebuffer : m_Framebuffers)
+    {
+        m_pDevice->DeferDelete(pFramebuffer);
+    }
+
+    m_Framebuffers.clear();
     CreateFramebuffers();
 }
 
@@ -31,8 +31,10 @@ private:
     FDeviceMemoryAllocator*  m_pDeviceAllocator;
     FDescriptorPool*         m_pDescriptorPool;
     
+    // One framebuffer for each image in the swapchain and one CommandBuffer for each frame in flight
     std::vector<class FFramebuffer*>   m_Framebuffers;
     std::vector<class FCommandBuffer*> m_CommandBuffers;
+    uint32_t                           m_FrameIndex;
     
     class FBuffer* m_pCameraBuffer;
     
@@ -1,18 +1,181 @@
 #include "Scene.h"
+#include "Model.h"
+
+void FDirtyRanges::Add(uint32_t first, uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    FDirtyRange range = { first, first + count };
+
+    // Skip the ranges that end before the new one starts, then merge with all ranges that start before it ends
+    auto begin = std::lower_bound(m_Ranges.begin(), m_Ranges.end(), range.First, [](const FDirtyRange& other, uint32_t value)
+    {
+        return other.End < value;
+    });
+
+    auto end = begin;
+    while (end != m_Ranges.end() && end->First <= range.End)
+    {
+        range.First = std::min(range.First, end->First);
+        range.End   = std::max(range.End, end->End);
+        end++;
+    }
+
+    begin = m_Ranges.erase(begin, end);
+    m_Ranges.insert(begin, range);
+}
 
 FScene::FScene()
     : m_Quads()
     , m_Spheres()
     , m_Planes()
     , m_Materials()
+    , m_Meshes()
     , m_Settings()
+    , m_DirtyQuads()
+    , m_DirtySpheres()
+    , m_DirtyPlanes()
+    , m_DirtyMaterials()
 {
     m_Settings.Exposure = 1.0f;
 
-    m_Quads.reserve(MAX_QUAD);
-    m_Spheres.reserve(MAX_SPHERES);
-    m_Planes.reserve(MAX_PLANES);
-    m_Materials.reserve(MAX_MATERIALS);
+    m_Meshes.reserve(MAX_MESHES);
+}
+
+bool FScene::LoadMesh(const std::string& filepath, const glm::mat4& transform, uint32_t materialIndex)
+{
+    if (m_Meshes.size() >= MAX_MESHES)
+    {
+        std::cout << "Scene already has the maximum number of meshes (" << MAX_MESHES << ")\n";
+        return false;
+    }
+
+    std::vector<FVertex>  vertices;
+    std::vector<uint32_t> indices;
+    if (!FModel::LoadMeshData(filepath, vertices, indices))
+    {
+        return false;
+    }
+
+    FMesh mesh;
+    mesh.Vertices.reserve(vertices.size());
+    for (const FVertex& vertex : vertices)
+    {
+        mesh.Vertices.push_back(transform * glm::vec4(vertex.Position, 1.0f));
+    }
+
+    mesh.Indices       = std::move(indices);
+    mesh.MaterialIndex = materialIndex;
+    m_Meshes.push_back(std::move(mesh));
+    return true;
+}
+
+void FScene::GetPrimitiveBounds(std::vector<FAABB>& outBounds, std::vector<uint32_t>& outPrimitives) const
+{
+    outBounds.clear();
+    outPrimitives.clear();
+    outBounds.reserve(m_Quads.size() + m_Spheres.size() + m_Meshes.size());
+    outPrimitives.reserve(m_Quads.size() + m_Spheres.size() + m_Meshes.size());
+
+    // Quads are flat so pad the bounds to avoid zero sized boxes
+    constexpr float quadPadding = 0.0001f;
+
+    for (uint32_t i = 0; i < m_Quads.size(); i++)
+    {
+        const FQuad&    quad  = m_Quads[i];
+        const glm::vec3 pos   = glm::vec3(quad.Position);
+        const glm::vec3 edge0 = glm::vec3(quad.Edge0);
+        const glm::vec3 edge1 = glm::vec3(quad.Edge1);
+
+        FAABB bounds;
+        bounds.Grow(pos);
+        bounds.Grow(pos + edge0);
+        bounds.Grow(pos + edge1);
+        bounds.Grow(pos + edge0 + edge1);
+        bounds.Min = bounds.Min - glm::vec3(quadPadding);
+        bounds.Max = bounds.Max + glm::vec3(quadPadding);
+
+        outBounds.push_back(bounds);
+        outPrimitives.push_back((PRIMITIVE_TYPE_QUAD << PRIMITIVE_INDEX_BITS) | i);
+    }
+
+    for (uint32_t i = 0; i < m_Spheres.size(); i++)
+    {
+        // Negative radius is used for hollow spheres
+        const FSphere& sphere = m_Spheres[i];
+        const float    radius = std::abs(sphere.Radius);
+
+        outBounds.push_back(FAABB(sphere.Position - glm::vec3(radius), sphere.Position + glm::vec3(radius)));
+        outPrimitives.push_back((PRIMITIVE_TYPE_SPHERE << PRIMITIVE_INDEX_BITS) | i);
+    }
+
+    // Meshes have their own BVH so the top level only needs the bounds of the whole mesh
+    for (uint32_t i = 0; i < m_Meshes.size(); i++)
+    {
+        if (m_Meshes[i].Indices.empty())
+        {
+            continue;
+        }
+
+        FAABB bounds;
+        for (const glm::vec4& vertex : m_Meshes[i].Vertices)
+        {
+            bounds.Grow(glm::vec3(vertex));
+        }
+
+        outBounds.push_back(bounds);
+        outPrimitives.push_back((PRIMITIVE_TYPE_MESH << PRIMITIVE_INDEX_BITS) | i);
+    }
+}
+
+void FScene::GetLights(std::vector<FLight>& outLights) const
+{
+    outLights.clear();
+
+    auto IsEmissive = [this](uint32_t materialIndex)
+    {
+        return materialIndex < m_Materials.size() && m_Materials[materialIndex].Type == MATERIAL_EMISSIVE;
+    };
+
+    for (uint32_t i = 0; i < m_Quads.size(); i++)
+    {
+        const FQuad& quad = m_Quads[i];
+        if (!IsEmissive(quad.MaterialIndex))
+        {
+            continue;
+        }
+
+        FLight light = {};
+        light.Primitive = (PRIMITIVE_TYPE_QUAD << PRIMITIVE_INDEX_BITS) | i;
+        light.Area      = glm::length(glm::cross(glm::vec3(quad.Edge0), glm::vec3(quad.Edge1)));
+        outLights.push_back(light);
+    }
+
+    for (uint32_t i = 0; i < m_Spheres.size(); i++)
+    {
+        const FSphere& sphere = m_Spheres[i];
+        if (!IsEmissive(sphere.MaterialIndex))
+        {
+            continue;
+        }
+
+        // Only the half of the sphere that faces the surface is sampled
+        FLight light = {};
+        light.Primitive = (PRIMITIVE_TYPE_SPHERE << PRIMITIVE_INDEX_BITS) | i;
+        light.Area      = 2.0f * glm::pi<float>() * sphere.Radius * sphere.Radius;
+        outLights.push_back(light);
+    }
+}
+
+void FScene::MarkAllDirty()
+{
+    m_DirtyQuads.Add(0, static_cast<uint32_t>(m_Quads.size()));
+    m_DirtySpheres.Add(0, static_cast<uint32_t>(m_Spheres.size()));
+    m_DirtyPlanes.Add(0, static_cast<uint32_t>(m_Planes.size()));
+    m_DirtyMaterials.Add(0, static_cast<uint32_t>(m_Materials.size()));
 }
 
 void FSphereScene::Initialize()
@@ -205,3 +368,50 @@ void FCornellBoxScene::Reset()
     glm::vec3 rotation(glm::pi<float>() / 8.0f, glm::pi<float>(), 0.0f);
     m_Camera.Rotate(rotation);
 }
+
+void FVikingRoomScene::Initialize()
+{
+    // Settings
+    m_Settings.BackgroundType = BACKGROUND_TYPE_GRADIENT;
+
+    // Setup Camera
+    Reset();
+
+    // The model is Z-up so rotate it to be Y-up
+    glm::mat4 transform = glm::scale(glm::identity<glm::mat4>(), glm::vec3(2.0f));
+    transform = glm::rotate(transform, -glm::pi<float>() / 2.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    
+    LoadMesh(RESOURCE_PATH"/models/viking_room.obj", transform, 0);
+
+    // Ground
+    m_Planes.push_back({ glm::vec3(0.0f, 1.0f, 0.0f), -0.25f, 1 });
+
+    // Materials
+    m_Materials.push_back(
+    {
+        glm::vec4(0.6f, 0.5f, 0.4f, 1.0f),
+        glm::vec4(0.0f, 0.0f, 0.0f, 0.0f),
+        MATERIAL_LAMBERTIAN,
+        1.0f,
+        0.0f,
+    });
+    m_Materials.push_back(
+    {
+        glm::vec4(0.5f, 0.5f, 0.5f, 1.0f),
+        glm::vec4(0.0f, 0.0f, 0.0f, 0.0f),
+        MATERIAL_LAMBERTIAN,
+        1.0f,
+        0.0f,
+    });
+}
+
+void FVikingRoomScene::Reset()
+{
+    m_Camera.Reset();
+
+    glm::vec3 translation(3.0f, 1.5f, -1.75f);
+    m_Camera.Move(translation);
+
+    glm::vec3 rotation(glm::pi<float>() / 8.0f, -glm::pi<float>() / 4.0f, 0.0f);
+    m_Camera.Rotate(rotation);
+}
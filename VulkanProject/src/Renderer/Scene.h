@@ -1,10 +1,8 @@
 #pragma once
 #include "Camera.h"
+#include "BVH.h"
 
-#define MAX_QUAD (128)
-#define MAX_SPHERES (32)
-#define MAX_PLANES (8)
-#define MAX_MATERIALS (32)
+#define MAX_MESHES (16)
 
 #define MATERIAL_LAMBERTIAN (1)
 #define MATERIAL_METAL (2)
@@ -15,6 +13,13 @@
 #define BACKGROUND_TYPE_GRADIENT (1)
 #define BACKGROUND_TYPE_SKYBOX (2)
 
+// Primitives in the BVH are stored as the type in the upper bits and the index in the lower bits
+#define PRIMITIVE_TYPE_QUAD (0)
+#define PRIMITIVE_TYPE_SPHERE (1)
+#define PRIMITIVE_TYPE_MESH (2)
+#define PRIMITIVE_INDEX_BITS (24)
+#define PRIMITIVE_INDEX_MASK ((1u << PRIMITIVE_INDEX_BITS) - 1u)
+
 struct FSphere
 {
     glm::vec3 Position;
@@ -56,6 +61,62 @@ struct FMaterial
     uint32_t  Padding1;
 };
 
+// Emissive quad or sphere that is sampled directly, Area is the area that is sampled on the light
+struct FLight
+{
+    uint32_t Primitive;
+    float    Area;
+    uint32_t Padding0;
+    uint32_t Padding1;
+};
+
+// Triangle mesh, the vertices are stored in world space
+struct FMesh
+{
+    std::vector<glm::vec4> Vertices;
+    std::vector<uint32_t>  Indices;
+    uint32_t               MaterialIndex = 0;
+
+    uint32_t GetNumTriangles() const
+    {
+        return static_cast<uint32_t>(Indices.size() / 3);
+    }
+};
+
+// Range of elements in one of the scene arrays, End is exclusive
+struct FDirtyRange
+{
+    uint32_t First;
+    uint32_t End;
+};
+
+// Elements of a scene array that changed since they were last uploaded. Overlapping and adjacent ranges are merged so
+// that each element is uploaded once.
+class FDirtyRanges
+{
+public:
+    void Add(uint32_t first, uint32_t count = 1);
+
+    void Clear()
+    {
+        m_Ranges.clear();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_Ranges.empty();
+    }
+
+    const std::vector<FDirtyRange>& GetRanges() const
+    {
+        return m_Ranges;
+    }
+
+private:
+    // Sorted and never overlapping
+    std::vector<FDirtyRange> m_Ranges;
+};
+
 struct FSceneSettings
 {
     uint32_t BackgroundType;
@@ -70,6 +131,18 @@ struct FScene
 
     virtual void Reset() {}
 
+    // Loads an OBJ-file and transforms it into world space
+    bool LoadMesh(const std::string& filepath, const glm::mat4& transform, uint32_t materialIndex);
+
+    // Retrieve the bounds of all primitives that can be stored in a BVH, planes are infinite and are not included
+    void GetPrimitiveBounds(std::vector<FAABB>& outBounds, std::vector<uint32_t>& outPrimitives) const;
+
+    // Retrieve all quads and spheres with an emissive material
+    void GetLights(std::vector<FLight>& outLights) const;
+
+    // Marks all quads, spheres, planes and materials as changed
+    void MarkAllDirty();
+
     FCamera                m_Camera;
     FSceneSettings         m_Settings;
 
@@ -77,6 +150,13 @@ struct FScene
     std::vector<FSphere>   m_Spheres;
     std::vector<FPlane>    m_Planes;
     std::vector<FMaterial> m_Materials;
+    std::vector<FMesh>     m_Meshes;
+
+    // Add the elements that are edited after the scene is initialized, only these are uploaded
+    FDirtyRanges m_DirtyQuads;
+    FDirtyRanges m_DirtySpheres;
+    FDirtyRanges m_DirtyPlanes;
+    FDirtyRanges m_DirtyMaterials;
 };
 
 struct FSphereScene : public FScene
@@ -92,3 +172,10 @@ struct FCornellBoxScene : public FScene
 
     virtual void Reset() override;
 };
+
+struct FVikingRoomScene : public FScene
+{
+    virtual void Initialize() override;
+
+    virtual void Reset() override;
+};
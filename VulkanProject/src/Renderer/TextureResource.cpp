@@ -13,6 +13,18 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "../thirdparty/std_image.h"
 
+// Deleter for the textures that have just been created with data, the transfer queue can still be copying into them
+struct FDeferredDelete
+{
+    FDevice* pDevice;
+
+    template<typename T>
+    void operator()(T* pObject) const
+    {
+        pDevice->DeferDelete(pObject);
+    }
+};
+
 FSampler*             FTextureResource::s_pCubeMapGenSampler             = nullptr;
 FDescriptorSetLayout* FTextureResource::s_pCubeMapGenDescriptorSetLayout = nullptr;
 FPipelineLayout*      FTextureResource::s_pCubeMapGenPipelineLayout      = nullptr;
@@ -171,7 +183,7 @@ static VkFormat GetFloatFormat(int32_t channels)
 }
 
 
-FTextureResource* FTextureResource::LoadFromFile(FDevice* pDevice, const char* filepath)
+FTextureResource* FTextureResource::LoadFromFile(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, const char* filepath)
 {
     FILE* file = fopen(filepath, "rb");
     if (!file)
@@ -241,7 +253,7 @@ FTextureResource* FTextureResource::LoadFromFile(FDevice* pDevice, const char* f
     textureParams.Usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     textureParams.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    std::unique_ptr<FTexture> pTexture = std::unique_ptr<FTexture>(FTexture::CreateWithData(pDevice, textureParams, pixels.get()));
+    std::unique_ptr<FTexture, FDeferredDelete> pTexture(FTexture::CreateWithData(pDevice, textureParams, pAllocator, pixels.get()), FDeferredDelete{ pDevice });
     if (!pTexture)
     {
         std::cout << "Failed to create Texture '" << filepath << "'\n";
@@ -277,9 +289,9 @@ FTextureResource* FTextureResource::LoadFromFile(FDevice* pDevice, const char* f
     return pTextureResource.release();
 }
 
-FTextureResource* FTextureResource::LoadCubeMapFromPanoramaFile(FDevice* pDevice, const char* filepath)
+FTextureResource* FTextureResource::LoadCubeMapFromPanoramaFile(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, const char* filepath)
 {
-    std::unique_ptr<FTextureResource> pPanorama = std::unique_ptr<FTextureResource>(LoadFromFile(pDevice, filepath));
+    std::unique_ptr<FTextureResource, FDeferredDelete> pPanorama(LoadFromFile(pDevice, pAllocator, filepath), FDeferredDelete{ pDevice });
     if (!pPanorama)
     {
         return nullptr;
@@ -295,8 +307,11 @@ FTextureResource* FTextureResource::LoadCubeMapFromPanoramaFile(FDevice* pDevice
     textureParams.Height         = CubeMapSize;
     textureParams.NumArraySlices = 6;
     textureParams.Usage          = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    // Generated on the graphics queue and sampled by the path tracer on the compute queue
+    textureParams.bConcurrentQueues = true;
     
-    std::unique_ptr<FTexture> pTexture = std::unique_ptr<FTexture>(FTexture::Create(pDevice, textureParams));
+    std::unique_ptr<FTexture> pTexture = std::unique_ptr<FTexture>(FTexture::Create(pDevice, textureParams, pAllocator));
     if (!pTexture)
     {
         std::cout << "Failed to create TextureCube '" << filepath << "'\n";
@@ -400,7 +415,7 @@ FTextureResource* FTextureResource::LoadCubeMapFromPanoramaFile(FDevice* pDevice
     pCommandBuffer->End();
     
     pDevice->ExecuteGraphics(pCommandBuffer.get(), nullptr, nullptr);
-    pDevice->WaitForIdle();
+    pCommandBuffer->WaitUntilFinished();
 
     std::unique_ptr<FTextureResource> pTextureResource = std::make_unique<FTextureResource>(pDevice);
     pTextureResource->m_pTexture     = pTexture.release();
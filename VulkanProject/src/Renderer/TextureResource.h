@@ -11,8 +11,9 @@ public:
     static bool InitLoader(FDevice* pDevice);
     static void ReleaseLoader();
 
-    static FTextureResource* LoadFromFile(FDevice* pDevice, const char* filepath);
-    static FTextureResource* LoadCubeMapFromPanoramaFile(FDevice* pDevice, const char* filepath);
+    // The allocator can be nullptr, then the textures get dedicated memory
+    static FTextureResource* LoadFromFile(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, const char* filepath);
+    static FTextureResource* LoadCubeMapFromPanoramaFile(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator, const char* filepath);
     
     FTextureResource(FDevice* pDevice);
     ~FTextureResource();
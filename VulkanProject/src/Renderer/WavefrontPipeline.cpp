@@ -0,0 +1,364 @@
+#include "WavefrontPipeline.h"
+#include "MathHelper.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/ShaderModule.h"
+#include "Vulkan/ShaderCompiler.h"
+#include "Vulkan/PipelineState.h"
+#include "Vulkan/PipelineLayout.h"
+#include "Vulkan/CommandBuffer.h"
+#include "Vulkan/DescriptorPool.h"
+#include "Vulkan/DescriptorSet.h"
+#include "Vulkan/DescriptorSetLayout.h"
+
+// Same group size as the megakernel, used for the stages that run per pixel
+#define WAVEFRONT_NUM_PIXEL_THREADS (16)
+
+// Barrier between two stages, the indirect arguments are written by the shade stage
+#define WAVEFRONT_STAGE_MASK  (VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT)
+#define WAVEFRONT_ACCESS_MASK (VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+
+// Loads the compiled shader, or compiles the GLSL source when there is a compiler
+static FComputePipeline* CreateComputePipelineFromFile(FDevice* pDevice, FPipelineLayout* pPipelineLayout, FShaderCompiler* pCompiler, const char* pShaderName)
+{
+    const std::string filepath = std::string(RESOURCE_PATH"/shaders/") + pShaderName + (pCompiler ? ".glsl" : ".spv");
+
+    FShaderModule* pComputeShader = pCompiler ?
+        FShaderModule::CreateFromSourceFile(pDevice, pCompiler, "main", filepath.c_str(), VK_SHADER_STAGE_COMPUTE_BIT) :
+        FShaderModule::CreateFromFile(pDevice, "main", filepath.c_str());
+    if (!pComputeShader)
+    {
+        std::cout << "FAILED to create ComputeShader '" << filepath << "'\n";
+        return nullptr;
+    }
+
+    FComputePipelineStateParams pipelineParams = {};
+    pipelineParams.pShader         = pComputeShader;
+    pipelineParams.pPipelineLayout = pPipelineLayout;
+
+    FComputePipeline* pComputePipeline = FComputePipeline::Create(pDevice, pipelineParams);
+    if (!pComputePipeline)
+    {
+        std::cout << "FAILED to create ComputePipeline '" << filepath << "'\n";
+    }
+
+    SAFE_DELETE(pComputeShader);
+    return pComputePipeline;
+}
+
+FWavefrontPipeline* FWavefrontPipeline::Create(FDevice* pDevice, FDescriptorSetLayout* pSceneLayout, FShaderCompiler* pCompiler)
+{
+    FWavefrontPipeline* pWavefrontPipeline = new FWavefrontPipeline(pDevice);
+
+    // Create DescriptorSetLayout
+    constexpr uint32_t numBindings = WAVEFRONT_NUM_BINDINGS;
+    VkDescriptorSetLayoutBinding bindings[numBindings];
+    for (uint32_t i = 0; i < numBindings; i++)
+    {
+        bindings[i].binding            = i;
+        bindings[i].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount    = 1;
+        bindings[i].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    FDescriptorSetLayoutParams descriptorSetLayoutParams;
+    descriptorSetLayoutParams.pBindings   = bindings;
+    descriptorSetLayoutParams.numBindings = numBindings;
+
+    pWavefrontPipeline->m_pDescriptorSetLayout = FDescriptorSetLayout::Create(pDevice, descriptorSetLayoutParams);
+    if (!pWavefrontPipeline->m_pDescriptorSetLayout)
+    {
+        SAFE_DELETE(pWavefrontPipeline);
+        return nullptr;
+    }
+
+    // Create PipelineLayout, the push constants are the frame constants followed by the current bounce, the max number of
+    // bounces and the current sample
+    FDescriptorSetLayout* layouts[] = { pSceneLayout, pWavefrontPipeline->m_pDescriptorSetLayout };
+
+    FPipelineLayoutParams pipelineLayoutParams;
+    pipelineLayoutParams.ppLayouts        = layouts;
+    pipelineLayoutParams.numLayouts       = 2;
+    pipelineLayoutParams.numPushConstants = (WAVEFRONT_PUSH_CONSTANT_OFFSET / sizeof(uint32_t)) + WAVEFRONT_NUM_PUSH_CONSTANTS;
+
+    pWavefrontPipeline->m_pPipelineLayout = FPipelineLayout::Create(pDevice, pipelineLayoutParams);
+    if (!pWavefrontPipeline->m_pPipelineLayout)
+    {
+        SAFE_DELETE(pWavefrontPipeline);
+        return nullptr;
+    }
+
+    // Fall back to the files compiled by the build
+    bool bCreatedShaders = pCompiler && pWavefrontPipeline->CreateShaders(pCompiler);
+    if (!bCreatedShaders)
+    {
+        bCreatedShaders = pWavefrontPipeline->CreateShaders(nullptr);
+    }
+
+    if (!bCreatedShaders)
+    {
+        SAFE_DELETE(pWavefrontPipeline);
+        return nullptr;
+    }
+
+    pWavefrontPipeline->SwapShaders();
+    return pWavefrontPipeline;
+}
+
+FWavefrontPipeline::FWavefrontPipeline(FDevice* pDevice)
+    : m_pDevice(pDevice)
+    , m_pPipelineLayout(nullptr)
+    , m_pDescriptorSetLayout(nullptr)
+    , m_pDescriptorPool(nullptr)
+    , m_pDescriptorSet(nullptr)
+    , m_pGeneratePipeline(nullptr)
+    , m_pExtendPipeline(nullptr)
+    , m_pShadePipeline(nullptr)
+    , m_pAccumulatePipeline(nullptr)
+    , m_pNewGeneratePipeline(nullptr)
+    , m_pNewExtendPipeline(nullptr)
+    , m_pNewShadePipeline(nullptr)
+    , m_pNewAccumulatePipeline(nullptr)
+    , m_pPathStateBuffer(nullptr)
+    , m_pPathHitBuffer(nullptr)
+    , m_pRayQueueBuffer(nullptr)
+    , m_pShadeQueueBuffer(nullptr)
+    , m_pCounterBuffer(nullptr)
+    , m_Width(0)
+    , m_Height(0)
+{
+}
+
+FWavefrontPipeline::~FWavefrontPipeline()
+{
+    ReleaseBuffers();
+
+    ReleaseNewShaders();
+
+    SAFE_DELETE(m_pGeneratePipeline);
+    SAFE_DELETE(m_pExtendPipeline);
+    SAFE_DELETE(m_pShadePipeline);
+    SAFE_DELETE(m_pAccumulatePipeline);
+
+    SAFE_DELETE(m_pPipelineLayout);
+    SAFE_DELETE(m_pDescriptorSetLayout);
+}
+
+void FWavefrontPipeline::Resize(uint32_t width, uint32_t height)
+{
+    if ((m_Width == width && m_Height == height) || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    // The old buffers can still be used by the frames in flight, the set is queued first so that it is freed before its pool
+    m_pDevice->DeferDelete(m_pDescriptorSet);
+    m_pDevice->DeferDelete(m_pDescriptorPool);
+    m_pDevice->DeferDelete(m_pPathStateBuffer);
+    m_pDevice->DeferDelete(m_pPathHitBuffer);
+    m_pDevice->DeferDelete(m_pRayQueueBuffer);
+    m_pDevice->DeferDelete(m_pShadeQueueBuffer);
+    m_pDevice->DeferDelete(m_pCounterBuffer);
+
+    m_Width  = width;
+    m_Height = height;
+
+    const bool bResult = CreateBuffers();
+    assert(bResult == true);
+    (void)bResult;
+}
+
+void FWavefrontPipeline::Dispatch(FCommandBuffer* pCommandBuffer, FDescriptorSet* pSceneDescriptorSet, uint32_t width, uint32_t height, uint32_t maxBounces, uint32_t numSamples)
+{
+    assert(m_pDescriptorSet != nullptr);
+    assert(width <= m_Width && height <= m_Height);
+
+    // The bounces are limited by the caller so that the image matches the megakernel
+    assert(maxBounces <= WAVEFRONT_MAX_BOUNCES);
+    assert(numSamples <= WAVEFRONT_MAX_SAMPLES);
+    const uint32_t numBounces = std::min<uint32_t>(maxBounces, WAVEFRONT_MAX_BOUNCES);
+    const uint32_t numSteps   = numBounces + 1;
+    const uint32_t numGroupsX = Math::AlignUp(width,  WAVEFRONT_NUM_PIXEL_THREADS) / WAVEFRONT_NUM_PIXEL_THREADS;
+    const uint32_t numGroupsY = Math::AlignUp(height, WAVEFRONT_NUM_PIXEL_THREADS) / WAVEFRONT_NUM_PIXEL_THREADS;
+
+    pCommandBuffer->BindComputeDescriptorSet(m_pPipelineLayout, pSceneDescriptorSet, 0);
+    pCommandBuffer->BindComputeDescriptorSet(m_pPipelineLayout, m_pDescriptorSet, 1);
+
+    // Every bounce of every sample has its own counters, so they are cleared once instead of before every bounce. The
+    // previous dispatch can still read the indirect arguments.
+    pCommandBuffer->PipelineBarrier(WAVEFRONT_STAGE_MASK, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+    pCommandBuffer->FillBuffer(m_pCounterBuffer, 0, sizeof(FWavefrontBounceCounters) * numSteps * numSamples, 0);
+    pCommandBuffer->PipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK);
+
+    // There is one path per pixel so each sample runs the whole pipeline
+    for (uint32_t sample = 0; sample < numSamples; sample++)
+    {
+        uint32_t pushConstants[WAVEFRONT_NUM_PUSH_CONSTANTS] = { 0, numBounces, sample };
+        pCommandBuffer->PushConstants(m_pPipelineLayout, VK_SHADER_STAGE_ALL, WAVEFRONT_PUSH_CONSTANT_OFFSET, sizeof(pushConstants), pushConstants);
+
+        // Generate, only adds the pixels that have not converged
+        pCommandBuffer->BindComputePipelineState(m_pGeneratePipeline);
+        pCommandBuffer->Dispatch(numGroupsX, numGroupsY, 1);
+        pCommandBuffer->PipelineBarrier(WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK, WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK);
+
+        // Extend and shade, the rays that survive are pushed to the queue of the next bounce. The number of bounces is fixed
+        // since the CPU does not know when the queues are empty, but the dispatches after that have no groups.
+        for (uint32_t bounce = 0; bounce < numBounces; bounce++)
+        {
+            pushConstants[0] = bounce;
+            pCommandBuffer->PushConstants(m_pPipelineLayout, VK_SHADER_STAGE_ALL, WAVEFRONT_PUSH_CONSTANT_OFFSET, sizeof(uint32_t), pushConstants);
+
+            // The dispatch arguments are stored after the counts
+            const VkDeviceSize countersOffset = sizeof(FWavefrontBounceCounters) * ((sample * numSteps) + bounce);
+            const VkDeviceSize extendOffset   = countersOffset + offsetof(FWavefrontBounceCounters, Rays) + offsetof(FWavefrontQueueCounter, NumGroupsX);
+            const VkDeviceSize shadeOffset    = countersOffset + offsetof(FWavefrontBounceCounters, Shade) + offsetof(FWavefrontShadeCounter, NumGroupsX);
+
+            pCommandBuffer->BindComputePipelineState(m_pExtendPipeline);
+            pCommandBuffer->DispatchIndirect(m_pCounterBuffer, extendOffset);
+            pCommandBuffer->PipelineBarrier(WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK, WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK);
+
+            pCommandBuffer->BindComputePipelineState(m_pShadePipeline);
+            pCommandBuffer->DispatchIndirect(m_pCounterBuffer, shadeOffset);
+            pCommandBuffer->PipelineBarrier(WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK, WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK);
+        }
+
+        // Accumulate, the next sample overwrites the paths and adds to the same image
+        pCommandBuffer->BindComputePipelineState(m_pAccumulatePipeline);
+        pCommandBuffer->Dispatch(numGroupsX, numGroupsY, 1);
+
+        if (sample + 1 < numSamples)
+        {
+            pCommandBuffer->PipelineBarrier(WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK, WAVEFRONT_STAGE_MASK, WAVEFRONT_ACCESS_MASK);
+        }
+    }
+}
+
+bool FWavefrontPipeline::CreateShaders(FShaderCompiler* pCompiler)
+{
+    ReleaseNewShaders();
+
+    m_pNewGeneratePipeline   = CreateComputePipelineFromFile(m_pDevice, m_pPipelineLayout, pCompiler, "wavefront_generate");
+    m_pNewExtendPipeline     = CreateComputePipelineFromFile(m_pDevice, m_pPipelineLayout, pCompiler, "wavefront_extend");
+    m_pNewShadePipeline      = CreateComputePipelineFromFile(m_pDevice, m_pPipelineLayout, pCompiler, "wavefront_shade");
+    m_pNewAccumulatePipeline = CreateComputePipelineFromFile(m_pDevice, m_pPipelineLayout, pCompiler, "wavefront_accumulate");
+    if (!m_pNewGeneratePipeline || !m_pNewExtendPipeline || !m_pNewShadePipeline || !m_pNewAccumulatePipeline)
+    {
+        ReleaseNewShaders();
+        return false;
+    }
+
+    return true;
+}
+
+void FWavefrontPipeline::SwapShaders()
+{
+    if (!m_pNewGeneratePipeline)
+    {
+        return;
+    }
+
+    std::swap(m_pGeneratePipeline, m_pNewGeneratePipeline);
+    std::swap(m_pExtendPipeline, m_pNewExtendPipeline);
+    std::swap(m_pShadePipeline, m_pNewShadePipeline);
+    std::swap(m_pAccumulatePipeline, m_pNewAccumulatePipeline);
+
+    // The old pipelines were swapped into the new ones, the frames in flight can still use them
+    m_pDevice->DeferDelete(m_pNewGeneratePipeline);
+    m_pDevice->DeferDelete(m_pNewExtendPipeline);
+    m_pDevice->DeferDelete(m_pNewShadePipeline);
+    m_pDevice->DeferDelete(m_pNewAccumulatePipeline);
+}
+
+void FWavefrontPipeline::ReleaseNewShaders()
+{
+    SAFE_DELETE(m_pNewGeneratePipeline);
+    SAFE_DELETE(m_pNewExtendPipeline);
+    SAFE_DELETE(m_pNewShadePipeline);
+    SAFE_DELETE(m_pNewAccumulatePipeline);
+}
+
+bool FWavefrontPipeline::CreateBuffers()
+{
+    const VkDeviceSize numPaths = VkDeviceSize(m_Width) * VkDeviceSize(m_Height);
+
+    FBufferParams bufferParams;
+    bufferParams.MemoryProperties = VK_GPU_BUFFER_USAGE;
+    bufferParams.Usage            = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    // PathStateBuffer
+    bufferParams.Size  = sizeof(FWavefrontPathState) * numPaths;
+    m_pPathStateBuffer = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!m_pPathStateBuffer)
+    {
+        return false;
+    }
+
+    // PathHitBuffer
+    bufferParams.Size = sizeof(FWavefrontPathHit) * numPaths;
+    m_pPathHitBuffer  = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!m_pPathHitBuffer)
+    {
+        return false;
+    }
+
+    // RayQueueBuffer
+    bufferParams.Size = sizeof(uint32_t) * numPaths * WAVEFRONT_NUM_QUEUES;
+    m_pRayQueueBuffer = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!m_pRayQueueBuffer)
+    {
+        return false;
+    }
+
+    // ShadeQueueBuffer
+    bufferParams.Size   = sizeof(uint32_t) * numPaths * WAVEFRONT_NUM_SHADE_QUEUES;
+    m_pShadeQueueBuffer = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!m_pShadeQueueBuffer)
+    {
+        return false;
+    }
+
+    // CounterBuffer, this is also the argument buffer for the indirect dispatches
+    bufferParams.Size  = sizeof(FWavefrontBounceCounters) * (WAVEFRONT_MAX_BOUNCES + 1) * WAVEFRONT_MAX_SAMPLES;
+    bufferParams.Usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    m_pCounterBuffer   = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!m_pCounterBuffer)
+    {
+        return false;
+    }
+
+    // The pool only holds this set, the old pool is still in use when the buffers are replaced during the frames in flight
+    FDescriptorPoolParams poolParams;
+    poolParams.NumStorageBuffers = WAVEFRONT_NUM_BINDINGS;
+    poolParams.MaxSets           = 1;
+
+    m_pDescriptorPool = FDescriptorPool::Create(m_pDevice, poolParams);
+    if (!m_pDescriptorPool)
+    {
+        return false;
+    }
+
+    m_pDescriptorSet = FDescriptorSet::Create(m_pDevice, m_pDescriptorPool, m_pDescriptorSetLayout);
+    if (!m_pDescriptorSet)
+    {
+        return false;
+    }
+
+    m_pDescriptorSet->BindStorageBuffer(m_pPathStateBuffer->GetBuffer(), 0);
+    m_pDescriptorSet->BindStorageBuffer(m_pPathHitBuffer->GetBuffer(), 1);
+    m_pDescriptorSet->BindStorageBuffer(m_pRayQueueBuffer->GetBuffer(), 2);
+    m_pDescriptorSet->BindStorageBuffer(m_pCounterBuffer->GetBuffer(), 3);
+    m_pDescriptorSet->BindStorageBuffer(m_pShadeQueueBuffer->GetBuffer(), 4);
+    return true;
+}
+
+void FWavefrontPipeline::ReleaseBuffers()
+{
+    SAFE_DELETE(m_pDescriptorSet);
+    SAFE_DELETE(m_pDescriptorPool);
+    SAFE_DELETE(m_pPathStateBuffer);
+    SAFE_DELETE(m_pPathHitBuffer);
+    SAFE_DELETE(m_pRayQueueBuffer);
+    SAFE_DELETE(m_pShadeQueueBuffer);
+    SAFE_DELETE(m_pCounterBuffer);
+}
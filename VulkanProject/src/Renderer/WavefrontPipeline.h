@@ -0,0 +1,149 @@
+#pragma once
+#include "Core.h"
+
+#define WAVEFRONT_NUM_THREADS   (256)
+#define WAVEFRONT_MAX_BOUNCES   (64)
+#define WAVEFRONT_MAX_SAMPLES   (64)
+#define WAVEFRONT_NUM_QUEUES    (2)
+
+// One shade queue per material type and one for the rays that missed
+#define WAVEFRONT_NUM_SHADE_QUEUES (5)
+
+// Storage buffers in the descriptor set of the wavefront kernels
+#define WAVEFRONT_NUM_BINDINGS (5)
+
+// The frame constants of the scene are pushed first, the wavefront constants are placed after them
+#define WAVEFRONT_PUSH_CONSTANT_OFFSET (sizeof(uint32_t) * 2)
+#define WAVEFRONT_NUM_PUSH_CONSTANTS   (3)
+
+class FDevice;
+class FBuffer;
+class FCommandBuffer;
+class FComputePipeline;
+class FDescriptorPool;
+class FDescriptorSet;
+class FDescriptorSetLayout;
+class FPipelineLayout;
+class FShaderCompiler;
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// Buffer Structs, these need to match wavefront.glsl
+
+struct FWavefrontPathState
+{
+    glm::vec3 Origin;
+    uint32_t  RandomSeed;
+    glm::vec3 Direction;
+    uint32_t  Depth;
+    glm::vec3 Throughput;
+    float     BSDFPdf;
+    glm::vec3 Radiance;
+    uint32_t  bActive;
+};
+
+struct FWavefrontPathHit
+{
+    glm::vec3 Normal;
+    float     T;
+    uint32_t  MaterialIndex;
+    uint32_t  FrontFace;
+    uint32_t  bHit;
+    uint32_t  Primitive;
+};
+
+// Count is the number of rays in the queue, the rest is used as VkDispatchIndirectCommand. The counters are cleared to
+// zero and the shaders set the group counts when they push the first ray.
+struct FWavefrontQueueCounter
+{
+    uint32_t Count;
+    uint32_t NumGroupsX;
+    uint32_t NumGroupsY;
+    uint32_t NumGroupsZ;
+};
+
+// The number of hits of each material type, the groups are used as VkDispatchIndirectCommand for the shade stage
+struct FWavefrontShadeCounter
+{
+    uint32_t Counts[WAVEFRONT_NUM_SHADE_QUEUES];
+    uint32_t NumGroupsX;
+    uint32_t NumGroupsY;
+    uint32_t NumGroupsZ;
+};
+
+// The counters of one bounce of a sample, the buffer has them for every bounce of every sample in a dispatch
+struct FWavefrontBounceCounters
+{
+    FWavefrontQueueCounter Rays;
+    FWavefrontShadeCounter Shade;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// WavefrontPipeline, traces the paths with one kernel per stage instead of a single megakernel.
+// The stages communicate through ray queues in GPU memory and the extend and shade stages are
+// dispatched indirectly with the number of paths that are still alive. The extend stage sorts the
+// hits into one shade queue per material type, so the groups of the shade stage stay coherent.
+// Every bounce has its own counters, so the whole chain is recorded without any transfers in
+// between and the bounces after the last path has finished dispatch no groups.
+
+class FWavefrontPipeline
+{
+public:
+    // The scene layout is bound to set 0 and needs to be the same one as the megakernel uses. The shaders are compiled
+    // with the compiler when there is one, and loaded from the compiled files otherwise.
+    static FWavefrontPipeline* Create(FDevice* pDevice, FDescriptorSetLayout* pSceneLayout, FShaderCompiler* pCompiler);
+
+    FWavefrontPipeline(FDevice* pDevice);
+    ~FWavefrontPipeline();
+
+    // Recreates the path buffers when the size of the render targets changes, there is one path per pixel of the targets
+    void Resize(uint32_t width, uint32_t height);
+
+    // Records all the stages once per sample for the image in the top left corner of the render targets, expects the scene
+    // to be uploaded, the frame constants to be pushed and the images to be in VK_IMAGE_LAYOUT_GENERAL. There can be at
+    // most WAVEFRONT_MAX_SAMPLES samples and WAVEFRONT_MAX_BOUNCES bounces.
+    void Dispatch(FCommandBuffer* pCommandBuffer, FDescriptorSet* pSceneDescriptorSet, uint32_t width, uint32_t height, uint32_t maxBounces, uint32_t numSamples);
+
+    // Creates new pipelines from the compiled shaders, or from the GLSL source when there is a compiler. Can be called
+    // from another thread while the current pipelines are used, returns false if any of them fails.
+    bool CreateShaders(FShaderCompiler* pCompiler);
+
+    // Starts using the pipelines from CreateShaders, the GPU must be done with the current ones
+    void SwapShaders();
+
+    FPipelineLayout* GetPipelineLayout() const
+    {
+        return m_pPipelineLayout;
+    }
+
+private:
+    bool CreateBuffers();
+    void ReleaseBuffers();
+
+    void ReleaseNewShaders();
+
+    FDevice*              m_pDevice;
+    FPipelineLayout*      m_pPipelineLayout;
+    FDescriptorSetLayout* m_pDescriptorSetLayout;
+    FDescriptorPool*      m_pDescriptorPool;
+    FDescriptorSet*       m_pDescriptorSet;
+    FComputePipeline*     m_pGeneratePipeline;
+    FComputePipeline*     m_pExtendPipeline;
+    FComputePipeline*     m_pShadePipeline;
+    FComputePipeline*     m_pAccumulatePipeline;
+
+    // Created by CreateShaders and used after SwapShaders
+    FComputePipeline* m_pNewGeneratePipeline;
+    FComputePipeline* m_pNewExtendPipeline;
+    FComputePipeline* m_pNewShadePipeline;
+    FComputePipeline* m_pNewAccumulatePipeline;
+
+    // Buffers
+    FBuffer* m_pPathStateBuffer;
+    FBuffer* m_pPathHitBuffer;
+    FBuffer* m_pRayQueueBuffer;
+    FBuffer* m_pShadeQueueBuffer;
+    FBuffer* m_pCounterBuffer;
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+};
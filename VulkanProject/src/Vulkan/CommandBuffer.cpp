@@ -7,7 +7,7 @@
 
 FCommandBuffer* FCommandBuffer::Create(FDevice* pDevice, const FCommandBufferParams& params)
 {
-    FCommandBuffer* pCommandBuffer = new FCommandBuffer(pDevice->GetDevice());
+    FCommandBuffer* pCommandBuffer = new FCommandBuffer(pDevice, params.QueueType);
     
     VkCommandPoolCreateInfo poolInfo;
     ZERO_STRUCT(&poolInfo);
@@ -45,46 +45,25 @@ FCommandBuffer* FCommandBuffer::Create(FDevice* pDevice, const FCommandBufferPar
         std::cout << "Allocated CommandBuffer\n";
     }
 
-    VkFenceCreateInfo fenceInfo;
-    ZERO_STRUCT(&fenceInfo);
-    
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    result = vkCreateFence(pCommandBuffer->m_Device, &fenceInfo, nullptr, &pCommandBuffer->m_Fence);
-    if (result != VK_SUCCESS)
-    {
-        std::cout << "vkCreateFence failed. Error: " << result << '\n';
-        return nullptr;
-    }
-    else
-    {
-        std::cout << "Created Fence for CommandBuffer\n";
-    }
-    
     return pCommandBuffer;
 }
 
-FCommandBuffer::FCommandBuffer(VkDevice device)
-    : m_Device(device)
+FCommandBuffer::FCommandBuffer(FDevice* pDevice, ECommandQueueType queueType)
+    : m_pDevice(pDevice)
+    , m_Device(pDevice->GetDevice())
+    , m_QueueType(queueType)
+    , m_SubmitValue(0)
     , m_CommandPool(VK_NULL_HANDLE)
     , m_CommandBuffer(VK_NULL_HANDLE)
-    , m_Fence(VK_NULL_HANDLE)
 {
 }
 
 FCommandBuffer::~FCommandBuffer()
 {
-    if (m_Fence != VK_NULL_HANDLE)
-    {
-        WaitForAndResetFences();
-        
-        vkDestroyFence(m_Device, m_Fence, nullptr);
-        m_Fence = VK_NULL_HANDLE;
-    }
-
     if (m_CommandPool != VK_NULL_HANDLE)
     {
+        WaitUntilFinished();
+
         vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
         m_CommandPool = VK_NULL_HANDLE;
     }
@@ -92,6 +71,25 @@ FCommandBuffer::~FCommandBuffer()
     m_Device = VK_NULL_HANDLE;
 }
 
+bool FCommandBuffer::IsFinishedOnGPU() const
+{
+    return m_pDevice->IsTimelineComplete(m_QueueType, m_SubmitValue);
+}
+
+void FCommandBuffer::WaitUntilFinished() const
+{
+    m_pDevice->WaitForTimeline(m_QueueType, m_SubmitValue);
+}
+
+void FCommandBuffer::Reset(VkCommandPoolResetFlags flags)
+{
+    // Wait for GPU to finish with this CommandBuffer and then reset it
+    WaitUntilFinished();
+    
+    // Avoid using the VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT since we can reuse the memory
+    vkResetCommandPool(m_Device, m_CommandPool, flags);
+}
+
 void FCommandBuffer::TransitionImage(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
 {
     VkImageMemoryBarrier barrier;
@@ -176,6 +174,22 @@ void FCommandBuffer::TransitionImage(VkImage image, VkImageLayout oldLayout, VkI
         sourceStage      = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
         destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     }
+    else if (oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+    {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        sourceStage      = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        sourceStage      = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
     else
     {
         std::cout << "Unsupported layout transition!\n";
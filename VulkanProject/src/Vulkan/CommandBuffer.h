@@ -1,5 +1,6 @@
 #pragma once
 #include "Core.h"
+#include "CommandQueue.h"
 #include "Buffer.h"
 #include "RenderPass.h"
 #include "Framebuffer.h"
@@ -9,13 +10,6 @@
 #include "PipelineLayout.h"
 #include <vulkan/vulkan.h>
 
-enum class ECommandQueueType
-{
-    Graphics = 1,
-    Compute  = 2,
-    Transfer = 3,
-};
-
 struct FCommandBufferParams
 {
     VkCommandBufferLevel Level;
@@ -27,7 +21,7 @@ class FCommandBuffer
 public:
     static FCommandBuffer* Create(class FDevice* pDevice, const FCommandBufferParams& params);
 
-    FCommandBuffer(VkDevice device);
+    FCommandBuffer(class FDevice* pDevice, ECommandQueueType queueType);
     ~FCommandBuffer();
 
     void Begin(VkCommandBufferUsageFlags flags = 0)
@@ -96,10 +90,10 @@ public:
         vkCmdBindDescriptorSets(m_CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pPipelineLayout->GetPipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
     }
     
-    void BindComputeDescriptorSet(FPipelineLayout* pPipelineLayout, FDescriptorSet* pDescriptorSet)
+    void BindComputeDescriptorSet(FPipelineLayout* pPipelineLayout, FDescriptorSet* pDescriptorSet, uint32_t setIndex = 0)
     {
         VkDescriptorSet descriptorSet = pDescriptorSet->GetDescriptorSet();
-        vkCmdBindDescriptorSets(m_CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pPipelineLayout->GetPipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdBindDescriptorSets(m_CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pPipelineLayout->GetPipelineLayout(), setIndex, 1, &descriptorSet, 0, nullptr);
     }
 
     void BindVertexBuffer(FBuffer* pBuffer, VkDeviceSize offset, uint32_t slot)
@@ -123,17 +117,74 @@ public:
     }
     
     void TransitionImage(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+    // Global memory barrier, used to synchronize buffers between passes
+    void PipelineBarrier(VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+    {
+        VkMemoryBarrier barrier;
+        ZERO_STRUCT(&barrier);
+
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = dstAccessMask;
+
+        vkCmdPipelineBarrier(m_CommandBuffer, srcStageMask, dstStageMask, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+    
+    // Image barrier on the whole image, the queue families are used to transfer the ownership of the image to another
+    // queue family. The release and the acquire must both be recorded with the same layouts and queue families.
+    void ImageBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask, uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED)
+    {
+        VkImageMemoryBarrier barrier;
+        ZERO_STRUCT(&barrier);
+
+        barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout                       = oldLayout;
+        barrier.newLayout                       = newLayout;
+        barrier.srcAccessMask                   = srcAccessMask;
+        barrier.dstAccessMask                   = dstAccessMask;
+        barrier.srcQueueFamilyIndex             = srcQueueFamily;
+        barrier.dstQueueFamilyIndex             = dstQueueFamily;
+        barrier.image                           = image;
+        barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel   = 0;
+        barrier.subresourceRange.levelCount     = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+        vkCmdPipelineBarrier(m_CommandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
     
     void UpdateBuffer(FBuffer* pBuffer, VkDeviceSize dstOffset, VkDeviceSize dataSize, const void* pData)
     {
         vkCmdUpdateBuffer(m_CommandBuffer, pBuffer->GetBuffer(), dstOffset, dataSize, pData);
     }
+
+    void FillBuffer(FBuffer* pBuffer, VkDeviceSize dstOffset, VkDeviceSize size, uint32_t data)
+    {
+        vkCmdFillBuffer(m_CommandBuffer, pBuffer->GetBuffer(), dstOffset, size, data);
+    }
+    
+    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions)
+    {
+        vkCmdCopyBuffer(m_CommandBuffer, srcBuffer, dstBuffer, regionCount, pRegions);
+    }
     
     void CopyBufferToImage(VkBuffer srcBuffer, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkBufferImageCopy* pRegions)
     {
         vkCmdCopyBufferToImage(m_CommandBuffer, srcBuffer, dstImage, dstImageLayout, regionCount, pRegions);
     }
 
+    void CopyImage(VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* pRegions)
+    {
+        vkCmdCopyImage(m_CommandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions);
+    }
+
+    void CopyImageToBuffer(VkImage srcImage, VkImageLayout srcImageLayout, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferImageCopy* pRegions)
+    {
+        vkCmdCopyImageToBuffer(m_CommandBuffer, srcImage, srcImageLayout, dstBuffer, regionCount, pRegions);
+    }
+
     void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
     {
         vkCmdDraw(m_CommandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
@@ -149,6 +200,11 @@ public:
         vkCmdDispatch(m_CommandBuffer, threadGroupsX, threadGroupsY, threadGroupsZ);
     }
 
+    void DispatchIndirect(FBuffer* pBuffer, VkDeviceSize offset)
+    {
+        vkCmdDispatchIndirect(m_CommandBuffer, pBuffer->GetBuffer(), offset);
+    }
+
     void EndRenderPass()
     {
         vkCmdEndRenderPass(m_CommandBuffer);
@@ -163,30 +219,26 @@ public:
         }
     }
     
-    bool IsFinishedOnGPU() const
-    {
-        VkResult result = vkGetFenceStatus(m_Device, m_Fence);
-        return result == VK_NOT_READY;
-    }
-    
-    void WaitForAndResetFences()
+    // The CommandBuffer has finished when the timeline of its queue has reached the value of the last submission
+    bool IsFinishedOnGPU() const;
+    void WaitUntilFinished() const;
+
+    void Reset(VkCommandPoolResetFlags flags = 0);
+
+    // Called by the device when the CommandBuffer is submitted
+    void SetSubmitValue(uint64_t submitValue)
     {
-        vkWaitForFences(m_Device, 1, &m_Fence, VK_TRUE, UINT64_MAX);
-        vkResetFences(m_Device, 1, &m_Fence);
+        m_SubmitValue = submitValue;
     }
 
-    void Reset(VkCommandPoolResetFlags flags = 0)
+    uint64_t GetSubmitValue() const
     {
-        // Wait for GPU to finish with this CommandBuffer and then reset it
-        WaitForAndResetFences();
-        
-        // Avoid using the VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT since we can reuse the memory
-        vkResetCommandPool(m_Device, m_CommandPool, flags);
+        return m_SubmitValue;
     }
 
-    VkFence GetFence() const
+    ECommandQueueType GetQueueType() const
     {
-        return m_Fence;
+        return m_QueueType;
     }
     
     VkCommandBuffer GetCommandBuffer() const
@@ -195,8 +247,10 @@ public:
     }
     
 private:
-    VkDevice        m_Device;
-    VkFence         m_Fence;
-    VkCommandPool   m_CommandPool;
-    VkCommandBuffer m_CommandBuffer;
+    class FDevice*    m_pDevice;
+    VkDevice          m_Device;
+    ECommandQueueType m_QueueType;
+    uint64_t          m_SubmitValue;
+    VkCommandPool     m_CommandPool;
+    VkCommandBuffer   m_CommandBuffer;
 };
@@ -0,0 +1,31 @@
+#pragma once
+#include "Core.h"
+
+enum class ECommandQueueType
+{
+    Graphics = 1,
+    Compute  = 2,
+    Transfer = 3,
+};
+
+#define NUM_COMMAND_QUEUE_TYPES (3)
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// TimelinePoint, a value of the timeline semaphore of each queue. Every submission signals the next
+// value of its queue, so the work that was submitted before the point was taken has finished when
+// the device has passed all of the values.
+
+struct FTimelinePoint
+{
+    uint64_t Values[NUM_COMMAND_QUEUE_TYPES] = {};
+
+    uint64_t& operator[](ECommandQueueType queueType)
+    {
+        return Values[static_cast<uint32_t>(queueType) - 1];
+    }
+
+    uint64_t operator[](ECommandQueueType queueType) const
+    {
+        return Values[static_cast<uint32_t>(queueType) - 1];
+    }
+};
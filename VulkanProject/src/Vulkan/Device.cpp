@@ -8,6 +8,31 @@
 #include "DeviceMemoryAllocator.h"
 #include "DescriptorPool.h"
 #include "Swapchain.h"
+#include "TextureUploader.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+// Identifies the pipeline cache files written by FDevice
+#define PIPELINE_CACHE_MAGIC   (0x48435050) // 'PPCH'
+#define PIPELINE_CACHE_VERSION (1)
+
+// Initial size of the staging ring for the texture uploads
+#define TEXTURE_UPLOADER_STAGING_SIZE (32 * 1024 * 1024)
+
+// Written in front of the data from vkGetPipelineCacheData. The driver also checks its own header, but only the
+// vendor, device and cache UUID, so the driver version is checked here as well.
+struct FPipelineCacheFileHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t VendorID;
+    uint32_t DeviceID;
+    uint32_t DriverVersion;
+    uint8_t  PipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t DataSize;
+};
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void*) 
 {
@@ -33,6 +58,13 @@ FDevice::FDevice()
     , m_GraphicsQueue(VK_NULL_HANDLE)
     , m_ComputeQueue(VK_NULL_HANDLE)
     , m_TransferQueue(VK_NULL_HANDLE)
+    , m_PipelineCache(VK_NULL_HANDLE)
+    , m_PipelineCachePath()
+    , m_TimelineSemaphores()
+    , m_SubmittedValues()
+    , m_CompletedValues()
+    , m_DeletionQueue()
+    , m_pTextureUploader(nullptr)
     , m_EnabledDeviceFeatures()
     , m_DeviceProperties()
     , m_DeviceFeatures()
@@ -40,11 +72,37 @@ FDevice::FDevice()
     , m_QueueFamilyIndices()
     , m_bValidationEnabled(false)
     , m_bRayTracingEnabled(false)
+    , m_bHeadless(false)
 {
 }
 
 FDevice::~FDevice()
 {
+    // The deferred objects still use the device
+    if (m_Device)
+    {
+        WaitForIdle();
+    }
+
+    SAFE_DELETE(m_pTextureUploader);
+
+    if (m_PipelineCache != VK_NULL_HANDLE)
+    {
+        SavePipelineCache();
+
+        vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
+        m_PipelineCache = VK_NULL_HANDLE;
+    }
+
+    for (VkSemaphore& semaphore : m_TimelineSemaphores)
+    {
+        if (semaphore != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(m_Device, semaphore, nullptr);
+            semaphore = VK_NULL_HANDLE;
+        }
+    }
+
     if (m_Device)
     {
         vkDestroyDevice(m_Device, nullptr);
@@ -78,12 +136,20 @@ uint32_t FDevice::GetQueueFamilyIndex(ECommandQueueType Type)
     }
 }
 
-void FDevice::ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapchain, VkPipelineStageFlags* pWaitStages)
+VkQueue FDevice::GetQueue(ECommandQueueType type) const
 {
-    VkSubmitInfo submitInfo;
-    ZERO_STRUCT(&submitInfo);
+    switch (type)
+    {
+        case ECommandQueueType::Graphics: return m_GraphicsQueue;
+        case ECommandQueueType::Compute:  return m_ComputeQueue;
+        case ECommandQueueType::Transfer: return m_TransferQueue;
+        default: return VK_NULL_HANDLE;
+    }
+}
 
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+uint64_t FDevice::ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapchain, VkPipelineStageFlags* pWaitStages)
+{
+    FSubmitParams submitParams;
 
     VkSemaphore waitSemaphores[1]   = {};
     VkSemaphore signalSemaphores[1] = {};
@@ -94,28 +160,99 @@ void FDevice::ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapc
         signalSemaphores[0] = pSwapchain->GetRenderSemaphore();
         waitSemaphores[0]   = pSwapchain->GetImageSemaphore();
         
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores    = signalSemaphores;
-        submitInfo.waitSemaphoreCount   = 1;
-        submitInfo.pWaitSemaphores      = waitSemaphores;
-        submitInfo.pWaitDstStageMask    = pWaitStages;
+        submitParams.NumSignalSemaphores = 1;
+        submitParams.pSignalSemaphores   = signalSemaphores;
+        submitParams.NumWaitSemaphores   = 1;
+        submitParams.pWaitSemaphores     = waitSemaphores;
+        submitParams.pWaitStages         = pWaitStages;
     }
-    else
+
+    return Execute(ECommandQueueType::Graphics, pCommandBuffer, submitParams);
+}
+
+uint64_t FDevice::Execute(ECommandQueueType queueType, FCommandBuffer* pCommandBuffer, const FSubmitParams& params)
+{
+    constexpr uint32_t maxSemaphores = 8;
+    assert(params.NumWaitSemaphores + params.NumTimelineWaits + 1 <= maxSemaphores);
+    assert(params.NumSignalSemaphores + 1 <= maxSemaphores);
+
+    // The submission can use the textures that have been uploaded so far, so it waits for the uploads unless they are
+    // known to have finished
+    uint64_t uploadValue = 0;
+    if (queueType != ECommandQueueType::Transfer && m_pTextureUploader)
+    {
+        uploadValue = m_pTextureUploader->Submit();
+    }
+
+    // The binary semaphores come first, their values are ignored
+    VkSemaphore          waitSemaphores[maxSemaphores]   = {};
+    VkPipelineStageFlags waitStages[maxSemaphores]       = {};
+    uint64_t             waitValues[maxSemaphores]       = {};
+    VkSemaphore          signalSemaphores[maxSemaphores] = {};
+    uint64_t             signalValues[maxSemaphores]     = {};
+
+    uint32_t numWaitSemaphores = 0;
+    for (uint32_t i = 0; i < params.NumWaitSemaphores; i++, numWaitSemaphores++)
+    {
+        waitSemaphores[numWaitSemaphores] = params.pWaitSemaphores[i];
+        waitStages[numWaitSemaphores]     = params.pWaitStages[i];
+    }
+
+    for (uint32_t i = 0; i < params.NumTimelineWaits; i++, numWaitSemaphores++)
     {
-        submitInfo.waitSemaphoreCount   = 0;
-        submitInfo.pWaitSemaphores      = nullptr;
-        submitInfo.pWaitDstStageMask    = nullptr;
-        submitInfo.signalSemaphoreCount = 0;
-        submitInfo.pSignalSemaphores    = nullptr;
+        const FTimelineWait& wait = params.pTimelineWaits[i];
+        waitSemaphores[numWaitSemaphores] = m_TimelineSemaphores[static_cast<uint32_t>(wait.QueueType) - 1];
+        waitStages[numWaitSemaphores]     = wait.Stage;
+        waitValues[numWaitSemaphores]     = wait.Value;
     }
 
+    if (params.UploadWaitStage != 0 && uploadValue > m_CompletedValues[ECommandQueueType::Transfer])
+    {
+        waitSemaphores[numWaitSemaphores] = m_TimelineSemaphores[static_cast<uint32_t>(ECommandQueueType::Transfer) - 1];
+        waitStages[numWaitSemaphores]     = params.UploadWaitStage;
+        waitValues[numWaitSemaphores]     = uploadValue;
+        numWaitSemaphores++;
+    }
+
+    uint32_t numSignalSemaphores = 0;
+    for (uint32_t i = 0; i < params.NumSignalSemaphores; i++, numSignalSemaphores++)
+    {
+        signalSemaphores[numSignalSemaphores] = params.pSignalSemaphores[i];
+    }
+
+    // Every submission signals the next value of the timeline of its queue
+    const uint64_t signalValue = ++m_SubmittedValues[queueType];
+    signalSemaphores[numSignalSemaphores] = m_TimelineSemaphores[static_cast<uint32_t>(queueType) - 1];
+    signalValues[numSignalSemaphores]     = signalValue;
+    numSignalSemaphores++;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo;
+    ZERO_STRUCT(&timelineInfo);
+
+    timelineInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount   = numWaitSemaphores;
+    timelineInfo.pWaitSemaphoreValues      = waitValues;
+    timelineInfo.signalSemaphoreValueCount = numSignalSemaphores;
+    timelineInfo.pSignalSemaphoreValues    = signalValues;
+
+    VkSubmitInfo submitInfo;
+    ZERO_STRUCT(&submitInfo);
+
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.waitSemaphoreCount   = numWaitSemaphores;
+    submitInfo.pWaitSemaphores      = waitSemaphores;
+    submitInfo.pWaitDstStageMask    = waitStages;
+    submitInfo.signalSemaphoreCount = numSignalSemaphores;
+    submitInfo.pSignalSemaphores    = signalSemaphores;
+
     // Calling execute with nullptr CommandBuffer results in waiting for the current semaphore
     // This seems to be the only way of handling this
-    VkFence fence = VK_NULL_HANDLE;
     VkCommandBuffer commandBuffers[1] = {};
     if (pCommandBuffer)
     {
-        fence = pCommandBuffer->GetFence();
+        assert(pCommandBuffer->GetQueueType() == queueType);
+        pCommandBuffer->SetSubmitValue(signalValue);
 
         commandBuffers[0] = pCommandBuffer->GetCommandBuffer();
         submitInfo.pCommandBuffers    = commandBuffers;
@@ -127,16 +264,118 @@ void FDevice::ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapc
         submitInfo.commandBufferCount = 0;
     }
 
-    VkResult result = vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, fence);
+    VkResult result = vkQueueSubmit(GetQueue(queueType), 1, &submitInfo, VK_NULL_HANDLE);
     if (result != VK_SUCCESS)
     {
         std::cout << "vkQueueSubmit failed. Error: " << result << '\n';
     }
+
+    return signalValue;
+}
+
+void FDevice::WaitForTimeline(ECommandQueueType queueType, uint64_t value)
+{
+    if (value <= m_CompletedValues[queueType])
+    {
+        return;
+    }
+
+    VkSemaphore semaphore = m_TimelineSemaphores[static_cast<uint32_t>(queueType) - 1];
+
+    VkSemaphoreWaitInfo waitInfo;
+    ZERO_STRUCT(&waitInfo);
+
+    waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &semaphore;
+    waitInfo.pValues        = &value;
+
+    VkResult result = vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX);
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "vkWaitSemaphores failed. Error: " << result << '\n';
+        return;
+    }
+
+    m_CompletedValues[queueType] = value;
+}
+
+bool FDevice::IsTimelineComplete(ECommandQueueType queueType, uint64_t value)
+{
+    if (value <= m_CompletedValues[queueType])
+    {
+        return true;
+    }
+
+    return value <= GetCompletedTimelineValue(queueType);
+}
+
+uint64_t FDevice::GetCompletedTimelineValue(ECommandQueueType queueType)
+{
+    uint64_t value = 0;
+
+    VkResult result = vkGetSemaphoreCounterValue(m_Device, m_TimelineSemaphores[static_cast<uint32_t>(queueType) - 1], &value);
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "vkGetSemaphoreCounterValue failed. Error: " << result << '\n';
+        return m_CompletedValues[queueType];
+    }
+
+    m_CompletedValues[queueType] = std::max(m_CompletedValues[queueType], value);
+    return m_CompletedValues[queueType];
+}
+
+void FDevice::WaitForQueue(ECommandQueueType queueType)
+{
+    WaitForTimeline(queueType, m_SubmittedValues[queueType]);
+}
+
+bool FDevice::HasPassed(const FTimelinePoint& point)
+{
+    return IsTimelineComplete(ECommandQueueType::Graphics, point[ECommandQueueType::Graphics]) &&
+           IsTimelineComplete(ECommandQueueType::Compute,  point[ECommandQueueType::Compute]) &&
+           IsTimelineComplete(ECommandQueueType::Transfer, point[ECommandQueueType::Transfer]);
+}
+
+void FDevice::DeferRelease(std::function<void()>&& release)
+{
+    // The object can be the destination of an upload that has not been submitted yet
+    if (m_pTextureUploader)
+    {
+        m_pTextureUploader->Submit();
+    }
+
+    FDeferredRelease deferred;
+    deferred.Release       = std::move(release);
+    deferred.TimelinePoint = m_SubmittedValues;
+    m_DeletionQueue.emplace_back(std::move(deferred));
+}
+
+void FDevice::EmptyDeletionQueue()
+{
+    // The points are in submission order so the first one that has not been passed ends the search. The entry is
+    // removed before it is released in case the release defers more objects.
+    while (!m_DeletionQueue.empty() && HasPassed(m_DeletionQueue.front().TimelinePoint))
+    {
+        std::function<void()> release = std::move(m_DeletionQueue.front().Release);
+        m_DeletionQueue.pop_front();
+        release();
+    }
 }
 
 void FDevice::WaitForIdle()
 {
+    // The uploads that are still recorded are part of the work that is waited for
+    if (m_pTextureUploader)
+    {
+        m_pTextureUploader->Submit();
+    }
+
     vkDeviceWaitIdle(m_Device);
+
+    // Everything that was submitted has finished
+    m_CompletedValues = m_SubmittedValues;
+    EmptyDeletionQueue();
 }
 
 void FDevice::Destroy()
@@ -147,6 +386,7 @@ void FDevice::Destroy()
 bool FDevice::Init(const FDeviceParams& params)
 {
     m_bValidationEnabled = params.bEnableValidation;
+    m_bHeadless          = params.pWindow == nullptr;
     if (CreateInstance(params))
     {
         std::cout << "Created Vulkan Instance\n";
@@ -186,6 +426,101 @@ bool FDevice::Init(const FDeviceParams& params)
         return false;
     }
 
+    if (CreateTimelineSemaphores())
+    {
+        std::cout << "Created Timeline Semaphores\n";
+    }
+    else
+    {
+        return false;
+    }
+
+    if (CreatePipelineCache(params))
+    {
+        std::cout << "Created Pipeline Cache\n";
+    }
+    else
+    {
+        return false;
+    }
+
+    FTextureUploaderParams textureUploaderParams;
+    textureUploaderParams.StagingSize = TEXTURE_UPLOADER_STAGING_SIZE;
+
+    m_pTextureUploader = FTextureUploader::Create(this, textureUploaderParams);
+    if (m_pTextureUploader)
+    {
+        std::cout << "Created Texture Uploader\n";
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool FDevice::SavePipelineCache()
+{
+    if (m_PipelineCache == VK_NULL_HANDLE || m_PipelineCachePath.empty())
+    {
+        return false;
+    }
+
+    size_t dataSize = 0;
+    VkResult result = vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "vkGetPipelineCacheData failed\n";
+        return false;
+    }
+
+    std::vector<char> data(dataSize);
+    result = vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, data.data());
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "vkGetPipelineCacheData failed\n";
+        return false;
+    }
+
+    FPipelineCacheFileHeader header;
+    ZERO_STRUCT(&header);
+
+    header.Magic         = PIPELINE_CACHE_MAGIC;
+    header.Version       = PIPELINE_CACHE_VERSION;
+    header.VendorID      = m_DeviceProperties.vendorID;
+    header.DeviceID      = m_DeviceProperties.deviceID;
+    header.DriverVersion = m_DeviceProperties.driverVersion;
+    header.DataSize      = dataSize;
+    memcpy(header.PipelineCacheUUID, m_DeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    // Write to a temporary file first so that a crash while saving does not leave a broken cache behind
+    const std::string tempPath = m_PipelineCachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cout << "Failed to open file '" << tempPath << "'\n";
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FPipelineCacheFileHeader));
+        file.write(data.data(), dataSize);
+        if (!file.good())
+        {
+            std::cout << "Failed to write pipeline cache to '" << tempPath << "'\n";
+            return false;
+        }
+    }
+
+    std::remove(m_PipelineCachePath.c_str());
+    if (std::rename(tempPath.c_str(), m_PipelineCachePath.c_str()) != 0)
+    {
+        std::cout << "Failed to rename '" << tempPath << "' to '" << m_PipelineCachePath << "'\n";
+        return false;
+    }
+
+    std::cout << "Saved pipeline cache '" << m_PipelineCachePath << "' (" << dataSize << " bytes)\n";
     return true;
 }
 
@@ -201,23 +536,26 @@ bool FDevice::CreateInstance(const FDeviceParams& params)
     appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
     appInfo.apiVersion         = VK_API_VERSION_1_2;
 
-    // Enable GLFW extensions
+    // Enable GLFW extensions, when running headless there is no surface so GLFW is never initialized
     std::vector<const char*> instanceExtensions;
 
-    uint32_t requiredInstanceExtensionCount = 0;
-    const char** ppRequiredInstanceExtension = glfwGetRequiredInstanceExtensions(&requiredInstanceExtensionCount);
-    if (requiredInstanceExtensionCount > 0)
+    if (!m_bHeadless)
     {
-        std::cout << "Required instance extensions:\n";
-        for (uint32_t i = 0; i < requiredInstanceExtensionCount; i++)
+        uint32_t requiredInstanceExtensionCount = 0;
+        const char** ppRequiredInstanceExtension = glfwGetRequiredInstanceExtensions(&requiredInstanceExtensionCount);
+        if (requiredInstanceExtensionCount > 0)
         {
-            std::cout << "   " << ppRequiredInstanceExtension[i] << '\n';
-            instanceExtensions.push_back(ppRequiredInstanceExtension[i]);
+            std::cout << "Required instance extensions:\n";
+            for (uint32_t i = 0; i < requiredInstanceExtensionCount; i++)
+            {
+                std::cout << "   " << ppRequiredInstanceExtension[i] << '\n';
+                instanceExtensions.push_back(ppRequiredInstanceExtension[i]);
+            }
+        }
+        else
+        {
+            return false;
         }
-    }
-    else
-    {
-        return false;
     }
 
     //Setup instance
@@ -577,22 +915,23 @@ bool FDevice::QueryPhysicalDevice(const FDeviceParams& params)
             }
         }
         
-        bool extensionsFound = false;
+        bool extensionsFound = true;
         for (const auto& extensionName : deviceExtensions)
         {
-            extensionsFound = false;
+            bool extensionFound = false;
             for (const auto& extension : availableDeviceExtension)
             {
                 if (strcmp(extension.extensionName, extensionName) == 0)
                 {
-                    extensionsFound = true;
+                    extensionFound = true;
                     break;
                 }
             }
             
-            if (!extensionsFound)
+            if (!extensionFound)
             {
                 std::cout << extensionName << " is not supported\n";
+                extensionsFound = false;
             }
         }
 
@@ -611,6 +950,10 @@ bool FDevice::QueryPhysicalDevice(const FDeviceParams& params)
     
     ZERO_STRUCT(&m_HostQueryFeatures);
     m_HostQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
+    m_HostQueryFeatures.pNext = &m_TimelineSemaphoreFeatures;
+
+    ZERO_STRUCT(&m_TimelineSemaphoreFeatures);
+    m_TimelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
     
     ZERO_STRUCT(&m_DeviceFeatures);
     m_DeviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
@@ -619,6 +962,122 @@ bool FDevice::QueryPhysicalDevice(const FDeviceParams& params)
     vkGetPhysicalDeviceProperties(m_PhysicalDevice, &m_DeviceProperties);
     vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &m_DeviceFeatures);
     vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_DeviceMemoryProperties);
+
+    // All the queues are synchronized with timeline semaphores
+    if (!m_TimelineSemaphoreFeatures.timelineSemaphore)
+    {
+        std::cout << "Timeline semaphores are not supported on '" << m_DeviceProperties.deviceName << "'\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool FDevice::CreateTimelineSemaphores()
+{
+    VkSemaphoreTypeCreateInfo typeInfo;
+    ZERO_STRUCT(&typeInfo);
+
+    typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo;
+    ZERO_STRUCT(&semaphoreInfo);
+
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    for (VkSemaphore& semaphore : m_TimelineSemaphores)
+    {
+        VkResult result = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &semaphore);
+        if (result != VK_SUCCESS)
+        {
+            std::cout << "vkCreateSemaphore failed. Error: " << result << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FDevice::CreatePipelineCache(const FDeviceParams& params)
+{
+    // Load the data from the last run, the cache starts empty when the file is missing or was not written by this
+    // device and driver
+    std::vector<char> initialData;
+    if (params.pPipelineCachePath)
+    {
+        m_PipelineCachePath = params.pPipelineCachePath;
+
+        std::ifstream file(m_PipelineCachePath, std::ios::ate | std::ios::binary);
+        if (file.is_open())
+        {
+            const size_t fileSize = static_cast<size_t>(file.tellg());
+            file.seekg(0);
+
+            FPipelineCacheFileHeader header;
+            ZERO_STRUCT(&header);
+
+            if (fileSize >= sizeof(FPipelineCacheFileHeader))
+            {
+                file.read(reinterpret_cast<char*>(&header), sizeof(FPipelineCacheFileHeader));
+            }
+
+            const bool bIsValid =
+                header.Magic         == PIPELINE_CACHE_MAGIC &&
+                header.Version       == PIPELINE_CACHE_VERSION &&
+                header.VendorID      == m_DeviceProperties.vendorID &&
+                header.DeviceID      == m_DeviceProperties.deviceID &&
+                header.DriverVersion == m_DeviceProperties.driverVersion &&
+                header.DataSize      == fileSize - sizeof(FPipelineCacheFileHeader) &&
+                memcmp(header.PipelineCacheUUID, m_DeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+            if (bIsValid)
+            {
+                initialData.resize(static_cast<size_t>(header.DataSize));
+                file.read(initialData.data(), initialData.size());
+                if (!file.good())
+                {
+                    initialData.clear();
+                }
+            }
+
+            if (initialData.empty())
+            {
+                std::cout << "Ignoring pipeline cache '" << m_PipelineCachePath << "', it was written by another device or driver\n";
+            }
+            else
+            {
+                std::cout << "Loaded pipeline cache '" << m_PipelineCachePath << "' (" << initialData.size() << " bytes)\n";
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo;
+    ZERO_STRUCT(&createInfo);
+
+    createInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = initialData.size();
+    createInfo.pInitialData    = initialData.empty() ? nullptr : initialData.data();
+
+    VkResult result = vkCreatePipelineCache(m_Device, &createInfo, nullptr, &m_PipelineCache);
+    if (result != VK_SUCCESS && !initialData.empty())
+    {
+        // Retry without the data in case the driver rejects it
+        std::cout << "vkCreatePipelineCache failed with the loaded data, starting with an empty cache\n";
+
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData    = nullptr;
+        result = vkCreatePipelineCache(m_Device, &createInfo, nullptr, &m_PipelineCache);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        std::cout << "vkCreatePipelineCache failed\n";
+        return false;
+    }
+
     return true;
 }
 
@@ -679,6 +1138,12 @@ FQueueFamilyIndices FDevice::GetQueueFamilyIndices(VkPhysicalDevice physicalDevi
 std::vector<const char*> FDevice::GetRequiredDeviceExtensions()
 {
     std::vector<const char*> deviceExtensions;
-    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    
+    // The swapchain is only needed when we present to a window
+    if (!m_bHeadless)
+    {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    
     return deviceExtensions;
 }
@@ -1,15 +1,47 @@
 #pragma once
 #include "Core.h"
 #include "CommandBuffer.h"
+#include <deque>
+#include <functional>
 
 class FSwapchain;
+class FTextureUploader;
 
 struct FDeviceParams
 {
+    // When no window is specified the device is created without surface support (Headless)
     GLFWwindow* pWindow           = nullptr;
     bool        bEnableRayTracing = false;
     bool        bEnableValidation = false;
     bool        bVerbose          = false;
+
+    // File that the pipeline cache is loaded from and saved to, nullptr keeps the cache in memory only
+    const char* pPipelineCachePath = nullptr;
+};
+
+// A value of the timeline of another queue that a submission waits for before the stage
+struct FTimelineWait
+{
+    ECommandQueueType    QueueType = ECommandQueueType::Graphics;
+    uint64_t             Value     = 0;
+    VkPipelineStageFlags Stage     = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+};
+
+// Semaphores that a submission waits for before the stages, and signals when it has finished. The binary semaphores
+// are only needed for the swapchain, the queues are synchronized with timeline values.
+struct FSubmitParams
+{
+    uint32_t                    NumWaitSemaphores   = 0;
+    const VkSemaphore*          pWaitSemaphores     = nullptr;
+    const VkPipelineStageFlags* pWaitStages         = nullptr;
+    uint32_t                    NumSignalSemaphores = 0;
+    const VkSemaphore*          pSignalSemaphores   = nullptr;
+    uint32_t                    NumTimelineWaits    = 0;
+    const FTimelineWait*        pTimelineWaits      = nullptr;
+
+    // The stages that wait for the texture uploads that have not finished, zero when the submission does not use any
+    // uploaded textures. The default is safe but keeps the whole submission waiting for the uploads.
+    VkPipelineStageFlags UploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 };
 
 struct FQueueFamilyIndices
@@ -33,10 +65,59 @@ public:
     FDevice();
     ~FDevice();
 
-    void ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapchain, VkPipelineStageFlags* pWaitStages);
+    uint64_t ExecuteGraphics(FCommandBuffer* pCommandBuffer, FSwapchain* pSwapchain, VkPipelineStageFlags* pWaitStages);
+
+    // Submits to the queue of the type, the CommandBuffer must have been created for the same type of queue. Returns
+    // the value that the timeline of the queue reaches when the submission has finished. The texture uploads are
+    // submitted before the graphics and compute queues, which wait for the uploads that have not finished at the
+    // FSubmitParams::UploadWaitStage.
+    uint64_t Execute(ECommandQueueType queueType, FCommandBuffer* pCommandBuffer, const FSubmitParams& params);
+
+    // Blocks until the timeline of the queue has reached the value, a value of zero has always been reached
+    void WaitForTimeline(ECommandQueueType queueType, uint64_t value);
+    bool IsTimelineComplete(ECommandQueueType queueType, uint64_t value);
+    uint64_t GetCompletedTimelineValue(ECommandQueueType queueType);
+
+    // Waits for all the work that has been submitted to the queue, the other queues keep running
+    void WaitForQueue(ECommandQueueType queueType);
+
+    // The last submitted value of every queue, see FTimelinePoint
+    FTimelinePoint GetSubmittedTimelinePoint() const
+    {
+        return m_SubmittedValues;
+    }
+
+    bool HasPassed(const FTimelinePoint& point);
+
+    // Deletes the object when the device has passed all the work that has been submitted so far, so the object must
+    // not be used by commands that have not been submitted yet. Used instead of waiting for the device when objects
+    // are replaced while the frames in flight can still use them.
+    template<typename T>
+    void DeferDelete(T*& pObject)
+    {
+        if (pObject)
+        {
+            T* pDeferred = pObject;
+            DeferRelease([pDeferred]()
+            {
+                delete pDeferred;
+            });
+
+            pObject = nullptr;
+        }
+    }
+
+    // Same as DeferDelete for objects that are not owned by a class, such as the handles of an old swapchain
+    void DeferRelease(std::function<void()>&& release);
+
+    // Releases the deferred objects that the device has passed, also done when the device becomes idle
+    void EmptyDeletionQueue();
 
     void WaitForIdle();
 
+    // Writes the pipeline cache to the file it was loaded from, also done when the device is destroyed
+    bool SavePipelineCache();
+
     void Destroy();
 
     uint32_t GetQueueFamilyIndex(ECommandQueueType Type);
@@ -66,10 +147,32 @@ public:
         return m_GraphicsQueue;
     }
 
+    VkQueue GetComputeQueue() const
+    {
+        return m_ComputeQueue;
+    }
+
+    VkQueue GetQueue(ECommandQueueType type) const;
+
+    VkPipelineCache GetPipelineCache() const
+    {
+        return m_PipelineCache;
+    }
+
+    FTextureUploader* GetTextureUploader() const
+    {
+        return m_pTextureUploader;
+    }
+
     float GetTimestampPeriod() const
     {
         return m_DeviceProperties.limits.timestampPeriod;
     }
+
+    bool IsHeadless() const
+    {
+        return m_bHeadless;
+    }
     
 private:
     bool Init(const FDeviceParams& props);
@@ -77,6 +180,14 @@ private:
     bool CreateDebugMessenger();
     bool CreateDeviceAndQueues(const FDeviceParams& props);
     bool QueryPhysicalDevice(const FDeviceParams& props);
+    bool CreatePipelineCache(const FDeviceParams& props);
+    bool CreateTimelineSemaphores();
+
+    struct FDeferredRelease
+    {
+        std::function<void()> Release;
+        FTimelinePoint        TimelinePoint;
+    };
 
     void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 
@@ -93,15 +204,32 @@ private:
     VkQueue m_ComputeQueue;
     VkQueue m_TransferQueue;
     VkQueue m_PresentationQueue;
+
+    // Shared by all pipelines, the file is ignored when it was written by another device or driver
+    VkPipelineCache m_PipelineCache;
+    std::string     m_PipelineCachePath;
+
+    // One timeline semaphore for each queue type, the completed values are cached to avoid querying the semaphores
+    VkSemaphore    m_TimelineSemaphores[NUM_COMMAND_QUEUE_TYPES];
+    FTimelinePoint m_SubmittedValues;
+    FTimelinePoint m_CompletedValues;
+
+    // Objects that are released when the device has passed their point, in submission order
+    std::deque<FDeferredRelease> m_DeletionQueue;
+
+    // Uploads the data of the textures on the transfer queue
+    FTextureUploader* m_pTextureUploader;
     
     // Device Features
-    VkPhysicalDeviceFeatures2              m_EnabledDeviceFeatures;
-    VkPhysicalDeviceProperties             m_DeviceProperties;
-    VkPhysicalDeviceFeatures2              m_DeviceFeatures;
-    VkPhysicalDeviceHostQueryResetFeatures m_HostQueryFeatures;
-    VkPhysicalDeviceMemoryProperties       m_DeviceMemoryProperties;
-    FQueueFamilyIndices                    m_QueueFamilyIndices;
+    VkPhysicalDeviceFeatures2                 m_EnabledDeviceFeatures;
+    VkPhysicalDeviceProperties                m_DeviceProperties;
+    VkPhysicalDeviceFeatures2                 m_DeviceFeatures;
+    VkPhysicalDeviceHostQueryResetFeatures    m_HostQueryFeatures;
+    VkPhysicalDeviceTimelineSemaphoreFeatures m_TimelineSemaphoreFeatures;
+    VkPhysicalDeviceMemoryProperties          m_DeviceMemoryProperties;
+    FQueueFamilyIndices                       m_QueueFamilyIndices;
           
     bool m_bValidationEnabled : 1;
     bool m_bRayTracingEnabled : 1;
+    bool m_bHeadless          : 1;
 };
@@ -1,13 +1,112 @@
 #include "DeviceMemoryAllocator.h"
+#include "Device.h"
 #include "Helpers.h"
 #include "MathHelper.h"
 #include <assert.h>
+#include <bit>
 
 //#define ALLOCATOR_DEBUG
+
+// Checks every page after each allocation and deallocation, this walks all the blocks so it is off by default
+//#define ALLOCATOR_VALIDATE
 #define MB(bytes) bytes * 1024 * 1024
 
 constexpr float mb = 1024.0f * 1024.0f;
 
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// TLSF bins
+
+// Sizes below TLSF_SL_COUNT share the first level and are binned linearly
+static void GetBinIndex(VkDeviceSize sizeInBytes, uint32_t& outFL, uint32_t& outSL)
+{
+    if (sizeInBytes < TLSF_SL_COUNT)
+    {
+        outFL = 0;
+        outSL = static_cast<uint32_t>(sizeInBytes);
+    }
+    else
+    {
+        const uint32_t log2 = static_cast<uint32_t>(std::bit_width(sizeInBytes)) - 1;
+        outFL = log2 - TLSF_SL_BITS + 1;
+        outSL = static_cast<uint32_t>(sizeInBytes >> (log2 - TLSF_SL_BITS)) ^ TLSF_SL_COUNT;
+    }
+}
+
+// Rounds the size up to the next bin so that every block in the bin that is found is large enough
+static VkDeviceSize RoundUpToBin(VkDeviceSize sizeInBytes)
+{
+    if (sizeInBytes < TLSF_SL_COUNT)
+    {
+        return sizeInBytes;
+    }
+
+    const uint32_t log2 = static_cast<uint32_t>(std::bit_width(sizeInBytes)) - 1;
+    return sizeInBytes + (VkDeviceSize(1) << (log2 - TLSF_SL_BITS)) - 1;
+}
+
+// The size of the free block that fits the allocation even with the worst case padding, the start can move up to the
+// next alignment or granularity page and the end must not share a granularity page with the next block
+static VkDeviceSize GetSearchSize(VkDeviceSize sizeInBytes, VkDeviceSize alignment, VkDeviceSize granularity)
+{
+    alignment = std::max<VkDeviceSize>(alignment, 1);
+    if (granularity > 1)
+    {
+        return sizeInBytes + (std::max(alignment, granularity) - 1) + (granularity - 1);
+    }
+
+    return sizeInBytes + (alignment - 1);
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// DeviceMemoryBlockPool
+
+FDeviceMemoryBlockPool::FDeviceMemoryBlockPool()
+    : m_Slabs(),
+    m_pFreeList(nullptr)
+{
+}
+
+FDeviceMemoryBlockPool::~FDeviceMemoryBlockPool()
+{
+    for (FDeviceMemoryBlock* pSlab : m_Slabs)
+    {
+        delete[] pSlab;
+    }
+
+    m_Slabs.clear();
+    m_pFreeList = nullptr;
+}
+
+FDeviceMemoryBlock* FDeviceMemoryBlockPool::Allocate()
+{
+    if (m_pFreeList == nullptr)
+    {
+        FDeviceMemoryBlock* pSlab = new FDeviceMemoryBlock[DEVICE_MEMORY_BLOCK_SLAB_SIZE];
+        for (uint32_t i = 0; i < DEVICE_MEMORY_BLOCK_SLAB_SIZE; i++)
+        {
+            pSlab[i].pNext = (i + 1 < DEVICE_MEMORY_BLOCK_SLAB_SIZE) ? &pSlab[i + 1] : nullptr;
+        }
+
+        m_Slabs.emplace_back(pSlab);
+        m_pFreeList = pSlab;
+    }
+
+    FDeviceMemoryBlock* pBlock = m_pFreeList;
+    m_pFreeList = pBlock->pNext;
+
+    *pBlock = FDeviceMemoryBlock();
+    return pBlock;
+}
+
+void FDeviceMemoryBlockPool::Free(FDeviceMemoryBlock* pBlock)
+{
+    pBlock->pNext = m_pFreeList;
+    m_pFreeList   = pBlock;
+}
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// DeviceMemoryPage
+
 FDeviceMemoryPage::FDeviceMemoryPage(VkDevice device, VkPhysicalDevice phyicalDevice, uint32_t id, VkDeviceSize sizeInBytes, uint32_t memoryType, VkMemoryPropertyFlags properties)
     : m_Device(device),
     m_PhysicalDevice(phyicalDevice),
@@ -18,8 +117,14 @@ FDeviceMemoryPage::FDeviceMemoryPage(VkDevice device, VkPhysicalDevice phyicalDe
     m_BlockCount(0),
     m_pHead(nullptr),
     m_pHostMemory(nullptr),
+    m_BlockPool(),
+    m_FLBitmap(0),
+    m_NumAllocations(0),
     m_IsMapped(false)
 {
+    ZERO_MEMORY(m_FreeLists, sizeof(m_FreeLists));
+    ZERO_MEMORY(m_SLBitmaps, sizeof(m_SLBitmaps));
+
     Init();
 }
 
@@ -27,6 +132,11 @@ FDeviceMemoryPage::~FDeviceMemoryPage()
 {
     if (m_DeviceMemory != VK_NULL_HANDLE)
     {
+        // Check the page once at teardown, the check after every change is too slow for debug builds
+    #if defined(DEBUG)
+        assert(Validate());
+    #endif
+
         // Unmap
         Unmap();
 
@@ -43,16 +153,8 @@ FDeviceMemoryPage::~FDeviceMemoryPage()
         }
     #endif
 
-        // Delete all blocks
-        FDeviceMemoryBlock* pCurrent = m_pHead;
-        while (pCurrent != nullptr)
-        {
-            FDeviceMemoryBlock* pOld = pCurrent;
-            pCurrent = pCurrent->pNext;
-
-            //Delete block
-            delete pOld;
-        }
+        // The blocks are released together with the pool
+        m_pHead = nullptr;
 
         // Free memory
         vkFreeMemory(m_Device, m_DeviceMemory, nullptr);
@@ -82,7 +184,7 @@ void FDeviceMemoryPage::Init()
     }
 
     // Setup first block
-    m_pHead = new FDeviceMemoryBlock();
+    m_pHead = m_BlockPool.Allocate();
     m_pHead->pPage              = this;
     m_pHead->pNext              = nullptr;
     m_pHead->pPrevious          = nullptr;
@@ -91,6 +193,7 @@ void FDeviceMemoryPage::Init()
     m_pHead->SizeInBytes        = m_SizeInBytes;
     m_pHead->PaddedSizeInBytes  = m_SizeInBytes;
     m_pHead->DeviceMemoryOffset = 0;
+    InsertFreeBlock(m_pHead);
 
     // If this is CPU visible -> Map
     if (m_Properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
@@ -102,75 +205,42 @@ void FDeviceMemoryPage::Init()
 
 bool FDeviceMemoryPage::Allocate(FDeviceAllocation& allocation, VkDeviceSize sizeInBytes, VkDeviceSize alignment, VkDeviceSize granularity)
 {
-    VkDeviceSize paddedDeviceOffset = 0;
-    VkDeviceSize paddedSizeInBytes  = 0;
-    FDeviceMemoryBlock* pBestFit = nullptr;
-
-    // Find enough free space, and find the block that best fits
-    for (FDeviceMemoryBlock* pCurrent = m_pHead; pCurrent != nullptr; pCurrent = pCurrent->pNext)
+    if (m_DeviceMemory == VK_NULL_HANDLE || sizeInBytes == 0)
     {
-        // Check if the block is allocated or not
-        if (!pCurrent->IsFree)
-        {
-            continue;
-        }
-
-        // Does it fit into the block
-        if (sizeInBytes > pCurrent->SizeInBytes)
-        {
-            continue;
-        }
-
-        // Align the offset
-        paddedDeviceOffset = Math::AlignUp<uint64_t>(pCurrent->DeviceMemoryOffset, alignment);
+        return false;
+    }
 
-        // Take granularity into account
-        if (pCurrent->pPrevious != nullptr && granularity > 1)
-        {
-            FDeviceMemoryBlock* pPrevious = pCurrent->pPrevious;
-            if (IsOnSamePage(pPrevious->DeviceMemoryOffset, pPrevious->SizeInBytes, paddedDeviceOffset, granularity))
-            {
-                paddedDeviceOffset = Math::AlignUp(paddedDeviceOffset, granularity);
-            }
-        }
+    alignment = std::max<VkDeviceSize>(alignment, 1);
 
-        // Calculate padding
-        paddedSizeInBytes = sizeInBytes + (paddedDeviceOffset - pCurrent->DeviceMemoryOffset);
+    const VkDeviceSize searchSize = GetSearchSize(sizeInBytes, alignment, granularity);
 
-        // Does it still fit
-        if (paddedSizeInBytes > pCurrent->SizeInBytes)
-        {
-            continue;
-        }
+    VkDeviceSize        paddedDeviceOffset = 0;
+    FDeviceMemoryBlock* pBestFit           = FindFreeBlock(RoundUpToBin(searchSize));
+    if (pBestFit == nullptr || !GetPlacement(pBestFit, sizeInBytes, alignment, granularity, paddedDeviceOffset))
+    {
+        // The bin with the exact size can still contain a block that is large enough
+        uint32_t fl;
+        uint32_t sl;
+        GetBinIndex(searchSize, fl, sl);
 
-        // Avoid granularity conflict
-        if (granularity > 1 && pCurrent->pNext != nullptr)
+        pBestFit = m_FreeLists[fl][sl];
+        if (pBestFit == nullptr || !GetPlacement(pBestFit, sizeInBytes, alignment, granularity, paddedDeviceOffset))
         {
-            FDeviceMemoryBlock* pNext = pCurrent->pNext;
-            if (IsOnSamePage(paddedDeviceOffset, sizeInBytes, pNext->DeviceMemoryOffset, granularity))
-            {
-                continue;
-            }
+            return false;
         }
-
-        pBestFit = pCurrent;
-        break;
     }
 
-    // Did we find a suitable block to make the allocation?
-    if (pBestFit == nullptr)
-    {
-        return false;
-    }
+    RemoveFreeBlock(pBestFit);
 
     //         Free block
     // |--------------------------|
     // padding Allocation Remaining
     // |------|----------|--------|
-    if (pBestFit->SizeInBytes > paddedSizeInBytes)
+    VkDeviceSize paddedSizeInBytes = sizeInBytes + (paddedDeviceOffset - pBestFit->DeviceMemoryOffset);
+    if (pBestFit->SizeInBytes >= paddedSizeInBytes + TLSF_MIN_BLOCK_SIZE)
     {
         // Create a new block after allocation
-        FDeviceMemoryBlock* pBlock = new FDeviceMemoryBlock();
+        FDeviceMemoryBlock* pBlock = m_BlockPool.Allocate();
         pBlock->pPage              = this;
         pBlock->ID                 = m_BlockCount++;
         pBlock->SizeInBytes        = pBestFit->SizeInBytes - paddedSizeInBytes;
@@ -187,12 +257,19 @@ bool FDeviceMemoryPage::Allocate(FDeviceAllocation& allocation, VkDeviceSize siz
         }
 
         pBestFit->pNext = pBlock;
+        InsertFreeBlock(pBlock);
+    }
+    else
+    {
+        // The remainder is too small to be useful and stays part of the allocation
+        paddedSizeInBytes = pBestFit->SizeInBytes;
     }
 
     //Update bestfit
     pBestFit->SizeInBytes       = sizeInBytes;
     pBestFit->PaddedSizeInBytes = paddedSizeInBytes;
     pBestFit->IsFree = false;
+    m_NumAllocations++;
 
     //Setup allocation
     allocation.pBlock             = pBestFit;
@@ -236,10 +313,134 @@ bool FDeviceMemoryPage::Allocate(FDeviceAllocation& allocation, VkDeviceSize siz
     }
 #endif
 
+#if defined(ALLOCATOR_VALIDATE)
+    assert(Validate());
+#endif
+
+    return true;
+}
+
+
+bool FDeviceMemoryPage::GetPlacement(const FDeviceMemoryBlock* pBlock, VkDeviceSize sizeInBytes, VkDeviceSize alignment, VkDeviceSize granularity, VkDeviceSize& outOffset)
+{
+    // Align the offset
+    VkDeviceSize paddedDeviceOffset = Math::AlignUp<uint64_t>(pBlock->DeviceMemoryOffset, alignment);
+
+    // Take granularity into account, the neighbours of a free block are always in use
+    if (pBlock->pPrevious != nullptr && granularity > 1)
+    {
+        const FDeviceMemoryBlock* pPrevious = pBlock->pPrevious;
+        if (IsOnSamePage(pPrevious->DeviceMemoryOffset, pPrevious->PaddedSizeInBytes, paddedDeviceOffset, granularity))
+        {
+            paddedDeviceOffset = Math::AlignUp(paddedDeviceOffset, granularity);
+        }
+    }
+
+    // Does it still fit
+    const VkDeviceSize paddedSizeInBytes = sizeInBytes + (paddedDeviceOffset - pBlock->DeviceMemoryOffset);
+    if (paddedSizeInBytes > pBlock->SizeInBytes)
+    {
+        return false;
+    }
+
+    // Avoid granularity conflict
+    if (granularity > 1 && pBlock->pNext != nullptr)
+    {
+        if (IsOnSamePage(paddedDeviceOffset, sizeInBytes, pBlock->pNext->DeviceMemoryOffset, granularity))
+        {
+            return false;
+        }
+    }
+
+    outOffset = paddedDeviceOffset;
     return true;
 }
 
 
+FDeviceMemoryBlock* FDeviceMemoryPage::FindFreeBlock(VkDeviceSize sizeInBytes)
+{
+    uint32_t fl;
+    uint32_t sl;
+    GetBinIndex(sizeInBytes, fl, sl);
+    if (fl >= TLSF_FL_COUNT)
+    {
+        return nullptr;
+    }
+
+    // First look for a larger second level in the same first level, then in the next first level that is not empty
+    uint32_t slBitmap = m_SLBitmaps[fl] & (~0u << sl);
+    if (slBitmap == 0)
+    {
+        const uint64_t flBitmap = (fl + 1 < 64) ? (m_FLBitmap & (~0ull << (fl + 1))) : 0;
+        if (flBitmap == 0)
+        {
+            return nullptr;
+        }
+
+        fl       = static_cast<uint32_t>(std::countr_zero(flBitmap));
+        slBitmap = m_SLBitmaps[fl];
+    }
+
+    sl = static_cast<uint32_t>(std::countr_zero(slBitmap));
+    return m_FreeLists[fl][sl];
+}
+
+
+void FDeviceMemoryPage::InsertFreeBlock(FDeviceMemoryBlock* pBlock)
+{
+    uint32_t fl;
+    uint32_t sl;
+    GetBinIndex(pBlock->SizeInBytes, fl, sl);
+
+    FDeviceMemoryBlock* pHead = m_FreeLists[fl][sl];
+    pBlock->pPreviousFree = nullptr;
+    pBlock->pNextFree     = pHead;
+    if (pHead)
+    {
+        pHead->pPreviousFree = pBlock;
+    }
+
+    m_FreeLists[fl][sl] = pBlock;
+    m_FLBitmap     |= (1ull << fl);
+    m_SLBitmaps[fl] |= (1u << sl);
+}
+
+
+void FDeviceMemoryPage::RemoveFreeBlock(FDeviceMemoryBlock* pBlock)
+{
+    uint32_t fl;
+    uint32_t sl;
+    GetBinIndex(pBlock->SizeInBytes, fl, sl);
+
+    if (pBlock->pPreviousFree)
+    {
+        pBlock->pPreviousFree->pNextFree = pBlock->pNextFree;
+    }
+    else
+    {
+        m_FreeLists[fl][sl] = pBlock->pNextFree;
+    }
+
+    if (pBlock->pNextFree)
+    {
+        pBlock->pNextFree->pPreviousFree = pBlock->pPreviousFree;
+    }
+
+    pBlock->pNextFree     = nullptr;
+    pBlock->pPreviousFree = nullptr;
+
+    // Clear the bits when the bin is empty
+    if (m_FreeLists[fl][sl] == nullptr)
+    {
+        m_SLBitmaps[fl] &= ~(1u << sl);
+        if (m_SLBitmaps[fl] == 0)
+        {
+            m_FLBitmap &= ~(1ull << fl);
+        }
+    }
+}
+
+
 bool FDeviceMemoryPage::IsOnSamePage(VkDeviceSize aOffset, VkDeviceSize aSize, VkDeviceSize bOffset, VkDeviceSize pageSize)
 {
     assert(aOffset + aSize <= bOffset && aSize > 0 && pageSize > 0);
@@ -289,10 +490,14 @@ void FDeviceMemoryPage::Deallocate(FDeviceAllocation& allocation)
         return;
     }
 
+#if defined(ALLOCATOR_DEBUG)
     std::cout << "Deallocating Block ID=" << pCurrent->ID << std::endl;
+#endif
 
-    // Set this block to free
-    pCurrent->IsFree = true;
+    // Set this block to free, the whole block is free again including the padding
+    pCurrent->IsFree      = true;
+    pCurrent->SizeInBytes = pCurrent->PaddedSizeInBytes;
+    m_NumAllocations--;
 
     // Merge previous with current
     if (pCurrent->pPrevious)
@@ -300,6 +505,8 @@ void FDeviceMemoryPage::Deallocate(FDeviceAllocation& allocation)
         FDeviceMemoryBlock* pPrevious = pCurrent->pPrevious;
         if (pPrevious->IsFree)
         {
+            RemoveFreeBlock(pPrevious);
+
             // Set size
             pPrevious->SizeInBytes       += pCurrent->PaddedSizeInBytes;
             pPrevious->PaddedSizeInBytes += pCurrent->PaddedSizeInBytes;
@@ -312,7 +519,7 @@ void FDeviceMemoryPage::Deallocate(FDeviceAllocation& allocation)
             }
 
             // Remove block
-            delete pCurrent;
+            m_BlockPool.Free(pCurrent);
             pCurrent = pPrevious;
         }
     }
@@ -323,6 +530,8 @@ void FDeviceMemoryPage::Deallocate(FDeviceAllocation& allocation)
         FDeviceMemoryBlock* pNext = pCurrent->pNext;
         if (pNext->IsFree)
         {
+            RemoveFreeBlock(pNext);
+
             // Set size
             pCurrent->SizeInBytes       += pNext->PaddedSizeInBytes;
             pCurrent->PaddedSizeInBytes += pNext->PaddedSizeInBytes;
@@ -336,26 +545,111 @@ void FDeviceMemoryPage::Deallocate(FDeviceAllocation& allocation)
             pCurrent->pNext = pNext->pNext;
 
             // Remove block
-            delete pNext;
+            m_BlockPool.Free(pNext);
         }
     }
+
+    InsertFreeBlock(pCurrent);
+
+#if defined(ALLOCATOR_VALIDATE)
+    assert(Validate());
+#endif
 }
 
-constexpr size_t numFrames = 3;
 
-FDeviceMemoryAllocator::FDeviceMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice)
-    : m_Device(device),
-    m_PhysicalDevice(physicalDevice),
+bool FDeviceMemoryPage::Validate() const
+{
+    // The blocks follow each other without gaps or overlaps and free blocks are never next to each other
+    uint32_t     numAllocations = 0;
+    uint32_t     numFreeBlocks  = 0;
+    VkDeviceSize offset         = 0;
+    for (const FDeviceMemoryBlock* pCurrent = m_pHead; pCurrent != nullptr; pCurrent = pCurrent->pNext)
+    {
+        if (pCurrent->DeviceMemoryOffset != offset || pCurrent->SizeInBytes > pCurrent->PaddedSizeInBytes)
+        {
+            std::cout << "Block '" << pCurrent->ID << "' in page '" << m_ID << "' does not start at the end of the previous block" << std::endl;
+            return false;
+        }
+
+        if (pCurrent->pNext && pCurrent->pNext->pPrevious != pCurrent)
+        {
+            std::cout << "Block '" << pCurrent->ID << "' in page '" << m_ID << "' is not linked to the next block" << std::endl;
+            return false;
+        }
+
+        if (pCurrent->IsFree)
+        {
+            if (pCurrent->pNext && pCurrent->pNext->IsFree)
+            {
+                std::cout << "Free blocks '" << pCurrent->ID << "' and '" << pCurrent->pNext->ID << "' in page '" << m_ID << "' are not merged" << std::endl;
+                return false;
+            }
+
+            // The block has to be in the list of its bin
+            uint32_t fl;
+            uint32_t sl;
+            GetBinIndex(pCurrent->SizeInBytes, fl, sl);
+
+            const FDeviceMemoryBlock* pFree = m_FreeLists[fl][sl];
+            while (pFree && pFree != pCurrent)
+            {
+                pFree = pFree->pNextFree;
+            }
+
+            if (!pFree || !(m_FLBitmap & (1ull << fl)) || !(m_SLBitmaps[fl] & (1u << sl)))
+            {
+                std::cout << "Free block '" << pCurrent->ID << "' in page '" << m_ID << "' is not in its bin" << std::endl;
+                return false;
+            }
+
+            numFreeBlocks++;
+        }
+        else
+        {
+            numAllocations++;
+        }
+
+        offset += pCurrent->PaddedSizeInBytes;
+    }
+
+    if (offset != m_SizeInBytes || numAllocations != m_NumAllocations)
+    {
+        std::cout << "Blocks in page '" << m_ID << "' do not cover the page" << std::endl;
+        return false;
+    }
+
+    // The bins do not contain any other blocks
+    uint32_t numBinnedBlocks = 0;
+    for (uint32_t fl = 0; fl < TLSF_FL_COUNT; fl++)
+    {
+        for (uint32_t sl = 0; sl < TLSF_SL_COUNT; sl++)
+        {
+            for (const FDeviceMemoryBlock* pFree = m_FreeLists[fl][sl]; pFree != nullptr; pFree = pFree->pNextFree)
+            {
+                numBinnedBlocks++;
+            }
+        }
+    }
+
+    if (numBinnedBlocks != numFreeBlocks)
+    {
+        std::cout << "Bins of page '" << m_ID << "' contain blocks that are not free" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+FDeviceMemoryAllocator::FDeviceMemoryAllocator(FDevice* pDevice)
+    : m_pDevice(pDevice),
+    m_Device(pDevice->GetDevice()),
+    m_PhysicalDevice(pDevice->GetPhysicalDevice()),
     m_MaxAllocations(0),
     m_TotalReserved(0),
     m_TotalAllocated(0),
-    m_FrameIndex(0),
     m_Pages(),
     m_GarbageMemory()
 {
-    // Resize the number of garbage memory vectors
-    m_GarbageMemory.resize(numFrames);
-
     // Setup from properties of the device
     VkPhysicalDeviceProperties properties = {};
     vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
@@ -367,12 +661,14 @@ FDeviceMemoryAllocator::FDeviceMemoryAllocator(VkDevice device, VkPhysicalDevice
 
 FDeviceMemoryAllocator::~FDeviceMemoryAllocator()
 {
-    // Cleanup all garbage memory before deleting
-    for (uint32_t i = 0; i < numFrames; i++)
+    // Cleanup all garbage memory before deleting, the device is idle when the allocator is deleted
+    for (FGarbageAllocation& garbage : m_GarbageMemory)
     {
-        EmptyGarbageMemory();
+        FreeAllocation(garbage.Allocation);
     }
 
+    m_GarbageMemory.clear();
+
     // Delete allocator
     std::cout << "Deleting DeviceAllocator. Number of Pages: " << m_Pages.size() << std::endl;
     for (FDeviceMemoryPage* page : m_Pages)
@@ -404,11 +700,14 @@ bool FDeviceMemoryAllocator::Allocate(FDeviceAllocation& allocation, const VkMem
 
     assert(m_Pages.size() < m_MaxAllocations);
 
-    // If allocated is large, make a dedicated allocation
+    // If allocated is large, make a dedicated allocation. The page must be large enough for the size that the page
+    // searches for, otherwise its only block is in a smaller bin than the search and is never found.
+    const VkDeviceSize requiredSize = RoundUpToBin(GetSearchSize(memoryRequirements.size, memoryRequirements.alignment, m_BufferImageGranularity));
+
     uint64_t bytesToReserve = MB(128);
-    if (memoryRequirements.size > bytesToReserve)
+    if (requiredSize > bytesToReserve)
     {
-        bytesToReserve = memoryRequirements.size;
+        bytesToReserve = requiredSize;
     }
 
     // Add to total
@@ -429,7 +728,10 @@ void FDeviceMemoryAllocator::Deallocate(FDeviceAllocation& allocation)
     //Set it to be removed
     if (allocation.pBlock && allocation.DeviceMemory != VK_NULL_HANDLE)
     {
-        m_GarbageMemory[m_FrameIndex].emplace_back(allocation);
+        FGarbageAllocation garbage;
+        garbage.Allocation    = allocation;
+        garbage.TimelinePoint = m_pDevice->GetSubmittedTimelinePoint();
+        m_GarbageMemory.emplace_back(garbage);
     }
 
     // Invalidate memory
@@ -443,28 +745,11 @@ void FDeviceMemoryAllocator::Deallocate(FDeviceAllocation& allocation)
 
 void FDeviceMemoryAllocator::EmptyGarbageMemory()
 {
-    //Move on a frame
-    m_FrameIndex = (m_FrameIndex + 1) % numFrames;
-
-    //Clean memory
-    auto& memoryBlocks = m_GarbageMemory[m_FrameIndex];
-    if (!memoryBlocks.empty())
+    //Clean memory, the points are in submission order so the first one that has not been passed ends the search
+    while (!m_GarbageMemory.empty() && m_pDevice->HasPassed(m_GarbageMemory.front().TimelinePoint))
     {
-        //Deallocate all the blocks
-        for (auto& memory : memoryBlocks)
-        {
-            if (memory.pBlock && memory.DeviceMemory != VK_NULL_HANDLE)
-            {
-                FDeviceMemoryPage* pPage = memory.pBlock->pPage;
-                pPage->Deallocate(memory);
-
-                m_TotalAllocated -= memory.SizeInBytes;
-
-                std::cout << "Deallocated '" << memory.SizeInBytes << "' bytes. Total Allocated: " << float(m_TotalAllocated) / mb << " MB. Total Reserved " << float(m_TotalReserved) / mb << " MB" << std::endl;
-            }
-        }
-
-        memoryBlocks.clear();
+        FreeAllocation(m_GarbageMemory.front().Allocation);
+        m_GarbageMemory.pop_front();
     }
 
 
@@ -490,3 +775,20 @@ void FDeviceMemoryAllocator::EmptyGarbageMemory()
         }
     }
 }
+
+
+void FDeviceMemoryAllocator::FreeAllocation(FDeviceAllocation& memory)
+{
+    if (memory.pBlock && memory.DeviceMemory != VK_NULL_HANDLE)
+    {
+        // The block is reset when it is freed
+        const VkDeviceSize sizeInBytes = memory.pBlock->SizeInBytes;
+
+        FDeviceMemoryPage* pPage = memory.pBlock->pPage;
+        pPage->Deallocate(memory);
+
+        m_TotalAllocated -= sizeInBytes;
+
+        std::cout << "Deallocated '" << sizeInBytes << "' bytes. Total Allocated: " << float(m_TotalAllocated) / mb << " MB. Total Reserved " << float(m_TotalReserved) / mb << " MB" << std::endl;
+    }
+}
@@ -1,11 +1,24 @@
 #pragma once
 #include "Core.h"
+#include "CommandQueue.h"
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <deque>
+
+// Two level segregated fit, the first level is the power of two of the size and the second level
+// splits each power of two into TLSF_SL_COUNT linear ranges
+#define TLSF_SL_BITS        (5)
+#define TLSF_SL_COUNT       (1u << TLSF_SL_BITS)
+#define TLSF_FL_COUNT       (64 - TLSF_SL_BITS + 1)
+#define TLSF_MIN_BLOCK_SIZE (256)
+
+// Number of blocks that the pool allocates at a time
+#define DEVICE_MEMORY_BLOCK_SLAB_SIZE (256)
 
 struct FDeviceMemoryBlock;
 struct FDeviceAllocation;
 class FDeviceMemoryPage;
+class FDevice;
 
 struct FDeviceMemoryBlock
 {
@@ -13,6 +26,10 @@ struct FDeviceMemoryBlock
     FDeviceMemoryBlock* pNext     = nullptr;
     FDeviceMemoryBlock* pPrevious = nullptr;
 
+    // Free list of the bin that the block is in, only used when the block is free
+    FDeviceMemoryBlock* pNextFree     = nullptr;
+    FDeviceMemoryBlock* pPreviousFree = nullptr;
+
     VkDeviceSize SizeInBytes        = 0;
     VkDeviceSize PaddedSizeInBytes  = 0;
     VkDeviceSize DeviceMemoryOffset = 0;
@@ -29,6 +46,25 @@ struct FDeviceAllocation
     VkDeviceMemory      DeviceMemory       = VK_NULL_HANDLE;
 };
 
+// Hands out blocks from larger slabs so that splitting and merging blocks does not call new and delete
+class FDeviceMemoryBlockPool
+{
+public:
+    FDeviceMemoryBlockPool();
+    ~FDeviceMemoryBlockPool();
+
+    FDeviceMemoryBlock* Allocate();
+    void Free(FDeviceMemoryBlock* pBlock);
+
+private:
+    std::vector<FDeviceMemoryBlock*> m_Slabs;
+
+    // Linked through pNext
+    FDeviceMemoryBlock* m_pFreeList;
+};
+
+// Allocation and deallocation are O(1), the free blocks are kept in TLSF bins and are merged with
+// their neighbours when they are freed
 class FDeviceMemoryPage
 {
 public:
@@ -40,7 +76,7 @@ public:
 
     bool IsEmpty() const
     {
-        return m_pHead->pPrevious == nullptr && m_pHead->pNext == nullptr && m_pHead->IsFree;
+        return m_NumAllocations == 0;
     }
     
     uint64_t GetSizeInBytes() const
@@ -55,6 +91,19 @@ public:
     
 private:
     bool IsOnSamePage(VkDeviceSize aOffset, VkDeviceSize aSize, VkDeviceSize bOffset, VkDeviceSize pageSize);
+
+    // Returns the aligned offset of the allocation inside the block or false if it does not fit
+    bool GetPlacement(const FDeviceMemoryBlock* pBlock, VkDeviceSize sizeInBytes, VkDeviceSize alignment, VkDeviceSize granularity, VkDeviceSize& outOffset);
+
+    FDeviceMemoryBlock* FindFreeBlock(VkDeviceSize sizeInBytes);
+    void InsertFreeBlock(FDeviceMemoryBlock* pBlock);
+    void RemoveFreeBlock(FDeviceMemoryBlock* pBlock);
+
+    // Checks that the blocks cover the page without overlaps, that free neighbours are merged and that every free
+    // block is in the bin of its size. Called after every change with ALLOCATOR_VALIDATE and when the page is deleted
+    // in debug builds
+    bool Validate() const;
+
     void Init();
     void Map();
     void Unmap();
@@ -64,6 +113,14 @@ private:
     VkDeviceMemory        m_DeviceMemory;
     FDeviceMemoryBlock*   m_pHead;
     uint8_t*              m_pHostMemory;
+
+    // Free blocks
+    FDeviceMemoryBlockPool m_BlockPool;
+    FDeviceMemoryBlock*    m_FreeLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    uint64_t               m_FLBitmap;
+    uint32_t               m_SLBitmaps[TLSF_FL_COUNT];
+    uint32_t               m_NumAllocations;
+
     VkMemoryPropertyFlags m_Properties;
     const uint32_t        m_ID;
     const uint32_t        m_MemoryType;
@@ -75,10 +132,13 @@ private:
 class FDeviceMemoryAllocator
 {
 public:
-    FDeviceMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+    FDeviceMemoryAllocator(FDevice* pDevice);
     ~FDeviceMemoryAllocator();
 
     bool Allocate(FDeviceAllocation& allocation, const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags properties);
+
+    // The memory is released when the device has passed all the work that was submitted before the deallocation, so
+    // the allocation must not be used by commands that have not been submitted yet
     void Deallocate(FDeviceAllocation& allocation);
     void EmptyGarbageMemory();
 
@@ -93,14 +153,22 @@ public:
     }
     
 private:
-    VkDevice                                    m_Device;
-    VkPhysicalDevice                            m_PhysicalDevice;
-    VkDeviceSize                                m_BufferImageGranularity;
-    std::vector<FDeviceMemoryPage*>             m_Pages;
-    std::vector<std::vector<FDeviceAllocation>> m_GarbageMemory;
-    uint64_t                                    m_FrameIndex;
-    uint64_t                                    m_TotalAllocated;
-    uint64_t                                    m_TotalReserved;
-    uint64_t                                    m_MaxAllocations;
+    struct FGarbageAllocation
+    {
+        FDeviceAllocation Allocation;
+        FTimelinePoint    TimelinePoint;
+    };
+
+    void FreeAllocation(FDeviceAllocation& allocation);
+
+    FDevice*                        m_pDevice;
+    VkDevice                        m_Device;
+    VkPhysicalDevice                m_PhysicalDevice;
+    VkDeviceSize                    m_BufferImageGranularity;
+    std::vector<FDeviceMemoryPage*> m_Pages;
+    std::deque<FGarbageAllocation>  m_GarbageMemory;
+    uint64_t                        m_TotalAllocated;
+    uint64_t                        m_TotalReserved;
+    uint64_t                        m_MaxAllocations;
 };
 
@@ -157,7 +157,7 @@ FGraphicsPipeline* FGraphicsPipeline::Create(FDevice* pDevice, const FGraphicsPi
     pipelineInfo.basePipelineHandle  = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex   = -1;
 
-    VkResult result = vkCreateGraphicsPipelines(pPipeline->m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pPipeline->m_Pipeline);
+    VkResult result = vkCreateGraphicsPipelines(pPipeline->m_Device, pDevice->GetPipelineCache(), 1, &pipelineInfo, nullptr, &pPipeline->m_Pipeline);
     if (result != VK_SUCCESS) 
     {
         std::cout << "vkCreateGraphicsPipelines failed\n";
@@ -199,7 +199,7 @@ FComputePipeline* FComputePipeline::Create(FDevice* pDevice, const FComputePipel
     pipelineInfo.layout            = params.pPipelineLayout->GetPipelineLayout();
     pipelineInfo.stage             = shaderStageInfo;
 
-    VkResult result = vkCreateComputePipelines(newPipeline->m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline->m_Pipeline);
+    VkResult result = vkCreateComputePipelines(newPipeline->m_Device, pDevice->GetPipelineCache(), 1, &pipelineInfo, nullptr, &newPipeline->m_Pipeline);
     if (result != VK_SUCCESS)
     {
         std::cout << "vkCreateComputePipelines failed\n";
@@ -0,0 +1,390 @@
+#include "ShaderCompiler.h"
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+
+// Identifies the cache files, the version must change when the compile options or the file layout change
+#define SHADER_CACHE_MAGIC   (0x43565053) // 'SPVC'
+#define SHADER_CACHE_VERSION (1)
+
+struct FShaderCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Hash;
+    uint32_t NumDependencies;
+    uint32_t ByteCodeSize;
+};
+
+// Owns the strings that an include result points to
+struct FIncludeResult
+{
+    shaderc_include_result Result;
+    std::string            SourceName;
+    std::string            Content;
+};
+
+// The includes are recorded for each compile together with the content that the compiler saw
+struct FIncludeContext
+{
+    std::vector<std::string> Dependencies;
+    std::vector<std::string> Contents;
+};
+
+static bool ReadTextFile(const std::string& filepath, std::string& outContent)
+{
+    std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    const size_t fileSize = static_cast<size_t>(file.tellg());
+    outContent.resize(fileSize);
+
+    file.seekg(0);
+    file.read(outContent.data(), fileSize);
+    return file.good();
+}
+
+// The same file is always stored with the same path so that the paths can be compared
+static std::string NormalizePath(const std::string& filepath)
+{
+    return std::filesystem::path(filepath).lexically_normal().generic_string();
+}
+
+// FNV-1a
+static void HashBytes(uint64_t& hash, const void* pData, size_t size)
+{
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pData);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= pBytes[i];
+        hash *= 0x100000001b3ull;
+    }
+}
+
+// Hashes the source of the shader and the content of its includes
+static uint64_t HashSources(VkShaderStageFlagBits stage, const std::string& source, const std::vector<std::string>& dependencies, const std::vector<std::string>& contents)
+{
+    assert(dependencies.size() == contents.size());
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    const uint32_t version = SHADER_CACHE_VERSION;
+    HashBytes(hash, &version, sizeof(uint32_t));
+    HashBytes(hash, &stage, sizeof(VkShaderStageFlagBits));
+    HashBytes(hash, source.data(), source.size());
+
+    for (size_t i = 0; i < dependencies.size(); i++)
+    {
+        HashBytes(hash, dependencies[i].data(), dependencies[i].size());
+        HashBytes(hash, contents[i].data(), contents[i].size());
+    }
+
+    return hash;
+}
+
+static std::string GetDirectory(const std::string& filepath)
+{
+    const size_t separator = filepath.find_last_of("/\\");
+    return separator != std::string::npos ? filepath.substr(0, separator + 1) : std::string();
+}
+
+static shaderc_include_result* ResolveInclude(void* pUserData, const char* pRequestedSource, int, const char* pRequestingSource, size_t)
+{
+    FIncludeResult* pInclude = new FIncludeResult();
+    pInclude->SourceName = NormalizePath(GetDirectory(pRequestingSource) + pRequestedSource);
+    if (ReadTextFile(pInclude->SourceName, pInclude->Content))
+    {
+        FIncludeContext* pContext = reinterpret_cast<FIncludeContext*>(pUserData);
+        if (std::find(pContext->Dependencies.begin(), pContext->Dependencies.end(), pInclude->SourceName) == pContext->Dependencies.end())
+        {
+            pContext->Dependencies.emplace_back(pInclude->SourceName);
+            pContext->Contents.emplace_back(pInclude->Content);
+        }
+    }
+    else
+    {
+        // An empty source name tells shaderc that the include failed, the content is the error message
+        pInclude->Content = "Failed to open file '" + pInclude->SourceName + "'";
+        pInclude->SourceName.clear();
+    }
+
+    pInclude->Result.source_name        = pInclude->SourceName.c_str();
+    pInclude->Result.source_name_length = pInclude->SourceName.size();
+    pInclude->Result.content            = pInclude->Content.c_str();
+    pInclude->Result.content_length     = pInclude->Content.size();
+    pInclude->Result.user_data          = pInclude;
+    return &pInclude->Result;
+}
+
+static void ReleaseInclude(void*, shaderc_include_result* pResult)
+{
+    FIncludeResult* pInclude = reinterpret_cast<FIncludeResult*>(pResult->user_data);
+    SAFE_DELETE(pInclude);
+}
+
+static shaderc_shader_kind GetShaderKind(VkShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+        case VK_SHADER_STAGE_VERTEX_BIT:   return shaderc_vertex_shader;
+        case VK_SHADER_STAGE_FRAGMENT_BIT: return shaderc_fragment_shader;
+        case VK_SHADER_STAGE_COMPUTE_BIT:  return shaderc_compute_shader;
+        default: return shaderc_glsl_infer_from_source;
+    }
+}
+
+FShaderCompiler* FShaderCompiler::Create(const char* pCacheDirectory)
+{
+    FShaderCompiler* pCompiler = new FShaderCompiler();
+    pCompiler->m_Compiler = shaderc_compiler_initialize();
+    if (!pCompiler->m_Compiler)
+    {
+        std::cout << "shaderc_compiler_initialize failed\n";
+        SAFE_DELETE(pCompiler);
+        return nullptr;
+    }
+
+    if (pCacheDirectory)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(pCacheDirectory, error);
+        if (error)
+        {
+            std::cout << "Failed to create shader cache directory '" << pCacheDirectory << "', the cache is disabled\n";
+        }
+        else
+        {
+            pCompiler->m_CacheDirectory = NormalizePath(pCacheDirectory);
+        }
+    }
+
+    return pCompiler;
+}
+
+FShaderCompiler::FShaderCompiler()
+    : m_Compiler(nullptr)
+    , m_CacheDirectory()
+    , m_DependencyMutex()
+    , m_Dependencies()
+{
+}
+
+FShaderCompiler::~FShaderCompiler()
+{
+    if (m_Compiler)
+    {
+        shaderc_compiler_release(m_Compiler);
+        m_Compiler = nullptr;
+    }
+}
+
+bool FShaderCompiler::CompileFromFile(const char* pFilePath, VkShaderStageFlagBits stage, std::vector<uint32_t>& outByteCode)
+{
+    assert(pFilePath != nullptr);
+
+    const std::string filepath = NormalizePath(pFilePath);
+
+    FIncludeContext context;
+    if (LoadFromCache(filepath, stage, outByteCode, context.Dependencies))
+    {
+        AddDependencies(filepath, context.Dependencies);
+
+        std::cout << "Loaded Shader '" << filepath << "' from the cache\n";
+        return true;
+    }
+
+    std::string source;
+    if (!ReadTextFile(filepath, source))
+    {
+        std::cout << "Failed to open file '" << filepath << "'\n";
+        return false;
+    }
+
+    // Same settings as glslc in the compile script
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+    shaderc_compile_options_set_source_language(options, shaderc_source_language_glsl);
+    shaderc_compile_options_set_include_callbacks(options, ResolveInclude, ReleaseInclude, &context);
+
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(m_Compiler, source.c_str(), source.size(), GetShaderKind(stage), filepath.c_str(), "main", options);
+    shaderc_compile_options_release(options);
+
+    // The includes are tracked even when the compile fails, so that fixing an include triggers a reload
+    AddDependencies(filepath, context.Dependencies);
+
+    const bool bSucceeded = shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success;
+    if (bSucceeded)
+    {
+        const size_t byteCodeSize = shaderc_result_get_length(result);
+        outByteCode.resize(byteCodeSize / sizeof(uint32_t));
+        memcpy(outByteCode.data(), shaderc_result_get_bytes(result), byteCodeSize);
+
+        // The hash is taken from the exact text that was compiled, the files can have changed since then
+        SaveToCache(filepath, HashSources(stage, source, context.Dependencies, context.Contents), outByteCode, context.Dependencies);
+
+        std::cout << "Compiled Shader '" << filepath << "'\n";
+    }
+    else
+    {
+        std::cout << "FAILED to compile Shader '" << filepath << "'\n" << shaderc_result_get_error_message(result) << '\n';
+    }
+
+    shaderc_result_release(result);
+    return bSucceeded;
+}
+
+bool FShaderCompiler::IsDependency(const char* pFilePath) const
+{
+    const std::string filepath = NormalizePath(pFilePath);
+
+    std::scoped_lock lock(m_DependencyMutex);
+    for (const auto& [shader, dependencies] : m_Dependencies)
+    {
+        if (shader == filepath || std::find(dependencies.begin(), dependencies.end(), filepath) != dependencies.end())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FShaderCompiler::LoadFromCache(const std::string& filepath, VkShaderStageFlagBits stage, std::vector<uint32_t>& outByteCode, std::vector<std::string>& outDependencies) const
+{
+    if (m_CacheDirectory.empty())
+    {
+        return false;
+    }
+
+    std::ifstream file(GetCachePath(filepath), std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    FShaderCacheHeader header;
+    ZERO_STRUCT(&header);
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(FShaderCacheHeader));
+    if (!file.good() || header.Magic != SHADER_CACHE_MAGIC || header.Version != SHADER_CACHE_VERSION)
+    {
+        return false;
+    }
+
+    std::vector<std::string> dependencies(header.NumDependencies);
+    for (std::string& dependency : dependencies)
+    {
+        uint32_t length = 0;
+        file.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+        if (!file.good())
+        {
+            return false;
+        }
+
+        dependency.resize(length);
+        file.read(dependency.data(), length);
+    }
+
+    if (!file.good())
+    {
+        return false;
+    }
+
+    // The includes are the ones from the last compile, if the shader includes other files now then the shader itself
+    // or one of these files must have changed as well
+    std::string              source;
+    std::vector<std::string> contents(dependencies.size());
+    if (!ReadTextFile(filepath, source))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < dependencies.size(); i++)
+    {
+        if (!ReadTextFile(dependencies[i], contents[i]))
+        {
+            return false;
+        }
+    }
+
+    if (HashSources(stage, source, dependencies, contents) != header.Hash)
+    {
+        return false;
+    }
+
+    std::vector<uint32_t> byteCode(header.ByteCodeSize / sizeof(uint32_t));
+    file.read(reinterpret_cast<char*>(byteCode.data()), byteCode.size() * sizeof(uint32_t));
+    if (!file.good() || byteCode.empty())
+    {
+        return false;
+    }
+
+    outByteCode     = std::move(byteCode);
+    outDependencies = std::move(dependencies);
+    return true;
+}
+
+void FShaderCompiler::SaveToCache(const std::string& filepath, uint64_t hash, const std::vector<uint32_t>& byteCode, const std::vector<std::string>& dependencies) const
+{
+    if (m_CacheDirectory.empty())
+    {
+        return;
+    }
+
+    FShaderCacheHeader header;
+    ZERO_STRUCT(&header);
+
+    header.Magic           = SHADER_CACHE_MAGIC;
+    header.Version         = SHADER_CACHE_VERSION;
+    header.Hash            = hash;
+    header.NumDependencies = static_cast<uint32_t>(dependencies.size());
+    header.ByteCodeSize    = static_cast<uint32_t>(byteCode.size() * sizeof(uint32_t));
+
+    // Write to a temporary file first so that another instance never reads a half written file
+    const std::string cachePath = GetCachePath(filepath);
+    const std::string tempPath  = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cout << "Failed to open file '" << tempPath << "'\n";
+            return;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FShaderCacheHeader));
+        for (const std::string& dependency : dependencies)
+        {
+            const uint32_t length = static_cast<uint32_t>(dependency.size());
+            file.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+            file.write(dependency.data(), length);
+        }
+
+        file.write(reinterpret_cast<const char*>(byteCode.data()), header.ByteCodeSize);
+        if (!file.good())
+        {
+            std::cout << "Failed to write shader cache '" << tempPath << "'\n";
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        std::cout << "Failed to rename '" << tempPath << "' to '" << cachePath << "'\n";
+    }
+}
+
+std::string FShaderCompiler::GetCachePath(const std::string& filepath) const
+{
+    // The shaders all live in the same folder so the file name is unique
+    return m_CacheDirectory + "/" + std::filesystem::path(filepath).filename().generic_string() + ".spvcache";
+}
+
+void FShaderCompiler::AddDependencies(const std::string& filepath, const std::vector<std::string>& dependencies)
+{
+    std::scoped_lock lock(m_DependencyMutex);
+    m_Dependencies[filepath] = dependencies;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Core.h"
+#include <vulkan/vulkan.h>
+#include <shaderc/shaderc.h>
+#include <mutex>
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// ShaderCompiler, compiles GLSL to SPIR-V in process with shaderc. The #include files are searched
+// relative to the file that includes them. Compiling is thread safe so the shaders can be compiled
+// on a background thread while the old ones are still in use.
+//
+// The SPIR-V is cached on disk together with the files that the shader included. A shader is only
+// compiled again when the hash of its source and all of its includes has changed.
+
+class FShaderCompiler
+{
+public:
+    // The cache is disabled when there is no cache directory
+    static FShaderCompiler* Create(const char* pCacheDirectory);
+
+    FShaderCompiler();
+    ~FShaderCompiler();
+
+    // Prints the errors and returns false when the file does not compile
+    bool CompileFromFile(const char* pFilePath, VkShaderStageFlagBits stage, std::vector<uint32_t>& outByteCode);
+
+    // Returns true if the file is one of the shaders that have been compiled or one of their includes
+    bool IsDependency(const char* pFilePath) const;
+
+private:
+    bool LoadFromCache(const std::string& filepath, VkShaderStageFlagBits stage, std::vector<uint32_t>& outByteCode, std::vector<std::string>& outDependencies) const;
+    void SaveToCache(const std::string& filepath, uint64_t hash, const std::vector<uint32_t>& byteCode, const std::vector<std::string>& dependencies) const;
+
+    std::string GetCachePath(const std::string& filepath) const;
+
+    void AddDependencies(const std::string& filepath, const std::vector<std::string>& dependencies);
+
+    shaderc_compiler_t m_Compiler;
+    std::string        m_CacheDirectory;
+
+    // Each compiled shader and the files that it included, used to find the shaders that a change affects
+    mutable std::mutex                                        m_DependencyMutex;
+    std::unordered_map<std::string, std::vector<std::string>> m_Dependencies;
+};
@@ -1,5 +1,6 @@
 #include "ShaderModule.h"
 #include "Device.h"
+#include "ShaderCompiler.h"
 #include <fstream>
 #include <iostream>
 
@@ -69,6 +70,19 @@ FShaderModule* FShaderModule::CreateFromFile(FDevice* pDevice, const char* pEntr
     }
 }
 
+FShaderModule* FShaderModule::CreateFromSourceFile(FDevice* pDevice, FShaderCompiler* pCompiler, const char* pEntryPoint, const char* pFilePath, VkShaderStageFlagBits stage)
+{
+    assert(pCompiler != nullptr);
+
+    std::vector<uint32_t> byteCode;
+    if (!pCompiler->CompileFromFile(pFilePath, stage, byteCode))
+    {
+        return nullptr;
+    }
+
+    return FShaderModule::Create(pDevice, byteCode.data(), static_cast<uint32_t>(byteCode.size() * sizeof(uint32_t)), pEntryPoint);
+}
+
 FShaderModule::FShaderModule(VkDevice device)
     : m_Device(device)
     , m_Module(VK_NULL_HANDLE)
@@ -3,12 +3,16 @@
 #include <vulkan/vulkan.h>
 
 class FDevice;
+class FShaderCompiler;
 
 class FShaderModule
 {
 public:
     static FShaderModule* Create(FDevice* pDevice, const uint32_t* pByteCode, uint32_t byteCodeLength, const char* pEntryPoint);
     static FShaderModule* CreateFromFile(FDevice* pDevice, const char* pEntryPoint, const char* pFilePath);
+
+    // Compiles the GLSL file, can be called from any thread
+    static FShaderModule* CreateFromSourceFile(FDevice* pDevice, FShaderCompiler* pCompiler, const char* pEntryPoint, const char* pFilePath, VkShaderStageFlagBits stage);
     
     FShaderModule(VkDevice device);
     ~FShaderModule();
@@ -68,9 +68,17 @@ FSwapchain::~FSwapchain()
     
     ReleaseSwapchainResources();
     
+    // The swapchains that were replaced by a resize can still be waiting in the deletion queue of the device, and
+    // they must be destroyed before the surface
     if (m_Surface != VK_NULL_HANDLE)
     {
-        vkDestroySurfaceKHR(m_pDevice->GetInstance(), m_Surface, nullptr);
+        VkInstance   instance = m_pDevice->GetInstance();
+        VkSurfaceKHR surface  = m_Surface;
+        m_pDevice->DeferRelease([instance, surface]()
+        {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        });
+
         m_Surface = VK_NULL_HANDLE;
     }
 }
@@ -87,7 +95,7 @@ bool FSwapchain::CreateSurface()
     return true;
 }
 
-bool FSwapchain::CreateSwapchain()
+bool FSwapchain::CreateSwapchain(VkSwapchainKHR oldSwapchain)
 {
     int32_t width  = 0;
     int32_t height = 0;
@@ -185,7 +193,7 @@ bool FSwapchain::CreateSwapchain()
         createInfo.compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         createInfo.presentMode      = m_PresentMode;
         createInfo.clipped          = VK_TRUE;
-        createInfo.oldSwapchain     = VK_NULL_HANDLE;
+        createInfo.oldSwapchain     = oldSwapchain;
 
         VkResult result = vkCreateSwapchainKHR(m_pDevice->GetDevice(), &createInfo, nullptr, &m_Swapchain);
         if (result != VK_SUCCESS)
@@ -299,32 +307,48 @@ VkResult FSwapchain::AquireNextImage()
 
 void FSwapchain::WaitForImage()
 {
-    VkSubmitInfo submitInfo;
-    ZERO_STRUCT(&submitInfo);
-
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore waitSemaphores[1] = {};
-    waitSemaphores[0] = GetImageSemaphore();
+    VkSemaphore          waitSemaphores[] = { GetImageSemaphore() };
+    VkPipelineStageFlags waitStages[]     = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+    FSubmitParams submitParams;
+    submitParams.NumWaitSemaphores = 1;
+    submitParams.pWaitSemaphores   = waitSemaphores;
+    submitParams.pWaitStages       = waitStages;
+    submitParams.UploadWaitStage   = 0;
+    m_pDevice->Execute(ECommandQueueType::Graphics, nullptr, submitParams);
+}
 
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores    = waitSemaphores;
-    submitInfo.pWaitDstStageMask  = waitStages;
+void FSwapchain::RecreateSwapchain()
+{
+    // The image semaphores can only be signaled again when the graphics queue has finished waiting on them. The
+    // compute queue keeps running, the old swapchain is destroyed when the graphics queue is done with it.
+    m_pDevice->WaitForQueue(ECommandQueueType::Graphics);
 
-    VkResult result = vkQueueSubmit(m_pDevice->GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-    if (result != VK_SUCCESS)
+    VkSwapchainKHR           oldSwapchain = m_Swapchain;
+    std::vector<VkImageView> oldImageViews;
+    for (FFrameData& frame : m_FrameData)
     {
-        std::cout << "vkQueueSubmit failed. Error: " << result << '\n';
+        oldImageViews.emplace_back(frame.BackBufferView);
+        frame.BackBuffer     = VK_NULL_HANDLE;
+        frame.BackBufferView = VK_NULL_HANDLE;
     }
-}
 
-void FSwapchain::RecreateSwapchain()
-{
-    m_pDevice->WaitForIdle();
+    m_Swapchain = VK_NULL_HANDLE;
+    CreateSwapchain(oldSwapchain);
 
-    ReleaseSwapchainResources();
-    CreateSwapchain();
+    VkDevice device = m_pDevice->GetDevice();
+    m_pDevice->DeferRelease([device, oldSwapchain, oldImageViews]()
+    {
+        for (VkImageView imageView : oldImageViews)
+        {
+            if (imageView != VK_NULL_HANDLE)
+            {
+                vkDestroyImageView(device, imageView, nullptr);
+            }
+        }
+
+        vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+    });
 }
 
 void FSwapchain::Resize(uint32_t width, uint32_t height)
@@ -333,10 +357,7 @@ void FSwapchain::Resize(uint32_t width, uint32_t height)
     {
         // Since we always acquire an image, we need to wait for it
         WaitForImage();
-        m_pDevice->WaitForIdle();
-
-        ReleaseSwapchainResources();
-        CreateSwapchain();
+        RecreateSwapchain();
         
         std::cout << "Resized Swapchain: w=" << m_Extent.width << ", h=" << m_Extent.height << '\n';
     }
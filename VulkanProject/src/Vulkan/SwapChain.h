@@ -68,7 +68,7 @@ public:
 private:
     bool CreateSurface();
     bool CreateSemaphores();
-    bool CreateSwapchain();
+    bool CreateSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
    
     void ReleaseSwapchainResources();
     void RecreateSwapchain();
@@ -2,7 +2,7 @@
 #include "Device.h"
 #include "Helpers.h"
 #include "CommandBuffer.h"
-#include "Buffer.h"
+#include "TextureUploader.h"
 
 #include <algorithm>
 
@@ -36,7 +36,7 @@ static VkDeviceSize GetStrideFromFormat(VkFormat format)
     return 0;
 }
 
-FTexture* FTexture::Create(FDevice* pDevice, const FTextureParams& params)
+FTexture* FTexture::Create(FDevice* pDevice, const FTextureParams& params, FDeviceMemoryAllocator* pAllocator)
 {
     FTexture* pTexture = new FTexture(pDevice);
     
@@ -57,39 +57,85 @@ FTexture* FTexture::Create(FDevice* pDevice, const FTextureParams& params)
     textureCreateInfo.usage         = params.Usage;
     textureCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
     textureCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    // Exclusive ownership is fine when all queues are in the same family, the families have to be unique otherwise
+    uint32_t queueFamilyIndices[NUM_COMMAND_QUEUE_TYPES] = {};
+    uint32_t numQueueFamilies = 0;
+    if (params.bConcurrentQueues)
+    {
+        const ECommandQueueType queueTypes[] = { ECommandQueueType::Graphics, ECommandQueueType::Compute, ECommandQueueType::Transfer };
+        for (ECommandQueueType queueType : queueTypes)
+        {
+            const uint32_t queueFamilyIndex = pDevice->GetQueueFamilyIndex(queueType);
+            if (std::find(queueFamilyIndices, queueFamilyIndices + numQueueFamilies, queueFamilyIndex) == queueFamilyIndices + numQueueFamilies)
+            {
+                queueFamilyIndices[numQueueFamilies++] = queueFamilyIndex;
+            }
+        }
+    }
+
+    if (numQueueFamilies > 1)
+    {
+        textureCreateInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        textureCreateInfo.queueFamilyIndexCount = numQueueFamilies;
+        textureCreateInfo.pQueueFamilyIndices   = queueFamilyIndices;
+    }
     
     VkResult result = vkCreateImage(pDevice->GetDevice(), &textureCreateInfo, nullptr, &pTexture->m_Image);
     if (result != VK_SUCCESS)
     {
         std::cout << "vkCreateImage failed\n";
+        SAFE_DELETE(pTexture);
         return nullptr;
     }
     
     VkMemoryRequirements memoryRequirements;
     vkGetImageMemoryRequirements(pDevice->GetDevice(), pTexture->m_Image, &memoryRequirements);
     
-    VkMemoryAllocateInfo memoryAllocteInfo = {};
-    ZERO_STRUCT(&memoryAllocteInfo);
-    
-    memoryAllocteInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocteInfo.allocationSize  = memoryRequirements.size;
-    memoryAllocteInfo.memoryTypeIndex = FindMemoryType(pDevice->GetPhysicalDevice(), memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    
-    result = vkAllocateMemory(pDevice->GetDevice(), &memoryAllocteInfo, nullptr, &pTexture->m_Memory);
-    if (result != VK_SUCCESS)
+    VkDeviceMemory deviceMemory       = VK_NULL_HANDLE;
+    VkDeviceSize   deviceMemoryOffset = 0;
+    if (pAllocator)
     {
-        std::cout << "vkAllocateMemory failed\n";
-        return nullptr;
+        pTexture->m_pAllocator = pAllocator;
+        if (!pAllocator->Allocate(pTexture->m_Allocation, memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        {
+            std::cout << "Failed to allocate texture memory\n";
+            SAFE_DELETE(pTexture);
+            return nullptr;
+        }
+
+        deviceMemory       = pTexture->m_Allocation.DeviceMemory;
+        deviceMemoryOffset = pTexture->m_Allocation.DeviceMemoryOffset;
     }
     else
     {
-        std::cout << "Allocated " << memoryRequirements.size << " bytes\n";
+        VkMemoryAllocateInfo memoryAllocteInfo = {};
+        ZERO_STRUCT(&memoryAllocteInfo);
+        
+        memoryAllocteInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocteInfo.allocationSize  = memoryRequirements.size;
+        memoryAllocteInfo.memoryTypeIndex = FindMemoryType(pDevice->GetPhysicalDevice(), memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        
+        result = vkAllocateMemory(pDevice->GetDevice(), &memoryAllocteInfo, nullptr, &pTexture->m_Memory);
+        if (result != VK_SUCCESS)
+        {
+            std::cout << "vkAllocateMemory failed\n";
+            SAFE_DELETE(pTexture);
+            return nullptr;
+        }
+        else
+        {
+            std::cout << "Allocated " << memoryRequirements.size << " bytes\n";
+        }
+
+        deviceMemory = pTexture->m_Memory;
     }
 
-    result = vkBindImageMemory(pDevice->GetDevice(), pTexture->m_Image, pTexture->m_Memory, 0);
+    result = vkBindImageMemory(pDevice->GetDevice(), pTexture->m_Image, deviceMemory, deviceMemoryOffset);
     if (result != VK_SUCCESS)
     {
-        std::cout << "vkAllocateMemory failed\n";
+        std::cout << "vkBindImageMemory failed\n";
+        SAFE_DELETE(pTexture);
         return nullptr;
     }
     else
@@ -111,7 +157,7 @@ FTexture* FTexture::Create(FDevice* pDevice, const FTextureParams& params)
         pCommandBuffer->End();
 
         pDevice->ExecuteGraphics(pCommandBuffer, nullptr, nullptr);
-        pDevice->WaitForIdle();
+        pCommandBuffer->WaitUntilFinished();
 
         SAFE_DELETE(pCommandBuffer);
     }
@@ -119,13 +165,16 @@ FTexture* FTexture::Create(FDevice* pDevice, const FTextureParams& params)
     return pTexture;
 }
 
-FTexture* FTexture::CreateWithData(FDevice* pDevice, const FTextureParams& params, const void* pSource)
+FTexture* FTexture::CreateWithData(FDevice* pDevice, const FTextureParams& params, FDeviceMemoryAllocator* pAllocator, const void* pSource)
 {
     FTextureParams paramsCopy = params;
     paramsCopy.Usage         = paramsCopy.Usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     paramsCopy.InitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    FTexture* pTexture = FTexture::Create(pDevice, paramsCopy);
+    // Written by the transfer queue, which can be in another family than the queues that read the texture
+    paramsCopy.bConcurrentQueues = true;
+
+    FTexture* pTexture = FTexture::Create(pDevice, paramsCopy, pAllocator);
     if (!pTexture)
     {
         return nullptr;
@@ -137,64 +186,28 @@ FTexture* FTexture::CreateWithData(FDevice* pDevice, const FTextureParams& param
     const VkDeviceSize stride      = GetStrideFromFormat(params.Format);
     const VkDeviceSize uploadSize  = params.Width * params.Height * numChannels * stride;
     
-    FBufferParams bufferParams = {};
-    bufferParams.Usage            = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    bufferParams.MemoryProperties = VK_CPU_BUFFER_USAGE;
-    bufferParams.Size             = uploadSize;
-    
-    FBuffer* pUploadBuffer = FBuffer::CreateWithData(pDevice, bufferParams, nullptr, pSource);
-    if (!pUploadBuffer)
-    {
-        SAFE_DELETE(pTexture);
-        return nullptr;
-    }
-    
-    FCommandBufferParams commandBufferParams = {};
-    commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferParams.QueueType = ECommandQueueType::Graphics;
-    
-    FCommandBuffer* pCommandBuffer = FCommandBuffer::Create(pDevice, commandBufferParams);
-    if (!pCommandBuffer)
+    // Recorded together with the other uploads, the layout is transitioned on the transfer queue as well
+    const VkImageLayout finalLayout = (params.InitialLayout == VK_IMAGE_LAYOUT_UNDEFINED) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : params.InitialLayout;
+    if (!pDevice->GetTextureUploader()->Upload(pTexture, pSource, uploadSize, finalLayout))
     {
-        SAFE_DELETE(pUploadBuffer);
         SAFE_DELETE(pTexture);
         return nullptr;
     }
-    
-    pCommandBuffer->Reset();
-    pCommandBuffer->Begin();
-    
-    pCommandBuffer->TransitionImage(pTexture->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    
-    VkBufferImageCopy region = {};
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.layerCount = 1;
-    region.imageExtent.width           = params.Width;
-    region.imageExtent.height          = params.Height;
-    region.imageExtent.depth           = 1;
-    
-    pCommandBuffer->CopyBufferToImage(pUploadBuffer->GetBuffer(), pTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-    const VkImageLayout finalLayout = (params.InitialLayout == VK_IMAGE_LAYOUT_UNDEFINED) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : params.InitialLayout;
-    pCommandBuffer->TransitionImage(pTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout);
-    
-    pCommandBuffer->End();
-    
-    pDevice->ExecuteGraphics(pCommandBuffer, nullptr, nullptr);
-    pDevice->WaitForIdle();
-    
-    SAFE_DELETE(pUploadBuffer);
-    SAFE_DELETE(pCommandBuffer);
     return pTexture;
 }
 
 FTexture::FTexture(FDevice* pDevice)
     : m_pDevice(pDevice)
+    , m_pAllocator(nullptr)
+    , m_Allocation()
     , m_Image(VK_NULL_HANDLE)
     , m_Memory(VK_NULL_HANDLE)
     , m_Format(VK_FORMAT_UNDEFINED)
     , m_Width(0)
     , m_Height(0)
+    , m_NumArraySlices(0)
+    , m_ImageType(VK_IMAGE_TYPE_2D)
 {
 }
 
@@ -208,7 +221,11 @@ FTexture::~FTexture()
         m_Image = VK_NULL_HANDLE;
     }
 
-    if (m_Memory != VK_NULL_HANDLE)
+    if (m_pAllocator)
+    {
+        m_pAllocator->Deallocate(m_Allocation);
+    }
+    else if (m_Memory != VK_NULL_HANDLE)
     {
         vkFreeMemory(device, m_Memory, nullptr);
         m_Memory = VK_NULL_HANDLE;
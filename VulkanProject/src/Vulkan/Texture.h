@@ -1,8 +1,10 @@
 #pragma once
 #include "Core.h"
+#include "DeviceMemoryAllocator.h"
 #include <vulkan/vulkan.h>
 
 class FDevice;
+class FTexture;
 
 struct FTextureParams
 {
@@ -15,13 +17,20 @@ struct FTextureParams
     uint32_t Width          = 0;
     uint32_t Height         = 0;
     uint32_t NumArraySlices = 1;
+
+    // The graphics, compute and transfer queues can all use the texture without transferring the ownership, meant for
+    // textures that are written once and then only read
+    bool bConcurrentQueues = false;
 };
 
 class FTexture
 {
 public:
-    static FTexture* Create(FDevice* pDevice, const FTextureParams& params);
-    static FTexture* CreateWithData(FDevice* pDevice, const FTextureParams& params, const void* pSource);
+    static FTexture* Create(FDevice* pDevice, const FTextureParams& params, FDeviceMemoryAllocator* pAllocator);
+
+    // The data is uploaded on the transfer queue without waiting for it, the queues that use the texture wait for the
+    // upload when they are submitted
+    static FTexture* CreateWithData(FDevice* pDevice, const FTextureParams& params, FDeviceMemoryAllocator* pAllocator, const void* pSource);
 
     FTexture(FDevice* pDevice);
     ~FTexture();
@@ -57,12 +66,14 @@ public:
     }
 
 private:
-    FDevice*       m_pDevice;
-    VkImage        m_Image;
-    VkDeviceMemory m_Memory;
-    VkFormat       m_Format;
-    uint32_t       m_Width;
-    uint32_t       m_Height;
-    uint32_t       m_NumArraySlices;
-    VkImageType    m_ImageType;
+    FDevice*                m_pDevice;
+    FDeviceMemoryAllocator* m_pAllocator;
+    FDeviceAllocation       m_Allocation;
+    VkImage                 m_Image;
+    VkDeviceMemory          m_Memory;
+    VkFormat                m_Format;
+    uint32_t                m_Width;
+    uint32_t                m_Height;
+    uint32_t                m_NumArraySlices;
+    VkImageType             m_ImageType;
 };
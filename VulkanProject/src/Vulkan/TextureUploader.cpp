@@ -0,0 +1,277 @@
+#include "TextureUploader.h"
+#include "Buffer.h"
+#include "CommandBuffer.h"
+#include "Device.h"
+#include "Texture.h"
+#include "MathHelper.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+FTextureUploader* FTextureUploader::Create(FDevice* pDevice, const FTextureUploaderParams& params)
+{
+    FTextureUploader* pTextureUploader = new FTextureUploader(pDevice);
+    if (!pTextureUploader->CreateBuffer(std::max<VkDeviceSize>(params.StagingSize, TEXTURE_UPLOADER_ALIGNMENT)))
+    {
+        SAFE_DELETE(pTextureUploader);
+        return nullptr;
+    }
+
+    return pTextureUploader;
+}
+
+FTextureUploader::FTextureUploader(FDevice* pDevice)
+    : m_pDevice(pDevice)
+    , m_pBuffer(nullptr)
+    , m_pHostMemory(nullptr)
+    , m_Size(0)
+    , m_Head(0)
+    , m_Tail(0)
+    , m_NumBytesInUse(0)
+    , m_NumPendingBytes(0)
+    , m_pCommandBuffer(nullptr)
+    , m_Batches()
+    , m_FreeCommandBuffers()
+    , m_SubmitValue(0)
+{
+}
+
+FTextureUploader::~FTextureUploader()
+{
+    // The CommandBuffers wait for the GPU before they are deleted, so the ring is deleted last
+    SAFE_DELETE(m_pCommandBuffer);
+
+    for (FBatch& batch : m_Batches)
+    {
+        SAFE_DELETE(batch.pCommandBuffer);
+    }
+
+    for (FCommandBuffer* pCommandBuffer : m_FreeCommandBuffers)
+    {
+        SAFE_DELETE(pCommandBuffer);
+    }
+
+    if (m_pBuffer)
+    {
+        m_pBuffer->Unmap();
+        SAFE_DELETE(m_pBuffer);
+    }
+}
+
+bool FTextureUploader::Upload(FTexture* pTexture, const void* pData, VkDeviceSize sizeInBytes, VkImageLayout finalLayout)
+{
+    assert(pTexture != nullptr);
+    assert(pData != nullptr && sizeInBytes > 0);
+
+    RetireBatches();
+
+    // The state before the allocation, so that it can be undone when the copy can not be recorded
+    VkDeviceSize offset          = 0;
+    VkDeviceSize head            = m_Head;
+    VkDeviceSize numPendingBytes = m_NumPendingBytes;
+    while (!Allocate(sizeInBytes, offset))
+    {
+        // The copies that are still recorded can only finish after they are submitted
+        Submit();
+
+        if (!m_Batches.empty())
+        {
+            m_pDevice->WaitForTimeline(ECommandQueueType::Transfer, m_Batches.front().Value);
+            RetireBatches();
+        }
+        else
+        {
+            // The GPU is done with the whole ring, which is too small for the texture
+            const VkDeviceSize size = std::bit_ceil(std::max(m_Size * 2, Math::AlignUp<uint64_t>(sizeInBytes, TEXTURE_UPLOADER_ALIGNMENT)));
+            if (!CreateBuffer(size))
+            {
+                return false;
+            }
+        }
+
+        head            = m_Head;
+        numPendingBytes = m_NumPendingBytes;
+    }
+
+    FCommandBuffer* pCommandBuffer = GetCommandBuffer();
+    if (!pCommandBuffer)
+    {
+        m_NumBytesInUse  -= m_NumPendingBytes - numPendingBytes;
+        m_NumPendingBytes = numPendingBytes;
+        m_Head            = head;
+        return false;
+    }
+
+    memcpy(m_pHostMemory + offset, pData, sizeInBytes);
+
+    pCommandBuffer->ImageBarrier(pTexture->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset                = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width           = pTexture->GetWidth();
+    region.imageExtent.height          = pTexture->GetHeight();
+    region.imageExtent.depth           = 1;
+
+    pCommandBuffer->CopyBufferToImage(m_pBuffer->GetBuffer(), pTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // The queues that use the texture wait for the transfer timeline, which makes the copy visible to them
+    pCommandBuffer->ImageBarrier(pTexture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    return true;
+}
+
+uint64_t FTextureUploader::Submit()
+{
+    if (!m_pCommandBuffer)
+    {
+        return m_SubmitValue;
+    }
+
+    m_pCommandBuffer->End();
+    m_SubmitValue = m_pDevice->Execute(ECommandQueueType::Transfer, m_pCommandBuffer, FSubmitParams());
+
+    FBatch batch;
+    batch.pCommandBuffer = m_pCommandBuffer;
+    batch.End            = m_Head;
+    batch.NumBytes       = m_NumPendingBytes;
+    batch.Value          = m_SubmitValue;
+    m_Batches.emplace_back(batch);
+
+    m_pCommandBuffer  = nullptr;
+    m_NumPendingBytes = 0;
+    return m_SubmitValue;
+}
+
+bool FTextureUploader::CreateBuffer(VkDeviceSize size)
+{
+    FBufferParams bufferParams;
+    bufferParams.Size             = size;
+    bufferParams.MemoryProperties = VK_CPU_BUFFER_USAGE;
+    bufferParams.Usage            = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    FBuffer* pBuffer = FBuffer::Create(m_pDevice, bufferParams, nullptr);
+    if (!pBuffer)
+    {
+        std::cout << "[FTextureUploader]: Failed to create buffer\n";
+        return false;
+    }
+
+    // The memory is coherent so the buffer stays mapped
+    uint8_t* pHostMemory = reinterpret_cast<uint8_t*>(pBuffer->Map());
+    if (!pHostMemory)
+    {
+        std::cout << "[FTextureUploader]: Failed to map buffer\n";
+        SAFE_DELETE(pBuffer);
+        return false;
+    }
+
+    // Only called when the GPU is done with the old ring
+    if (m_pBuffer)
+    {
+        m_pBuffer->Unmap();
+        SAFE_DELETE(m_pBuffer);
+    }
+
+    m_pBuffer         = pBuffer;
+    m_pHostMemory     = pHostMemory;
+    m_Size            = size;
+    m_Head            = 0;
+    m_Tail            = 0;
+    m_NumBytesInUse   = 0;
+    m_NumPendingBytes = 0;
+
+    std::cout << "[FTextureUploader]: Staging size " << size << " bytes\n";
+    return true;
+}
+
+bool FTextureUploader::Allocate(VkDeviceSize sizeInBytes, VkDeviceSize& outOffset)
+{
+    // Start at the beginning when the GPU is done with the whole ring, so that there is room for large textures
+    if (m_NumBytesInUse == 0)
+    {
+        m_Head = 0;
+        m_Tail = 0;
+    }
+    else if (m_NumBytesInUse >= m_Size)
+    {
+        return false;
+    }
+
+    // The data of a texture is not split, so it starts over at the beginning when it does not fit before the end
+    VkDeviceSize offset = Math::AlignUp<uint64_t>(m_Head, TEXTURE_UPLOADER_ALIGNMENT);
+    VkDeviceSize end    = offset + sizeInBytes;
+    if (m_Head >= m_Tail)
+    {
+        if (end > m_Size)
+        {
+            offset = 0;
+            end    = sizeInBytes;
+            if (end > m_Tail)
+            {
+                return false;
+            }
+        }
+    }
+    else if (end > m_Tail)
+    {
+        return false;
+    }
+
+    // The padding in front of the data is freed together with it
+    const VkDeviceSize numBytes = (offset >= m_Head) ? (end - m_Head) : ((m_Size - m_Head) + end);
+    m_NumBytesInUse   += numBytes;
+    m_NumPendingBytes += numBytes;
+    m_Head             = end;
+
+    outOffset = offset;
+    return true;
+}
+
+void FTextureUploader::RetireBatches()
+{
+    // The batches finish in submission order
+    while (!m_Batches.empty() && m_pDevice->IsTimelineComplete(ECommandQueueType::Transfer, m_Batches.front().Value))
+    {
+        const FBatch& batch = m_Batches.front();
+        m_Tail           = batch.End;
+        m_NumBytesInUse -= batch.NumBytes;
+        m_FreeCommandBuffers.emplace_back(batch.pCommandBuffer);
+        m_Batches.pop_front();
+    }
+}
+
+FCommandBuffer* FTextureUploader::GetCommandBuffer()
+{
+    if (m_pCommandBuffer)
+    {
+        return m_pCommandBuffer;
+    }
+
+    FCommandBuffer* pCommandBuffer = nullptr;
+    if (!m_FreeCommandBuffers.empty())
+    {
+        pCommandBuffer = m_FreeCommandBuffers.back();
+        m_FreeCommandBuffers.pop_back();
+    }
+    else
+    {
+        FCommandBufferParams commandBufferParams = {};
+        commandBufferParams.Level     = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferParams.QueueType = ECommandQueueType::Transfer;
+
+        pCommandBuffer = FCommandBuffer::Create(m_pDevice, commandBufferParams);
+        if (!pCommandBuffer)
+        {
+            std::cout << "[FTextureUploader]: Failed to create CommandBuffer\n";
+            return nullptr;
+        }
+    }
+
+    pCommandBuffer->Reset();
+    pCommandBuffer->Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    m_pCommandBuffer = pCommandBuffer;
+    return m_pCommandBuffer;
+}
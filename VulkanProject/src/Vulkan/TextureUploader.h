@@ -0,0 +1,81 @@
+#pragma once
+#include "Core.h"
+#include <deque>
+
+// The uploads inside the staging ring are aligned to this, which is a multiple of the texel size of all formats
+#define TEXTURE_UPLOADER_ALIGNMENT (16)
+
+class FDevice;
+class FBuffer;
+class FTexture;
+class FCommandBuffer;
+
+struct FTextureUploaderParams
+{
+    // Initial size of the staging ring, the ring grows when a texture does not fit
+    VkDeviceSize StagingSize = 0;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// TextureUploader, copies the data of textures into a persistently mapped staging ring and records
+// the copies into a CommandBuffer for the transfer queue. All the copies that are recorded between
+// two submits end up in the same CommandBuffer, and the other queues wait for them on the timeline
+// of the transfer queue. The CPU only waits when the ring is full of copies that are still running.
+
+class FTextureUploader
+{
+public:
+    static FTextureUploader* Create(FDevice* pDevice, const FTextureUploaderParams& params);
+
+    FTextureUploader(FDevice* pDevice);
+    ~FTextureUploader();
+
+    // Copies the data into the ring and records the copy into the first array slice of the texture, which has to be in
+    // the undefined layout and ends up in finalLayout. The texture must be usable by the transfer queue, see
+    // FTextureParams::bConcurrentQueues.
+    bool Upload(FTexture* pTexture, const void* pData, VkDeviceSize sizeInBytes, VkImageLayout finalLayout);
+
+    // Submits the copies that were recorded since the last submit. Returns the value of the transfer timeline that is
+    // reached when all the copies so far have finished, zero when nothing has been submitted yet.
+    uint64_t Submit();
+
+private:
+    // The copies of one submit, the part of the ring that they read is free when the transfer timeline has the value
+    struct FBatch
+    {
+        FCommandBuffer* pCommandBuffer;
+        VkDeviceSize    End;
+        VkDeviceSize    NumBytes;
+        uint64_t        Value;
+    };
+
+    bool CreateBuffer(VkDeviceSize size);
+
+    // Places the data after the head of the ring, fails when the space up to the tail is too small
+    bool Allocate(VkDeviceSize sizeInBytes, VkDeviceSize& outOffset);
+
+    // Frees the parts of the ring that the finished batches used
+    void RetireBatches();
+
+    // Returns the CommandBuffer that the copies are recorded into, begins a new one after a submit
+    FCommandBuffer* GetCommandBuffer();
+
+    FDevice*     m_pDevice;
+    FBuffer*     m_pBuffer;
+    uint8_t*     m_pHostMemory;
+    VkDeviceSize m_Size;
+
+    // The ring is written at the head and the GPU reads the part from the tail, NumBytesInUse includes the padding at
+    // the end of the ring when an upload wraps around
+    VkDeviceSize m_Head;
+    VkDeviceSize m_Tail;
+    VkDeviceSize m_NumBytesInUse;
+    VkDeviceSize m_NumPendingBytes;
+
+    // The copies that have not been submitted yet
+    FCommandBuffer* m_pCommandBuffer;
+
+    std::deque<FBatch>           m_Batches;
+    std::vector<FCommandBuffer*> m_FreeCommandBuffers;
+    uint64_t                     m_SubmitValue;
+};
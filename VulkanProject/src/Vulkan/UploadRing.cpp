@@ -0,0 +1,223 @@
+#include "UploadRing.h"
+#include "Buffer.h"
+#include "CommandBuffer.h"
+#include "Device.h"
+#include "MathHelper.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+FUploadRing* FUploadRing::Create(FDevice* pDevice, const FUploadRingParams& params, FDeviceMemoryAllocator* pAllocator)
+{
+    assert(params.NumFrames > 0);
+
+    FUploadRing* pUploadRing = new FUploadRing(pDevice, pAllocator);
+    pUploadRing->m_NumFrames = params.NumFrames;
+    pUploadRing->m_RetiredBuffers.resize(params.NumFrames);
+
+    if (!pUploadRing->CreateBuffer(std::max<VkDeviceSize>(params.FrameSize, UPLOAD_RING_ALIGNMENT)))
+    {
+        SAFE_DELETE(pUploadRing);
+        return nullptr;
+    }
+
+    return pUploadRing;
+}
+
+FUploadRing::FUploadRing(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator)
+    : m_pDevice(pDevice)
+    , m_pAllocator(pAllocator)
+    , m_pBuffer(nullptr)
+    , m_pHostMemory(nullptr)
+    , m_FrameSize(0)
+    , m_NumFrames(0)
+    , m_FrameIndex(0)
+    , m_FrameOffset(0)
+    , m_NumBytesUploaded(0)
+    , m_PendingCopies()
+    , m_RetiredBuffers()
+{
+}
+
+FUploadRing::~FUploadRing()
+{
+    for (std::vector<FBuffer*>& retiredBuffers : m_RetiredBuffers)
+    {
+        for (FBuffer* pBuffer : retiredBuffers)
+        {
+            SAFE_DELETE(pBuffer);
+        }
+    }
+
+    if (m_pBuffer)
+    {
+        m_pBuffer->Unmap();
+        SAFE_DELETE(m_pBuffer);
+    }
+}
+
+void FUploadRing::BeginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < m_NumFrames);
+    assert(m_PendingCopies.empty());
+
+    m_FrameIndex       = frameIndex;
+    m_FrameOffset      = 0;
+    m_NumBytesUploaded = 0;
+
+    // The last frame that used this index has finished, and with it all the frames that were submitted before it
+    std::vector<FBuffer*>& retiredBuffers = m_RetiredBuffers[frameIndex];
+    for (FBuffer* pBuffer : retiredBuffers)
+    {
+        SAFE_DELETE(pBuffer);
+    }
+
+    retiredBuffers.clear();
+}
+
+bool FUploadRing::Upload(FBuffer* pDstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize sizeInBytes)
+{
+    assert(pDstBuffer != nullptr);
+    if (sizeInBytes == 0)
+    {
+        return true;
+    }
+
+    VkDeviceSize frameOffset = Math::AlignUp(m_FrameOffset, UPLOAD_RING_ALIGNMENT);
+    if (frameOffset + sizeInBytes > m_FrameSize)
+    {
+        if (!Grow(sizeInBytes))
+        {
+            return false;
+        }
+
+        frameOffset = 0;
+    }
+
+    const VkDeviceSize srcOffset = (m_FrameSize * m_FrameIndex) + frameOffset;
+    memcpy(m_pHostMemory + srcOffset, pData, sizeInBytes);
+
+    m_FrameOffset       = frameOffset + sizeInBytes;
+    m_NumBytesUploaded += sizeInBytes;
+
+    FPendingCopy copy;
+    copy.SrcBuffer        = m_pBuffer->GetBuffer();
+    copy.DstBuffer        = pDstBuffer->GetBuffer();
+    copy.Region.srcOffset = srcOffset;
+    copy.Region.dstOffset = dstOffset;
+    copy.Region.size      = sizeInBytes;
+    m_PendingCopies.emplace_back(copy);
+    return true;
+}
+
+void FUploadRing::Flush(FCommandBuffer* pCommandBuffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    if (m_PendingCopies.empty())
+    {
+        return;
+    }
+
+    // Group the copies so that there is one vkCmdCopyBuffer per pair of buffers, the order inside a group is kept
+    std::stable_sort(m_PendingCopies.begin(), m_PendingCopies.end(), [](const FPendingCopy& a, const FPendingCopy& b)
+    {
+        if (a.SrcBuffer != b.SrcBuffer)
+        {
+            return a.SrcBuffer < b.SrcBuffer;
+        }
+
+        return a.DstBuffer < b.DstBuffer;
+    });
+
+    // The destinations can still be read by the previous frame, which uses the same stages
+    pCommandBuffer->PipelineBarrier(dstStageMask, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(m_PendingCopies.size());
+
+    size_t first = 0;
+    while (first < m_PendingCopies.size())
+    {
+        const FPendingCopy& group = m_PendingCopies[first];
+
+        regions.clear();
+        size_t last = first;
+        for (; last < m_PendingCopies.size(); last++)
+        {
+            const FPendingCopy& copy = m_PendingCopies[last];
+            if (copy.SrcBuffer != group.SrcBuffer || copy.DstBuffer != group.DstBuffer)
+            {
+                break;
+            }
+
+            // Merge copies that are contiguous in both buffers
+            if (!regions.empty())
+            {
+                VkBufferCopy& previous = regions.back();
+                if (previous.srcOffset + previous.size == copy.Region.srcOffset && previous.dstOffset + previous.size == copy.Region.dstOffset)
+                {
+                    previous.size += copy.Region.size;
+                    continue;
+                }
+            }
+
+            regions.emplace_back(copy.Region);
+        }
+
+        pCommandBuffer->CopyBuffer(group.SrcBuffer, group.DstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+        first = last;
+    }
+
+    m_PendingCopies.clear();
+
+    pCommandBuffer->PipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, dstStageMask, dstAccessMask);
+}
+
+bool FUploadRing::CreateBuffer(VkDeviceSize frameSize)
+{
+    FBufferParams bufferParams;
+    bufferParams.Size             = frameSize * m_NumFrames;
+    bufferParams.MemoryProperties = VK_CPU_BUFFER_USAGE;
+    bufferParams.Usage            = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    FBuffer* pBuffer = FBuffer::Create(m_pDevice, bufferParams, m_pAllocator);
+    if (!pBuffer)
+    {
+        std::cout << "[FUploadRing]: Failed to create buffer\n";
+        return false;
+    }
+
+    // The memory is coherent so the buffer stays mapped
+    uint8_t* pHostMemory = reinterpret_cast<uint8_t*>(pBuffer->Map());
+    if (!pHostMemory)
+    {
+        std::cout << "[FUploadRing]: Failed to map buffer\n";
+        SAFE_DELETE(pBuffer);
+        return false;
+    }
+
+    m_pBuffer     = pBuffer;
+    m_pHostMemory = pHostMemory;
+    m_FrameSize   = frameSize;
+
+    std::cout << "[FUploadRing]: Frame size " << frameSize << " bytes\n";
+    return true;
+}
+
+bool FUploadRing::Grow(VkDeviceSize minFrameSize)
+{
+    FBuffer* pOldBuffer = m_pBuffer;
+
+    const VkDeviceSize frameSize = std::bit_ceil(std::max(m_FrameSize * 2, Math::AlignUp(minFrameSize, UPLOAD_RING_ALIGNMENT)));
+    if (!CreateBuffer(frameSize))
+    {
+        return false;
+    }
+
+    // The copies of this frame and the frames in flight can still read from the old buffer
+    pOldBuffer->Unmap();
+    m_RetiredBuffers[m_FrameIndex].emplace_back(pOldBuffer);
+
+    m_FrameOffset = 0;
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "Core.h"
+#include "DeviceMemoryAllocator.h"
+#include <vector>
+
+// The uploads inside a frame are aligned to this
+#define UPLOAD_RING_ALIGNMENT (16)
+
+class FDevice;
+class FBuffer;
+class FCommandBuffer;
+
+struct FUploadRingParams
+{
+    // Initial size of the region of each frame, the ring grows when a frame needs more
+    VkDeviceSize FrameSize = 0;
+    uint32_t     NumFrames = 0;
+};
+
+/*///////////////////////////////////////////////////////////////////////////////////////////////*/
+// UploadRing, a persistently mapped staging buffer with one region per frame in flight. The data
+// is written into the region of the current frame and the copies into the GPU buffers are recorded
+// when the ring is flushed, batched per destination buffer and followed by a single barrier.
+
+class FUploadRing
+{
+public:
+    static FUploadRing* Create(FDevice* pDevice, const FUploadRingParams& params, FDeviceMemoryAllocator* pAllocator);
+
+    FUploadRing(FDevice* pDevice, FDeviceMemoryAllocator* pAllocator);
+    ~FUploadRing();
+
+    // The GPU must be done with the last frame that used frameIndex
+    void BeginFrame(uint32_t frameIndex);
+
+    // Copies the data into the ring, the copy to the destination is recorded by Flush
+    bool Upload(FBuffer* pDstBuffer, VkDeviceSize dstOffset, const void* pData, VkDeviceSize sizeInBytes);
+
+    // Records the copies of this frame and makes them visible to the destination stages, the copies wait for the same
+    // stages of the previous frames to finish reading
+    void Flush(FCommandBuffer* pCommandBuffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+    VkDeviceSize GetFrameSize() const
+    {
+        return m_FrameSize;
+    }
+
+    // Number of bytes uploaded in the current frame
+    VkDeviceSize GetNumBytesUploaded() const
+    {
+        return m_NumBytesUploaded;
+    }
+
+private:
+    struct FPendingCopy
+    {
+        VkBuffer     SrcBuffer;
+        VkBuffer     DstBuffer;
+        VkBufferCopy Region;
+    };
+
+    bool CreateBuffer(VkDeviceSize frameSize);
+
+    // Moves on to a larger buffer, the old one is deleted when the GPU is done with the current frame
+    bool Grow(VkDeviceSize minFrameSize);
+
+    FDevice*                m_pDevice;
+    FDeviceMemoryAllocator* m_pAllocator;
+    FBuffer*                m_pBuffer;
+    uint8_t*                m_pHostMemory;
+    VkDeviceSize            m_FrameSize;
+    uint32_t                m_NumFrames;
+
+    // Current frame
+    uint32_t                  m_FrameIndex;
+    VkDeviceSize              m_FrameOffset;
+    VkDeviceSize              m_NumBytesUploaded;
+    std::vector<FPendingCopy> m_PendingCopies;
+
+    // Buffers that were replaced when growing, one list per frame
+    std::vector<std::vector<FBuffer*>> m_RetiredBuffers;
+};
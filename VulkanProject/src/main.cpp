@@ -1,10 +1,95 @@
 #include "Application.h"
+#include "Renderer/CPUIntersect.h"
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 
-int main()
+static bool ParseCommandLine(int argc, const char* argv[], FApplicationParams& params)
 {
+    for (int i = 1; i < argc; i++)
+    {
+        const char* pArg   = argv[i];
+        const bool  bValue = (i + 1) < argc;
+        if (strcmp(pArg, "--headless") == 0)
+        {
+            params.bHeadless = true;
+        }
+        else if (strcmp(pArg, "--width") == 0 && bValue)
+        {
+            params.Width = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (strcmp(pArg, "--height") == 0 && bValue)
+        {
+            params.Height = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (strcmp(pArg, "--samples") == 0 && bValue)
+        {
+            params.NumSamples = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (strcmp(pArg, "--output") == 0 && bValue)
+        {
+            params.OutputPath = argv[++i];
+        }
+        else if (strcmp(pArg, "--tile-size") == 0 && bValue)
+        {
+            params.TileSize = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (strcmp(pArg, "--cpu") == 0)
+        {
+            params.bHeadless = true;
+            params.bUseCPU   = true;
+        }
+        else if (strcmp(pArg, "--threads") == 0 && bValue)
+        {
+            params.NumThreads = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (strcmp(pArg, "--validation") == 0)
+        {
+            params.bEnableValidation = true;
+        }
+        else if (strcmp(pArg, "--benchmark-simd") == 0 && bValue)
+        {
+            params.NumBenchmarkRays = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else
+        {
+            std::cout << "Unknown argument '" << pArg << "'\n";
+            std::cout << "Usage: [--headless] [--width N] [--height N] [--samples N] [--output file.pfm|file.ppm] [--tile-size N] [--cpu] [--threads N] [--validation] [--benchmark-simd N]\n";
+            return false;
+        }
+    }
+
+    if (params.Width == 0 || params.Height == 0 || params.NumSamples == 0)
+    {
+        std::cout << "Width, height and samples must be larger than zero\n";
+        return false;
+    }
+
+    if (params.bUseCPU && params.TileSize > 0)
+    {
+        std::cout << "Tiled rendering is not supported on the CPU\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    FApplicationParams params;
+    if (!ParseCommandLine(argc, argv, params))
+    {
+        return 1;
+    }
+
+    if (params.NumBenchmarkRays > 0)
+    {
+        CPUIntersect::RunBenchmark(params.NumBenchmarkRays);
+        return 0;
+    }
+
     FApplication* pApp = FApplication::Create();
-    if (!pApp->Init())
+    if (!pApp->Init(params))
     {
         return 1;
     }
@@ -371,6 +371,17 @@ workspace "Vulkan-Project"
 		filter { "system:macosx", "files:**.cpp" }
 			compileas("Objective-C++")
 		filter {}
+
+		-- The CPU intersection kernels are compiled once per instruction set and selected at runtime
+		filter { "files:**AVX2.cpp", "action:vs*" }
+			buildoptions { "/arch:AVX2" }
+		filter { "files:**AVX2.cpp", "not action:vs*" }
+			buildoptions { "-mavx2", "-mfma" }
+		filter { "files:**AVX512.cpp", "action:vs*" }
+			buildoptions { "/arch:AVX512" }
+		filter { "files:**AVX512.cpp", "not action:vs*" }
+			buildoptions { "-mavx2", "-mfma", "-mavx512f" }
+		filter {}
 		
 		local shaderScriptPath   = os.getcwd() .. "/VulkanProject/res/compile_shaders"
 		printf("shaderScriptPath=%s", shaderScriptPath)
@@ -383,6 +394,7 @@ workspace "Vulkan-Project"
 			links
 			{
 				"vulkan-1",
+				"shaderc_shared",
 			}
 			libdirs
 			{
@@ -401,7 +413,6 @@ workspace "Vulkan-Project"
 			defines
 			{
 				"RESOURCE_PATH=" .. "\"" .. resourceFolderPath .. "\"", 
-				"SHADER_SCRIPT_PATH=" .. "\"" .. shaderScriptPath .. ".bat\"", 
 			}
 
 		-- macOS
@@ -409,6 +420,7 @@ workspace "Vulkan-Project"
 			links
 			{
 				"vulkan.1",
+				"shaderc_shared",
 				"Cocoa.framework",
 				"OpenGL.framework",
 				"IOKit.framework",
@@ -431,7 +443,6 @@ workspace "Vulkan-Project"
 			defines
 			{
 				"RESOURCE_PATH=" .. "\"" .. resourceFolderPath .. "\"", 
-				"SHADER_SCRIPT_PATH=" .. "\"" .. shaderScriptPath .. ".command\"", 
 			}
 
 		-- Visual Studio